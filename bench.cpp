@@ -0,0 +1,746 @@
+/*
+ * ZeroTier One - Network Virtualization Everywhere
+ * Copyright (C) 2011-2019  ZeroTier, Inc.  https://www.zerotier.com/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * --
+ *
+ * You can be released from the requirements of the license by purchasing
+ * a commercial license. Buying such a license is mandatory as soon as you
+ * develop commercial closed-source software that incorporates or links
+ * directly against ZeroTier software without disclosing the source code
+ * of your own application.
+ */
+
+
+/*
+ * zerotier-bench: timings for core primitives with machine-readable output
+ *
+ * Results are written as JSON. Given a previous run's JSON as a baseline,
+ * any benchmark that got slower by more than the threshold is reported and
+ * the exit code is 1, so this can gate a release build.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+
+#include "node/Constants.hpp"
+#include "node/Utils.hpp"
+#include "node/Identity.hpp"
+#include "node/C25519.hpp"
+#include "node/Packet.hpp"
+#include "node/Hashtable.hpp"
+#include "node/FlatHashtable.hpp"
+#include "node/Dictionary.hpp"
+#include "node/NetworkConfig.hpp"
+#include "node/CertificateOfMembership.hpp"
+#include "node/RuntimeEnvironment.hpp"
+#include "node/Multicaster.hpp"
+#include "node/Network.hpp"
+#include "node/Node.hpp"
+
+#include "osdep/OSUtils.hpp"
+#include "osdep/LoopbackHarness.hpp"
+
+#include "controller/DB.hpp"
+
+#include "ext/json/json.hpp"
+
+#include "version.h"
+
+using namespace ZeroTier;
+using json = nlohmann::json;
+
+// Default measurement time per benchmark in milliseconds
+#define ZT_BENCH_DEFAULT_MS 250
+
+// Target duration of one timed batch in nanoseconds
+#define ZT_BENCH_BATCH_NS 10000000LL
+
+// Default regression threshold in percent
+#define ZT_BENCH_DEFAULT_THRESHOLD 10.0
+
+// Members in the synthetic controller DB, about what a large controller holds
+#define ZT_BENCH_CONTROLLER_MEMBERS 1000000UL
+
+namespace {
+
+struct BenchResult
+{
+	std::string name;
+	double opsPerSecond;
+	double nsPerOp;
+	double bytesPerSecond; // 0 if not a throughput benchmark
+};
+
+std::vector<BenchResult> benchResults;
+unsigned int benchMs = ZT_BENCH_DEFAULT_MS;
+const char *benchFilter = (const char *)0;
+volatile uint64_t benchSink = 0; // keeps results of timed work live
+
+inline int64_t benchNowNs() { return (int64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count(); }
+
+inline bool benchSelected(const char *name) { return ((!benchFilter)||(strstr(name,benchFilter))); }
+
+/**
+ * Time f(n), which must perform n operations
+ *
+ * The batch size is doubled until a batch takes about ZT_BENCH_BATCH_NS,
+ * then batches are repeated for benchMs and the fastest one is reported.
+ * Taking the best batch rather than the mean filters out preemption and
+ * frequency ramp noise, which is what makes runs comparable.
+ */
+template<typename F>
+void bench(const char *name,unsigned int bytesPerOp,F f)
+{
+	if (!benchSelected(name))
+		return;
+
+	unsigned long n = 1;
+	for(;;) {
+		const int64_t start = benchNowNs();
+		f(n);
+		if (((benchNowNs() - start) >= ZT_BENCH_BATCH_NS)||(n >= 0x40000000UL))
+			break;
+		n <<= 1;
+	}
+
+	double best = 0.0;
+	int64_t total = 0;
+	do {
+		const int64_t start = benchNowNs();
+		f(n);
+		const int64_t el = std::max(benchNowNs() - start,(int64_t)1);
+		best = std::max(best,((double)n * 1000000000.0) / (double)el);
+		total += el;
+	} while (total < ((int64_t)benchMs * 1000000LL));
+
+	BenchResult r;
+	r.name = name;
+	r.opsPerSecond = best;
+	r.nsPerOp = 1000000000.0 / best;
+	r.bytesPerSecond = best * (double)bytesPerOp;
+	benchResults.push_back(r);
+
+	if (bytesPerOp)
+		fprintf(stderr,"%-44s %14.0f ops/s %12.1f ns/op %10.1f MiB/s" ZT_EOL_S,name,r.opsPerSecond,r.nsPerOp,r.bytesPerSecond / 1048576.0);
+	else fprintf(stderr,"%-44s %14.0f ops/s %12.1f ns/op" ZT_EOL_S,name,r.opsPerSecond,r.nsPerOp);
+}
+
+/**
+ * Record a result measured some other way (e.g. the loopback harness)
+ */
+void benchRecord(const char *name,double opsPerSecond,unsigned int bytesPerOp)
+{
+	BenchResult r;
+	r.name = name;
+	r.opsPerSecond = opsPerSecond;
+	r.nsPerOp = (opsPerSecond > 0.0) ? (1000000000.0 / opsPerSecond) : 0.0;
+	r.bytesPerSecond = opsPerSecond * (double)bytesPerOp;
+	benchResults.push_back(r);
+	fprintf(stderr,"%-44s %14.0f ops/s %12.1f ns/op %10.1f MiB/s" ZT_EOL_S,name,r.opsPerSecond,r.nsPerOp,r.bytesPerSecond / 1048576.0);
+}
+
+// A filter typical of real networks: IPv4/ARP/IPv6 only, no inbound SSH or
+// RDP, established TCP and everything else accepted. Benchmark frames are
+// non-SYN TCP to port 443 so they traverse most of the table.
+unsigned int benchRules(ZT_VirtualNetworkRule *rules)
+{
+	unsigned int n = 0;
+	memset(rules,0,sizeof(ZT_VirtualNetworkRule) * 16);
+	rules[n].t = (uint8_t)ZT_NETWORK_RULE_MATCH_ETHERTYPE | 0x80; // NOT
+	rules[n++].v.etherType = 0x0800;
+	rules[n].t = (uint8_t)ZT_NETWORK_RULE_MATCH_ETHERTYPE | 0x80; // NOT
+	rules[n++].v.etherType = 0x0806;
+	rules[n].t = (uint8_t)ZT_NETWORK_RULE_MATCH_ETHERTYPE | 0x80; // NOT
+	rules[n++].v.etherType = 0x86dd;
+	rules[n++].t = (uint8_t)ZT_NETWORK_RULE_ACTION_DROP;
+	rules[n].t = (uint8_t)ZT_NETWORK_RULE_MATCH_IP_PROTOCOL;
+	rules[n++].v.ipProtocol = 0x06; // TCP
+	rules[n].t = (uint8_t)ZT_NETWORK_RULE_MATCH_IP_DEST_PORT_RANGE;
+	rules[n].v.port[0] = 22;
+	rules[n++].v.port[1] = 22;
+	rules[n++].t = (uint8_t)ZT_NETWORK_RULE_ACTION_DROP;
+	rules[n].t = (uint8_t)ZT_NETWORK_RULE_MATCH_IP_PROTOCOL;
+	rules[n++].v.ipProtocol = 0x06; // TCP
+	rules[n].t = (uint8_t)ZT_NETWORK_RULE_MATCH_IP_DEST_PORT_RANGE;
+	rules[n].v.port[0] = 3389;
+	rules[n++].v.port[1] = 3389;
+	rules[n++].t = (uint8_t)ZT_NETWORK_RULE_ACTION_DROP;
+	rules[n].t = (uint8_t)ZT_NETWORK_RULE_MATCH_CHARACTERISTICS | 0x80; // NOT
+	rules[n++].v.characteristics = ZT_RULE_PACKET_CHARACTERISTICS_TCP_SYN;
+	rules[n++].t = (uint8_t)ZT_NETWORK_RULE_ACTION_ACCEPT;
+	rules[n++].t = (uint8_t)ZT_NETWORK_RULE_ACTION_ACCEPT;
+	return n;
+}
+
+// Minimal IPv4 + TCP (ACK, no SYN) frame to port 443 with the given total length
+void benchTcpFrame(uint8_t *f,unsigned int len)
+{
+	memset(f,0,len);
+	f[0] = 0x45; // IPv4, 20 byte header
+	f[2] = (uint8_t)(len >> 8);
+	f[3] = (uint8_t)len;
+	f[8] = 64; // TTL
+	f[9] = 0x06; // TCP
+	f[12] = 10; f[13] = 147; f[14] = 17; f[15] = 1; // source IP
+	f[16] = 10; f[17] = 147; f[18] = 17; f[19] = 2; // dest IP
+	f[20] = 0xc3; f[21] = 0x50; // source port 50000
+	f[22] = 0x01; f[23] = 0xbb; // dest port 443
+	f[32] = 0x50; // data offset 5
+	f[33] = 0x10; // ACK
+}
+
+void benchCrypto()
+{
+	const C25519::Pair kp(C25519::generate());
+	const C25519::Pair kp2(C25519::generate());
+	uint8_t msg[128];
+	Utils::getSecureRandom(msg,sizeof(msg));
+
+	bench("c25519.sign.128",0,[&](unsigned long n) {
+		for(unsigned long i=0;i<n;++i) {
+			msg[0] = (uint8_t)i;
+			benchSink += C25519::sign(kp,msg,sizeof(msg)).data[0];
+		}
+	});
+	msg[0] = 0;
+	const C25519::Signature sig0(C25519::sign(kp,msg,sizeof(msg)));
+	bench("c25519.verify.128",0,[&](unsigned long n) {
+		for(unsigned long i=0;i<n;++i)
+			benchSink += (uint64_t)C25519::verify(kp.pub,msg,sizeof(msg),sig0);
+	});
+	bench("c25519.agree",0,[&](unsigned long n) {
+		uint8_t key[32];
+		for(unsigned long i=0;i<n;++i) {
+			C25519::agree(kp.priv,kp2.pub,key,sizeof(key));
+			benchSink += key[0];
+		}
+	});
+
+	if (benchSelected("identity.locallyValidate")) {
+		Identity id;
+		id.generate();
+		bench("identity.locallyValidate",0,[&](unsigned long n) {
+			for(unsigned long i=0;i<n;++i)
+				benchSink += (uint64_t)id.locallyValidate();
+		});
+	}
+}
+
+void benchPacket()
+{
+	uint8_t key[32];
+	Utils::getSecureRandom(key,sizeof(key));
+	const Address src(0x1122334455ULL),dst(0x5544332211ULL);
+	static const unsigned int sizes[3] = { 64,512,1400 };
+
+	for(unsigned int s=0;s<3;++s) {
+		uint8_t payload[1400];
+		Utils::getSecureRandom(payload,sizes[s]);
+		Packet plain(dst,src,Packet::VERB_FRAME);
+		plain.append(payload,sizes[s]);
+		Packet armored(plain);
+		armored.armor(key,true);
+		Packet p;
+
+		char name[64];
+		OSUtils::ztsnprintf(name,sizeof(name),"packet.armor.%u",sizes[s]);
+		bench(name,sizes[s],[&](unsigned long n) {
+			for(unsigned long i=0;i<n;++i) {
+				p = plain;
+				p.armor(key,true);
+				benchSink += p[ZT_PACKET_IDX_MAC];
+			}
+		});
+		OSUtils::ztsnprintf(name,sizeof(name),"packet.dearmor.%u",sizes[s]);
+		bench(name,sizes[s],[&](unsigned long n) {
+			for(unsigned long i=0;i<n;++i) {
+				p = armored;
+				benchSink += (uint64_t)p.dearmor(key);
+			}
+		});
+	}
+
+	// Text-like payload that LZ4 can actually shrink
+	std::string text;
+	while (text.length() < 1400)
+		text.append("GET /api/v1/network/8056c2e21c000001/member HTTP/1.1\r\nHost: my.example.com\r\nAccept: application/json\r\n\r\n");
+	Packet plain(dst,src,Packet::VERB_FRAME);
+	plain.append(text.data(),1400);
+	Packet compressed(plain);
+	compressed.compress();
+	Packet p;
+	bench("packet.compress.1400",1400,[&](unsigned long n) {
+		for(unsigned long i=0;i<n;++i) {
+			p = plain;
+			benchSink += (uint64_t)p.compress();
+		}
+	});
+	bench("packet.uncompress.1400",1400,[&](unsigned long n) {
+		for(unsigned long i=0;i<n;++i) {
+			p = compressed;
+			benchSink += (uint64_t)p.uncompress();
+		}
+	});
+}
+
+template<typename T>
+void benchHashtable(const char *prefix,const unsigned long count)
+{
+	// Real addresses are hash derived, so use random 40-bit keys rather than
+	// a sequence that happens to map perfectly onto power of two buckets.
+	std::vector<uint64_t> keys(count),missing(count);
+	Utils::getSecureRandom(keys.data(),(unsigned int)(sizeof(uint64_t) * count));
+	for(unsigned long i=0;i<count;++i) {
+		keys[i] &= 0x7fffffffffULL;
+		missing[i] = keys[i] | 0x8000000000ULL;
+	}
+	T ht;
+	for(unsigned long i=0;i<count;++i)
+		ht.set(keys[i],i);
+
+	char name[128];
+	OSUtils::ztsnprintf(name,sizeof(name),"%s.set.%lu",prefix,count);
+	bench(name,0,[&](unsigned long n) {
+		for(unsigned long i=0;i<n;++i)
+			ht.set(keys[i % count],i);
+	});
+	OSUtils::ztsnprintf(name,sizeof(name),"%s.get.hit.%lu",prefix,count);
+	bench(name,0,[&](unsigned long n) {
+		for(unsigned long i=0;i<n;++i) {
+			const uint64_t *const v = ht.get(keys[i % count]);
+			benchSink += (v) ? *v : 0;
+		}
+	});
+	OSUtils::ztsnprintf(name,sizeof(name),"%s.get.miss.%lu",prefix,count);
+	bench(name,0,[&](unsigned long n) {
+		for(unsigned long i=0;i<n;++i)
+			benchSink += (uint64_t)(ht.get(missing[i % count]) != (uint64_t *)0);
+	});
+	OSUtils::ztsnprintf(name,sizeof(name),"%s.erase+set.%lu",prefix,count);
+	bench(name,0,[&](unsigned long n) {
+		for(unsigned long i=0;i<n;++i) {
+			const uint64_t k = keys[i % count];
+			ht.erase(k);
+			ht.set(k,i);
+		}
+	});
+}
+
+void benchHashtable()
+{
+	for(unsigned long count=10000;count<=1000000;count*=10) {
+		benchHashtable< Hashtable<uint64_t,uint64_t> >("hashtable",count);
+		benchHashtable< FlatHashtable<uint64_t,uint64_t> >("flathashtable",count);
+	}
+}
+
+void benchDictionary()
+{
+	Identity controller;
+	controller.generate();
+	ZT_VirtualNetworkRule rules[16];
+
+	std::unique_ptr<NetworkConfig> nc(new NetworkConfig());
+	nc->networkId = (controller.address().toInt() << 24) | 0x000001ULL;
+	nc->timestamp = OSUtils::now();
+	nc->credentialTimeMaxDelta = ZT_NETWORKCONFIG_DEFAULT_CREDENTIAL_TIME_MAX_MAX_DELTA;
+	nc->revision = 42;
+	nc->issuedTo = Address(0x1122334455ULL);
+	nc->flags = ZT_NETWORKCONFIG_FLAG_ENABLE_BROADCAST;
+	nc->mtu = ZT_DEFAULT_MTU;
+	nc->multicastLimit = 32;
+	nc->type = ZT_NETWORK_TYPE_PRIVATE;
+	Utils::scopy(nc->name,sizeof(nc->name),"benchmark");
+	nc->ruleCount = benchRules(rules);
+	for(unsigned int i=0;i<nc->ruleCount;++i)
+		nc->rules[i] = rules[i];
+	nc->staticIpCount = 2;
+	nc->staticIps[0] = InetAddress("10.147.17.1/24");
+	nc->staticIps[1] = InetAddress("fd80:56c2:e21c:0:199:9311:2233:4455/88");
+	nc->routeCount = 1;
+	*(reinterpret_cast<InetAddress *>(&(nc->routes[0].target))) = InetAddress("10.147.17.0/24");
+	nc->com = CertificateOfMembership(nc->timestamp,nc->credentialTimeMaxDelta,nc->networkId,nc->issuedTo);
+	nc->com.sign(controller);
+
+	Dictionary<ZT_NETWORKCONFIG_DICT_CAPACITY> *const d = new Dictionary<ZT_NETWORKCONFIG_DICT_CAPACITY>();
+	nc->toDictionary(*d,false);
+
+	bench("dictionary.get.networkconfig",0,[&](unsigned long n) {
+		char tmp[128];
+		for(unsigned long i=0;i<n;++i) {
+			benchSink += d->getUI(ZT_NETWORKCONFIG_DICT_KEY_NETWORK_ID,0);
+			benchSink += d->getUI(ZT_NETWORKCONFIG_DICT_KEY_REVISION,0);
+			benchSink += d->getUI(ZT_NETWORKCONFIG_DICT_KEY_MTU,0);
+			benchSink += (uint64_t)d->get(ZT_NETWORKCONFIG_DICT_KEY_NAME,tmp,sizeof(tmp));
+		}
+	});
+
+	std::unique_ptr<NetworkConfig> parsed(new NetworkConfig());
+	bench("dictionary.parse.networkconfig",(unsigned int)d->sizeBytes(),[&](unsigned long n) {
+		for(unsigned long i=0;i<n;++i)
+			benchSink += (uint64_t)parsed->fromDictionary(*d);
+	});
+
+	delete d;
+}
+
+void benchNode()
+{
+	// The filter and multicast benchmarks need a node that has joined a
+	// network, which the loopback harness provides.
+	const bool filter = benchSelected("network.filterOutgoing");
+	const bool gather = benchSelected("multicaster.gather");
+	if ((!filter)&&(!gather))
+		return;
+
+	LoopbackHarness::Wire w;
+	LoopbackHarness h(2,w);
+	ZT_VirtualNetworkRule rules[16];
+	const unsigned int ruleCount = benchRules(rules);
+	h.setRules(rules,ruleCount);
+	if (!h.start(15000)) {
+		fprintf(stderr,"loopback harness failed to start, skipping node benchmarks" ZT_EOL_S);
+		return;
+	}
+
+	Node *const node = reinterpret_cast<Node *>(h.node(1));
+	SharedPtr<Network> network(node->network(h.networkId()));
+
+	if ((filter)&&(network)) {
+		uint8_t frame[1400];
+		benchTcpFrame(frame,sizeof(frame));
+		const Address self(node->address()),peer(0x1122334455ULL);
+		const MAC macSource(self,h.networkId()),macDest(peer,h.networkId());
+		char name[64];
+		OSUtils::ztsnprintf(name,sizeof(name),"network.filterOutgoing.%urules",ruleCount);
+		bench(name,0,[&](unsigned long n) {
+			uint8_t qosBucket = 0;
+			for(unsigned long i=0;i<n;++i)
+				benchSink += (uint64_t)network->filterOutgoingPacket((void *)0,false,self,peer,macSource,macDest,frame,sizeof(frame),0x0800,0,qosBucket);
+		});
+
+		// Same filter run from several threads at once, which should scale
+		// with cores since filtering no longer holds the network's lock. The
+		// core Mutex is a spinlock, so never run more threads than cores.
+		const unsigned int threadCount = std::min(4U,std::thread::hardware_concurrency());
+		if (threadCount >= 2) {
+			OSUtils::ztsnprintf(name,sizeof(name),"network.filterOutgoing.%urules.%uthreads",ruleCount,threadCount);
+			bench(name,0,[&](unsigned long n) {
+				std::vector<std::thread> threads;
+				std::vector<uint64_t> sinks(threadCount,0);
+				for(unsigned int t=0;t<threadCount;++t) {
+					threads.push_back(std::thread([&,t]() {
+						uint8_t qosBucket = 0;
+						uint64_t sink = 0;
+						for(unsigned long i=t;i<n;i+=threadCount)
+							sink += (uint64_t)network->filterOutgoingPacket((void *)0,false,self,peer,macSource,macDest,frame,sizeof(frame),0x0800,0,qosBucket);
+						sinks[t] = sink;
+					}));
+				}
+				for(unsigned int t=0;t<threadCount;++t) {
+					threads[t].join();
+					benchSink += sinks[t];
+				}
+			});
+		}
+	}
+
+	if (gather) {
+		RuntimeEnvironment renv(node);
+		renv.identity = node->identity();
+		Multicaster mc(&renv);
+		const MulticastGroup mg(MAC(0xffffffffffffULL),0x0a931101);
+		const int64_t now = OSUtils::now();
+		for(uint64_t i=1;i<=1000;++i)
+			mc.add((void *)0,now,h.networkId(),mg,Address(0x0100000000ULL + (i * 7919)));
+		bench("multicaster.gather.32of1000",0,[&](unsigned long n) {
+			Buffer<ZT_PROTO_MAX_PACKET_LENGTH> b;
+			for(unsigned long i=0;i<n;++i) {
+				b.clear();
+				benchSink += mc.gather(Address(0x0200000000ULL),h.networkId(),mg,b,32);
+			}
+		});
+	}
+}
+
+void benchLoopback()
+{
+	// Whole data path: two endpoints streaming through a relay-capable root
+	// over a clean simulated wire, with the default accept-all rules.
+	if (!benchSelected("loopback.frames.2endpoints.1400"))
+		return;
+	LoopbackHarness::Wire w;
+	LoopbackHarness h(3,w);
+	if (!h.start(15000)) {
+		fprintf(stderr,"loopback harness failed to start, skipping loopback benchmark" ZT_EOL_S);
+		return;
+	}
+	const LoopbackHarness::Result r(h.run(1400,500,std::max(benchMs * 4,1000U),32));
+	benchRecord("loopback.frames.2endpoints.1400",r.framesPerSecond,r.frameSize);
+}
+
+// In-memory controller DB with nothing behind it
+class BenchControllerDB : public DB
+{
+public:
+	virtual bool waitForReady() { return true; }
+	virtual bool isReady() { return true; }
+	virtual bool save(nlohmann::json &record,bool notifyListeners) { return false; }
+	virtual void eraseNetwork(const uint64_t networkId) {}
+	virtual void eraseMember(const uint64_t networkId,const uint64_t memberId) {}
+	virtual void nodeIsOnline(const uint64_t networkId,const uint64_t memberId,const InetAddress &physicalAddress) {}
+	inline void load(nlohmann::json &record)
+	{
+		nlohmann::json old;
+		if (record["objtype"] == "network")
+			_networkChanged(old,record,false);
+		else _memberChanged(old,record,false);
+	}
+};
+
+void benchController()
+{
+	// Member gets against a controller DB the size of a large deployment,
+	// spread over one network per thousand members.
+	const bool load = benchSelected("controller.member.load");
+	const bool get = benchSelected("controller.member.get");
+	if ((!load)&&(!get))
+		return;
+
+	const unsigned long count = ZT_BENCH_CONTROLLER_MEMBERS;
+	const unsigned long networkCount = count / 1000;
+	char tmp[ZT_IDENTITY_STRING_BUFFER_LENGTH];
+	Identity id;
+	id.generate();
+	const std::string idStr(id.toString(false,tmp));
+
+	BenchControllerDB db;
+	for(unsigned long n=0;n<networkCount;++n) {
+		json network;
+		OSUtils::ztsnprintf(tmp,sizeof(tmp),"%.16llx",(unsigned long long)(0x8056c2e21c000000ULL + n));
+		network["id"] = tmp;
+		network["nwid"] = tmp;
+		DB::initNetwork(network);
+		db.load(network);
+	}
+	const int64_t start = benchNowNs();
+	for(unsigned long i=0;i<count;++i) {
+		json m;
+		OSUtils::ztsnprintf(tmp,sizeof(tmp),"%.16llx",(unsigned long long)(0x8056c2e21c000000ULL + (i % networkCount)));
+		m["nwid"] = tmp;
+		OSUtils::ztsnprintf(tmp,sizeof(tmp),"%.10llx",(unsigned long long)(0x1000000000ULL + i));
+		m["id"] = tmp;
+		m["address"] = tmp;
+		m["identity"] = std::string(tmp) + idStr.substr(10);
+		DB::initMember(m);
+		m["authorized"] = true;
+		m["tags"].push_back(json::array({ 1,(int)(i % 4) }));
+		m["capabilities"].push_back(1);
+		OSUtils::ztsnprintf(tmp,sizeof(tmp),"10.%u.%u.%u",(unsigned int)((i >> 16) & 0xff),(unsigned int)((i >> 8) & 0xff),(unsigned int)(i & 0xff));
+		m["ipAssignments"].push_back(tmp);
+		db.load(m);
+	}
+	if (load)
+		benchRecord("controller.member.load.1000000",((double)count * 1000000000.0) / (double)std::max(benchNowNs() - start,(int64_t)1),0);
+	if (!get)
+		return;
+
+	// Members are visited in a scattered order so lookups miss the cache
+	// the way request bursts from many members do.
+	unsigned long k = 0;
+	bench("controller.member.get.1000000",0,[&](unsigned long n) {
+		json network;
+		MemberRecord mr;
+		for(unsigned long j=0;j<n;++j) {
+			const unsigned long i = (unsigned long)(((k++) * 2654435761ULL) % count);
+			db.get(0x8056c2e21c000000ULL + (i % networkCount),network,0x1000000000ULL + i,mr);
+			benchSink += mr.revision;
+		}
+	});
+	bench("controller.member.get.json.1000000",0,[&](unsigned long n) {
+		json network,mj;
+		for(unsigned long j=0;j<n;++j) {
+			const unsigned long i = (unsigned long)(((k++) * 2654435761ULL) % count);
+			db.get(0x8056c2e21c000000ULL + (i % networkCount),network,0x1000000000ULL + i,mj);
+			benchSink += (uint64_t)mj.size();
+		}
+	});
+
+	// Request-path gets on one network from several threads, which should
+	// scale with cores since readers share the network's lock.
+	const unsigned int threadCount = std::min(4U,std::thread::hardware_concurrency());
+	if (threadCount >= 2) {
+		char name[64];
+		OSUtils::ztsnprintf(name,sizeof(name),"controller.member.get.1000000.%uthreads",threadCount);
+		bench(name,0,[&](unsigned long n) {
+			std::vector<std::thread> threads;
+			std::vector<uint64_t> sinks(threadCount,0);
+			for(unsigned int t=0;t<threadCount;++t) {
+				threads.push_back(std::thread([&,t]() {
+					json network;
+					MemberRecord mr;
+					DB::NetworkSummaryInfo ns;
+					uint64_t sink = 0;
+					for(unsigned long j=t;j<n;j+=threadCount) {
+						const unsigned long i = (unsigned long)((j * 2654435761ULL) % (count / networkCount)) * networkCount;
+						db.get(0x8056c2e21c000000ULL,network,0x1000000000ULL + i,mr,ns);
+						sink += mr.revision;
+					}
+					sinks[t] = sink;
+				}));
+			}
+			for(unsigned int t=0;t<threadCount;++t) {
+				threads[t].join();
+				benchSink += sinks[t];
+			}
+		});
+	}
+}
+
+bool benchCompare(const json &baseline,double threshold)
+{
+	bool regressed = false;
+	const json &b = baseline["results"];
+	if (!b.is_array()) {
+		fprintf(stderr,"baseline has no results array" ZT_EOL_S);
+		return true;
+	}
+	fprintf(stderr,ZT_EOL_S "%-44s %14s %14s %9s" ZT_EOL_S,"benchmark","baseline","current","change");
+	for(std::vector<BenchResult>::const_iterator r(benchResults.begin());r!=benchResults.end();++r) {
+		for(json::const_iterator e(b.begin());e!=b.end();++e) {
+			if ((e->is_object())&&((*e)["name"] == r->name)) {
+				const double base = (*e)["opsPerSecond"].is_number() ? (*e)["opsPerSecond"].get<double>() : 0.0;
+				if (base <= 0.0)
+					break;
+				const double change = ((r->opsPerSecond - base) / base) * 100.0;
+				const bool bad = (change < -threshold);
+				regressed |= bad;
+				fprintf(stderr,"%-44s %14.0f %14.0f %+8.1f%%%s" ZT_EOL_S,r->name.c_str(),base,r->opsPerSecond,change,bad ? "  REGRESSION" : "");
+				break;
+			}
+		}
+	}
+	return regressed;
+}
+
+void printHelp(const char *cn,FILE *out)
+{
+	fprintf(out,"ZeroTier One benchmarks version %d.%d.%d" ZT_EOL_S,ZEROTIER_ONE_VERSION_MAJOR,ZEROTIER_ONE_VERSION_MINOR,ZEROTIER_ONE_VERSION_REVISION);
+	fprintf(out,ZT_EOL_S "Usage: %s [-switches] [name filter]" ZT_EOL_S,cn);
+	fprintf(out,ZT_EOL_S "Available switches:" ZT_EOL_S);
+	fprintf(out,"  -h                - Display this help" ZT_EOL_S);
+	fprintf(out,"  -d<ms>            - Measurement time per benchmark (default: %u)" ZT_EOL_S,ZT_BENCH_DEFAULT_MS);
+	fprintf(out,"  -o<file>          - Write JSON results to file instead of stdout" ZT_EOL_S);
+	fprintf(out,"  -b<file>          - Compare against JSON results of an earlier run" ZT_EOL_S);
+	fprintf(out,"  -t<percent>       - Slowdown that counts as a regression (default: %.0f)" ZT_EOL_S,ZT_BENCH_DEFAULT_THRESHOLD);
+	fprintf(out,ZT_EOL_S "Exit code is 1 if any benchmark regressed against the baseline." ZT_EOL_S);
+}
+
+} // anonymous namespace
+
+int main(int argc,char **argv)
+{
+	const char *outPath = (const char *)0;
+	const char *baselinePath = (const char *)0;
+	double threshold = ZT_BENCH_DEFAULT_THRESHOLD;
+
+	for(int i=1;i<argc;++i) {
+		if (argv[i][0] == '-') {
+			switch(argv[i][1]) {
+				case 'd':
+					benchMs = std::max(Utils::strToUInt(argv[i] + 2),1U);
+					break;
+				case 'o':
+					outPath = argv[i] + 2;
+					break;
+				case 'b':
+					baselinePath = argv[i] + 2;
+					break;
+				case 't':
+					threshold = strtod(argv[i] + 2,(char **)0);
+					break;
+				case 'h':
+				case '?':
+				default:
+					printHelp(argv[0],stdout);
+					return 0;
+			}
+		} else {
+			benchFilter = argv[i];
+		}
+	}
+
+	json baseline;
+	if (baselinePath) {
+		std::string buf;
+		if (!OSUtils::readFile(baselinePath,buf)) {
+			fprintf(stderr,"%s: unable to read baseline %s" ZT_EOL_S,argv[0],baselinePath);
+			return 2;
+		}
+		baseline = OSUtils::jsonParse(buf);
+		if (!baseline.is_object()) {
+			fprintf(stderr,"%s: baseline %s is not valid JSON" ZT_EOL_S,argv[0],baselinePath);
+			return 2;
+		}
+	}
+
+	benchCrypto();
+	benchPacket();
+	benchHashtable();
+	benchDictionary();
+	benchNode();
+	benchLoopback();
+	benchController();
+
+	json out = json::object();
+	char ver[64];
+	OSUtils::ztsnprintf(ver,sizeof(ver),"%d.%d.%d",ZEROTIER_ONE_VERSION_MAJOR,ZEROTIER_ONE_VERSION_MINOR,ZEROTIER_ONE_VERSION_REVISION);
+	out["version"] = ver;
+	out["timestamp"] = OSUtils::now();
+	out["measureMs"] = benchMs;
+	json &res = out["results"] = json::array();
+	for(std::vector<BenchResult>::const_iterator r(benchResults.begin());r!=benchResults.end();++r) {
+		json e = json::object();
+		e["name"] = r->name;
+		e["opsPerSecond"] = r->opsPerSecond;
+		e["nsPerOp"] = r->nsPerOp;
+		if (r->bytesPerSecond > 0.0)
+			e["bytesPerSecond"] = r->bytesPerSecond;
+		res.push_back(e);
+	}
+	const std::string js(OSUtils::jsonDump(out));
+	if (outPath) {
+		if (!OSUtils::writeFile(outPath,js)) {
+			fprintf(stderr,"%s: unable to write %s" ZT_EOL_S,argv[0],outPath);
+			return 2;
+		}
+	} else {
+		printf("%s" ZT_EOL_S,js.c_str());
+	}
+
+	if ((baselinePath)&&(benchCompare(baseline,threshold)))
+		return 1;
+	return 0;
+}
@@ -30,11 +30,423 @@
 #include <chrono>
 #include <algorithm>
 #include <stdexcept>
+#include <unordered_map>
 
 using json = nlohmann::json;
 
 namespace ZeroTier {
 
+const MemberRecord::CapabilityList MemberRecord::_EMPTY_CAPABILITIES;
+const MemberRecord::TagList MemberRecord::_EMPTY_TAGS;
+
+namespace {
+
+static bool _jsonInt64(const json &v,int64_t &out)
+{
+	if (v.is_number_unsigned()) {
+		const uint64_t u = v.get<uint64_t>();
+		if (u > 0x7fffffffffffffffULL)
+			return false;
+		out = (int64_t)u;
+		return true;
+	} else if (v.is_number_integer()) {
+		out = v.get<int64_t>();
+		return true;
+	}
+	return false;
+}
+
+static bool _jsonInt32(const json &v,int32_t &out)
+{
+	int64_t i;
+	if ((!_jsonInt64(v,i))||(i < -2147483647LL)||(i > 2147483647LL))
+		return false;
+	out = (int32_t)i;
+	return true;
+}
+
+static bool _jsonUInt32(const json &v,uint32_t &out)
+{
+	int64_t i;
+	if ((!_jsonInt64(v,i))||(i < 0)||(i > 0xffffffffLL))
+		return false;
+	out = (uint32_t)i;
+	return true;
+}
+
+static uint32_t _fieldForKey(const std::string &k)
+{
+	static const struct { const char *key; uint32_t field; } keys[] = {
+		{ "id",MemberRecord::F_ID },
+		{ "address",MemberRecord::F_ADDRESS },
+		{ "nwid",MemberRecord::F_NWID },
+		{ "objtype",MemberRecord::F_OBJTYPE },
+		{ "identity",MemberRecord::F_IDENTITY },
+		{ "authorized",MemberRecord::F_AUTHORIZED },
+		{ "activeBridge",MemberRecord::F_ACTIVE_BRIDGE },
+		{ "noAutoAssignIps",MemberRecord::F_NO_AUTO_ASSIGN_IPS },
+		{ "creationTime",MemberRecord::F_CREATION_TIME },
+		{ "lastAuthorizedTime",MemberRecord::F_LAST_AUTHORIZED_TIME },
+		{ "lastDeauthorizedTime",MemberRecord::F_LAST_DEAUTHORIZED_TIME },
+		{ "revision",MemberRecord::F_REVISION },
+		{ "vMajor",MemberRecord::F_V_MAJOR },
+		{ "vMinor",MemberRecord::F_V_MINOR },
+		{ "vRev",MemberRecord::F_V_REV },
+		{ "vProto",MemberRecord::F_V_PROTO },
+		{ "remoteTraceTarget",MemberRecord::F_REMOTE_TRACE_TARGET },
+		{ "remoteTraceLevel",MemberRecord::F_REMOTE_TRACE_LEVEL },
+		{ "capabilities",MemberRecord::F_CAPABILITIES },
+		{ "tags",MemberRecord::F_TAGS },
+		{ "ipAssignments",MemberRecord::F_IP_ASSIGNMENTS },
+		{ "lastAuthorizedCredentialType",MemberRecord::F_CREDENTIAL_TYPE },
+		{ "lastAuthorizedCredential",MemberRecord::F_CREDENTIAL }
+	};
+	for(unsigned int i=0;i<(sizeof(keys) / sizeof(keys[0]));++i) {
+		if (k == keys[i].key)
+			return keys[i].field;
+	}
+	return 0;
+}
+
+static const Identity _NIL_IDENTITY; // static storage, so its key bytes are zero rather than uninitialized
+
+} // anonymous namespace
+
+MemberRecord::MemberRecord() :
+	networkId(0),
+	id(0),
+	identity(_NIL_IDENTITY),
+	revision(0),
+	creationTime(0),
+	lastAuthorizedTime(0),
+	lastDeauthorizedTime(0),
+	remoteTraceTarget(0),
+	remoteTraceLevel(0),
+	vMajor(-1),
+	vMinor(-1),
+	vRev(-1),
+	vProto(-1),
+	fields(0),
+	authorized(false),
+	activeBridge(false),
+	noAutoAssignIps(false),
+	identityInvalid(false),
+	credentialNull(true),
+	credentialType(CREDENTIAL_NULL),
+	_untyped(0)
+{
+}
+
+void MemberRecord::fromJson(const nlohmann::json &j,const uint64_t nwid,const uint64_t mid,Interner *interner)
+{
+	*this = MemberRecord();
+	networkId = nwid;
+	id = mid;
+	if (!j.is_object())
+		return;
+
+	char tmp[ZT_IDENTITY_STRING_BUFFER_LENGTH];
+	json extra;
+	for(auto i=j.begin();i!=j.end();++i) {
+		const std::string &k = i.key();
+		const json &v = i.value();
+		bool typed = false;
+		if (k == "id") {
+			OSUtils::ztsnprintf(tmp,sizeof(tmp),"%.10llx",(unsigned long long)mid);
+			if ((typed = ((v.is_string())&&(v.get<std::string>() == tmp)))) fields |= F_ID;
+		} else if (k == "address") {
+			OSUtils::ztsnprintf(tmp,sizeof(tmp),"%.10llx",(unsigned long long)mid);
+			if ((typed = ((v.is_string())&&(v.get<std::string>() == tmp)))) fields |= F_ADDRESS;
+		} else if (k == "nwid") {
+			OSUtils::ztsnprintf(tmp,sizeof(tmp),"%.16llx",(unsigned long long)nwid);
+			if ((typed = ((v.is_string())&&(v.get<std::string>() == tmp)))) fields |= F_NWID;
+		} else if (k == "objtype") {
+			if ((typed = ((v.is_string())&&(v.get<std::string>() == "member")))) fields |= F_OBJTYPE;
+		} else if (k == "identity") {
+			if (v.is_string()) {
+				const std::string ids(v.get<std::string>());
+				if (ids.length() > 0) {
+					Identity tid;
+					if ((ids.length() < sizeof(tmp))&&(tid.fromString(ids.c_str()))) {
+						identity = tid;
+						if ((typed = ((!tid.hasPrivate())&&(ids == tid.toString(false,tmp)))))
+							fields |= F_IDENTITY;
+					} else {
+						identityInvalid = true;
+					}
+				}
+			}
+		} else if (k == "authorized") {
+			if ((typed = v.is_boolean())) { authorized = v.get<bool>(); fields |= F_AUTHORIZED; }
+		} else if (k == "activeBridge") {
+			if ((typed = v.is_boolean())) { activeBridge = v.get<bool>(); fields |= F_ACTIVE_BRIDGE; }
+		} else if (k == "noAutoAssignIps") {
+			if ((typed = v.is_boolean())) { noAutoAssignIps = v.get<bool>(); fields |= F_NO_AUTO_ASSIGN_IPS; }
+		} else if (k == "creationTime") {
+			if ((typed = _jsonInt64(v,creationTime))) fields |= F_CREATION_TIME;
+		} else if (k == "lastAuthorizedTime") {
+			if ((typed = _jsonInt64(v,lastAuthorizedTime))) fields |= F_LAST_AUTHORIZED_TIME;
+		} else if (k == "lastDeauthorizedTime") {
+			if ((typed = _jsonInt64(v,lastDeauthorizedTime))) fields |= F_LAST_DEAUTHORIZED_TIME;
+		} else if (k == "revision") {
+			if (v.is_number_unsigned()) {
+				revision = v.get<uint64_t>();
+				typed = true;
+			} else if ((v.is_number_integer())&&(v.get<int64_t>() >= 0)) {
+				revision = (uint64_t)v.get<int64_t>();
+				typed = true;
+			}
+			if (typed) fields |= F_REVISION;
+		} else if (k == "vMajor") {
+			if ((typed = _jsonInt32(v,vMajor))) fields |= F_V_MAJOR;
+		} else if (k == "vMinor") {
+			if ((typed = _jsonInt32(v,vMinor))) fields |= F_V_MINOR;
+		} else if (k == "vRev") {
+			if ((typed = _jsonInt32(v,vRev))) fields |= F_V_REV;
+		} else if (k == "vProto") {
+			if ((typed = _jsonInt32(v,vProto))) fields |= F_V_PROTO;
+		} else if (k == "remoteTraceLevel") {
+			if ((typed = _jsonInt32(v,remoteTraceLevel))) fields |= F_REMOTE_TRACE_LEVEL;
+		} else if (k == "remoteTraceTarget") {
+			if (v.is_null()) {
+				typed = true;
+			} else if (v.is_string()) {
+				const std::string rt(v.get<std::string>());
+				const uint64_t a = Utils::hexStrToU64(rt.c_str());
+				OSUtils::ztsnprintf(tmp,sizeof(tmp),"%.10llx",(unsigned long long)a);
+				if ((typed = ((a != 0)&&(rt == tmp))))
+					remoteTraceTarget = a;
+			}
+			if (typed) fields |= F_REMOTE_TRACE_TARGET;
+		} else if (k == "capabilities") {
+			if (v.is_array()) {
+				CapabilityList l;
+				uint32_t c = 0;
+				typed = true;
+				for(auto e=v.begin();e!=v.end();++e) {
+					if (!_jsonUInt32(*e,c)) {
+						typed = false;
+						break;
+					}
+					l.push_back(c);
+				}
+				if (typed) {
+					if (interner) _capabilities = interner->capabilities(l);
+					else if (!l.empty()) _capabilities.reset(new CapabilityList(l));
+					fields |= F_CAPABILITIES;
+				}
+			}
+		} else if (k == "tags") {
+			if (v.is_array()) {
+				TagList l;
+				uint32_t tid = 0,tv = 0;
+				typed = true;
+				for(auto e=v.begin();e!=v.end();++e) {
+					if ((!e->is_array())||(e->size() != 2)||(!_jsonUInt32((*e)[0],tid))||(!_jsonUInt32((*e)[1],tv))) {
+						typed = false;
+						break;
+					}
+					l.push_back(std::pair<uint32_t,uint32_t>(tid,tv));
+				}
+				if (typed) {
+					if (interner) _tags = interner->tags(l);
+					else if (!l.empty()) _tags.reset(new TagList(l));
+					fields |= F_TAGS;
+				}
+			}
+		} else if (k == "ipAssignments") {
+			if (v.is_array()) {
+				typed = true;
+				for(auto e=v.begin();e!=v.end();++e) {
+					if (!e->is_string()) {
+						typed = false;
+						break;
+					}
+					const std::string ips(e->get<std::string>());
+					const InetAddress ip(ips.c_str());
+					if (((ip.ss_family != AF_INET)&&(ip.ss_family != AF_INET6))||(ips != ip.toIpString(tmp))) {
+						typed = false;
+						break;
+					}
+					addIpAssignment(ip);
+				}
+				if (!typed) {
+					_ips.clear();
+					fields &= ~((uint32_t)F_IP_ASSIGNMENTS);
+				}
+			}
+		} else if (k == "lastAuthorizedCredentialType") {
+			typed = true;
+			if (v.is_null()) credentialType = CREDENTIAL_NULL;
+			else if (v == "api") credentialType = CREDENTIAL_API;
+			else if (v == "public") credentialType = CREDENTIAL_PUBLIC;
+			else if (v == "token") credentialType = CREDENTIAL_TOKEN;
+			else typed = false;
+			if (typed) fields |= F_CREDENTIAL_TYPE;
+		} else if (k == "lastAuthorizedCredential") {
+			if (v.is_null()) {
+				typed = true;
+			} else if (v.is_string()) {
+				credential = v.get<std::string>();
+				credentialNull = false;
+				typed = true;
+			}
+			if (typed) fields |= F_CREDENTIAL;
+		}
+		if (!typed) {
+			extra[k] = v;
+			_untyped |= _fieldForKey(k);
+		}
+	}
+	if (!extra.empty())
+		_extra = OSUtils::jsonDump(extra,-1);
+}
+
+void MemberRecord::toJson(nlohmann::json &j) const
+{
+	char tmp[ZT_IDENTITY_STRING_BUFFER_LENGTH];
+	j = json::object();
+	if (!_extra.empty()) {
+		try {
+			j = OSUtils::jsonParse(_extra);
+		} catch ( ... ) {}
+	}
+	if (fields & (F_ID|F_ADDRESS)) {
+		OSUtils::ztsnprintf(tmp,sizeof(tmp),"%.10llx",(unsigned long long)id);
+		if (fields & F_ID) j["id"] = tmp;
+		if (fields & F_ADDRESS) j["address"] = tmp;
+	}
+	if (fields & F_NWID) {
+		OSUtils::ztsnprintf(tmp,sizeof(tmp),"%.16llx",(unsigned long long)networkId);
+		j["nwid"] = tmp;
+	}
+	if (fields & F_OBJTYPE) j["objtype"] = "member";
+	if (fields & F_IDENTITY) j["identity"] = identity.toString(false,tmp);
+	if (fields & F_AUTHORIZED) j["authorized"] = authorized;
+	if (fields & F_ACTIVE_BRIDGE) j["activeBridge"] = activeBridge;
+	if (fields & F_NO_AUTO_ASSIGN_IPS) j["noAutoAssignIps"] = noAutoAssignIps;
+	if (fields & F_CREATION_TIME) j["creationTime"] = creationTime;
+	if (fields & F_LAST_AUTHORIZED_TIME) j["lastAuthorizedTime"] = lastAuthorizedTime;
+	if (fields & F_LAST_DEAUTHORIZED_TIME) j["lastDeauthorizedTime"] = lastDeauthorizedTime;
+	if (fields & F_REVISION) j["revision"] = revision;
+	if (fields & F_V_MAJOR) j["vMajor"] = vMajor;
+	if (fields & F_V_MINOR) j["vMinor"] = vMinor;
+	if (fields & F_V_REV) j["vRev"] = vRev;
+	if (fields & F_V_PROTO) j["vProto"] = vProto;
+	if (fields & F_REMOTE_TRACE_LEVEL) j["remoteTraceLevel"] = remoteTraceLevel;
+	if (fields & F_REMOTE_TRACE_TARGET) {
+		if (remoteTraceTarget) {
+			OSUtils::ztsnprintf(tmp,sizeof(tmp),"%.10llx",(unsigned long long)remoteTraceTarget);
+			j["remoteTraceTarget"] = tmp;
+		} else j["remoteTraceTarget"] = json();
+	}
+	if (fields & F_CAPABILITIES) {
+		json &c = j["capabilities"];
+		c = json::array();
+		const CapabilityList &cl = capabilities();
+		for(auto i=cl.begin();i!=cl.end();++i)
+			c.push_back(*i);
+	}
+	if (fields & F_TAGS) {
+		json &t = j["tags"];
+		t = json::array();
+		const TagList &tl = tags();
+		for(auto i=tl.begin();i!=tl.end();++i) {
+			json tp = json::array();
+			tp.push_back(i->first);
+			tp.push_back(i->second);
+			t.push_back(tp);
+		}
+	}
+	if (fields & F_IP_ASSIGNMENTS) {
+		json &ipa = j["ipAssignments"];
+		ipa = json::array();
+		std::vector<InetAddress> ips;
+		ipAssignments(ips);
+		for(auto i=ips.begin();i!=ips.end();++i)
+			ipa.push_back(i->toIpString(tmp));
+	}
+	if (fields & F_CREDENTIAL_TYPE) {
+		switch(credentialType) {
+			case CREDENTIAL_API: j["lastAuthorizedCredentialType"] = "api"; break;
+			case CREDENTIAL_PUBLIC: j["lastAuthorizedCredentialType"] = "public"; break;
+			case CREDENTIAL_TOKEN: j["lastAuthorizedCredentialType"] = "token"; break;
+			default: j["lastAuthorizedCredentialType"] = json(); break;
+		}
+	}
+	if (fields & F_CREDENTIAL) {
+		if (credentialNull) j["lastAuthorizedCredential"] = json();
+		else j["lastAuthorizedCredential"] = credential;
+	}
+}
+
+void MemberRecord::init()
+{
+	fields |= ~_untyped & (F_AUTHORIZED|F_IP_ASSIGNMENTS|F_ACTIVE_BRIDGE|F_TAGS|F_CAPABILITIES|F_NO_AUTO_ASSIGN_IPS|F_REVISION|F_LAST_DEAUTHORIZED_TIME|F_LAST_AUTHORIZED_TIME|F_CREDENTIAL_TYPE|F_CREDENTIAL|F_V_MAJOR|F_V_MINOR|F_V_REV|F_V_PROTO|F_REMOTE_TRACE_TARGET|F_REMOTE_TRACE_LEVEL|F_OBJTYPE);
+	if (!((fields|_untyped) & F_CREATION_TIME)) {
+		creationTime = OSUtils::now();
+		fields |= F_CREATION_TIME;
+	}
+}
+
+void MemberRecord::ipAssignments(std::vector<InetAddress> &ips) const
+{
+	const char *p = _ips.data();
+	const char *const eof = p + _ips.length();
+	while (p < eof) {
+		if (*p == 4) {
+			ips.push_back(InetAddress(p + 1,4,0));
+			p += 5;
+		} else {
+			ips.push_back(InetAddress(p + 1,16,0));
+			p += 17;
+		}
+	}
+}
+
+void MemberRecord::addIpAssignment(const InetAddress &ip)
+{
+	if (ip.ss_family == AF_INET) {
+		_ips.push_back((char)4);
+		_ips.append(reinterpret_cast<const char *>(ip.rawIpData()),4);
+	} else if (ip.ss_family == AF_INET6) {
+		_ips.push_back((char)6);
+		_ips.append(reinterpret_cast<const char *>(ip.rawIpData()),16);
+	} else return;
+	fields |= F_IP_ASSIGNMENTS;
+}
+
+bool MemberRecord::operator==(const MemberRecord &r) const
+{
+	return (
+		(networkId == r.networkId)&&
+		(id == r.id)&&
+		(fields == r.fields)&&
+		(identity == r.identity)&&
+		(revision == r.revision)&&
+		(creationTime == r.creationTime)&&
+		(lastAuthorizedTime == r.lastAuthorizedTime)&&
+		(lastDeauthorizedTime == r.lastDeauthorizedTime)&&
+		(remoteTraceTarget == r.remoteTraceTarget)&&
+		(remoteTraceLevel == r.remoteTraceLevel)&&
+		(vMajor == r.vMajor)&&
+		(vMinor == r.vMinor)&&
+		(vRev == r.vRev)&&
+		(vProto == r.vProto)&&
+		(authorized == r.authorized)&&
+		(activeBridge == r.activeBridge)&&
+		(noAutoAssignIps == r.noAutoAssignIps)&&
+		(identityInvalid == r.identityInvalid)&&
+		(credentialNull == r.credentialNull)&&
+		(credentialType == r.credentialType)&&
+		(credential == r.credential)&&
+		((_capabilities == r._capabilities)||(capabilities() == r.capabilities()))&&
+		((_tags == r._tags)||(tags() == r.tags()))&&
+		(_ips == r._ips)&&
+		(_untyped == r._untyped)&&
+		(_extra == r._extra));
+}
+
 void DB::initNetwork(nlohmann::json &network)
 {
 	if (!network.count("private")) network["private"] = true;
@@ -105,7 +517,7 @@ void DB::cleanMember(nlohmann::json &member)
 	member.erase("lastRequestMetaData");
 }
 
-DB::DB() {}
+DB::DB() : _memberChangeCount(0),_memberChangeWaiters(0) {}
 DB::~DB() {}
 
 bool DB::get(const uint64_t networkId,nlohmann::json &network)
@@ -113,14 +525,14 @@ bool DB::get(const uint64_t networkId,nlohmann::json &network)
 	waitForReady();
 	std::shared_ptr<_Network> nw;
 	{
-		std::lock_guard<std::mutex> l(_networks_l);
+		RWMutex::RLock l(_networks_l);
 		auto nwi = _networks.find(networkId);
 		if (nwi == _networks.end())
 			return false;
 		nw = nwi->second;
 	}
 	{
-		std::lock_guard<std::mutex> l2(nw->lock);
+		RWMutex::RLock l2(nw->lock);
 		network = nw->config;
 	}
 	return true;
@@ -131,19 +543,19 @@ bool DB::get(const uint64_t networkId,nlohmann::json &network,const uint64_t mem
 	waitForReady();
 	std::shared_ptr<_Network> nw;
 	{
-		std::lock_guard<std::mutex> l(_networks_l);
+		RWMutex::RLock l(_networks_l);
 		auto nwi = _networks.find(networkId);
 		if (nwi == _networks.end())
 			return false;
 		nw = nwi->second;
 	}
 	{
-		std::lock_guard<std::mutex> l2(nw->lock);
+		RWMutex::RLock l2(nw->lock);
 		network = nw->config;
 		auto m = nw->members.find(memberId);
 		if (m == nw->members.end())
 			return false;
-		member = m->second;
+		m->second.toJson(member);
 	}
 	return true;
 }
@@ -153,20 +565,20 @@ bool DB::get(const uint64_t networkId,nlohmann::json &network,const uint64_t mem
 	waitForReady();
 	std::shared_ptr<_Network> nw;
 	{
-		std::lock_guard<std::mutex> l(_networks_l);
+		RWMutex::RLock l(_networks_l);
 		auto nwi = _networks.find(networkId);
 		if (nwi == _networks.end())
 			return false;
 		nw = nwi->second;
 	}
 	{
-		std::lock_guard<std::mutex> l2(nw->lock);
+		RWMutex::RLock l2(nw->lock);
 		network = nw->config;
 		_fillSummaryInfo(nw,info);
 		auto m = nw->members.find(memberId);
 		if (m == nw->members.end())
 			return false;
-		member = m->second;
+		m->second.toJson(member);
 	}
 	return true;
 }
@@ -176,17 +588,64 @@ bool DB::get(const uint64_t networkId,nlohmann::json &network,std::vector<nlohma
 	waitForReady();
 	std::shared_ptr<_Network> nw;
 	{
-		std::lock_guard<std::mutex> l(_networks_l);
+		RWMutex::RLock l(_networks_l);
+		auto nwi = _networks.find(networkId);
+		if (nwi == _networks.end())
+			return false;
+		nw = nwi->second;
+	}
+	{
+		RWMutex::RLock l2(nw->lock);
+		network = nw->config;
+		for(auto m=nw->members.begin();m!=nw->members.end();++m) {
+			members.push_back(nlohmann::json());
+			m->second.toJson(members.back());
+		}
+	}
+	return true;
+}
+
+bool DB::get(const uint64_t networkId,nlohmann::json &network,const uint64_t memberId,MemberRecord &member)
+{
+	waitForReady();
+	std::shared_ptr<_Network> nw;
+	{
+		RWMutex::RLock l(_networks_l);
+		auto nwi = _networks.find(networkId);
+		if (nwi == _networks.end())
+			return false;
+		nw = nwi->second;
+	}
+	{
+		RWMutex::RLock l2(nw->lock);
+		network = nw->config;
+		auto m = nw->members.find(memberId);
+		if (m == nw->members.end())
+			return false;
+		member = m->second;
+	}
+	return true;
+}
+
+bool DB::get(const uint64_t networkId,nlohmann::json &network,const uint64_t memberId,MemberRecord &member,NetworkSummaryInfo &info)
+{
+	waitForReady();
+	std::shared_ptr<_Network> nw;
+	{
+		RWMutex::RLock l(_networks_l);
 		auto nwi = _networks.find(networkId);
 		if (nwi == _networks.end())
 			return false;
 		nw = nwi->second;
 	}
 	{
-		std::lock_guard<std::mutex> l2(nw->lock);
+		RWMutex::RLock l2(nw->lock);
 		network = nw->config;
-		for(auto m=nw->members.begin();m!=nw->members.end();++m)
-			members.push_back(m->second);
+		_fillSummaryInfo(nw,info);
+		auto m = nw->members.find(memberId);
+		if (m == nw->members.end())
+			return false;
+		member = m->second;
 	}
 	return true;
 }
@@ -194,11 +653,151 @@ bool DB::get(const uint64_t networkId,nlohmann::json &network,std::vector<nlohma
 void DB::networks(std::set<uint64_t> &networks)
 {
 	waitForReady();
-	std::lock_guard<std::mutex> l(_networks_l);
+	RWMutex::RLock l(_networks_l);
 	for(auto n=_networks.begin();n!=_networks.end();++n)
 		networks.insert(n->first);
 }
 
+bool DB::memberRevisions(const uint64_t networkId,std::vector<MemberChange> &members)
+{
+	waitForReady();
+	std::shared_ptr<_Network> nw;
+	{
+		RWMutex::RLock l(_networks_l);
+		auto nwi = _networks.find(networkId);
+		if (nwi == _networks.end())
+			return false;
+		nw = nwi->second;
+	}
+
+	members.clear();
+	RWMutex::RLock l(nw->lock);
+	members.reserve(nw->members.size());
+	for(auto m=nw->members.begin();m!=nw->members.end();++m) {
+		members.push_back(MemberChange());
+		members.back().memberId = m->first;
+		members.back().revision = m->second.revision;
+		members.back().erased = false;
+	}
+	return true;
+}
+
+bool DB::memberChanges(const uint64_t networkId,const uint64_t since,const int64_t sinceTime,const unsigned long maxWait,std::vector<MemberChange> &changes,uint64_t &cursor,bool &full)
+{
+	waitForReady();
+	std::shared_ptr<_Network> nw;
+	{
+		RWMutex::RLock l(_networks_l);
+		auto nwi = _networks.find(networkId);
+		if (nwi == _networks.end())
+			return false;
+		nw = nwi->second;
+	}
+
+	if (!maxWait) {
+		_readMemberChanges(*nw,since,sinceTime,changes,cursor,full);
+		return true;
+	}
+
+	// Register as a waiter before reading so a change logged after the read
+	// is sure to see us and bump the count.
+	uint64_t count;
+	{
+		std::lock_guard<std::mutex> l(_memberChanges_l);
+		++_memberChangeWaiters;
+		count = _memberChangeCount;
+	}
+	_readMemberChanges(*nw,since,sinceTime,changes,cursor,full);
+	if ((changes.empty())&&(!full)) {
+		{
+			std::unique_lock<std::mutex> l(_memberChanges_l);
+			_memberChanges_c.wait_for(l,std::chrono::milliseconds(maxWait),[this,count]() { return (_memberChangeCount != count); });
+		}
+		_readMemberChanges(*nw,since,sinceTime,changes,cursor,full);
+	}
+	--_memberChangeWaiters;
+	return true;
+}
+
+void DB::wakeMemberChangeWaiters()
+{
+	std::lock_guard<std::mutex> l(_memberChanges_l);
+	++_memberChangeCount;
+	_memberChanges_c.notify_all();
+}
+
+void DB::_logMemberChange(_Network &nw,const uint64_t memberId,const uint64_t revision,const bool erased)
+{
+	// assumes nw.lock is locked for writing
+	++nw.changeSeq;
+	if (!nw.changesWatched) {
+		nw.changeLogTruncated = true;
+		return;
+	}
+	nw.changes.push_back(_MemberChange());
+	_MemberChange &c = nw.changes.back();
+	c.seq = nw.changeSeq;
+	c.memberId = memberId;
+	c.revision = revision;
+	c.ts = OSUtils::now();
+	c.erased = erased;
+	if (nw.changes.size() > ZT_CONTROLLER_MEMBER_CHANGE_LOG_SIZE) {
+		nw.changes.pop_front();
+		nw.changeLogTruncated = true;
+	}
+}
+
+void DB::_readMemberChanges(_Network &nw,const uint64_t since,const int64_t sinceTime,std::vector<MemberChange> &changes,uint64_t &cursor,bool &full)
+{
+	changes.clear();
+	RWMutex::RLock l(nw.lock);
+
+	// Written under the read lock on purpose. changesWatched is atomic, so
+	// readers setting it at the same time don't race. Writers only test it
+	// from _logMemberChange() under the write lock, which can't be taken
+	// until this read lock is released. So every change after the cursor
+	// returned below is logged. Changes before it were either logged or
+	// marked changeLogTruncated.
+	nw.changesWatched = true;
+	cursor = nw.changeSeq;
+	auto c = nw.changes.begin();
+	if (sinceTime > 0) {
+		while ((c != nw.changes.end())&&(c->ts <= sinceTime))
+			++c;
+		full = ((nw.changeLogTruncated)&&(c == nw.changes.begin()));
+	} else {
+		const uint64_t first = (nw.changes.empty()) ? (nw.changeSeq + 1) : nw.changes.front().seq;
+		full = ((since > nw.changeSeq)||((since + 1) < first));
+		if (!full)
+			c += (std::ptrdiff_t)((since + 1) - first);
+	}
+
+	if (full) {
+		changes.reserve(nw.members.size());
+		for(auto m=nw.members.begin();m!=nw.members.end();++m) {
+			changes.push_back(MemberChange());
+			changes.back().memberId = m->first;
+			changes.back().revision = m->second.revision;
+			changes.back().erased = false;
+		}
+		return;
+	}
+
+	std::unordered_map<uint64_t,std::size_t> seen;
+	for(;c!=nw.changes.end();++c) {
+		auto s = seen.find(c->memberId);
+		if (s == seen.end()) {
+			seen[c->memberId] = changes.size();
+			changes.push_back(MemberChange());
+			changes.back().memberId = c->memberId;
+			s = seen.find(c->memberId);
+		}
+		MemberChange &mc = changes[s->second];
+		mc.revision = c->revision;
+		mc.erased = c->erased;
+	}
+}
+
 void DB::_memberChanged(nlohmann::json &old,nlohmann::json &memberConfig,bool notifyListeners)
 {
 	uint64_t memberId = 0;
@@ -212,13 +811,13 @@ void DB::_memberChanged(nlohmann::json &old,nlohmann::json &memberConfig,bool no
 		networkId = OSUtils::jsonIntHex(old["nwid"],0ULL);
 		if ((memberId)&&(networkId)) {
 			{
-				std::lock_guard<std::mutex> l(_networks_l);
+				RWMutex::RLock l(_networks_l);
 				auto nw2 = _networks.find(networkId);
 				if (nw2 != _networks.end())
 					nw = nw2->second;
 			}
 			if (nw) {
-				std::lock_guard<std::mutex> l(nw->lock);
+				std::lock_guard<RWMutex> l(nw->lock);
 				if (OSUtils::jsonBool(old["activeBridge"],false))
 					nw->activeBridgeMembers.erase(memberId);
 				wasAuth = OSUtils::jsonBool(old["authorized"],false);
@@ -246,7 +845,7 @@ void DB::_memberChanged(nlohmann::json &old,nlohmann::json &memberConfig,bool no
 			networkId = OSUtils::jsonIntHex(memberConfig["nwid"],0ULL);
 			if ((!memberId)||(!networkId))
 				return;
-			std::lock_guard<std::mutex> l(_networks_l);
+			std::lock_guard<RWMutex> l(_networks_l);
 			std::shared_ptr<_Network> &nw2 = _networks[networkId];
 			if (!nw2)
 				nw2.reset(new _Network);
@@ -254,9 +853,11 @@ void DB::_memberChanged(nlohmann::json &old,nlohmann::json &memberConfig,bool no
 		}
 
 		{
-			std::lock_guard<std::mutex> l(nw->lock);
+			std::lock_guard<RWMutex> l(nw->lock);
 
-			nw->members[memberId] = memberConfig;
+			MemberRecord &mr = nw->members[memberId];
+			mr.fromJson(memberConfig,networkId,memberId,&(nw->interner));
+			_logMemberChange(*nw,memberId,mr.revision,false);
 
 			if (OSUtils::jsonBool(memberConfig["activeBridge"],false))
 				nw->activeBridgeMembers.insert(memberId);
@@ -283,19 +884,21 @@ void DB::_memberChanged(nlohmann::json &old,nlohmann::json &memberConfig,bool no
 			}
 		}
 
-		if (notifyListeners) {
-			std::lock_guard<std::mutex> ll(_changeListeners_l);
-			for(auto i=_changeListeners.begin();i!=_changeListeners.end();++i) {
-				(*i)->onNetworkMemberUpdate(this,networkId,memberId,memberConfig);
-			}
-		}
+		if (_memberChangeWaiters > 0)
+			wakeMemberChangeWaiters();
+
 	} else if (memberId) {
 		if (nw) {
-			std::lock_guard<std::mutex> l(nw->lock);
-			nw->members.erase(memberId);
+			{
+				std::lock_guard<RWMutex> l(nw->lock);
+				if (nw->members.erase(memberId))
+					_logMemberChange(*nw,memberId,0,true);
+			}
+			if (_memberChangeWaiters > 0)
+				wakeMemberChangeWaiters();
 		}
 		if (networkId) {
-			std::lock_guard<std::mutex> l(_networks_l);
+			std::lock_guard<RWMutex> l(_networks_l);
 			auto er = _networkByMember.equal_range(memberId);
 			for(auto i=er.first;i!=er.second;++i) {
 				if (i->second == networkId) {
@@ -306,8 +909,19 @@ void DB::_memberChanged(nlohmann::json &old,nlohmann::json &memberConfig,bool no
 		}
 	}
 
-	if ((notifyListeners)&&((wasAuth)&&(!isAuth)&&(networkId)&&(memberId))) {
-		std::lock_guard<std::mutex> ll(_changeListeners_l);
+	if ((notifyListeners)&&(networkId)&&(memberId))
+		_notifyMemberChanged(networkId,memberId,memberConfig,(wasAuth)&&(!isAuth));
+}
+
+void DB::_notifyMemberChanged(const uint64_t networkId,const uint64_t memberId,const nlohmann::json &memberConfig,const bool deauthorized)
+{
+	std::lock_guard<std::mutex> ll(_changeListeners_l);
+	if (memberConfig.is_object()) {
+		for(auto i=_changeListeners.begin();i!=_changeListeners.end();++i) {
+			(*i)->onNetworkMemberUpdate(this,networkId,memberId,memberConfig);
+		}
+	}
+	if (deauthorized) {
 		for(auto i=_changeListeners.begin();i!=_changeListeners.end();++i) {
 			(*i)->onNetworkMemberDeauthorize(this,networkId,memberId);
 		}
@@ -322,33 +936,37 @@ void DB::_networkChanged(nlohmann::json &old,nlohmann::json &networkConfig,bool
 		if (networkId) {
 			std::shared_ptr<_Network> nw;
 			{
-				std::lock_guard<std::mutex> l(_networks_l);
+				std::lock_guard<RWMutex> l(_networks_l);
 				std::shared_ptr<_Network> &nw2 = _networks[networkId];
 				if (!nw2)
 					nw2.reset(new _Network);
 				nw = nw2;
 			}
 			{
-				std::lock_guard<std::mutex> l2(nw->lock);
+				std::lock_guard<RWMutex> l2(nw->lock);
 				nw->config = networkConfig;
 			}
-			if (notifyListeners) {
-				std::lock_guard<std::mutex> ll(_changeListeners_l);
-				for(auto i=_changeListeners.begin();i!=_changeListeners.end();++i) {
-					(*i)->onNetworkUpdate(this,networkId,networkConfig);
-				}
-			}
+			if (notifyListeners)
+				_notifyNetworkChanged(networkId,networkConfig);
 		}
 	} else if (old.is_object()) {
 		const std::string ids = old["id"];
 		const uint64_t networkId = Utils::hexStrToU64(ids.c_str());
 		if (networkId) {
-			std::lock_guard<std::mutex> l(_networks_l);
+			std::lock_guard<RWMutex> l(_networks_l);
 			_networks.erase(networkId);
 		}
 	}
 }
 
+void DB::_notifyNetworkChanged(const uint64_t networkId,const nlohmann::json &networkConfig)
+{
+	std::lock_guard<std::mutex> ll(_changeListeners_l);
+	for(auto i=_changeListeners.begin();i!=_changeListeners.end();++i) {
+		(*i)->onNetworkUpdate(this,networkId,networkConfig);
+	}
+}
+
 void DB::_fillSummaryInfo(const std::shared_ptr<_Network> &nw,NetworkSummaryInfo &info)
 {
 	for(auto ab=nw->activeBridgeMembers.begin();ab!=nw->activeBridgeMembers.end();++ab)
@@ -34,22 +34,216 @@
 #include "../node/InetAddress.hpp"
 #include "../osdep/OSUtils.hpp"
 #include "../osdep/BlockingQueue.hpp"
+#include "../osdep/RWMutex.hpp"
 
 #include <memory>
 #include <string>
 #include <thread>
+#include <deque>
+#include <condition_variable>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
 #include <atomic>
 #include <mutex>
 #include <set>
+#include <map>
 
 #include "../ext/json/json.hpp"
 
+// Member changes remembered per network for DB::memberChanges()
+#define ZT_CONTROLLER_MEMBER_CHANGE_LOG_SIZE 16384
+
 namespace ZeroTier
 {
 
+/**
+ * Compact in-memory form of a controller member record
+ *
+ * Fields the controller reads when building network configs are typed.
+ * Capability and tag lists are interned per network since most members share
+ * a few combinations, and IP assignments are packed into a short string.
+ * Anything else is kept as compact JSON so toJson() reproduces the record.
+ */
+class MemberRecord
+{
+public:
+	typedef std::vector<uint32_t> CapabilityList;
+	typedef std::vector< std::pair<uint32_t,uint32_t> > TagList;
+
+	/**
+	 * Bits in 'fields' for JSON fields this record holds in typed form
+	 */
+	enum Field
+	{
+		F_ID =                      0x00000001,
+		F_ADDRESS =                 0x00000002,
+		F_NWID =                    0x00000004,
+		F_OBJTYPE =                 0x00000008,
+		F_IDENTITY =                0x00000010,
+		F_AUTHORIZED =              0x00000020,
+		F_ACTIVE_BRIDGE =           0x00000040,
+		F_NO_AUTO_ASSIGN_IPS =      0x00000080,
+		F_CREATION_TIME =           0x00000100,
+		F_LAST_AUTHORIZED_TIME =    0x00000200,
+		F_LAST_DEAUTHORIZED_TIME =  0x00000400,
+		F_REVISION =                0x00000800,
+		F_V_MAJOR =                 0x00001000,
+		F_V_MINOR =                 0x00002000,
+		F_V_REV =                   0x00004000,
+		F_V_PROTO =                 0x00008000,
+		F_REMOTE_TRACE_TARGET =     0x00010000,
+		F_REMOTE_TRACE_LEVEL =      0x00020000,
+		F_CAPABILITIES =            0x00040000,
+		F_TAGS =                    0x00080000,
+		F_IP_ASSIGNMENTS =          0x00100000,
+		F_CREDENTIAL_TYPE =         0x00200000,
+		F_CREDENTIAL =              0x00400000
+	};
+
+	/**
+	 * Values of lastAuthorizedCredentialType
+	 */
+	enum CredentialType
+	{
+		CREDENTIAL_NULL = 0,
+		CREDENTIAL_API = 1,
+		CREDENTIAL_PUBLIC = 2,
+		CREDENTIAL_TOKEN = 3
+	};
+
+	/**
+	 * Per-network table of shared capability and tag lists
+	 *
+	 * Not thread safe; DB uses it only under the owning network's lock.
+	 */
+	class Interner
+	{
+	public:
+		Interner() : _n(0) {}
+
+		inline std::shared_ptr<const CapabilityList> capabilities(const CapabilityList &l) { return _intern(_caps,l); }
+		inline std::shared_ptr<const TagList> tags(const TagList &l) { return _intern(_tags,l); }
+
+	private:
+		template<typename L>
+		inline std::shared_ptr<const L> _intern(std::map< L,std::shared_ptr<const L> > &m,const L &l)
+		{
+			if (l.empty())
+				return std::shared_ptr<const L>();
+			auto i = m.find(l);
+			if (i != m.end())
+				return i->second;
+			if ((++_n % 4096) == 0) { // drop lists no member refers to any more
+				for(auto j=m.begin();j!=m.end();) {
+					if (j->second.use_count() == 1)
+						m.erase(j++);
+					else ++j;
+				}
+			}
+			std::shared_ptr<const L> e(new L(l));
+			m[l] = e;
+			return e;
+		}
+
+		std::map< CapabilityList,std::shared_ptr<const CapabilityList> > _caps;
+		std::map< TagList,std::shared_ptr<const TagList> > _tags;
+		unsigned long _n;
+	};
+
+	MemberRecord();
+
+	/**
+	 * Load from a member JSON object, replacing all current contents
+	 *
+	 * @param j Member JSON
+	 * @param nwid Network ID
+	 * @param mid Member ID
+	 * @param interner Interner for capability and tag lists or NULL to not share them
+	 */
+	void fromJson(const nlohmann::json &j,const uint64_t nwid,const uint64_t mid,Interner *interner);
+
+	/**
+	 * @param j JSON object to fill with this record
+	 */
+	void toJson(nlohmann::json &j) const;
+
+	/**
+	 * Add defaults for missing fields, as DB::initMember() does for JSON
+	 */
+	void init();
+
+	inline const CapabilityList &capabilities() const { return (_capabilities) ? *_capabilities : _EMPTY_CAPABILITIES; }
+	inline void setCapabilities(const CapabilityList &c)
+	{
+		if (c.empty()) _capabilities.reset();
+		else _capabilities.reset(new CapabilityList(c));
+		fields |= F_CAPABILITIES;
+	}
+
+	inline const TagList &tags() const { return (_tags) ? *_tags : _EMPTY_TAGS; }
+	inline void setTags(const TagList &t)
+	{
+		if (t.empty()) _tags.reset();
+		else _tags.reset(new TagList(t));
+		fields |= F_TAGS;
+	}
+
+	/**
+	 * @param ips Vector to which assigned IPs are appended (port 0)
+	 */
+	void ipAssignments(std::vector<InetAddress> &ips) const;
+
+	/**
+	 * @param ip IP to append to this member's IP assignments
+	 */
+	void addIpAssignment(const InetAddress &ip);
+
+	/**
+	 * @return Bytes this record occupies, including heap memory it owns but not interned lists
+	 */
+	inline unsigned long sizeBytes() const { return (unsigned long)sizeof(MemberRecord) + _heapBytes(credential) + _heapBytes(_ips) + _heapBytes(_extra); }
+
+	bool operator==(const MemberRecord &r) const;
+	inline bool operator!=(const MemberRecord &r) const { return !(*this == r); }
+
+	uint64_t networkId;
+	uint64_t id;
+	Identity identity; // may be set without F_IDENTITY if the stored string is not in canonical form
+	uint64_t revision;
+	int64_t creationTime;
+	int64_t lastAuthorizedTime;
+	int64_t lastDeauthorizedTime;
+	uint64_t remoteTraceTarget; // 0 for null
+	int32_t remoteTraceLevel;
+	int32_t vMajor,vMinor,vRev,vProto;
+	uint32_t fields;
+	bool authorized;
+	bool activeBridge;
+	bool noAutoAssignIps;
+	bool identityInvalid; // an identity is present but could not be parsed
+	bool credentialNull;
+	uint8_t credentialType;
+	std::string credential;
+
+private:
+	// Short strings are stored inline, so only count storage outside this object
+	inline unsigned long _heapBytes(const std::string &s) const
+	{
+		const char *const p = s.data();
+		return ((p >= reinterpret_cast<const char *>(this))&&(p < reinterpret_cast<const char *>(this + 1))) ? 0UL : (unsigned long)(s.capacity() + 1);
+	}
+
+	static const CapabilityList _EMPTY_CAPABILITIES;
+	static const TagList _EMPTY_TAGS;
+
+	std::shared_ptr<const CapabilityList> _capabilities;
+	std::shared_ptr<const TagList> _tags;
+	std::string _ips; // sequence of (4 or 6, raw address bytes)
+	std::string _extra; // untyped fields as compact JSON, or empty
+	uint32_t _untyped; // F_ bits of known fields that are in _extra because their values are not in typed form
+};
+
 /**
  * Base class with common infrastructure for all controller DB implementations
  */
@@ -66,6 +260,16 @@ public:
 		virtual void onNetworkMemberDeauthorize(const void *db,uint64_t networkId,uint64_t memberId) {}
 	};
 
+	/**
+	 * Latest change to a member, as returned by memberChanges()
+	 */
+	struct MemberChange
+	{
+		uint64_t memberId;
+		uint64_t revision; // 0 if erased
+		bool erased;
+	};
+
 	struct NetworkSummaryInfo
 	{
 		NetworkSummaryInfo() : authorizedMemberCount(0),totalMemberCount(0),mostRecentDeauthTime(0) {}
@@ -89,7 +293,7 @@ public:
 
 	inline bool hasNetwork(const uint64_t networkId) const
 	{
-		std::lock_guard<std::mutex> l(_networks_l);
+		RWMutex::RLock l(_networks_l);
 		return (_networks.find(networkId) != _networks.end());
 	}
 
@@ -98,17 +302,73 @@ public:
 	bool get(const uint64_t networkId,nlohmann::json &network,const uint64_t memberId,nlohmann::json &member,NetworkSummaryInfo &info);
 	bool get(const uint64_t networkId,nlohmann::json &network,std::vector<nlohmann::json> &members);
 
+	/**
+	 * Get a network and the compact form of one of its members
+	 *
+	 * This avoids materializing member JSON and is used by the request path.
+	 *
+	 * @return True if both network and member were found
+	 */
+	bool get(const uint64_t networkId,nlohmann::json &network,const uint64_t memberId,MemberRecord &member);
+	bool get(const uint64_t networkId,nlohmann::json &network,const uint64_t memberId,MemberRecord &member,NetworkSummaryInfo &info);
+
 	void networks(std::set<uint64_t> &networks);
 
+	/**
+	 * Get every current member of a network and its revision
+	 *
+	 * Unlike memberChanges() this does not start keeping a change log for
+	 * the network.
+	 *
+	 * @param networkId Network ID
+	 * @param members Filled with one entry per member, none of them erased
+	 * @return False if the network was not found
+	 */
+	bool memberRevisions(const uint64_t networkId,std::vector<MemberChange> &members);
+
+	/**
+	 * Get members of a network that changed after a position in its change log
+	 *
+	 * Each network numbers its member changes. Once memberChanges() has been
+	 * called for a network it also keeps the most recent
+	 * ZT_CONTROLLER_MEMBER_CHANGE_LOG_SIZE of them, so networks nobody
+	 * watches cost nothing. Callers pass back the cursor from their last
+	 * call. If that's 0, from another run, or older than anything still
+	 * logged, 'full' is set and every current member is returned instead,
+	 * so callers never need a separate member list.
+	 *
+	 * @param networkId Network ID
+	 * @param since Cursor from a previous call, or 0 for all members
+	 * @param sinceTime If nonzero, return changes after this time (ms since epoch) instead of after since
+	 * @param maxWait If there are no changes, wait up to this many ms for any member change (in any network) before returning
+	 * @param changes Filled with the latest change for each changed member in log order
+	 * @param cursor Set to the position of the network's most recent change
+	 * @param full Set if changes contains all members rather than a delta
+	 * @return False if the network was not found
+	 */
+	bool memberChanges(const uint64_t networkId,const uint64_t since,const int64_t sinceTime,const unsigned long maxWait,std::vector<MemberChange> &changes,uint64_t &cursor,bool &full);
+
+	/**
+	 * Wake any threads waiting in memberChanges()
+	 */
+	void wakeMemberChangeWaiters();
+
 	template<typename F>
 	inline void each(F f)
 	{
 		nlohmann::json nullJson;
-		std::lock_guard<std::mutex> lck(_networks_l);
-		for(auto nw=_networks.begin();nw!=_networks.end();++nw) {
+		std::vector< std::pair< uint64_t,std::shared_ptr<_Network> > > nws;
+		{
+			RWMutex::RLock lck(_networks_l);
+			nws.assign(_networks.begin(),_networks.end());
+		}
+		for(auto nw=nws.begin();nw!=nws.end();++nw) {
+			RWMutex::RLock lck2(nw->second->lock);
 			f(nw->first,nw->second->config,0,nullJson); // first provide network with 0 for member ID
 			for(auto m=nw->second->members.begin();m!=nw->second->members.end();++m) {
-				f(nw->first,nw->second->config,m->first,m->second);
+				nlohmann::json member;
+				m->second.toJson(member);
+				f(nw->first,nw->second->config,m->first,member);
 			}
 		}
 	}
@@ -149,27 +409,62 @@ protected:
 		return false;
 	}
 
+	struct _MemberChange
+	{
+		uint64_t seq;
+		uint64_t memberId;
+		uint64_t revision;
+		int64_t ts;
+		bool erased;
+	};
+
 	struct _Network
 	{
-		_Network() : mostRecentDeauthTime(0) {}
+		// Change numbering starts from the time in seconds shifted up 20 bits,
+		// so cursors from a previous run are always before this run's log but
+		// are still exact in JavaScript and other double-only JSON readers.
+		_Network() : mostRecentDeauthTime(0),changeSeq(((uint64_t)OSUtils::now() / 1000ULL) << 20),changeLogTruncated(false),changesWatched(false) {}
 		nlohmann::json config;
-		std::unordered_map<uint64_t,nlohmann::json> members;
+		std::unordered_map<uint64_t,MemberRecord> members;
+		MemberRecord::Interner interner;
 		std::unordered_set<uint64_t> activeBridgeMembers;
 		std::unordered_set<uint64_t> authorizedMembers;
 		std::unordered_set<InetAddress,InetAddress::Hasher> allocatedIps;
 		int64_t mostRecentDeauthTime;
-		std::mutex lock;
+		std::deque<_MemberChange> changes; // most recent member changes, oldest first
+		uint64_t changeSeq; // seq of most recent change
+		bool changeLogTruncated; // true once changes have been dropped or not logged
+		std::atomic_bool changesWatched; // set by memberChanges(), changes are only logged once set
+		RWMutex lock;
 	};
 
+	void _logMemberChange(_Network &nw,const uint64_t memberId,const uint64_t revision,const bool erased);
+	void _readMemberChanges(_Network &nw,const uint64_t since,const int64_t sinceTime,std::vector<MemberChange> &changes,uint64_t &cursor,bool &full);
+
 	void _memberChanged(nlohmann::json &old,nlohmann::json &memberConfig,bool notifyListeners);
 	void _networkChanged(nlohmann::json &old,nlohmann::json &networkConfig,bool notifyListeners);
+
+	/**
+	 * Notify change listeners of a member or network change
+	 *
+	 * _memberChanged() and _networkChanged() call these when notifyListeners
+	 * is set. Subclasses that apply a change under their own lock can apply it
+	 * with notifyListeners false and call these once that lock is released.
+	 */
+	void _notifyMemberChanged(const uint64_t networkId,const uint64_t memberId,const nlohmann::json &memberConfig,const bool deauthorized);
+	void _notifyNetworkChanged(const uint64_t networkId,const nlohmann::json &networkConfig);
 	void _fillSummaryInfo(const std::shared_ptr<_Network> &nw,NetworkSummaryInfo &info);
 
 	std::vector<DB::ChangeListener *> _changeListeners;
 	std::unordered_map< uint64_t,std::shared_ptr<_Network> > _networks;
 	std::unordered_multimap< uint64_t,uint64_t > _networkByMember;
 	mutable std::mutex _changeListeners_l;
-	mutable std::mutex _networks_l;
+	mutable RWMutex _networks_l;
+
+	uint64_t _memberChangeCount; // bumped for every logged member change to wake memberChanges()
+	std::atomic<unsigned long> _memberChangeWaiters; // threads in memberChanges() that may wait
+	std::mutex _memberChanges_l;
+	std::condition_variable _memberChanges_c;
 };
 
 } // namespace ZeroTier
@@ -49,9 +49,14 @@ public:
 	bool get(const uint64_t networkId,nlohmann::json &network,const uint64_t memberId,nlohmann::json &member);
 	bool get(const uint64_t networkId,nlohmann::json &network,const uint64_t memberId,nlohmann::json &member,DB::NetworkSummaryInfo &info);
 	bool get(const uint64_t networkId,nlohmann::json &network,std::vector<nlohmann::json> &members);
+	bool get(const uint64_t networkId,nlohmann::json &network,const uint64_t memberId,MemberRecord &member,DB::NetworkSummaryInfo &info);
 
 	void networks(std::set<uint64_t> &networks);
 
+	bool memberRevisions(const uint64_t networkId,std::vector<DB::MemberChange> &members);
+	bool memberChanges(const uint64_t networkId,const uint64_t since,const int64_t sinceTime,const unsigned long maxWait,std::vector<DB::MemberChange> &changes,uint64_t &cursor,bool &full);
+	void wakeMemberChangeWaiters();
+
 	bool waitForReady();
 	bool isReady();
 	bool save(nlohmann::json &record,bool notifyListeners);
@@ -67,7 +72,7 @@ public:
 	inline void addDB(const std::shared_ptr<DB> &db)
 	{
 		db->addListener(this);
-		std::lock_guard<std::mutex> l(_dbs_l);
+		std::lock_guard<RWMutex> l(_dbs_l);
 		_dbs.push_back(db);
 	}
 
@@ -76,7 +81,7 @@ private:
 	std::atomic_bool _running;
 	std::thread _syncCheckerThread;
 	std::vector< std::shared_ptr< DB > > _dbs;
-	mutable std::mutex _dbs_l;
+	mutable RWMutex _dbs_l;
 };
 
 } // namespace ZeroTier
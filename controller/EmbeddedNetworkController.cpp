@@ -39,8 +39,11 @@
 #include <utility>
 #include <stdexcept>
 #include <map>
+#include <deque>
+#include <unordered_set>
 #include <thread>
 #include <memory>
+#include <chrono>
 
 #include "../include/ZeroTierOne.h"
 #include "../version.h"
@@ -477,14 +480,25 @@ EmbeddedNetworkController::EmbeddedNetworkController(Node *node,const char *ztPa
 	_path(dbPath),
 	_sender((NetworkController::Sender *)0),
 	_db(this),
+	_pushRunning(true),
+	_longPolls(0),
+	_longPollsStopped(false),
 	_mqc(mqc)
 {
 }
 
 EmbeddedNetworkController::~EmbeddedNetworkController()
 {
+	{
+		std::lock_guard<std::mutex> pl(_pendingPushes_l);
+		_pushRunning = false;
+		_pendingPushes_c.notify_all();
+	}
+	if (_pushThread.joinable()) // not under _threads_l since pushes call request()
+		_pushThread.join();
 	std::lock_guard<std::mutex> l(_threads_l);
-	_queue.stop();
+	for(auto q=_queues.begin();q!=_queues.end();++q)
+		(*q)->stop();
 	for(auto t=_threads.begin();t!=_threads.end();++t)
 		t->join();
 }
@@ -496,41 +510,42 @@ void EmbeddedNetworkController::init(const Identity &signingId,Sender *sender)
 	_sender = sender;
 	_signingIdAddressString = signingId.address().toString(tmp);
 
+	// local.conf may select a controller database type: "log" stores FileDB
+	// records in an append-only log, "lf" adds an LF mirror
+	std::string lfJSON;
+	nlohmann::json controllerDb;
+	OSUtils::readFile((_ztPath + ZT_PATH_SEPARATOR_S "local.conf").c_str(),lfJSON);
+	if (lfJSON.length() > 0) {
+		nlohmann::json lfConfig(OSUtils::jsonParse(lfJSON));
+		nlohmann::json &settings = lfConfig["settings"];
+		if (settings.is_object())
+			controllerDb = settings["controllerDb"];
+	}
+	const std::string dbType((controllerDb.is_object()) ? OSUtils::jsonString(controllerDb["type"],"") : std::string());
+
 #ifdef ZT_CONTROLLER_USE_LIBPQ
 	if ((_path.length() > 9)&&(_path.substr(0,9) == "postgres:")) {
 		_db.addDB(std::shared_ptr<DB>(new PostgreSQL(_signingId,_path.substr(9).c_str(), _listenPort, _mqc)));
 	} else {
 #endif
-		_db.addDB(std::shared_ptr<DB>(new FileDB(_path.c_str())));
+		_db.addDB(std::shared_ptr<DB>(new FileDB(_path.c_str(),(dbType == "log"))));
 #ifdef ZT_CONTROLLER_USE_LIBPQ
 	}
 #endif
 
-	std::string lfJSON;
-	OSUtils::readFile((_ztPath + ZT_PATH_SEPARATOR_S "local.conf").c_str(),lfJSON);
-	if (lfJSON.length() > 0) {
-		nlohmann::json lfConfig(OSUtils::jsonParse(lfJSON));
-		nlohmann::json &settings = lfConfig["settings"];
-		if (settings.is_object()) {
-			nlohmann::json &controllerDb = settings["controllerDb"];
-			if (controllerDb.is_object()) {
-				std::string type = controllerDb["type"];
-				if (type == "lf") {
-					std::string lfOwner = controllerDb["owner"];
-					std::string lfHost = controllerDb["host"];
-					int lfPort = controllerDb["port"];
-					bool storeOnlineState = controllerDb["storeOnlineState"];
-					if ((lfOwner.length())&&(lfHost.length())&&(lfPort > 0)&&(lfPort < 65536)) {
-						std::size_t pubHdrLoc = lfOwner.find("Public: ");
-						if ((pubHdrLoc > 0)&&((pubHdrLoc + 8) < lfOwner.length())) {
-							std::string lfOwnerPublic = lfOwner.substr(pubHdrLoc + 8);
-							std::size_t pubHdrEnd = lfOwnerPublic.find_first_of("\n\r\t ");
-							if (pubHdrEnd != std::string::npos) {
-								lfOwnerPublic = lfOwnerPublic.substr(0,pubHdrEnd);
-								_db.addDB(std::shared_ptr<DB>(new LFDB(_signingId,_path.c_str(),lfOwner.c_str(),lfOwnerPublic.c_str(),lfHost.c_str(),lfPort,storeOnlineState)));
-							}
-						}
-					}
+	if (dbType == "lf") {
+		std::string lfOwner = controllerDb["owner"];
+		std::string lfHost = controllerDb["host"];
+		int lfPort = controllerDb["port"];
+		bool storeOnlineState = controllerDb["storeOnlineState"];
+		if ((lfOwner.length())&&(lfHost.length())&&(lfPort > 0)&&(lfPort < 65536)) {
+			std::size_t pubHdrLoc = lfOwner.find("Public: ");
+			if ((pubHdrLoc > 0)&&((pubHdrLoc + 8) < lfOwner.length())) {
+				std::string lfOwnerPublic = lfOwner.substr(pubHdrLoc + 8);
+				std::size_t pubHdrEnd = lfOwnerPublic.find_first_of("\n\r\t ");
+				if (pubHdrEnd != std::string::npos) {
+					lfOwnerPublic = lfOwnerPublic.substr(0,pubHdrEnd);
+					_db.addDB(std::shared_ptr<DB>(new LFDB(_signingId,_path.c_str(),lfOwner.c_str(),lfOwnerPublic.c_str(),lfHost.c_str(),lfPort,storeOnlineState)));
 				}
 			}
 		}
@@ -556,7 +571,7 @@ void EmbeddedNetworkController::request(
 	qe->identity = identity;
 	qe->metaData = metaData;
 	qe->type = _RQEntry::RQENTRY_TYPE_REQUEST;
-	_queue.post(qe);
+	_queues[_shardHash(nwid,identity.address().toInt()) % _queues.size()]->post(qe);
 }
 
 unsigned int EmbeddedNetworkController::handleControlPlaneHttpGET(
@@ -592,15 +607,13 @@ unsigned int EmbeddedNetworkController::handleControlPlaneHttpGET(
 					} else {
 						// List members and their revisions
 
+						std::vector<DB::MemberChange> members;
 						responseBody = "{";
-						std::vector<json> members;
-						if (_db.get(nwid,network,members)) {
+						if (_db.memberRevisions(nwid,members)) {
 							responseBody.reserve((members.size() + 2) * 32);
-							std::string mid;
-							for(auto member=members.begin();member!=members.end();++member) {
-								mid = (*member)["id"];
-								char tmp[128];
-								OSUtils::ztsnprintf(tmp,sizeof(tmp),"%s\"%s\":%llu",(responseBody.length() > 1) ? "," : "",mid.c_str(),(unsigned long long)OSUtils::jsonInt((*member)["revision"],0));
+							char tmp[128];
+							for(auto m=members.begin();m!=members.end();++m) {
+								OSUtils::ztsnprintf(tmp,sizeof(tmp),"%s\"%.10llx\":%llu",(responseBody.length() > 1) ? "," : "",(unsigned long long)m->memberId,(unsigned long long)m->revision);
 								responseBody.append(tmp);
 							}
 						}
@@ -610,6 +623,65 @@ unsigned int EmbeddedNetworkController::handleControlPlaneHttpGET(
 					}
 					return 200;
 
+				} else if (path[2] == "memberChanges") {
+					// Members changed since a cursor from a previous call, waiting for a change if asked to
+
+					uint64_t since = 0;
+					int64_t sinceTime = 0;
+					unsigned long wait = 0;
+					std::map<std::string,std::string>::const_iterator a(urlArgs.find("since"));
+					if (a != urlArgs.end())
+						since = Utils::strToU64(a->second.c_str());
+					a = urlArgs.find("sinceTime");
+					if (a != urlArgs.end())
+						sinceTime = (int64_t)Utils::strToU64(a->second.c_str());
+					a = urlArgs.find("wait");
+					if (a != urlArgs.end())
+						wait = (unsigned long)std::min(Utils::strToU64(a->second.c_str()),(unsigned long long)ZT_CONTROLLER_MAX_LONG_POLL_WAIT);
+
+					bool waiting = false;
+					if ((wait)&&(!_longPollsStopped)) {
+						if (++_longPolls <= ZT_CONTROLLER_MAX_LONG_POLLS) {
+							waiting = true;
+						} else {
+							--_longPolls;
+							wait = 0;
+						}
+					} else wait = 0;
+
+					// Wait in slices so stopLongPolls() is noticed promptly
+					std::vector<DB::MemberChange> changes;
+					uint64_t cursor = 0;
+					bool full = false,found;
+					const int64_t deadline = OSUtils::now() + (int64_t)wait;
+					for(;;) {
+						found = _db.memberChanges(nwid,since,sinceTime,std::min(wait,1000UL),changes,cursor,full);
+						if ((!found)||(!changes.empty())||(full)||(_longPollsStopped))
+							break;
+						const int64_t left = deadline - OSUtils::now();
+						if (left <= 0)
+							break;
+						wait = (unsigned long)left;
+					}
+					if (waiting)
+						--_longPolls;
+					if (!found)
+						return 404;
+
+					char tmp[128];
+					OSUtils::ztsnprintf(tmp,sizeof(tmp),"{\"cursor\":%llu,\"full\":%s,\"members\":{",(unsigned long long)cursor,(full) ? "true" : "false");
+					responseBody = tmp;
+					responseBody.reserve((changes.size() + 2) * 32);
+					for(auto c=changes.begin();c!=changes.end();++c) {
+						if (c->erased)
+							OSUtils::ztsnprintf(tmp,sizeof(tmp),"%s\"%.10llx\":null",(c == changes.begin()) ? "" : ",",(unsigned long long)c->memberId);
+						else OSUtils::ztsnprintf(tmp,sizeof(tmp),"%s\"%.10llx\":%llu",(c == changes.begin()) ? "" : ",",(unsigned long long)c->memberId,(unsigned long long)c->revision);
+						responseBody.append(tmp);
+					}
+					responseBody.append("}}");
+					responseContentType = "application/json";
+					return 200;
+
 				} // else 404
 
 			} else {
@@ -1089,8 +1161,9 @@ unsigned int EmbeddedNetworkController::handleControlPlaneHttpDELETE(
 					_db.eraseMember(nwid, address);
 
 					{
-						std::lock_guard<std::mutex> l(_memberStatus_l);
-						_memberStatus.erase(_MemberStatusKey(nwid,address));
+						_MemberStatusShard &mss = _memberStatusShard(nwid,address);
+						std::lock_guard<std::mutex> l(mss.lock);
+						mss.statuses.erase(_MemberStatusKey(nwid,address));
 					}
 
 					if (!member.size())
@@ -1104,11 +1177,11 @@ unsigned int EmbeddedNetworkController::handleControlPlaneHttpDELETE(
 				_db.get(nwid,network);
 				_db.eraseNetwork(nwid);
 
-				{
-					std::lock_guard<std::mutex> l(_memberStatus_l);
-					for(auto i=_memberStatus.begin();i!=_memberStatus.end();) {
+				for(unsigned int s=0;s<ZT_CONTROLLER_MEMBER_STATUS_SHARDS;++s) {
+					std::lock_guard<std::mutex> l(_memberStatus[s].lock);
+					for(auto i=_memberStatus[s].statuses.begin();i!=_memberStatus[s].statuses.end();) {
 						if (i->first.networkId == nwid)
-							_memberStatus.erase(i++);
+							_memberStatus[s].statuses.erase(i++);
 						else ++i;
 					}
 				}
@@ -1126,6 +1199,12 @@ unsigned int EmbeddedNetworkController::handleControlPlaneHttpDELETE(
 	return 404;
 }
 
+void EmbeddedNetworkController::stopLongPolls()
+{
+	_longPollsStopped = true;
+	_db.wakeMemberChangeWaiters();
+}
+
 void EmbeddedNetworkController::handleRemoteTrace(const ZT_RemoteTrace &rt)
 {
 	static volatile unsigned long idCounter = 0;
@@ -1179,23 +1258,13 @@ void EmbeddedNetworkController::handleRemoteTrace(const ZT_RemoteTrace &rt)
 void EmbeddedNetworkController::onNetworkUpdate(const void *db,uint64_t networkId,const nlohmann::json &network)
 {
 	// Send an update to all members of the network that are online
-	const int64_t now = OSUtils::now();
-	std::lock_guard<std::mutex> l(_memberStatus_l);
-	for(auto i=_memberStatus.begin();i!=_memberStatus.end();++i) {
-		if ((i->first.networkId == networkId)&&(i->second.online(now))&&(i->second.lastRequestMetaData))
-			request(networkId,InetAddress(),0,i->second.identity,i->second.lastRequestMetaData);
-	}
+	_schedulePush(networkId,0);
 }
 
 void EmbeddedNetworkController::onNetworkMemberUpdate(const void *db,uint64_t networkId,uint64_t memberId,const nlohmann::json &member)
 {
 	// Push update to member if online
-	try {
-		std::lock_guard<std::mutex> l(_memberStatus_l);
-		_MemberStatus &ms = _memberStatus[_MemberStatusKey(networkId,memberId)];
-		if ((ms.online(OSUtils::now()))&&(ms.lastRequestMetaData))
-			request(networkId,InetAddress(),0,ms.identity,ms.lastRequestMetaData);
-	} catch ( ... ) {}
+	_schedulePush(networkId,memberId);
 }
 
 void EmbeddedNetworkController::onNetworkMemberDeauthorize(const void *db,uint64_t networkId,uint64_t memberId)
@@ -1203,9 +1272,9 @@ void EmbeddedNetworkController::onNetworkMemberDeauthorize(const void *db,uint64
 	const int64_t now = OSUtils::now();
 	Revocation rev((uint32_t)_node->prng(),networkId,0,now,ZT_REVOCATION_FLAG_FAST_PROPAGATE,Address(memberId),Revocation::CREDENTIAL_TYPE_COM);
 	rev.sign(_signingId);
-	{
-		std::lock_guard<std::mutex> l(_memberStatus_l);
-		for(auto i=_memberStatus.begin();i!=_memberStatus.end();++i) {
+	for(unsigned int s=0;s<ZT_CONTROLLER_MEMBER_STATUS_SHARDS;++s) {
+		std::lock_guard<std::mutex> l(_memberStatus[s].lock);
+		for(auto i=_memberStatus[s].statuses.begin();i!=_memberStatus[s].statuses.end();++i) {
 			if ((i->first.networkId == networkId)&&(i->second.online(now)))
 				_node->ncSendRevocation(Address(i->first.nodeId),rev);
 		}
@@ -1219,18 +1288,19 @@ void EmbeddedNetworkController::_request(
 	const Identity &identity,
 	const Dictionary<ZT_NETWORKCONFIG_METADATA_DICT_CAPACITY> &metaData)
 {
-	char nwids[24];
 	DB::NetworkSummaryInfo ns;
-	json network,member;
+	json network;
+	MemberRecord member;
 
 	if (((!_signingId)||(!_signingId.hasPrivate()))||(_signingId.address().toInt() != (nwid >> 24))||(!_sender))
 		return;
 
 	const int64_t now = OSUtils::now();
 
+	_MemberStatusShard &mss = _memberStatusShard(nwid,identity.address().toInt());
 	if (requestPacketId) {
-		std::lock_guard<std::mutex> l(_memberStatus_l);
-		_MemberStatus &ms = _memberStatus[_MemberStatusKey(nwid,identity.address().toInt())];
+		std::lock_guard<std::mutex> l(mss.lock);
+		_MemberStatus &ms = mss.statuses[_MemberStatusKey(nwid,identity.address().toInt())];
 		if ((now - ms.lastRequestTime) <= ZT_NETCONF_MIN_REQUEST_PERIOD)
 			return;
 		ms.lastRequestTime = now;
@@ -1238,56 +1308,41 @@ void EmbeddedNetworkController::_request(
 
 	_db.nodeIsOnline(nwid,identity.address().toInt(),fromAddr);
 
-	Utils::hex(nwid,nwids);
-	_db.get(nwid,network,identity.address().toInt(),member,ns);
+	const bool newMember = !_db.get(nwid,network,identity.address().toInt(),member,ns);
 	if ((!network.is_object())||(network.size() == 0)) {
 		_sender->ncSendError(nwid,requestPacketId,identity.address(),NetworkController::NC_ERROR_OBJECT_NOT_FOUND);
 		return;
 	}
-	const bool newMember = ((!member.is_object())||(member.size() == 0));
-	DB::initMember(member);
+	const MemberRecord original(member);
+	member.init();
 
-	{
-		const std::string haveIdStr(OSUtils::jsonString(member["identity"],""));
-		if (haveIdStr.length() > 0) {
-			// If we already know this member's identity perform a full compare. This prevents
-			// a "collision" from being able to auth onto our network in place of an already
-			// known member.
-			try {
-				if (Identity(haveIdStr.c_str()) != identity) {
-					_sender->ncSendError(nwid,requestPacketId,identity.address(),NetworkController::NC_ERROR_ACCESS_DENIED);
-					return;
-				}
-			} catch ( ... ) {
-				_sender->ncSendError(nwid,requestPacketId,identity.address(),NetworkController::NC_ERROR_ACCESS_DENIED);
-				return;
-			}
-		} else {
-			// If we do not yet know this member's identity, learn it.
-			char idtmp[1024];
-			member["identity"] = identity.toString(false,idtmp);
-		}
+	// If we already know this member's identity perform a full compare. This prevents
+	// a "collision" from being able to auth onto our network in place of an already
+	// known member. If we do not yet know this member's identity, learn it.
+	if ((member.identityInvalid)||((member.identity)&&(member.identity != identity))) {
+		_sender->ncSendError(nwid,requestPacketId,identity.address(),NetworkController::NC_ERROR_ACCESS_DENIED);
+		return;
+	} else if (!member.identity) {
+		member.identity = identity;
+		member.fields |= MemberRecord::F_IDENTITY;
 	}
 
 	// These are always the same, but make sure they are set
-	{
-		char tmpid[128];
-		const std::string addrs(identity.address().toString(tmpid));
-		member["id"] = addrs;
-		member["address"] = addrs;
-		member["nwid"] = nwids;
-	}
+	member.networkId = nwid;
+	member.id = identity.address().toInt();
+	member.fields |= MemberRecord::F_ID|MemberRecord::F_ADDRESS|MemberRecord::F_NWID;
 
 	// Determine whether and how member is authorized
 	bool authorized = false;
 	bool autoAuthorized = false;
-	json autoAuthCredentialType,autoAuthCredential;
-	if (OSUtils::jsonBool(member["authorized"],false)) {
+	uint8_t autoAuthCredentialType = MemberRecord::CREDENTIAL_NULL;
+	const char *autoAuthCredential = (const char *)0;
+	if (member.authorized) {
 		authorized = true;
 	} else if (!OSUtils::jsonBool(network["private"],true)) {
 		authorized = true;
 		autoAuthorized = true;
-		autoAuthCredentialType = "public";
+		autoAuthCredentialType = MemberRecord::CREDENTIAL_PUBLIC;
 	} else {
 		char presentedAuth[512];
 		if (metaData.get(ZT_NETWORKCONFIG_REQUEST_METADATA_KEY_AUTH,presentedAuth,sizeof(presentedAuth)) > 0) {
@@ -1300,7 +1355,7 @@ void EmbeddedNetworkController::_request(
 					if ((tokenExpires == 0)||(tokenExpires > now)) {
 						authorized = true;
 						autoAuthorized = true;
-						autoAuthCredentialType = "token";
+						autoAuthCredentialType = MemberRecord::CREDENTIAL_TOKEN;
 						autoAuthCredential = presentedToken;
 					}
 				}
@@ -1310,10 +1365,14 @@ void EmbeddedNetworkController::_request(
 
 	// If we auto-authorized, update member record
 	if ((autoAuthorized)&&(authorized)) {
-		member["authorized"] = true;
-		member["lastAuthorizedTime"] = now;
-		member["lastAuthorizedCredentialType"] = autoAuthCredentialType;
-		member["lastAuthorizedCredential"] = autoAuthCredential;
+		member.authorized = true;
+		member.lastAuthorizedTime = now;
+		member.credentialType = autoAuthCredentialType;
+		member.credentialNull = (autoAuthCredential == (const char *)0);
+		if (autoAuthCredential)
+			member.credential = autoAuthCredential;
+		else member.credential.clear();
+		member.fields |= MemberRecord::F_AUTHORIZED|MemberRecord::F_LAST_AUTHORIZED_TIME|MemberRecord::F_CREDENTIAL_TYPE|MemberRecord::F_CREDENTIAL;
 	}
 
 	if (authorized) {
@@ -1324,14 +1383,15 @@ void EmbeddedNetworkController::_request(
 			const uint64_t vRev = metaData.getUI(ZT_NETWORKCONFIG_REQUEST_METADATA_KEY_NODE_REVISION,0);
 			const uint64_t vProto = metaData.getUI(ZT_NETWORKCONFIG_REQUEST_METADATA_KEY_PROTOCOL_VERSION,0);
 
-			member["vMajor"] = vMajor;
-			member["vMinor"] = vMinor;
-			member["vRev"] = vRev;
-			member["vProto"] = vProto;
+			member.vMajor = (int32_t)vMajor;
+			member.vMinor = (int32_t)vMinor;
+			member.vRev = (int32_t)vRev;
+			member.vProto = (int32_t)vProto;
+			member.fields |= MemberRecord::F_V_MAJOR|MemberRecord::F_V_MINOR|MemberRecord::F_V_REV|MemberRecord::F_V_PROTO;
 
 			{
-				std::lock_guard<std::mutex> l(_memberStatus_l);
-				_MemberStatus &ms = _memberStatus[_MemberStatusKey(nwid,identity.address().toInt())];
+				std::lock_guard<std::mutex> l(mss.lock);
+				_MemberStatus &ms = mss.statuses[_MemberStatusKey(nwid,identity.address().toInt())];
 
 				ms.vMajor = (int)vMajor;
 				ms.vMinor = (int)vMinor;
@@ -1343,8 +1403,7 @@ void EmbeddedNetworkController::_request(
 		}
 	} else {
 		// If they are not authorized, STOP!
-		DB::cleanMember(member);
-		_db.save(member,true);
+		_saveMember(member,original,newMember);
 		_sender->ncSendError(nwid,requestPacketId,identity.address(),NetworkController::NC_ERROR_ACCESS_DENIED);
 		return;
 	}
@@ -1379,12 +1438,11 @@ void EmbeddedNetworkController::_request(
 	nc->mtu = std::max(std::min((unsigned int)OSUtils::jsonInt(network["mtu"],ZT_DEFAULT_MTU),(unsigned int)ZT_MAX_MTU),(unsigned int)ZT_MIN_MTU);
 	nc->multicastLimit = (unsigned int)OSUtils::jsonInt(network["multicastLimit"],32ULL);
 
-	std::string rtt(OSUtils::jsonString(member["remoteTraceTarget"],""));
-	if (rtt.length() == 10) {
-		nc->remoteTraceTarget = Address(Utils::hexStrToU64(rtt.c_str()));
-		nc->remoteTraceLevel = (Trace::Level)OSUtils::jsonInt(member["remoteTraceLevel"],0ULL);
+	if (member.remoteTraceTarget) {
+		nc->remoteTraceTarget = Address(member.remoteTraceTarget);
+		nc->remoteTraceLevel = (Trace::Level)member.remoteTraceLevel;
 	} else {
-		rtt = OSUtils::jsonString(network["remoteTraceTarget"],"");
+		const std::string rtt(OSUtils::jsonString(network["remoteTraceTarget"],""));
 		if (rtt.length() == 10) {
 			nc->remoteTraceTarget = Address(Utils::hexStrToU64(rtt.c_str()));
 		} else {
@@ -1403,8 +1461,6 @@ void EmbeddedNetworkController::_request(
 	json &rules = network["rules"];
 	json &capabilities = network["capabilities"];
 	json &tags = network["tags"];
-	json &memberCapabilities = member["capabilities"];
-	json &memberTags = member["tags"];
 
 	if (metaData.getUI(ZT_NETWORKCONFIG_REQUEST_METADATA_KEY_RULES_ENGINE_REV,0) <= 0) {
 		// Old versions with no rules engine support get an allow everything rule.
@@ -1423,8 +1479,7 @@ void EmbeddedNetworkController::_request(
 		}
 
 		std::map< uint64_t,json * > capsById;
-		if (!memberCapabilities.is_array())
-			memberCapabilities = json::array();
+		MemberRecord::CapabilityList memberCapabilities(member.capabilities());
 		if (capabilities.is_array()) {
 			for(unsigned long i=0;i<capabilities.size();++i) {
 				json &cap = capabilities[i];
@@ -1432,21 +1487,16 @@ void EmbeddedNetworkController::_request(
 					const uint64_t id = OSUtils::jsonInt(cap["id"],0ULL) & 0xffffffffULL;
 					capsById[id] = &cap;
 					if ((newMember)&&(OSUtils::jsonBool(cap["default"],false))) {
-						bool have = false;
-						for(unsigned long i=0;i<memberCapabilities.size();++i) {
-							if (id == (OSUtils::jsonInt(memberCapabilities[i],0ULL) & 0xffffffffULL)) {
-								have = true;
-								break;
-							}
-						}
-						if (!have)
-							memberCapabilities.push_back(id);
+						if (std::find(memberCapabilities.begin(),memberCapabilities.end(),(uint32_t)id) == memberCapabilities.end())
+							memberCapabilities.push_back((uint32_t)id);
 					}
 				}
 			}
 		}
+		if (memberCapabilities.size() != member.capabilities().size())
+			member.setCapabilities(memberCapabilities);
 		for(unsigned long i=0;i<memberCapabilities.size();++i) {
-			const uint64_t capId = OSUtils::jsonInt(memberCapabilities[i],0ULL) & 0xffffffffULL;
+			const uint64_t capId = memberCapabilities[i];
 			std::map< uint64_t,json * >::const_iterator ctmp = capsById.find(capId);
 			if (ctmp != capsById.end()) {
 				json *cap = ctmp->second;
@@ -1472,13 +1522,9 @@ void EmbeddedNetworkController::_request(
 		}
 
 		std::map< uint32_t,uint32_t > memberTagsById;
-		if (memberTags.is_array()) {
-			for(unsigned long i=0;i<memberTags.size();++i) {
-				json &t = memberTags[i];
-				if ((t.is_array())&&(t.size() == 2))
-					memberTagsById[(uint32_t)(OSUtils::jsonInt(t[0],0ULL) & 0xffffffffULL)] = (uint32_t)(OSUtils::jsonInt(t[1],0ULL) & 0xffffffffULL);
-			}
-		}
+		MemberRecord::TagList memberTags(member.tags());
+		for(auto t=memberTags.begin();t!=memberTags.end();++t)
+			memberTagsById[t->first] = t->second;
 		if (tags.is_array()) { // check network tags array for defaults that are not present in member tags
 			for(unsigned long i=0;i<tags.size();++i) {
 				json &t = tags[i];
@@ -1487,13 +1533,12 @@ void EmbeddedNetworkController::_request(
 					json &dfl = t["default"];
 					if ((dfl.is_number())&&(memberTagsById.find(id) == memberTagsById.end())) {
 						memberTagsById[id] = (uint32_t)(OSUtils::jsonInt(dfl,0) & 0xffffffffULL);
-						json mt = json::array();
-						mt.push_back(id);
-						mt.push_back(dfl);
-						memberTags.push_back(mt); // add default to member tags if not present
+						memberTags.push_back(std::pair<uint32_t,uint32_t>(id,memberTagsById[id])); // add default to member tags if not present
 					}
 				}
 			}
+			if (memberTags.size() != member.tags().size())
+				member.setTags(memberTags);
 		}
 		for(std::map< uint32_t,uint32_t >::const_iterator t(memberTagsById.begin());t!=memberTagsById.end();++t) {
 			if (nc->tagCount >= ZT_MAX_NETWORK_TAGS)
@@ -1526,7 +1571,7 @@ void EmbeddedNetworkController::_request(
 		}
 	}
 
-	const bool noAutoAssignIps = OSUtils::jsonBool(member["noAutoAssignIps"],false);
+	const bool noAutoAssignIps = member.noAutoAssignIps;
 
 	if ((v6AssignMode.is_object())&&(!noAutoAssignIps)) {
 		if ((OSUtils::jsonBool(v6AssignMode["rfc4193"],false))&&(nc->staticIpCount < ZT_MAX_ZT_ASSIGNED_ADDRESSES)) {
@@ -1541,36 +1586,30 @@ void EmbeddedNetworkController::_request(
 
 	bool haveManagedIpv4AutoAssignment = false;
 	bool haveManagedIpv6AutoAssignment = false; // "special" NDP-emulated address types do not count
-	json ipAssignments = member["ipAssignments"]; // we want to make a copy
-	if (ipAssignments.is_array()) {
-		for(unsigned long i=0;i<ipAssignments.size();++i) {
-			if (ipAssignments[i].is_string()) {
-				const std::string ips = ipAssignments[i];
-				InetAddress ip(ips.c_str());
-
-				int routedNetmaskBits = -1;
-				for(unsigned int rk=0;rk<nc->routeCount;++rk) {
-					if (reinterpret_cast<const InetAddress *>(&(nc->routes[rk].target))->containsAddress(ip)) {
-						const int nb = (int)(reinterpret_cast<const InetAddress *>(&(nc->routes[rk].target))->netmaskBits());
-						if (nb > routedNetmaskBits)
-							routedNetmaskBits = nb;
-					}
-				}
+	std::vector<InetAddress> ipAssignments;
+	member.ipAssignments(ipAssignments);
+	for(unsigned long i=0;i<ipAssignments.size();++i) {
+		InetAddress ip(ipAssignments[i]);
+
+		int routedNetmaskBits = -1;
+		for(unsigned int rk=0;rk<nc->routeCount;++rk) {
+			if (reinterpret_cast<const InetAddress *>(&(nc->routes[rk].target))->containsAddress(ip)) {
+				const int nb = (int)(reinterpret_cast<const InetAddress *>(&(nc->routes[rk].target))->netmaskBits());
+				if (nb > routedNetmaskBits)
+					routedNetmaskBits = nb;
+			}
+		}
 
-				if (routedNetmaskBits >= 0) {
-					if (nc->staticIpCount < ZT_MAX_ZT_ASSIGNED_ADDRESSES) {
-						ip.setPort(routedNetmaskBits);
-						nc->staticIps[nc->staticIpCount++] = ip;
-					}
-					if (ip.ss_family == AF_INET)
-						haveManagedIpv4AutoAssignment = true;
-					else if (ip.ss_family == AF_INET6)
-						haveManagedIpv6AutoAssignment = true;
-				}
+		if (routedNetmaskBits >= 0) {
+			if (nc->staticIpCount < ZT_MAX_ZT_ASSIGNED_ADDRESSES) {
+				ip.setPort(routedNetmaskBits);
+				nc->staticIps[nc->staticIpCount++] = ip;
 			}
+			if (ip.ss_family == AF_INET)
+				haveManagedIpv4AutoAssignment = true;
+			else if (ip.ss_family == AF_INET6)
+				haveManagedIpv6AutoAssignment = true;
 		}
-	} else {
-		ipAssignments = json::array();
 	}
 
 	if ( (ipAssignmentPools.is_array()) && ((v6AssignMode.is_object())&&(OSUtils::jsonBool(v6AssignMode["zt"],false))) && (!haveManagedIpv6AutoAssignment) && (!noAutoAssignIps) ) {
@@ -1619,11 +1658,12 @@ void EmbeddedNetworkController::_request(
 
 						// If it's routed, then try to claim and assign it and if successful end loop
 						if ( (routedNetmaskBits > 0) && (!std::binary_search(ns.allocatedIps.begin(),ns.allocatedIps.end(),ip6)) ) {
-							char tmpip[64];
-							const std::string ipStr(ip6.toIpString(tmpip));
-							if (std::find(ipAssignments.begin(),ipAssignments.end(),ipStr) == ipAssignments.end()) {
-								ipAssignments.push_back(ipStr);
-								member["ipAssignments"] = ipAssignments;
+							bool have = false;
+							for(auto a=ipAssignments.begin();((!have)&&(a!=ipAssignments.end()));++a)
+								have = a->ipsEqual(ip6);
+							if (!have) {
+								ipAssignments.push_back(ip6);
+								member.addIpAssignment(ip6);
 								ip6.setPort((unsigned int)routedNetmaskBits);
 								if (nc->staticIpCount < ZT_MAX_ZT_ASSIGNED_ADDRESSES)
 									nc->staticIps[nc->staticIpCount++] = ip6;
@@ -1677,11 +1717,12 @@ void EmbeddedNetworkController::_request(
 						// If it's routed, then try to claim and assign it and if successful end loop
 						const InetAddress ip4(Utils::hton(ip),0);
 						if ( (routedNetmaskBits > 0) && (!std::binary_search(ns.allocatedIps.begin(),ns.allocatedIps.end(),ip4)) ) {
-							char tmpip[64];
-							const std::string ipStr(ip4.toIpString(tmpip));
-							if (std::find(ipAssignments.begin(),ipAssignments.end(),ipStr) == ipAssignments.end()) {
-								ipAssignments.push_back(ipStr);
-								member["ipAssignments"] = ipAssignments;
+							bool have = false;
+							for(auto a=ipAssignments.begin();((!have)&&(a!=ipAssignments.end()));++a)
+								have = a->ipsEqual(ip4);
+							if (!have) {
+								ipAssignments.push_back(ip4);
+								member.addIpAssignment(ip4);
 								if (nc->staticIpCount < ZT_MAX_ZT_ASSIGNED_ADDRESSES) {
 									struct sockaddr_in *const v4ip = reinterpret_cast<struct sockaddr_in *>(&(nc->staticIps[nc->staticIpCount++]));
 									v4ip->sin_family = AF_INET;
@@ -1715,22 +1756,117 @@ void EmbeddedNetworkController::_request(
 		return;
 	}
 
-	DB::cleanMember(member);
-	_db.save(member,true);
+	_saveMember(member,original,newMember);
 	_sender->ncSendConfig(nwid,requestPacketId,identity.address(),*(nc.get()),metaData.getUI(ZT_NETWORKCONFIG_REQUEST_METADATA_KEY_VERSION,0) < 6);
 }
 
+void EmbeddedNetworkController::_saveMember(const MemberRecord &member,const MemberRecord &original,const bool newMember)
+{
+	if ((newMember)||(member != original)) {
+		json mj;
+		member.toJson(mj);
+		DB::cleanMember(mj);
+		_db.save(mj,true);
+	}
+}
+
+void EmbeddedNetworkController::_schedulePush(const uint64_t nwid,const uint64_t nodeId)
+{
+	std::lock_guard<std::mutex> l(_pendingPushes_l);
+	// emplace() keeps the original due time so a steady stream of edits can't postpone a push forever
+	if (_pendingPushes.emplace(_MemberStatusKey(nwid,nodeId),OSUtils::now() + ZT_CONTROLLER_PUSH_DEBOUNCE).second)
+		_pendingPushes_c.notify_one();
+}
+
+void EmbeddedNetworkController::_pushThreadMain()
+{
+	std::vector<_MemberStatusKey> due;
+	std::deque<_MemberStatusKey> ready; // members to push, each at most once
+	std::unordered_set< _MemberStatusKey,_MemberStatusHash > readySet;
+	double tokens = ZT_CONTROLLER_MAX_PUSHES_PER_SECOND;
+	int64_t lastRefill = OSUtils::now();
+
+	for(;;) {
+		due.clear();
+		{
+			std::unique_lock<std::mutex> l(_pendingPushes_l);
+			bool waited = false;
+			for(;;) {
+				if (!_pushRunning)
+					return;
+				const int64_t now = OSUtils::now();
+				int64_t wait = (ready.empty()) ? ZT_CONTROLLER_PUSH_DEBOUNCE : 10; // if rate limited, come back for more tokens soon
+				for(auto p=_pendingPushes.begin();p!=_pendingPushes.end();) {
+					if (p->second <= now) {
+						due.push_back(p->first);
+						_pendingPushes.erase(p++);
+					} else {
+						wait = std::min(wait,p->second - now);
+						++p;
+					}
+				}
+				if ((!due.empty())||((waited)&&(!ready.empty())))
+					break;
+				_pendingPushes_c.wait_for(l,std::chrono::milliseconds(wait));
+				waited = true;
+			}
+		}
+
+		const int64_t now = OSUtils::now();
+		for(auto k=due.begin();k!=due.end();++k) {
+			if (k->nodeId) {
+				if (readySet.insert(*k).second)
+					ready.push_back(*k);
+			} else {
+				for(unsigned int s=0;s<ZT_CONTROLLER_MEMBER_STATUS_SHARDS;++s) {
+					std::lock_guard<std::mutex> l(_memberStatus[s].lock);
+					for(auto i=_memberStatus[s].statuses.begin();i!=_memberStatus[s].statuses.end();++i) {
+						if ((i->first.networkId == k->networkId)&&(i->second.online(now))&&(readySet.insert(i->first).second))
+							ready.push_back(i->first);
+					}
+				}
+			}
+		}
+
+		tokens = std::min(tokens + ((double)(now - lastRefill) * (double)ZT_CONTROLLER_MAX_PUSHES_PER_SECOND) / 1000.0,(double)ZT_CONTROLLER_MAX_PUSHES_PER_SECOND);
+		lastRefill = now;
+		while ((!ready.empty())&&(tokens >= 1.0)) {
+			const _MemberStatusKey k(ready.front());
+			ready.pop_front();
+			readySet.erase(k);
+
+			Identity identity;
+			Dictionary<ZT_NETWORKCONFIG_METADATA_DICT_CAPACITY> metaData;
+			{
+				_MemberStatusShard &mss = _memberStatusShard(k.networkId,k.nodeId);
+				std::lock_guard<std::mutex> l(mss.lock);
+				auto ms = mss.statuses.find(k);
+				if ((ms == mss.statuses.end())||(!ms->second.online(now))||(!ms->second.lastRequestMetaData))
+					continue;
+				identity = ms->second.identity;
+				metaData = ms->second.lastRequestMetaData;
+			}
+			request(k.networkId,InetAddress(),0,identity,metaData);
+			tokens -= 1.0;
+		}
+	}
+}
+
 void EmbeddedNetworkController::_startThreads()
 {
 	std::lock_guard<std::mutex> l(_threads_l);
 	if (!_threads.empty())
 		return;
+	_pushThread = std::thread([this]() { _pushThreadMain(); });
 	const long hwc = std::max((long)std::thread::hardware_concurrency(),(long)1);
+	for(long t=0;t<hwc;++t)
+		_queues.emplace_back(new BlockingQueue< _RQEntry * >());
 	for(long t=0;t<hwc;++t) {
-		_threads.emplace_back([this]() {
+		BlockingQueue< _RQEntry * > *const q = _queues[t].get();
+		_threads.emplace_back([q,this]() {
 			for(;;) {
 				_RQEntry *qe = (_RQEntry *)0;
-				if (!_queue.get(qe))
+				if (!q->get(qe))
 					break;
 				try {
 					if (qe) {
@@ -37,6 +37,9 @@
 #include <thread>
 #include <unordered_map>
 #include <atomic>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
 
 #include "../node/Constants.hpp"
 #include "../node/NetworkController.hpp"
@@ -53,6 +56,21 @@
 #include "DB.hpp"
 #include "DBMirrorSet.hpp"
 
+// Number of independently locked shards of the member status table
+#define ZT_CONTROLLER_MEMBER_STATUS_SHARDS 64
+
+// Changes to a member or network are collected for this long (ms) before online members are pushed new configs
+#define ZT_CONTROLLER_PUSH_DEBOUNCE 250
+
+// Maximum rate of pushed config updates per second across all networks (bursts of up to one second's worth)
+#define ZT_CONTROLLER_MAX_PUSHES_PER_SECOND 2000
+
+// Longest a GET of member changes may wait for one (ms)
+#define ZT_CONTROLLER_MAX_LONG_POLL_WAIT 60000
+
+// GETs of member changes that may wait at once, so they can't tie up every API thread (others return at once)
+#define ZT_CONTROLLER_MAX_LONG_POLLS 2
+
 namespace ZeroTier {
 
 class Node;
@@ -102,13 +120,23 @@ public:
 
 	void handleRemoteTrace(const ZT_RemoteTrace &rt);
 
+	/**
+	 * Make any waiting GETs of member changes return and stop new ones from waiting
+	 *
+	 * Called on shutdown before API threads are joined.
+	 */
+	void stopLongPolls();
+
 	virtual void onNetworkUpdate(const void *db,uint64_t networkId,const nlohmann::json &network);
 	virtual void onNetworkMemberUpdate(const void *db,uint64_t networkId,uint64_t memberId,const nlohmann::json &member);
 	virtual void onNetworkMemberDeauthorize(const void *db,uint64_t networkId,uint64_t memberId);
 
 private:
 	void _request(uint64_t nwid,const InetAddress &fromAddr,uint64_t requestPacketId,const Identity &identity,const Dictionary<ZT_NETWORKCONFIG_METADATA_DICT_CAPACITY> &metaData);
+	void _saveMember(const MemberRecord &member,const MemberRecord &original,const bool newMember);
 	void _startThreads();
+	void _schedulePush(const uint64_t nwid,const uint64_t nodeId);
+	void _pushThreadMain();
 
 	struct _RQEntry
 	{
@@ -145,6 +173,19 @@ private:
 			return (std::size_t)(networkIdNodeId.networkId + networkIdNodeId.nodeId);
 		}
 	};
+	struct _MemberStatusShard
+	{
+		std::unordered_map< _MemberStatusKey,_MemberStatus,_MemberStatusHash > statuses;
+		std::mutex lock;
+	};
+
+	// Spreads (network,member) pairs evenly; a given member always maps to the same request thread and status shard
+	static inline uint64_t _shardHash(const uint64_t nwid,const uint64_t nodeId)
+	{
+		uint64_t h = (nwid ^ (nodeId * 0x9e3779b97f4a7c15ULL)) * 0xff51afd7ed558ccdULL;
+		return (h ^ (h >> 32));
+	}
+	inline _MemberStatusShard &_memberStatusShard(const uint64_t nwid,const uint64_t nodeId) { return _memberStatus[_shardHash(nwid,nodeId) % ZT_CONTROLLER_MEMBER_STATUS_SHARDS]; }
 
 	const int64_t _startTime;
 	int _listenPort;
@@ -156,13 +197,23 @@ private:
 	NetworkController::Sender *_sender;
 
 	DBMirrorSet _db;
-	BlockingQueue< _RQEntry * > _queue;
 
+	// One request queue per thread, indexed by _shardHash()
+	std::vector< std::unique_ptr< BlockingQueue< _RQEntry * > > > _queues;
 	std::vector<std::thread> _threads;
 	std::mutex _threads_l;
 
-	std::unordered_map< _MemberStatusKey,_MemberStatus,_MemberStatusHash > _memberStatus;
-	std::mutex _memberStatus_l;
+	_MemberStatusShard _memberStatus[ZT_CONTROLLER_MEMBER_STATUS_SHARDS];
+
+	// Debounced config pushes: due time by member (nodeId != 0) or whole network (nodeId == 0)
+	std::unordered_map< _MemberStatusKey,int64_t,_MemberStatusHash > _pendingPushes;
+	std::mutex _pendingPushes_l;
+	std::condition_variable _pendingPushes_c;
+	std::thread _pushThread;
+	bool _pushRunning;
+
+	std::atomic<unsigned int> _longPolls;
+	std::atomic_bool _longPollsStopped;
 
 	MQConfig *_mqc;
 };
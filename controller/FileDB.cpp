@@ -26,50 +26,232 @@
 
 #include "FileDB.hpp"
 
+#include <string.h>
+
+#ifdef __WINDOWS__
+#include <io.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#endif
+
+#include <algorithm>
+#include <chrono>
+
 namespace ZeroTier
 {
 
-FileDB::FileDB(const char *path) :
+namespace {
+
+// Every log and snapshot file starts with this
+static const char ZT_FILEDB_LOG_MAGIC[8] = { 'Z','T','D','B','L','O','G','1' };
+
+// Record types; network and member records carry compact JSON, erase records
+// carry big-endian IDs
+enum {
+	_REC_NETWORK = 1,
+	_REC_MEMBER = 2,
+	_REC_ERASE_NETWORK = 3,
+	_REC_ERASE_MEMBER = 4
+};
+
+struct _Crc32Table
+{
+	_Crc32Table()
+	{
+		for(uint32_t i=0;i<256;++i) {
+			uint32_t c = i;
+			for(int k=0;k<8;++k)
+				c = (c & 1) ? (0xedb88320 ^ (c >> 1)) : (c >> 1);
+			t[i] = c;
+		}
+	}
+	uint32_t t[256];
+};
+
+static uint32_t _crc32(const void *data,unsigned long len)
+{
+	static const _Crc32Table table;
+	const uint8_t *p = reinterpret_cast<const uint8_t *>(data);
+	uint32_t c = 0xffffffff;
+	while (len--)
+		c = table.t[(c ^ *(p++)) & 0xff] ^ (c >> 8);
+	return c ^ 0xffffffff;
+}
+
+// Flush a file through to stable storage
+static bool _syncFile(FILE *f)
+{
+	if (fflush(f) != 0)
+		return false;
+#ifdef __WINDOWS__
+	return (_commit(_fileno(f)) == 0);
+#else
+	return (fsync(fileno(f)) == 0);
+#endif
+}
+
+// Make a rename within a directory durable (a no-op on Windows)
+static bool _syncDirectory(const std::string &path)
+{
+#ifdef __WINDOWS__
+	return true;
+#else
+	const int fd = ::open(path.c_str(),O_RDONLY);
+	if (fd < 0)
+		return false;
+	const bool ok = (fsync(fd) == 0);
+	::close(fd);
+	return ok;
+#endif
+}
+
+static inline uint32_t _be32(const char *p)
+{
+	const uint8_t *b = reinterpret_cast<const uint8_t *>(p);
+	return (((uint32_t)b[0] << 24) | ((uint32_t)b[1] << 16) | ((uint32_t)b[2] << 8) | (uint32_t)b[3]);
+}
+
+static inline uint64_t _be64(const char *p) { return (((uint64_t)_be32(p) << 32) | (uint64_t)_be32(p + 4)); }
+
+static inline void _putBe32(std::string &s,const uint32_t i)
+{
+	s.push_back((char)(i >> 24));
+	s.push_back((char)(i >> 16));
+	s.push_back((char)(i >> 8));
+	s.push_back((char)i);
+}
+
+static inline void _putBe64(std::string &s,const uint64_t i)
+{
+	_putBe32(s,(uint32_t)(i >> 32));
+	_putBe32(s,(uint32_t)i);
+}
+
+// Frame: 32-bit body length, CRC-32 of body, then the body (type byte + payload)
+static void _encodeRecord(std::string &out,const unsigned int type,const std::string &payload)
+{
+	const std::string::size_type hdr = out.length();
+	_putBe32(out,(uint32_t)(payload.length() + 1));
+	_putBe32(out,0);
+	out.push_back((char)type);
+	out.append(payload);
+	const uint32_t crc = _crc32(out.data() + hdr + 8,(unsigned long)(payload.length() + 1));
+	for(int i=0;i<4;++i)
+		out[hdr + 4 + i] = (char)(crc >> (24 - (i * 8)));
+}
+
+struct _Record
+{
+	_Record() : type(0),nwid(0),id(0) {}
+	unsigned int type;
+	uint64_t nwid;
+	uint64_t id;
+	nlohmann::json obj;
+};
+
+// Verify and decode one framed record body; returns false if damaged or invalid
+static bool _decodeRecord(const char *body,const unsigned long len,const uint32_t crc,_Record &r)
+{
+	if ((len < 1)||(_crc32(body,len) != crc))
+		return false;
+	r.type = (unsigned int)((const uint8_t *)body)[0];
+	try {
+		switch(r.type) {
+			case _REC_NETWORK:
+				r.obj = OSUtils::jsonParse(std::string(body + 1,len - 1));
+				r.nwid = OSUtils::jsonIntHex(r.obj["id"],0ULL);
+				return (r.nwid != 0);
+			case _REC_MEMBER:
+				r.obj = OSUtils::jsonParse(std::string(body + 1,len - 1));
+				r.nwid = OSUtils::jsonIntHex(r.obj["nwid"],0ULL);
+				r.id = OSUtils::jsonIntHex(r.obj["id"],0ULL);
+				return ((r.nwid != 0)&&(r.id != 0));
+			case _REC_ERASE_NETWORK:
+				if (len != 9)
+					return false;
+				r.nwid = _be64(body + 1);
+				return true;
+			case _REC_ERASE_MEMBER:
+				if (len != 17)
+					return false;
+				r.nwid = _be64(body + 1);
+				r.id = _be64(body + 9);
+				return true;
+		}
+	} catch ( ... ) {}
+	return false;
+}
+
+// Run f(i) for i in [0,count) split into contiguous ranges across cores
+template<typename F>
+static void _parallelFor(const unsigned long count,F f)
+{
+	unsigned long tc = std::thread::hardware_concurrency();
+	if (tc > ZT_FILEDB_MAX_LOAD_THREADS)
+		tc = ZT_FILEDB_MAX_LOAD_THREADS;
+	if (tc > (count / 256))
+		tc = count / 256;
+	if (tc <= 1) {
+		for(unsigned long i=0;i<count;++i)
+			f(i);
+		return;
+	}
+	std::vector<std::thread> threads;
+	for(unsigned long t=0;t<tc;++t) {
+		const unsigned long b = (count * t) / tc;
+		const unsigned long e = (count * (t + 1)) / tc;
+		threads.push_back(std::thread([&f,b,e]() {
+			for(unsigned long i=b;i<e;++i)
+				f(i);
+		}));
+	}
+	for(auto t=threads.begin();t!=threads.end();++t)
+		t->join();
+}
+
+} // anonymous namespace
+
+FileDB::FileDB(const char *path,bool useLog) :
 	DB(),
 	_path(path),
 	_networksPath(_path + ZT_PATH_SEPARATOR_S + "network"),
 	_tracePath(_path + ZT_PATH_SEPARATOR_S + "trace"),
-	_running(true)
+	_running(true),
+	_logPath(_path + ZT_PATH_SEPARATOR_S ZT_FILEDB_LOG_FILE),
+	_snapshotPath(_path + ZT_PATH_SEPARATOR_S ZT_FILEDB_SNAPSHOT_FILE),
+	_log((FILE *)0),
+	_logSize(0),
+	_snapshotSize(0),
+	_lastSnapshot(OSUtils::now()),
+	_useLog(useLog)
 {
 	OSUtils::mkdir(_path.c_str());
 	OSUtils::lockDownFile(_path.c_str(),true);
 	OSUtils::mkdir(_networksPath.c_str());
 	OSUtils::mkdir(_tracePath.c_str());
 
-	std::vector<std::string> networks(OSUtils::listDirectory(_networksPath.c_str(),false));
-	std::string buf;
-	for(auto n=networks.begin();n!=networks.end();++n) {
-		buf.clear();
-		if ((n->length() == 21)&&(OSUtils::readFile((_networksPath + ZT_PATH_SEPARATOR_S + *n).c_str(),buf))) {
-			try {
-				nlohmann::json network(OSUtils::jsonParse(buf));
-				const std::string nwids = network["id"];
-				if (nwids.length() == 16) {
-					nlohmann::json nullJson;
-					_networkChanged(nullJson,network,false);
-					std::string membersPath(_networksPath + ZT_PATH_SEPARATOR_S + nwids + ZT_PATH_SEPARATOR_S "member");
-					std::vector<std::string> members(OSUtils::listDirectory(membersPath.c_str(),false));
-					for(auto m=members.begin();m!=members.end();++m) {
-						buf.clear();
-						if ((m->length() == 15)&&(OSUtils::readFile((membersPath + ZT_PATH_SEPARATOR_S + *m).c_str(),buf))) {
-							try {
-								nlohmann::json member(OSUtils::jsonParse(buf));
-								const std::string addrs = member["id"];
-								if (addrs.length() == 10) {
-									nlohmann::json nullJson2;
-									_memberChanged(nullJson2,member,false);
-								}
-							} catch ( ... ) {}
-						}
-					}
-				}
-			} catch ( ... ) {}
+	if (_useLog) {
+		const bool haveSnapshot = OSUtils::fileExists(_snapshotPath.c_str());
+		const bool haveLog = OSUtils::fileExists(_logPath.c_str());
+		bool rewrite = false;
+		if ((!haveSnapshot)&&(!haveLog)) {
+			// First start in log mode: import the per-file layout, if any
+			_loadDirectory();
+			rewrite = true;
+		} else {
+			if (haveSnapshot)
+				_replay(_snapshotPath,true);
+			if (haveLog)
+				rewrite = !_replay(_logPath,false);
 		}
+		_snapshotSize = std::max(OSUtils::getFileSize(_snapshotPath.c_str()),(int64_t)0);
+
+		if ((!rewrite)||(!_compact()))
+			_openLog();
+		_compactThread = std::thread(&FileDB::_compactThreadMain,this);
+	} else {
+		_loadDirectory();
 	}
 }
 
@@ -79,8 +261,13 @@ FileDB::~FileDB()
 		_online_l.lock();
 		_running = false;
 		_online_l.unlock();
-		_onlineUpdateThread.join();
+		if (_compactThread.joinable())
+			_compactThread.join();
+		if (_onlineUpdateThread.joinable())
+			_onlineUpdateThread.join();
 	} catch ( ... ) {}
+	if (_log)
+		fclose(_log);
 }
 
 bool FileDB::waitForReady() { return true; }
@@ -100,6 +287,19 @@ bool FileDB::save(nlohmann::json &record,bool notifyListeners)
 				get(nwid,old);
 				if ((!old.is_object())||(!_compareRecords(old,record))) {
 					record["revision"] = OSUtils::jsonInt(record["revision"],0ULL) + 1ULL;
+					if (_useLog) {
+						// Listeners are notified outside _log_l so a slow listener
+						// doesn't hold up other writers behind the log.
+						{
+							std::lock_guard<std::mutex> l(_log_l);
+							if (!_append(_REC_NETWORK,OSUtils::jsonDump(record,-1)))
+								return false;
+							_networkChanged(old,record,false);
+						}
+						if (notifyListeners)
+							_notifyNetworkChanged(nwid,record);
+						return true;
+					}
 					OSUtils::ztsnprintf(p1,sizeof(p1),"%s" ZT_PATH_SEPARATOR_S "%.16llx.json",_networksPath.c_str(),nwid);
 					if (!OSUtils::writeFile(p1,OSUtils::jsonDump(record,-1)))
 						fprintf(stderr,"WARNING: controller unable to write to path: %s" ZT_EOL_S,p1);
@@ -117,6 +317,18 @@ bool FileDB::save(nlohmann::json &record,bool notifyListeners)
 				get(nwid,network,id,old);
 				if ((!old.is_object())||(!_compareRecords(old,record))) {
 					record["revision"] = OSUtils::jsonInt(record["revision"],0ULL) + 1ULL;
+					if (_useLog) {
+						const bool deauthorized = ((old.is_object())&&(OSUtils::jsonBool(old["authorized"],false))&&(!OSUtils::jsonBool(record["authorized"],false)));
+						{
+							std::lock_guard<std::mutex> l(_log_l);
+							if (!_append(_REC_MEMBER,OSUtils::jsonDump(record,-1)))
+								return false;
+							_memberChanged(old,record,false);
+						}
+						if (notifyListeners)
+							_notifyMemberChanged(nwid,id,record,deauthorized);
+						return true;
+					}
 					OSUtils::ztsnprintf(pb,sizeof(pb),"%s" ZT_PATH_SEPARATOR_S "%.16llx" ZT_PATH_SEPARATOR_S "member",_networksPath.c_str(),(unsigned long long)nwid);
 					OSUtils::ztsnprintf(p1,sizeof(p1),"%s" ZT_PATH_SEPARATOR_S "%.10llx.json",pb,(unsigned long long)id);
 					if (!OSUtils::writeFile(p1,OSUtils::jsonDump(record,-1))) {
@@ -140,12 +352,23 @@ void FileDB::eraseNetwork(const uint64_t networkId)
 {
 	nlohmann::json network,nullJson;
 	get(networkId,network);
-	char p[16384];
-	OSUtils::ztsnprintf(p,sizeof(p),"%s" ZT_PATH_SEPARATOR_S "%.16llx.json",_networksPath.c_str(),networkId);
-	OSUtils::rm(p);
-	OSUtils::ztsnprintf(p,sizeof(p),"%s" ZT_PATH_SEPARATOR_S "%.16llx" ZT_PATH_SEPARATOR_S "member",_networksPath.c_str(),(unsigned long long)networkId);
-	OSUtils::rmDashRf(p);
-	_networkChanged(network,nullJson,true);
+	if (_useLog) {
+		std::string rec;
+		_putBe64(rec,networkId);
+		{
+			std::lock_guard<std::mutex> l(_log_l);
+			if (!_append(_REC_ERASE_NETWORK,rec))
+				return;
+			_networkChanged(network,nullJson,false);
+		}
+	} else {
+		char p[16384];
+		OSUtils::ztsnprintf(p,sizeof(p),"%s" ZT_PATH_SEPARATOR_S "%.16llx.json",_networksPath.c_str(),networkId);
+		OSUtils::rm(p);
+		OSUtils::ztsnprintf(p,sizeof(p),"%s" ZT_PATH_SEPARATOR_S "%.16llx" ZT_PATH_SEPARATOR_S "member",_networksPath.c_str(),(unsigned long long)networkId);
+		OSUtils::rmDashRf(p);
+		_networkChanged(network,nullJson,true);
+	}
 	std::lock_guard<std::mutex> l(this->_online_l);
 	this->_online.erase(networkId);
 }
@@ -153,12 +376,25 @@ void FileDB::eraseNetwork(const uint64_t networkId)
 void FileDB::eraseMember(const uint64_t networkId,const uint64_t memberId)
 {
 	nlohmann::json network,member,nullJson;
-	get(networkId,network);
-	get(memberId,member);
-	char p[4096];
-	OSUtils::ztsnprintf(p,sizeof(p),"%s" ZT_PATH_SEPARATOR_S "%.16llx" ZT_PATH_SEPARATOR_S "member" ZT_PATH_SEPARATOR_S "%.10llx.json",_networksPath.c_str(),networkId,memberId);
-	OSUtils::rm(p);
-	_memberChanged(member,nullJson,true);
+	get(networkId,network,memberId,member);
+	if (_useLog) {
+		std::string rec;
+		_putBe64(rec,networkId);
+		_putBe64(rec,memberId);
+		{
+			std::lock_guard<std::mutex> l(_log_l);
+			if (!_append(_REC_ERASE_MEMBER,rec))
+				return;
+			_memberChanged(member,nullJson,false);
+		}
+		if ((member.is_object())&&(OSUtils::jsonBool(member["authorized"],false)))
+			_notifyMemberChanged(networkId,memberId,nullJson,true);
+	} else {
+		char p[4096];
+		OSUtils::ztsnprintf(p,sizeof(p),"%s" ZT_PATH_SEPARATOR_S "%.16llx" ZT_PATH_SEPARATOR_S "member" ZT_PATH_SEPARATOR_S "%.10llx.json",_networksPath.c_str(),networkId,memberId);
+		OSUtils::rm(p);
+		_memberChanged(member,nullJson,true);
+	}
 	std::lock_guard<std::mutex> l(this->_online_l);
 	this->_online[networkId].erase(memberId);
 }
@@ -172,4 +408,323 @@ void FileDB::nodeIsOnline(const uint64_t networkId,const uint64_t memberId,const
 	this->_online[networkId][memberId][OSUtils::now()] = physicalAddress;
 }
 
+bool FileDB::compact()
+{
+	if (!_useLog)
+		return false;
+	return _compact();
+}
+
+void FileDB::_loadDirectory()
+{
+	std::vector<std::string> networks(OSUtils::listDirectory(_networksPath.c_str(),false));
+	for(auto n=networks.begin();n!=networks.end();) {
+		if (n->length() == 21)
+			++n;
+		else n = networks.erase(n);
+	}
+
+	std::vector<std::string> networkIds(networks.size());
+	_parallelFor(networks.size(),[&](const unsigned long i) {
+		std::string buf;
+		if (OSUtils::readFile((_networksPath + ZT_PATH_SEPARATOR_S + networks[i]).c_str(),buf)) {
+			try {
+				nlohmann::json network(OSUtils::jsonParse(buf));
+				const std::string nwids = network["id"];
+				if (nwids.length() == 16) {
+					nlohmann::json nullJson;
+					_networkChanged(nullJson,network,false);
+					networkIds[i] = nwids;
+				}
+			} catch ( ... ) {}
+		}
+	});
+
+	// Members are loaded as one flat list so a single large network still
+	// spreads across all threads
+	std::vector<std::string> members;
+	for(auto nwids=networkIds.begin();nwids!=networkIds.end();++nwids) {
+		if (nwids->empty())
+			continue;
+		std::string membersPath(_networksPath + ZT_PATH_SEPARATOR_S + *nwids + ZT_PATH_SEPARATOR_S "member");
+		std::vector<std::string> m(OSUtils::listDirectory(membersPath.c_str(),false));
+		for(auto mf=m.begin();mf!=m.end();++mf) {
+			if (mf->length() == 15)
+				members.push_back(membersPath + ZT_PATH_SEPARATOR_S + *mf);
+		}
+	}
+	_parallelFor(members.size(),[&](const unsigned long i) {
+		std::string buf;
+		if (OSUtils::readFile(members[i].c_str(),buf)) {
+			try {
+				nlohmann::json member(OSUtils::jsonParse(buf));
+				const std::string addrs = member["id"];
+				if (addrs.length() == 10) {
+					nlohmann::json nullJson;
+					_memberChanged(nullJson,member,false);
+				}
+			} catch ( ... ) {}
+		}
+	});
+}
+
+bool FileDB::_replay(const std::string &path,const bool unique)
+{
+	std::string buf;
+	if (!OSUtils::readFile(path.c_str(),buf))
+		return false;
+	if ((buf.length() < sizeof(ZT_FILEDB_LOG_MAGIC))||(memcmp(buf.data(),ZT_FILEDB_LOG_MAGIC,sizeof(ZT_FILEDB_LOG_MAGIC)) != 0)) {
+		fprintf(stderr,"WARNING: controller ignoring unrecognized record file: %s" ZT_EOL_S,path.c_str());
+		return false;
+	}
+
+	// Framing is walked serially; checksums and JSON parsing are the real cost
+	// and run in parallel below.
+	std::vector<unsigned long> offsets;
+	unsigned long p = sizeof(ZT_FILEDB_LOG_MAGIC);
+	while ((p + 8) <= buf.length()) {
+		const unsigned long len = _be32(buf.data() + p);
+		if ((len == 0)||((p + 8 + len) > buf.length()))
+			break;
+		offsets.push_back(p);
+		p += 8 + len;
+	}
+	bool clean = (p == buf.length());
+	if (!clean)
+		fprintf(stderr,"WARNING: controller ignoring truncated record at end of %s" ZT_EOL_S,path.c_str());
+
+	std::atomic<unsigned long> damaged(0);
+	if (unique) {
+		// Snapshot records name each object once, so order does not matter
+		_parallelFor(offsets.size(),[&](const unsigned long i) {
+			const char *const f = buf.data() + offsets[i];
+			_Record r;
+			if (_decodeRecord(f + 8,_be32(f),_be32(f + 4),r))
+				_applyRecord(r.type,r.nwid,r.id,r.obj,true);
+			else ++damaged;
+		});
+	} else {
+		std::vector<_Record> records(offsets.size());
+		std::vector<char> valid(offsets.size());
+		_parallelFor(offsets.size(),[&](const unsigned long i) {
+			const char *const f = buf.data() + offsets[i];
+			valid[i] = _decodeRecord(f + 8,_be32(f),_be32(f + 4),records[i]) ? 1 : 0;
+		});
+		for(unsigned long i=0;i<records.size();++i) {
+			if (valid[i])
+				_applyRecord(records[i].type,records[i].nwid,records[i].id,records[i].obj,false);
+			else ++damaged;
+		}
+	}
+	if (damaged > 0) {
+		fprintf(stderr,"WARNING: controller skipped %lu damaged records in %s" ZT_EOL_S,(unsigned long)damaged,path.c_str());
+		clean = false;
+	}
+
+	return clean;
+}
+
+void FileDB::_applyRecord(const unsigned int type,const uint64_t nwid,const uint64_t id,nlohmann::json &obj,const bool unique)
+{
+	nlohmann::json network,old,nullJson;
+	switch(type) {
+		case _REC_NETWORK:
+			_networkChanged(nullJson,obj,false);
+			break;
+		case _REC_MEMBER:
+			if (!unique) {
+				std::shared_ptr<_Network> nw;
+				{
+					RWMutex::RLock l(_networks_l);
+					auto nwi = _networks.find(nwid);
+					if (nwi != _networks.end())
+						nw = nwi->second;
+				}
+				if (nw) {
+					RWMutex::RLock l(nw->lock);
+					auto m = nw->members.find(id);
+					if (m != nw->members.end())
+						m->second.toJson(old);
+				}
+			}
+			_memberChanged(old,obj,false);
+			break;
+		case _REC_ERASE_NETWORK:
+			if (get(nwid,old))
+				_networkChanged(old,nullJson,false);
+			break;
+		case _REC_ERASE_MEMBER:
+			if (get(nwid,network,id,old))
+				_memberChanged(old,nullJson,false);
+			break;
+	}
+}
+
+bool FileDB::_append(const unsigned int type,const std::string &data)
+{
+	std::string rec;
+	_encodeRecord(rec,type,data);
+	if ((!_log)||(fwrite(rec.data(),1,rec.length(),_log) != rec.length())||(!_syncFile(_log))) {
+		fprintf(stderr,"WARNING: controller unable to write to path: %s" ZT_EOL_S,_logPath.c_str());
+		// Cut off any partial record so later appends still frame correctly
+		if (_log) {
+			clearerr(_log);
+#ifdef __WINDOWS__
+			_chsize_s(_fileno(_log),_logSize);
+#else
+			if (ftruncate(fileno(_log),(off_t)_logSize) != 0) {}
+#endif
+		}
+		return false;
+	}
+	_logSize += (int64_t)rec.length();
+	return true;
+}
+
+bool FileDB::_compact()
+{
+	std::lock_guard<std::mutex> cl(_compact_l);
+
+	// Records are applied to memory under _log_l in log order, so everything
+	// before this offset is in what we are about to serialize. Anything logged
+	// while the snapshot is written is carried over into the new log below.
+	// Every record is a full write or an erase, so replaying records that the
+	// snapshot already reflects leaves the same state.
+	int64_t logStart;
+	{
+		std::lock_guard<std::mutex> l(_log_l);
+		logStart = (_log) ? _logSize : 0;
+	}
+
+	const std::string tmpPath(_snapshotPath + ".tmp");
+	FILE *f = fopen(tmpPath.c_str(),"wb");
+	if (!f) {
+		fprintf(stderr,"WARNING: controller unable to write to path: %s" ZT_EOL_S,tmpPath.c_str());
+		return false;
+	}
+
+	std::vector< std::shared_ptr<_Network> > nws;
+	{
+		RWMutex::RLock l(_networks_l);
+		for(auto n=_networks.begin();n!=_networks.end();++n)
+			nws.push_back(n->second);
+	}
+
+	bool ok = (fwrite(ZT_FILEDB_LOG_MAGIC,1,sizeof(ZT_FILEDB_LOG_MAGIC),f) == sizeof(ZT_FILEDB_LOG_MAGIC));
+	int64_t size = sizeof(ZT_FILEDB_LOG_MAGIC);
+	std::string rec;
+	for(auto n=nws.begin();((ok)&&(n!=nws.end()));++n) {
+		rec.clear();
+		{
+			RWMutex::RLock l((*n)->lock);
+			if ((*n)->config.is_object())
+				_encodeRecord(rec,_REC_NETWORK,OSUtils::jsonDump((*n)->config,-1));
+			nlohmann::json mj;
+			for(auto m=(*n)->members.begin();m!=(*n)->members.end();++m) {
+				m->second.toJson(mj);
+				_encodeRecord(rec,_REC_MEMBER,OSUtils::jsonDump(mj,-1));
+			}
+		}
+		ok = (fwrite(rec.data(),1,rec.length(),f) == rec.length());
+		size += (int64_t)rec.length();
+	}
+	ok &= _syncFile(f);
+	fclose(f);
+
+	if ((!ok)||(!OSUtils::rename(tmpPath.c_str(),_snapshotPath.c_str()))) {
+		fprintf(stderr,"WARNING: controller unable to write to path: %s" ZT_EOL_S,_snapshotPath.c_str());
+		OSUtils::rm(tmpPath.c_str());
+		return false;
+	}
+
+	// The log must not be replaced until the rename itself is on disk, or a
+	// crash could leave the old snapshot next to a shortened log.
+	if (!_syncDirectory(_path)) {
+		fprintf(stderr,"WARNING: controller unable to sync directory: %s" ZT_EOL_S,_path.c_str());
+		return false;
+	}
+
+	// Replaying the whole old log over the new snapshot is harmless, so a
+	// crash before the new log is renamed into place loses nothing.
+	std::lock_guard<std::mutex> l(_log_l);
+	std::string tail;
+	if ((_log)&&(_logSize > logStart)) {
+		FILE *lf = fopen(_logPath.c_str(),"rb");
+		if (lf) {
+			tail.resize((size_t)(_logSize - logStart));
+			if ((fseek(lf,(long)logStart,SEEK_SET) != 0)||(fread(const_cast<char *>(tail.data()),1,tail.length(),lf) != tail.length()))
+				tail.clear();
+			fclose(lf);
+		}
+		if (tail.empty()) {
+			fprintf(stderr,"WARNING: controller unable to read log tail from: %s" ZT_EOL_S,_logPath.c_str());
+			_snapshotSize = size;
+			_lastSnapshot = OSUtils::now();
+			return true;
+		}
+	}
+
+	const std::string logTmpPath(_logPath + ".tmp");
+	f = fopen(logTmpPath.c_str(),"wb");
+	ok = (f != nullptr);
+	if (ok) {
+		ok = (fwrite(ZT_FILEDB_LOG_MAGIC,1,sizeof(ZT_FILEDB_LOG_MAGIC),f) == sizeof(ZT_FILEDB_LOG_MAGIC));
+		if ((ok)&&(!tail.empty()))
+			ok = (fwrite(tail.data(),1,tail.length(),f) == tail.length());
+		ok &= _syncFile(f);
+		fclose(f);
+	}
+	if (_log) {
+		fclose(_log);
+		_log = (FILE *)0;
+	}
+	if ((!ok)||(!OSUtils::rename(logTmpPath.c_str(),_logPath.c_str()))) {
+		fprintf(stderr,"WARNING: controller unable to write to path: %s" ZT_EOL_S,_logPath.c_str());
+		OSUtils::rm(logTmpPath.c_str());
+	} else {
+		_syncDirectory(_path);
+	}
+	_openLog();
+	_snapshotSize = size;
+	_lastSnapshot = OSUtils::now();
+	return true;
+}
+
+void FileDB::_openLog()
+{
+	_log = fopen(_logPath.c_str(),"ab");
+	if (!_log) {
+		fprintf(stderr,"WARNING: controller unable to write to path: %s" ZT_EOL_S,_logPath.c_str());
+		return;
+	}
+	_logSize = std::max(OSUtils::getFileSize(_logPath.c_str()),(int64_t)0);
+	if (_logSize == 0) {
+		if (fwrite(ZT_FILEDB_LOG_MAGIC,1,sizeof(ZT_FILEDB_LOG_MAGIC),_log) == sizeof(ZT_FILEDB_LOG_MAGIC))
+			_logSize = sizeof(ZT_FILEDB_LOG_MAGIC);
+		_syncFile(_log);
+	}
+}
+
+void FileDB::_compactThreadMain()
+{
+	for(unsigned long k=1;;++k) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		{
+			std::lock_guard<std::mutex> l(_online_l);
+			if (!_running)
+				break;
+		}
+		if ((k % 10) != 0)
+			continue;
+		bool compactNow = false;
+		{
+			std::lock_guard<std::mutex> l(_log_l);
+			if (_logSize > (int64_t)sizeof(ZT_FILEDB_LOG_MAGIC))
+				compactNow = ( ((_logSize >= ZT_FILEDB_COMPACT_MIN_LOG_SIZE)&&(_logSize > _snapshotSize)) || ((OSUtils::now() - _lastSnapshot) >= ZT_FILEDB_SNAPSHOT_INTERVAL) );
+		}
+		if (compactNow)
+			_compact();
+	}
+}
+
 } // namespace ZeroTier
@@ -29,13 +29,41 @@
 
 #include "DB.hpp"
 
+#include <stdio.h>
+
+// Record log and snapshot file names under the controller directory
+#define ZT_FILEDB_LOG_FILE "controller.log"
+#define ZT_FILEDB_SNAPSHOT_FILE "controller.snapshot"
+
+// Compact once the log is at least this big and larger than the last snapshot
+#define ZT_FILEDB_COMPACT_MIN_LOG_SIZE 16777216
+
+// Maximum time unsnapshotted records may sit in the log (ms)
+#define ZT_FILEDB_SNAPSHOT_INTERVAL 3600000
+
+// Upper bound on threads used to load records at startup
+#define ZT_FILEDB_MAX_LOAD_THREADS 16
+
 namespace ZeroTier
 {
 
+/**
+ * Controller database stored in the local filesystem
+ *
+ * By default each network and member is a JSON file under network/. In log
+ * mode records are instead appended to a checksummed log that is folded into
+ * a snapshot by compaction, so a change costs one small append rather than a
+ * file rewrite and startup reads two files instead of one per member. The
+ * first start in log mode imports any existing network/ directory tree.
+ */
 class FileDB : public DB
 {
 public:
-	FileDB(const char *path);
+	/**
+	 * @param path Controller data directory
+	 * @param useLog If true, store records in an append-only log
+	 */
+	FileDB(const char *path,bool useLog = false);
 	virtual ~FileDB();
 
 	virtual bool waitForReady();
@@ -45,7 +73,25 @@ public:
 	virtual void eraseMember(const uint64_t networkId,const uint64_t memberId);
 	virtual void nodeIsOnline(const uint64_t networkId,const uint64_t memberId,const InetAddress &physicalAddress);
 
+	/**
+	 * Write a snapshot of all current records and truncate the log
+	 *
+	 * This runs automatically in the background; it does nothing unless
+	 * this FileDB is in log mode.
+	 *
+	 * @return True if a new snapshot was written
+	 */
+	bool compact();
+
 protected:
+	void _loadDirectory();
+	bool _replay(const std::string &path,const bool unique);
+	void _applyRecord(const unsigned int type,const uint64_t nwid,const uint64_t id,nlohmann::json &obj,const bool unique);
+	bool _append(const unsigned int type,const std::string &data);
+	bool _compact();
+	void _openLog();
+	void _compactThreadMain();
+
 	std::string _path;
 	std::string _networksPath;
 	std::string _tracePath;
@@ -53,6 +99,17 @@ protected:
 	std::map< uint64_t,std::map<uint64_t,std::map<int64_t,InetAddress> > > _online;
 	std::mutex _online_l;
 	bool _running;
+
+	std::string _logPath;
+	std::string _snapshotPath;
+	FILE *_log;
+	int64_t _logSize;
+	int64_t _snapshotSize;
+	int64_t _lastSnapshot;
+	std::thread _compactThread;
+	std::mutex _log_l;
+	std::mutex _compact_l; // serializes _compact(), which holds _log_l only briefly
+	const bool _useLog;
 };
 
 } // namespace ZeroTier
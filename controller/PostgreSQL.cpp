@@ -35,6 +35,7 @@
 
 #include <libpq-fe.h>
 #include <sstream>
+#include <algorithm>
 #include <amqp.h>
 #include <amqp_tcp_socket.h>
 
@@ -78,6 +79,221 @@ std::string join(const std::vector<std::string> &elements, const char * const se
 }
 */
 
+// Statements issued by the batched member commit path. These are prepared
+// once per commit connection unless a transaction pooler sits in front of
+// the database, since prepared statements do not survive across pooled
+// server connections.
+struct _CommitStatement
+{
+	const char *name;
+	const char *sql;
+	int nParams;
+};
+
+static const _CommitStatement _MEMBER_UPSERT = {
+	"zt_member_upsert",
+	"INSERT INTO ztc_member (id, network_id, active_bridge, authorized, capabilities, "
+	"identity, last_authorized_time, last_deauthorized_time, no_auto_assign_ips, "
+	"remote_trace_level, remote_trace_target, revision, tags, v_major, v_minor, v_rev, v_proto) "
+	"VALUES ($1, $2, $3, $4, $5, $6, "
+	"TO_TIMESTAMP($7::double precision/1000), TO_TIMESTAMP($8::double precision/1000), "
+	"$9, $10, $11, $12, $13, $14, $15, $16, $17) ON CONFLICT (network_id, id) DO UPDATE SET "
+	"active_bridge = EXCLUDED.active_bridge, authorized = EXCLUDED.authorized, capabilities = EXCLUDED.capabilities, "
+	"identity = EXCLUDED.identity, last_authorized_time = EXCLUDED.last_authorized_time, "
+	"last_deauthorized_time = EXCLUDED.last_deauthorized_time, no_auto_assign_ips = EXCLUDED.no_auto_assign_ips, "
+	"remote_trace_level = EXCLUDED.remote_trace_level, remote_trace_target = EXCLUDED.remote_trace_target, "
+	"revision = EXCLUDED.revision+1, tags = EXCLUDED.tags, v_major = EXCLUDED.v_major, "
+	"v_minor = EXCLUDED.v_minor, v_rev = EXCLUDED.v_rev, v_proto = EXCLUDED.v_proto",
+	17
+};
+
+static const _CommitStatement _MEMBER_IP_DELETE = {
+	"zt_member_ip_delete",
+	"DELETE FROM ztc_member_ip_assignment WHERE member_id = $1 AND network_id = $2",
+	2
+};
+
+static const _CommitStatement _MEMBER_IP_INSERT = {
+	"zt_member_ip_insert",
+	"INSERT INTO ztc_member_ip_assignment (member_id, network_id, address) VALUES ($1, $2, $3)",
+	3
+};
+
+// Transaction control is never prepared
+static const _CommitStatement _BEGIN = { "","BEGIN",0 };
+static const _CommitStatement _COMMIT = { "","COMMIT",0 };
+
+static bool _prepare(PGconn *conn,const _CommitStatement &s)
+{
+	PGresult *res = PQprepare(conn,s.name,s.sql,s.nParams,NULL);
+	const bool ok = (PQresultStatus(res) == PGRES_COMMAND_OK);
+	if (!ok)
+		fprintf(stderr, "ERROR: Error preparing statement %s: %s\n", s.name, PQresultErrorMessage(res));
+	PQclear(res);
+	return ok;
+}
+
+static PGresult *_exec(PGconn *conn,const bool prepared,const _CommitStatement &s,const char *const *values)
+{
+	if (prepared)
+		return PQexecPrepared(conn,s.name,s.nParams,values,NULL,NULL,0);
+	return PQexecParams(conn,s.sql,s.nParams,NULL,values,NULL,NULL,0);
+}
+
+#ifdef LIBPQ_HAS_PIPELINING
+static bool _send(PGconn *conn,const bool prepared,const _CommitStatement &s,const char *const *values)
+{
+	if (prepared)
+		return (PQsendQueryPrepared(conn,s.name,s.nParams,values,NULL,NULL,0) != 0);
+	return (PQsendQueryParams(conn,s.sql,s.nParams,NULL,values,NULL,NULL,0) != 0);
+}
+#endif
+
+// One member record flattened into statement parameters
+struct _MemberRow
+{
+	_MemberRow(nlohmann::json &config) :
+		memberId(config["id"].get<std::string>()),
+		networkId(config["nwid"].get<std::string>()),
+		identity(config["identity"].get<std::string>()),
+		caps(ZeroTier::OSUtils::jsonDump(config["capabilities"], -1)),
+		lastAuthTime(std::to_string((long long)config["lastAuthorizedTime"])),
+		lastDeauthTime(std::to_string((long long)config["lastDeauthorizedTime"])),
+		rtraceLevel(std::to_string((int)config["remoteTraceLevel"])),
+		rev(std::to_string((unsigned long long)config["revision"])),
+		tags(ZeroTier::OSUtils::jsonDump(config["tags"], -1)),
+		vmajor(std::to_string((int)config["vMajor"])),
+		vminor(std::to_string((int)config["vMinor"])),
+		vrev(std::to_string((int)config["vRev"])),
+		vproto(std::to_string((int)config["vProto"])),
+		activeBridge((bool)config["activeBridge"]),
+		authorized((bool)config["authorized"]),
+		noAutoAssignIps((bool)config["noAutoAssignIps"]),
+		hasTarget(!config["remoteTraceTarget"].is_null())
+	{
+		if (hasTarget)
+			target = config["remoteTraceTarget"].get<std::string>();
+		for (auto i = config["ipAssignments"].begin(); i != config["ipAssignments"].end(); ++i) {
+			std::string addr = *i;
+			if (std::find(ipAssignments.begin(), ipAssignments.end(), addr) == ipAssignments.end())
+				ipAssignments.push_back(addr);
+		}
+	}
+
+	inline void upsertValues(const char **values) const
+	{
+		values[0] = memberId.c_str();
+		values[1] = networkId.c_str();
+		values[2] = activeBridge ? "true" : "false";
+		values[3] = authorized ? "true" : "false";
+		values[4] = caps.c_str();
+		values[5] = identity.c_str();
+		values[6] = lastAuthTime.c_str();
+		values[7] = lastDeauthTime.c_str();
+		values[8] = noAutoAssignIps ? "true" : "false";
+		values[9] = rtraceLevel.c_str();
+		values[10] = hasTarget ? target.c_str() : NULL;
+		values[11] = rev.c_str();
+		values[12] = tags.c_str();
+		values[13] = vmajor.c_str();
+		values[14] = vminor.c_str();
+		values[15] = vrev.c_str();
+		values[16] = vproto.c_str();
+	}
+
+	std::string memberId,networkId,identity,target,caps,lastAuthTime,lastDeauthTime,rtraceLevel,rev,tags,vmajor,vminor,vrev,vproto;
+	std::vector<std::string> ipAssignments;
+	bool activeBridge,authorized,noAutoAssignIps,hasTarget;
+};
+
+// Write a run of member records and their IP assignments in one transaction.
+// With libpq pipeline mode the whole run costs a single round trip.
+static bool _commitMembers(PGconn *conn,const bool prepared,const _MemberRow *rows,const unsigned long count)
+{
+	const char *values[17];
+#ifdef LIBPQ_HAS_PIPELINING
+	if (PQenterPipelineMode(conn)) {
+		unsigned long sent = 0;
+		bool ok = _send(conn,false,_BEGIN,NULL);
+		if (ok) ++sent;
+		for(unsigned long r=0;((ok)&&(r<count));++r) {
+			rows[r].upsertValues(values);
+			if (!(ok = _send(conn,prepared,_MEMBER_UPSERT,values))) break;
+			++sent;
+			if (!(ok = _send(conn,prepared,_MEMBER_IP_DELETE,values))) break;
+			++sent;
+			for(auto a=rows[r].ipAssignments.begin();a!=rows[r].ipAssignments.end();++a) {
+				values[2] = a->c_str();
+				if (!(ok = _send(conn,prepared,_MEMBER_IP_INSERT,values))) break;
+				++sent;
+			}
+		}
+		if ((ok)&&(_send(conn,false,_COMMIT,NULL)))
+			++sent;
+		else ok = false;
+		if (!ok)
+			fprintf(stderr, "ERROR: Error queueing member commit: %s\n", PQerrorMessage(conn));
+		PQpipelineSync(conn);
+
+		for(unsigned long i=0;i<sent;++i) {
+			PGresult *res = PQgetResult(conn);
+			if (!res) {
+				ok = false;
+				break;
+			}
+			const ExecStatusType st = PQresultStatus(res);
+			if (st != PGRES_COMMAND_OK) {
+				if ((ok)&&(st != PGRES_PIPELINE_ABORTED))
+					fprintf(stderr, "ERROR: Error updating member: %s\n", PQresultErrorMessage(res));
+				ok = false;
+			}
+			PQclear(res);
+			PQclear(PQgetResult(conn)); // NULL terminating this statement's results
+		}
+		PQclear(PQgetResult(conn)); // PGRES_PIPELINE_SYNC
+		PQexitPipelineMode(conn);
+
+		if (!ok)
+			PQclear(PQexec(conn, "ROLLBACK"));
+		return ok;
+	}
+#endif
+
+	PGresult *res = _exec(conn,false,_BEGIN,NULL);
+	if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+		fprintf(stderr, "ERROR: Error beginning transaction: %s\n", PQresultErrorMessage(res));
+		PQclear(res);
+		return false;
+	}
+	PQclear(res);
+	for(unsigned long r=0;r<count;++r) {
+		rows[r].upsertValues(values);
+		res = _exec(conn,prepared,_MEMBER_UPSERT,values);
+		if (PQresultStatus(res) == PGRES_COMMAND_OK) {
+			PQclear(res);
+			res = _exec(conn,prepared,_MEMBER_IP_DELETE,values);
+			for(auto a=rows[r].ipAssignments.begin();((PQresultStatus(res) == PGRES_COMMAND_OK)&&(a!=rows[r].ipAssignments.end()));++a) {
+				PQclear(res);
+				values[2] = a->c_str();
+				res = _exec(conn,prepared,_MEMBER_IP_INSERT,values);
+			}
+		}
+		if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+			fprintf(stderr, "ERROR: Error updating member: %s\n", PQresultErrorMessage(res));
+			PQclear(res);
+			PQclear(PQexec(conn, "ROLLBACK"));
+			return false;
+		}
+		PQclear(res);
+	}
+	res = _exec(conn,false,_COMMIT,NULL);
+	const bool ok = (PQresultStatus(res) == PGRES_COMMAND_OK);
+	if (!ok)
+		fprintf(stderr, "ERROR: Error committing member data: %s\n", PQresultErrorMessage(res));
+	PQclear(res);
+	return ok;
+}
+
 } // anonymous namespace
 
 using namespace ZeroTier;
@@ -86,6 +302,7 @@ PostgreSQL::PostgreSQL(const Identity &myId, const char *path, int listenPort, M
 	: DB()
 	, _myId(myId)
 	, _myAddress(myId.address())
+	, _commitLatency(0)
 	, _ready(0)
 	, _connected(1)
 	, _run(1)
@@ -185,7 +402,7 @@ bool PostgreSQL::save(nlohmann::json &record,bool notifyListeners)
 				get(nwid,old);
 				if ((!old.is_object())||(!_compareRecords(old,record))) {
 					record["revision"] = OSUtils::jsonInt(record["revision"],0ULL) + 1ULL;
-					_commitQueue.post(std::pair<nlohmann::json,bool>(record,notifyListeners));
+					_commitQueue.post(_CommitQueueItem(record,notifyListeners));
 					modified = true;
 				}
 			}
@@ -197,7 +414,7 @@ bool PostgreSQL::save(nlohmann::json &record,bool notifyListeners)
 				get(nwid,network,id,old);
 				if ((!old.is_object())||(!_compareRecords(old,record))) {
 					record["revision"] = OSUtils::jsonInt(record["revision"],0ULL) + 1ULL;
-					_commitQueue.post(std::pair<nlohmann::json,bool>(record,notifyListeners));
+					_commitQueue.post(_CommitQueueItem(record,notifyListeners));
 					modified = true;
 				}
 			}
@@ -215,23 +432,21 @@ void PostgreSQL::eraseNetwork(const uint64_t networkId)
 	char tmp2[24];
 	waitForReady();
 	Utils::hex(networkId, tmp2);
-	std::pair<nlohmann::json,bool> tmp;
-	tmp.first["id"] = tmp2;
-	tmp.first["objtype"] = "_delete_network";
-	tmp.second = true;
+	_CommitQueueItem tmp(nlohmann::json::object(),true);
+	tmp.record["id"] = tmp2;
+	tmp.record["objtype"] = "_delete_network";
 	_commitQueue.post(tmp);
 }
 
 void PostgreSQL::eraseMember(const uint64_t networkId, const uint64_t memberId) 
 {
 	char tmp2[24];
-	std::pair<nlohmann::json,bool> tmp;
+	_CommitQueueItem tmp(nlohmann::json::object(),true);
 	Utils::hex(networkId, tmp2);
-	tmp.first["nwid"] = tmp2;
+	tmp.record["nwid"] = tmp2;
 	Utils::hex(memberId, tmp2);
-	tmp.first["id"] = tmp2;
-	tmp.first["objtype"] = "_delete_member";
-	tmp.second = true;
+	tmp.record["id"] = tmp2;
+	tmp.record["objtype"] = "_delete_member";
 	_commitQueue.post(tmp);
 }
 
@@ -588,6 +803,7 @@ void PostgreSQL::heartbeat()
 		PQfinish(conn);
 		exit(1);
 	}
+	int64_t lastCommitReport = OSUtils::now();
 	while (_run == 1) {
 		if(PQstatus(conn) != CONNECTION_OK) {
 			fprintf(stderr, "%s heartbeat thread lost connection to Database\n", _myAddressStr.c_str());
@@ -635,6 +851,13 @@ void PostgreSQL::heartbeat()
 			PQclear(res);
 		}
 
+		if ((OSUtils::now() - lastCommitReport) >= ZT_CENTRAL_COMMIT_REPORT_INTERVAL) {
+			lastCommitReport = OSUtils::now();
+			const unsigned long depth = commitQueueDepth();
+			if (depth > 0)
+				fprintf(stderr, "%s commit queue: %lu pending, %lldms average commit latency\n", _myAddressStr.c_str(), depth, (long long)commitLatency());
+		}
+
 		std::this_thread::sleep_for(std::chrono::milliseconds(1000));
 	}
 
@@ -861,386 +1084,222 @@ void PostgreSQL::commitThread()
 		exit(1);
 	}
 
-	std::pair<nlohmann::json,bool> qitem;
-	while(_commitQueue.get(qitem)&(_run == 1)) {
-		if (!qitem.first.is_object()) {
-			continue;
-		}
+	bool prepared = (getenv("PGBOUNCER_CONNSTR") == NULL);
+	if (prepared)
+		prepared = ((_prepare(conn,_MEMBER_UPSERT))&&(_prepare(conn,_MEMBER_IP_DELETE))&&(_prepare(conn,_MEMBER_IP_INSERT)));
+
+	std::vector<_CommitQueueItem> batch;
+	std::vector<_MemberRow> rows;
+	std::vector<_CommitQueueItem *> rowItems;
+	while(_commitQueue.getBatch(batch,ZT_CENTRAL_COMMIT_BATCH)&&(_run == 1)) {
 		if (PQstatus(conn) == CONNECTION_BAD) {
 			fprintf(stderr, "ERROR: Connection to database failed: %s\n", PQerrorMessage(conn));
 			PQfinish(conn);
 			exit(1);
 		}
-		try {
-			nlohmann::json *config = &(qitem.first);
-			const std::string objtype = (*config)["objtype"];
-			if (objtype == "member") {
-				try {
-					std::string memberId = (*config)["id"];
-					std::string networkId = (*config)["nwid"];
-					std::string identity = (*config)["identity"];
-					std::string target = "NULL";
-
-					if (!(*config)["remoteTraceTarget"].is_null()) {
-						target = (*config)["remoteTraceTarget"];
-					}
 
-					std::string caps = OSUtils::jsonDump((*config)["capabilities"], -1);
-					std::string lastAuthTime = std::to_string((long long)(*config)["lastAuthorizedTime"]);
-					std::string lastDeauthTime = std::to_string((long long)(*config)["lastDeauthorizedTime"]);
-					std::string rtraceLevel = std::to_string((int)(*config)["remoteTraceLevel"]);
-					std::string rev = std::to_string((unsigned long long)(*config)["revision"]);
-					std::string tags = OSUtils::jsonDump((*config)["tags"], -1);
-					std::string vmajor = std::to_string((int)(*config)["vMajor"]);
-					std::string vminor = std::to_string((int)(*config)["vMinor"]);
-					std::string vrev = std::to_string((int)(*config)["vRev"]);
-					std::string vproto = std::to_string((int)(*config)["vProto"]);
-					const char *values[19] = {
-						memberId.c_str(),
-						networkId.c_str(),
-						((*config)["activeBridge"] ? "true" : "false"),
-						((*config)["authorized"] ? "true" : "false"),
-						caps.c_str(),
-						identity.c_str(),
-						lastAuthTime.c_str(),
-						lastDeauthTime.c_str(),
-						((*config)["noAutoAssignIps"] ? "true" : "false"),
-						rtraceLevel.c_str(),
-						(target == "NULL") ? NULL : target.c_str(),
-						rev.c_str(),
-						tags.c_str(),
-						vmajor.c_str(),
-						vminor.c_str(),
-						vrev.c_str(),
-						vproto.c_str()
-					};
-
-					PGresult *res = PQexecParams(conn,
-						"INSERT INTO ztc_member (id, network_id, active_bridge, authorized, capabilities, "
-						"identity, last_authorized_time, last_deauthorized_time, no_auto_assign_ips, "
-						"remote_trace_level, remote_trace_target, revision, tags, v_major, v_minor, v_rev, v_proto) "
-						"VALUES ($1, $2, $3, $4, $5, $6, "
-						"TO_TIMESTAMP($7::double precision/1000), TO_TIMESTAMP($8::double precision/1000), "
-						"$9, $10, $11, $12, $13, $14, $15, $16, $17) ON CONFLICT (network_id, id) DO UPDATE SET "
-						"active_bridge = EXCLUDED.active_bridge, authorized = EXCLUDED.authorized, capabilities = EXCLUDED.capabilities, "
-						"identity = EXCLUDED.identity, last_authorized_time = EXCLUDED.last_authorized_time, "
-						"last_deauthorized_time = EXCLUDED.last_deauthorized_time, no_auto_assign_ips = EXCLUDED.no_auto_assign_ips, "
-						"remote_trace_level = EXCLUDED.remote_trace_level, remote_trace_target = EXCLUDED.remote_trace_target, "
-						"revision = EXCLUDED.revision+1, tags = EXCLUDED.tags, v_major = EXCLUDED.v_major, "
-						"v_minor = EXCLUDED.v_minor, v_rev = EXCLUDED.v_rev, v_proto = EXCLUDED.v_proto",
-						17,
-						NULL,
-						values,
-						NULL,
-						NULL,
-						0);
-					
-					if (PQresultStatus(res) != PGRES_COMMAND_OK) {
-						fprintf(stderr, "ERROR: Error updating member: %s\n", PQresultErrorMessage(res));
-						fprintf(stderr, "%s", OSUtils::jsonDump(*config, 2).c_str());
-						PQclear(res);
-						delete config;
-						config = nullptr;
-						continue;
+		for(unsigned long i=0;i<batch.size();) {
+			_CommitQueueItem &qitem = batch[i++];
+			if (!qitem.record.is_object()) {
+				continue;
+			}
+			try {
+				nlohmann::json *config = &(qitem.record);
+				const std::string objtype = (*config)["objtype"];
+				if (objtype == "member") {
+					// Consecutive member saves go out as one transaction. If that fails the
+					// run is retried record by record so one bad record can't sink the rest.
+					rows.clear();
+					rowItems.clear();
+					for(--i;i<batch.size();++i) {
+						nlohmann::json &r = batch[i].record;
+						if ((!r.is_object())||(r["objtype"] != "member"))
+							break;
+						try {
+							rows.emplace_back(r);
+							rowItems.push_back(&(batch[i]));
+						} catch (std::exception &e) {
+							fprintf(stderr, "ERROR: Error updating member: %s\n", e.what());
+						}
 					}
 
-					PQclear(res);
-
-					res = PQexec(conn, "BEGIN");
-					if (PQresultStatus(res) != PGRES_COMMAND_OK) {
-						fprintf(stderr, "ERROR: Error beginning transaction: %s\n", PQresultErrorMessage(res));
-						PQclear(res);
-						delete config;
-						config = nullptr;
-						continue;
+					std::vector<bool> committed(rows.size(),true);
+					if ((!rows.empty())&&(!_commitMembers(conn,prepared,rows.data(),(unsigned long)rows.size()))) {
+						for(unsigned long k=0;k<rows.size();++k) {
+							committed[k] = ((rows.size() > 1)&&(_commitMembers(conn,prepared,&(rows[k]),1)));
+							if (!committed[k])
+								fprintf(stderr, "%s", OSUtils::jsonDump(rowItems[k]->record, 2).c_str());
+						}
 					}
 
-					PQclear(res);
+					for(unsigned long k=0;k<rows.size();++k) {
+						if (!committed[k])
+							continue;
+						nlohmann::json &m = rowItems[k]->record;
+						const uint64_t nwidInt = OSUtils::jsonIntHex(m["nwid"], 0ULL);
+						const uint64_t memberidInt = OSUtils::jsonIntHex(m["id"], 0ULL);
+						if (nwidInt && memberidInt) {
+							nlohmann::json nwOrig;
+							nlohmann::json memOrig;
 
-					const char *v2[2] = {
-						memberId.c_str(),
-						networkId.c_str()
-					};
+							nlohmann::json memNew(m);
 
-					res = PQexecParams(conn,
-						"DELETE FROM ztc_member_ip_assignment WHERE member_id = $1 AND network_id = $2",
-						2,
-						NULL,
-						v2,
-						NULL,
-						NULL,
-						0);
+							get(nwidInt, nwOrig, memberidInt, memOrig);
 
-					if (PQresultStatus(res) != PGRES_COMMAND_OK) {
-						fprintf(stderr, "ERROR: Error updating IP address assignments: %s\n", PQresultErrorMessage(res));
-						PQclear(res);
-						PQclear(PQexec(conn, "ROLLBACK"));;
-						delete config;
-						config = nullptr;
-						continue;
+							_memberChanged(memOrig, memNew, rowItems[k]->notify);
+						} else {
+							fprintf(stderr, "Can't notify of change.  Error parsing nwid or memberid: %llu-%llu\n", (unsigned long long)nwidInt, (unsigned long long)memberidInt);
+						}
 					}
-
-					PQclear(res);
-
-					std::vector<std::string> assignments;
-					for (auto i = (*config)["ipAssignments"].begin(); i != (*config)["ipAssignments"].end(); ++i) {
-						std::string addr = *i;
-
-						if (std::find(assignments.begin(), assignments.end(), addr) != assignments.end()) {
-							continue;
+				} else if (objtype == "network") {
+					try {
+						std::string id = (*config)["id"];
+						std::string controllerId = _myAddressStr.c_str();
+						std::string name = (*config)["name"];
+						std::string remoteTraceTarget("NULL");
+						if (!(*config)["remoteTraceTarget"].is_null()) {
+							remoteTraceTarget = (*config)["remoteTraceTarget"];
 						}
-
-						const char *v3[3] = {
-							memberId.c_str(),
-							networkId.c_str(),
-							addr.c_str()
+						std::string rulesSource;
+						if ((*config)["rulesSource"].is_string()) {
+							rulesSource = (*config)["rulesSource"];
+						}
+						std::string caps = OSUtils::jsonDump((*config)["capabilitles"], -1);
+						std::string now = std::to_string(OSUtils::now());
+						std::string mtu = std::to_string((int)(*config)["mtu"]);
+						std::string mcastLimit = std::to_string((int)(*config)["multicastLimit"]);
+						std::string rtraceLevel = std::to_string((int)(*config)["remoteTraceLevel"]);
+						std::string rules = OSUtils::jsonDump((*config)["rules"], -1);
+						std::string tags = OSUtils::jsonDump((*config)["tags"], -1);
+						std::string v4mode = OSUtils::jsonDump((*config)["v4AssignMode"],-1);
+						std::string v6mode = OSUtils::jsonDump((*config)["v6AssignMode"], -1);
+						bool enableBroadcast = (*config)["enableBroadcast"];
+						bool isPrivate = (*config)["private"];
+
+						const char *values[16] = {
+							id.c_str(),
+							controllerId.c_str(),
+							caps.c_str(),
+							enableBroadcast ? "true" : "false",
+							now.c_str(),
+							mtu.c_str(),
+							mcastLimit.c_str(),
+							name.c_str(),
+							isPrivate ? "true" : "false",
+							rtraceLevel.c_str(),
+							(remoteTraceTarget == "NULL" ? NULL : remoteTraceTarget.c_str()),
+							rules.c_str(),
+							rulesSource.c_str(),
+							tags.c_str(),
+							v4mode.c_str(),
+							v6mode.c_str(),
 						};
 
-						res = PQexecParams(conn,
-							"INSERT INTO ztc_member_ip_assignment (member_id, network_id, address) VALUES ($1, $2, $3)",
-							3,
+						// This ugly query exists because when we want to mirror networks to/from
+						// another data store (e.g. FileDB or LFDB) it is possible to get a network
+						// that doesn't exist in Central's database. This does an upsert and sets
+						// the owner_id to the "first" global admin in the user DB if the record
+						// did not previously exist. If the record already exists owner_id is left
+						// unchanged, so owner_id should be left out of the update clause.
+						PGresult *res = PQexecParams(conn,
+							"INSERT INTO ztc_network (id, creation_time, owner_id, controller_id, capabilities, enable_broadcast, "
+							"last_modified, mtu, multicast_limit, name, private, "
+							"remote_trace_level, remote_trace_target, rules, rules_source, "
+							"tags, v4_assign_mode, v6_assign_mode) VALUES ("
+							"$1, TO_TIMESTAMP($5::double precision/1000), "
+							"(SELECT user_id AS owner_id FROM ztc_global_permissions WHERE authorize = true AND del = true AND modify = true AND read = true LIMIT 1),"
+							"$2, $3, $4, TO_TIMESTAMP($5::double precision/1000), "
+							"$6, $7, $8, $9, $10, $11, $12, $13, $14, $15, $16) "
+							"ON CONFLICT (id) DO UPDATE set controller_id = EXCLUDED.controller_id, "
+							"capabilities = EXCLUDED.capabilities, enable_broadcast = EXCLUDED.enable_broadcast, "
+							"last_modified = EXCLUDED.last_modified, mtu = EXCLUDED.mtu, "
+							"multicast_limit = EXCLUDED.multicast_limit, name = EXCLUDED.name, "
+							"private = EXCLUDED.private, remote_trace_level = EXCLUDED.remote_trace_level, "
+							"remote_trace_target = EXCLUDED.remote_trace_target, rules = EXCLUDED.rules, "
+							"rules_source = EXCLUDED.rules_source, tags = EXCLUDED.tags, "
+							"v4_assign_mode = EXCLUDED.v4_assign_mode, v6_assign_mode = EXCLUDED.v6_assign_mode",
+							16,
 							NULL,
-							v3,
+							values,
 							NULL,
 							NULL,
 							0);
 						
 						if (PQresultStatus(res) != PGRES_COMMAND_OK) {
-							fprintf(stderr, "ERROR: Error setting IP addresses for member: %s\n", PQresultErrorMessage(res));
+							fprintf(stderr, "ERROR: Error updating network record: %s\n", PQresultErrorMessage(res));
 							PQclear(res);
-							PQclear(PQexec(conn, "ROLLBACK"));
-							break;;
+							continue;
 						}
-					}
-
-					res = PQexec(conn, "COMMIT");
-					if (PQresultStatus(res) != PGRES_COMMAND_OK) {
-						fprintf(stderr, "ERROR: Error committing ip address data: %s\n", PQresultErrorMessage(res));
-					}
-
-					PQclear(res);
-
-					const uint64_t nwidInt = OSUtils::jsonIntHex((*config)["nwid"], 0ULL);
-					const uint64_t memberidInt = OSUtils::jsonIntHex((*config)["id"], 0ULL);
-					if (nwidInt && memberidInt) {
-						nlohmann::json nwOrig;
-						nlohmann::json memOrig;
 
-						nlohmann::json memNew(*config);
-
-						get(nwidInt, nwOrig, memberidInt, memOrig);
-				
-						_memberChanged(memOrig, memNew, qitem.second);
-					} else {
-						fprintf(stderr, "Can't notify of change.  Error parsing nwid or memberid: %llu-%llu\n", (unsigned long long)nwidInt, (unsigned long long)memberidInt);
-					}
-
-				} catch (std::exception &e) {
-					fprintf(stderr, "ERROR: Error updating member: %s\n", e.what());
-				}
-			} else if (objtype == "network") {
-				try {
-					std::string id = (*config)["id"];
-					std::string controllerId = _myAddressStr.c_str();
-					std::string name = (*config)["name"];
-					std::string remoteTraceTarget("NULL");
-					if (!(*config)["remoteTraceTarget"].is_null()) {
-						remoteTraceTarget = (*config)["remoteTraceTarget"];
-					}
-					std::string rulesSource;
-					if ((*config)["rulesSource"].is_string()) {
-						rulesSource = (*config)["rulesSource"];
-					}
-					std::string caps = OSUtils::jsonDump((*config)["capabilitles"], -1);
-					std::string now = std::to_string(OSUtils::now());
-					std::string mtu = std::to_string((int)(*config)["mtu"]);
-					std::string mcastLimit = std::to_string((int)(*config)["multicastLimit"]);
-					std::string rtraceLevel = std::to_string((int)(*config)["remoteTraceLevel"]);
-					std::string rules = OSUtils::jsonDump((*config)["rules"], -1);
-					std::string tags = OSUtils::jsonDump((*config)["tags"], -1);
-					std::string v4mode = OSUtils::jsonDump((*config)["v4AssignMode"],-1);
-					std::string v6mode = OSUtils::jsonDump((*config)["v6AssignMode"], -1);
-					bool enableBroadcast = (*config)["enableBroadcast"];
-					bool isPrivate = (*config)["private"];
-
-					const char *values[16] = {
-						id.c_str(),
-						controllerId.c_str(),
-						caps.c_str(),
-						enableBroadcast ? "true" : "false",
-						now.c_str(),
-						mtu.c_str(),
-						mcastLimit.c_str(),
-						name.c_str(),
-						isPrivate ? "true" : "false",
-						rtraceLevel.c_str(),
-						(remoteTraceTarget == "NULL" ? NULL : remoteTraceTarget.c_str()),
-						rules.c_str(),
-						rulesSource.c_str(),
-						tags.c_str(),
-						v4mode.c_str(),
-						v6mode.c_str(),
-					};
-
-					// This ugly query exists because when we want to mirror networks to/from
-					// another data store (e.g. FileDB or LFDB) it is possible to get a network
-					// that doesn't exist in Central's database. This does an upsert and sets
-					// the owner_id to the "first" global admin in the user DB if the record
-					// did not previously exist. If the record already exists owner_id is left
-					// unchanged, so owner_id should be left out of the update clause.
-					PGresult *res = PQexecParams(conn,
-						"INSERT INTO ztc_network (id, creation_time, owner_id, controller_id, capabilities, enable_broadcast, "
-						"last_modified, mtu, multicast_limit, name, private, "
-						"remote_trace_level, remote_trace_target, rules, rules_source, "
-						"tags, v4_assign_mode, v6_assign_mode) VALUES ("
-						"$1, TO_TIMESTAMP($5::double precision/1000), "
-						"(SELECT user_id AS owner_id FROM ztc_global_permissions WHERE authorize = true AND del = true AND modify = true AND read = true LIMIT 1),"
-						"$2, $3, $4, TO_TIMESTAMP($5::double precision/1000), "
-						"$6, $7, $8, $9, $10, $11, $12, $13, $14, $15, $16) "
-						"ON CONFLICT (id) DO UPDATE set controller_id = EXCLUDED.controller_id, "
-						"capabilities = EXCLUDED.capabilities, enable_broadcast = EXCLUDED.enable_broadcast, "
-						"last_modified = EXCLUDED.last_modified, mtu = EXCLUDED.mtu, "
-						"multicast_limit = EXCLUDED.multicast_limit, name = EXCLUDED.name, "
-						"private = EXCLUDED.private, remote_trace_level = EXCLUDED.remote_trace_level, "
-						"remote_trace_target = EXCLUDED.remote_trace_target, rules = EXCLUDED.rules, "
-						"rules_source = EXCLUDED.rules_source, tags = EXCLUDED.tags, "
-						"v4_assign_mode = EXCLUDED.v4_assign_mode, v6_assign_mode = EXCLUDED.v6_assign_mode",
-						16,
-						NULL,
-						values,
-						NULL,
-						NULL,
-						0);
-					
-					if (PQresultStatus(res) != PGRES_COMMAND_OK) {
-						fprintf(stderr, "ERROR: Error updating network record: %s\n", PQresultErrorMessage(res));
 						PQclear(res);
-						delete config;
-						config = nullptr;
-						continue;
-					}
-
-					PQclear(res);
 
-					res = PQexec(conn, "BEGIN");
-					if (PQresultStatus(res) != PGRES_COMMAND_OK) {
-						fprintf(stderr, "ERROR: Error beginnning transaction: %s\n", PQresultErrorMessage(res));
-						PQclear(res);
-						delete config;
-						config = nullptr;
-						continue;
-					}
+						res = PQexec(conn, "BEGIN");
+						if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+							fprintf(stderr, "ERROR: Error beginnning transaction: %s\n", PQresultErrorMessage(res));
+							PQclear(res);
+							continue;
+						}
 
-					PQclear(res);
-
-					const char *params[1] = {
-						id.c_str()
-					};
-					res = PQexecParams(conn, 
-						"DELETE FROM ztc_network_assignment_pool WHERE network_id = $1",
-						1,
-						NULL,
-						params,
-						NULL,
-						NULL,
-						0);
-					if (PQresultStatus(res) != PGRES_COMMAND_OK) {
-						fprintf(stderr, "ERROR: Error updating assignment pool: %s\n", PQresultErrorMessage(res));
 						PQclear(res);
-						PQclear(PQexec(conn, "ROLLBACK"));
-						delete config;
-						config = nullptr;
-						continue;
-					}
-
-					PQclear(res);
 
-					auto pool = (*config)["ipAssignmentPools"];
-					bool err = false;
-					for (auto i = pool.begin(); i != pool.end(); ++i) {
-						std::string start = (*i)["ipRangeStart"];
-						std::string end = (*i)["ipRangeEnd"];
-						const char *p[3] = {
-							id.c_str(),
-							start.c_str(),
-							end.c_str()
+						const char *params[1] = {
+							id.c_str()
 						};
-
-						res = PQexecParams(conn,
-							"INSERT INTO ztc_network_assignment_pool (network_id, ip_range_start, ip_range_end) "
-							"VALUES ($1, $2, $3)",
-							3,
+						res = PQexecParams(conn, 
+							"DELETE FROM ztc_network_assignment_pool WHERE network_id = $1",
+							1,
 							NULL,
-							p,
+							params,
 							NULL,
 							NULL,
 							0);
 						if (PQresultStatus(res) != PGRES_COMMAND_OK) {
 							fprintf(stderr, "ERROR: Error updating assignment pool: %s\n", PQresultErrorMessage(res));
 							PQclear(res);
-							err = true;
-							break;
+							PQclear(PQexec(conn, "ROLLBACK"));
+							continue;
 						}
-						PQclear(res);
-					}
-					if (err) {
-						PQclear(PQexec(conn, "ROLLBACK"));
-						delete config;
-						config = nullptr;
-						continue;
-					}
 
-					res = PQexecParams(conn, 
-						"DELETE FROM ztc_network_route WHERE network_id = $1",
-						1,
-						NULL,
-						params,
-						NULL,
-						NULL,
-						0);
-
-					if (PQresultStatus(res) != PGRES_COMMAND_OK) {
-						fprintf(stderr, "ERROR: Error updating routes: %s\n", PQresultErrorMessage(res));
 						PQclear(res);
-						PQclear(PQexec(conn, "ROLLBACK"));
-						delete config;
-						config = nullptr;
-						continue;
-					}
 
-
-					auto routes = (*config)["routes"];
-					err = false;
-					for (auto i = routes.begin(); i != routes.end(); ++i) {
-						std::string t = (*i)["target"];
-						std::vector<std::string> target;
-						std::istringstream f(t);
-						std::string s;
-						while(std::getline(f, s, '/')) {
-							target.push_back(s);
+						auto pool = (*config)["ipAssignmentPools"];
+						bool err = false;
+						for (auto i = pool.begin(); i != pool.end(); ++i) {
+							std::string start = (*i)["ipRangeStart"];
+							std::string end = (*i)["ipRangeEnd"];
+							const char *p[3] = {
+								id.c_str(),
+								start.c_str(),
+								end.c_str()
+							};
+
+							res = PQexecParams(conn,
+								"INSERT INTO ztc_network_assignment_pool (network_id, ip_range_start, ip_range_end) "
+								"VALUES ($1, $2, $3)",
+								3,
+								NULL,
+								p,
+								NULL,
+								NULL,
+								0);
+							if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+								fprintf(stderr, "ERROR: Error updating assignment pool: %s\n", PQresultErrorMessage(res));
+								PQclear(res);
+								err = true;
+								break;
+							}
+							PQclear(res);
 						}
-						if (target.empty() || target.size() != 2) {
+						if (err) {
+							PQclear(PQexec(conn, "ROLLBACK"));
 							continue;
 						}
-						std::string targetAddr = target[0];
-						std::string targetBits = target[1];
-						std::string via = "NULL";
-						if (!(*i)["via"].is_null()) {
-							via = (*i)["via"];
-						}
-
-						const char *p[4] = {
-							id.c_str(),
-							targetAddr.c_str(),
-							targetBits.c_str(),
-							(via == "NULL" ? NULL : via.c_str()),
-						};
 
-						res = PQexecParams(conn,
-							"INSERT INTO ztc_network_route (network_id, address, bits, via) VALUES ($1, $2, $3, $4)",
-							4,
+						res = PQexecParams(conn, 
+							"DELETE FROM ztc_network_route WHERE network_id = $1",
+							1,
 							NULL,
-							p,
+							params,
 							NULL,
 							NULL,
 							0);
@@ -1248,96 +1307,148 @@ void PostgreSQL::commitThread()
 						if (PQresultStatus(res) != PGRES_COMMAND_OK) {
 							fprintf(stderr, "ERROR: Error updating routes: %s\n", PQresultErrorMessage(res));
 							PQclear(res);
-							err = true;
-							break;
+							PQclear(PQexec(conn, "ROLLBACK"));
+							continue;
+						}
+
+
+						auto routes = (*config)["routes"];
+						err = false;
+						for (auto i = routes.begin(); i != routes.end(); ++i) {
+							std::string t = (*i)["target"];
+							std::vector<std::string> target;
+							std::istringstream f(t);
+							std::string s;
+							while(std::getline(f, s, '/')) {
+								target.push_back(s);
+							}
+							if (target.empty() || target.size() != 2) {
+								continue;
+							}
+							std::string targetAddr = target[0];
+							std::string targetBits = target[1];
+							std::string via = "NULL";
+							if (!(*i)["via"].is_null()) {
+								via = (*i)["via"];
+							}
+
+							const char *p[4] = {
+								id.c_str(),
+								targetAddr.c_str(),
+								targetBits.c_str(),
+								(via == "NULL" ? NULL : via.c_str()),
+							};
+
+							res = PQexecParams(conn,
+								"INSERT INTO ztc_network_route (network_id, address, bits, via) VALUES ($1, $2, $3, $4)",
+								4,
+								NULL,
+								p,
+								NULL,
+								NULL,
+								0);
+
+							if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+								fprintf(stderr, "ERROR: Error updating routes: %s\n", PQresultErrorMessage(res));
+								PQclear(res);
+								err = true;
+								break;
+							}
+							PQclear(res);
+						}
+						if (err) {
+							PQclear(PQexec(conn, "ROLLBACK"));
+							continue;
+						}
+
+						res = PQexec(conn, "COMMIT");
+						if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+							fprintf(stderr, "ERROR: Error committing network update: %s\n", PQresultErrorMessage(res));
 						}
 						PQclear(res);
-					}
-					if (err) {
-						PQclear(PQexec(conn, "ROLLBACK"));
-						delete config;
-						config = nullptr;
-						continue;
-					}
 
-					res = PQexec(conn, "COMMIT");
-					if (PQresultStatus(res) != PGRES_COMMAND_OK) {
-						fprintf(stderr, "ERROR: Error committing network update: %s\n", PQresultErrorMessage(res));
-					}
-					PQclear(res);
+						const uint64_t nwidInt = OSUtils::jsonIntHex((*config)["nwid"], 0ULL);
+						if (nwidInt) {
+							nlohmann::json nwOrig;
+							nlohmann::json nwNew(*config);
 
-					const uint64_t nwidInt = OSUtils::jsonIntHex((*config)["nwid"], 0ULL);
-					if (nwidInt) {
-						nlohmann::json nwOrig;
-						nlohmann::json nwNew(*config);
+							get(nwidInt, nwOrig);
 
-						get(nwidInt, nwOrig);
+							_networkChanged(nwOrig, nwNew, qitem.notify);
+						} else {
+							fprintf(stderr, "Can't notify network changed: %llu\n", (unsigned long long)nwidInt);
+						}
 
-						_networkChanged(nwOrig, nwNew, qitem.second);
-					} else {
-						fprintf(stderr, "Can't notify network changed: %llu\n", (unsigned long long)nwidInt);
+					} catch (std::exception &e) {
+						fprintf(stderr, "ERROR: Error updating member: %s\n", e.what());
 					}
+				} else if (objtype == "_delete_network") {
+					try {
+						std::string networkId = (*config)["nwid"];
+						const char *values[1] = {
+							networkId.c_str()
+						};
+						PGresult * res = PQexecParams(conn,
+							"UPDATE ztc_network SET deleted = true WHERE id = $1",
+							1,
+							NULL,
+							values,
+							NULL,
+							NULL,
+							0);
+						
+						if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+							fprintf(stderr, "ERROR: Error deleting network: %s\n", PQresultErrorMessage(res));
+						}
 
-				} catch (std::exception &e) {
-					fprintf(stderr, "ERROR: Error updating member: %s\n", e.what());
-				}
-			} else if (objtype == "_delete_network") {
-				try {
-					std::string networkId = (*config)["nwid"];
-					const char *values[1] = {
-						networkId.c_str()
-					};
-					PGresult * res = PQexecParams(conn,
-						"UPDATE ztc_network SET deleted = true WHERE id = $1",
-						1,
-						NULL,
-						values,
-						NULL,
-						NULL,
-						0);
-					
-					if (PQresultStatus(res) != PGRES_COMMAND_OK) {
-						fprintf(stderr, "ERROR: Error deleting network: %s\n", PQresultErrorMessage(res));
+						PQclear(res);
+					} catch (std::exception &e) {
+						fprintf(stderr, "ERROR: Error deleting network: %s\n", e.what());
 					}
+				} else if (objtype == "_delete_member") {
+					try {
+						std::string memberId = (*config)["id"];
+						std::string networkId = (*config)["nwid"];
 
-					PQclear(res);
-				} catch (std::exception &e) {
-					fprintf(stderr, "ERROR: Error deleting network: %s\n", e.what());
-				}
-			} else if (objtype == "_delete_member") {
-				try {
-					std::string memberId = (*config)["id"];
-					std::string networkId = (*config)["nwid"];
-
-					const char *values[2] = {
-						memberId.c_str(),
-						networkId.c_str()
-					};
-
-					PGresult *res = PQexecParams(conn,
-						"UPDATE ztc_member SET hidden = true, deleted = true WHERE id = $1 AND network_id = $2",
-						2,
-						NULL,
-						values,
-						NULL,
-						NULL,
-						0);
-
-					if (PQresultStatus(res) != PGRES_COMMAND_OK) {
-						fprintf(stderr, "ERROR: Error deleting member: %s\n", PQresultErrorMessage(res));
-					}
+						const char *values[2] = {
+							memberId.c_str(),
+							networkId.c_str()
+						};
 
-					PQclear(res);
-				} catch (std::exception &e) {
-					fprintf(stderr, "ERROR: Error deleting member: %s\n", e.what());
+						PGresult *res = PQexecParams(conn,
+							"UPDATE ztc_member SET hidden = true, deleted = true WHERE id = $1 AND network_id = $2",
+							2,
+							NULL,
+							values,
+							NULL,
+							NULL,
+							0);
+
+						if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+							fprintf(stderr, "ERROR: Error deleting member: %s\n", PQresultErrorMessage(res));
+						}
+
+						PQclear(res);
+					} catch (std::exception &e) {
+						fprintf(stderr, "ERROR: Error deleting member: %s\n", e.what());
+					}
+				} else {
+					fprintf(stderr, "ERROR: unknown objtype");
 				}
-			} else {
-				fprintf(stderr, "ERROR: unknown objtype");
+			} catch (std::exception &e) {
+				fprintf(stderr, "ERROR: Error getting objtype: %s\n", e.what());
 			}
-		} catch (std::exception &e) {
-			fprintf(stderr, "ERROR: Error getting objtype: %s\n", e.what());
 		}
 
+		const int64_t now = OSUtils::now();
+		int64_t latency = 0;
+		for(auto q=batch.begin();q!=batch.end();++q)
+			latency += now - q->enqueued;
+		latency /= (int64_t)batch.size();
+		const int64_t prevLatency = _commitLatency;
+		_commitLatency = (prevLatency) ? (((prevLatency * 7) + latency) / 8) : latency;
+		batch.clear();
+
 		std::this_thread::sleep_for(std::chrono::milliseconds(10));
 	}
 
@@ -1358,8 +1469,7 @@ void PostgreSQL::onlineNotificationThread()
 	}
 	_connected = 1;
 
-	//int64_t	lastUpdatedNetworkStatus = 0;
-	std::unordered_map< std::pair<uint64_t,uint64_t>,int64_t,_PairHasher > lastOnlineCumulative;
+	std::vector<OnlineRecord> records;
 
 	while (_run == 1) {
 		if (PQstatus(conn) != CONNECTION_OK) {
@@ -1368,100 +1478,47 @@ void PostgreSQL::onlineNotificationThread()
 			exit(5);
 		}
 
-		// map used to send notifications to front end
-		std::unordered_map<std::string, std::vector<std::string>> updateMap;
-
 		std::unordered_map< std::pair<uint64_t,uint64_t>,std::pair<int64_t,InetAddress>,_PairHasher > lastOnline;
 		{
 			std::lock_guard<std::mutex> l(_lastOnline_l);
 			lastOnline.swap(_lastOnline);
 		}
 
-		PGresult *res = NULL;
-
-		std::stringstream memberUpdate;
-		memberUpdate << "INSERT INTO ztc_member_status (network_id, member_id, address, last_updated) VALUES ";
-		bool firstRun = true;
-		bool memberAdded = false;
-		for (auto i=lastOnline.begin(); i != lastOnline.end(); ++i) {
-			uint64_t nwid_i = i->first.first;
-			char nwidTmp[64];
-			char memTmp[64];
-			char ipTmp[64];
-			OSUtils::ztsnprintf(nwidTmp,sizeof(nwidTmp), "%.16llx", nwid_i);
-			OSUtils::ztsnprintf(memTmp,sizeof(memTmp), "%.10llx", i->first.second);
-
-			auto found = _networks.find(nwid_i);
-			if (found == _networks.end()) {
-				continue; // skip members trying to join non-existant networks
-			}
-			
-			std::string networkId(nwidTmp);
-			std::string memberId(memTmp);
-			
-			std::vector<std::string> &members = updateMap[networkId];
-			members.push_back(memberId);
-
-			lastOnlineCumulative[i->first] = i->second.first;
-			
-			
-			const char *qvals[2] = {
-				networkId.c_str(),
-				memberId.c_str()
-			};
-
-			res = PQexecParams(conn,
-				"SELECT id, network_id FROM ztc_member WHERE network_id = $1 AND id = $2",
-				2,
-				NULL,
-				qvals,
-				NULL,
-				NULL,
-				0);
-
-			if (PQresultStatus(res) != PGRES_TUPLES_OK) {
-				fprintf(stderr, "Member count failed: %s", PQerrorMessage(conn));
-				PQclear(res);
-				continue;
-			}
-
-			int nrows = PQntuples(res);
-			PQclear(res);
-
-			if (nrows == 1) {
-				int64_t ts = i->second.first;
-				std::string ipAddr = i->second.second.toIpString(ipTmp);
-				std::string timestamp = std::to_string(ts);
-				
-				if (firstRun) {
-					firstRun = false;
-				} else {
-					memberUpdate << ", ";
+		// Only members we know about are written; the in-memory network and member
+		// maps mirror ztc_network and ztc_member so no per-member query is needed.
+		records.clear();
+		if (!lastOnline.empty()) {
+			std::unordered_map< uint64_t,std::shared_ptr<_Network> > nws;
+			{
+				RWMutex::RLock l(_networks_l);
+				for (auto i=lastOnline.begin(); i != lastOnline.end(); ++i) {
+					if (nws.find(i->first.first) == nws.end()) {
+						auto found = _networks.find(i->first.first);
+						nws[i->first.first] = (found == _networks.end()) ? std::shared_ptr<_Network>() : found->second;
+					}
 				}
-
-				memberUpdate << "('" << networkId << "', '" << memberId << "', ";
-				if (ipAddr.empty()) {
-					memberUpdate << "NULL, ";
-				} else {
-					memberUpdate << "'" << ipAddr << "', ";
+			}
+			for (auto i=lastOnline.begin(); i != lastOnline.end(); ++i) {
+				const std::shared_ptr<_Network> &nw = nws[i->first.first];
+				if (!nw)
+					continue; // skip members trying to join non-existant networks
+				{
+					RWMutex::RLock l2(nw->lock);
+					if (nw->members.find(i->first.second) == nw->members.end())
+						continue;
 				}
-				memberUpdate << "TO_TIMESTAMP(" << timestamp << "::double precision/1000))";
-				memberAdded = true;
-			} else if (nrows > 1) {
-				fprintf(stderr, "nrows > 1?!?");
-				continue;
-			} else {
-				continue;
+				records.push_back(OnlineRecord());
+				OnlineRecord &r = records.back();
+				r.networkId = i->first.first;
+				r.memberId = i->first.second;
+				r.lastSeen = i->second.first;
+				r.physicalAddress = i->second.second;
 			}
 		}
-		memberUpdate << " ON CONFLICT (network_id, member_id) DO UPDATE SET address = EXCLUDED.address, last_updated = EXCLUDED.last_updated;";
 
-		if (memberAdded) {
-			res = PQexec(conn, memberUpdate.str().c_str());
-			if (PQresultStatus(res) != PGRES_COMMAND_OK) {
-				fprintf(stderr, "Multiple insert failed: %s", PQerrorMessage(conn));
-			}
-			PQclear(res);
+		if (!records.empty()) {
+			if (upsertMemberStatus(conn, records) < 0)
+				fprintf(stderr, "Member status upsert failed: %s", PQerrorMessage(conn));
 		}
 
 		std::this_thread::sleep_for(std::chrono::milliseconds(10));
@@ -1474,6 +1531,69 @@ void PostgreSQL::onlineNotificationThread()
 	}
 }
 
+long PostgreSQL::upsertMemberStatus(PGconn *conn,const std::vector<OnlineRecord> &records)
+{
+	long written = 0;
+	std::string nwids,mids,addrs,times;
+	char tmp[64];
+	for(size_t b=0;b<records.size();b+=ZT_CENTRAL_ONLINE_UPSERT_BATCH) {
+		const size_t e = std::min(records.size(),b + ZT_CENTRAL_ONLINE_UPSERT_BATCH);
+		nwids = "{";
+		mids = "{";
+		addrs = "{";
+		times = "{";
+		for(size_t i=b;i<e;++i) {
+			if (i != b) {
+				nwids.push_back(',');
+				mids.push_back(',');
+				addrs.push_back(',');
+				times.push_back(',');
+			}
+			OSUtils::ztsnprintf(tmp,sizeof(tmp),"%.16llx",(unsigned long long)records[i].networkId);
+			nwids.append(tmp);
+			OSUtils::ztsnprintf(tmp,sizeof(tmp),"%.10llx",(unsigned long long)records[i].memberId);
+			mids.append(tmp);
+			if (records[i].physicalAddress) {
+				addrs.push_back('"');
+				addrs.append(records[i].physicalAddress.toIpString(tmp));
+				addrs.push_back('"');
+			} else {
+				addrs.append("NULL");
+			}
+			OSUtils::ztsnprintf(tmp,sizeof(tmp),"%lld",(long long)records[i].lastSeen);
+			times.append(tmp);
+		}
+		nwids.push_back('}');
+		mids.push_back('}');
+		addrs.push_back('}');
+		times.push_back('}');
+
+		const char *values[4] = {
+			nwids.c_str(),
+			mids.c_str(),
+			addrs.c_str(),
+			times.c_str()
+		};
+		PGresult *res = PQexecParams(conn,
+			"INSERT INTO ztc_member_status (network_id, member_id, address, last_updated) "
+			"SELECT t.network_id, t.member_id, t.address, TO_TIMESTAMP(t.ts::double precision/1000) "
+			"FROM UNNEST($1::text[], $2::text[], $3::inet[], $4::bigint[]) AS t(network_id, member_id, address, ts) "
+			"ON CONFLICT (network_id, member_id) DO UPDATE SET address = EXCLUDED.address, last_updated = EXCLUDED.last_updated",
+			4,
+			NULL,
+			values,
+			NULL,
+			NULL,
+			0);
+		const bool ok = (PQresultStatus(res) == PGRES_COMMAND_OK);
+		PQclear(res);
+		if (!ok)
+			return -1;
+		written += (long)(e - b);
+	}
+	return written;
+}
+
 PGconn *PostgreSQL::getPgConn(OverrideMode m)
 {
 	if (m == ALLOW_PGBOUNCER_OVERRIDE) {
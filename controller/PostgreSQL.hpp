@@ -33,6 +33,15 @@
 
 #define ZT_CENTRAL_CONTROLLER_COMMIT_THREADS 4
 
+// Maximum rows sent to ztc_member_status in one upsert statement
+#define ZT_CENTRAL_ONLINE_UPSERT_BATCH 10000
+
+// Maximum queued records committed together by one commit thread
+#define ZT_CENTRAL_COMMIT_BATCH 256
+
+// Interval in ms between commit queue reports from the heartbeat thread
+#define ZT_CENTRAL_COMMIT_REPORT_INTERVAL 60000
+
 extern "C" {
 typedef struct pg_conn PGconn;
 }
@@ -60,6 +69,40 @@ public:
 	virtual void eraseMember(const uint64_t networkId, const uint64_t memberId);
 	virtual void nodeIsOnline(const uint64_t networkId, const uint64_t memberId, const InetAddress &physicalAddress);
 
+	/**
+	 * A member's most recent check-in, as written to ztc_member_status
+	 */
+	struct OnlineRecord
+	{
+		uint64_t networkId;
+		uint64_t memberId;
+		int64_t lastSeen;
+		InetAddress physicalAddress;
+	};
+
+	/**
+	 * Upsert member online status with one set-based statement per batch
+	 *
+	 * Records are passed as arrays and unnested server side, so each batch of
+	 * up to ZT_CENTRAL_ONLINE_UPSERT_BATCH rows costs a single round trip.
+	 * Each (network, member) pair may appear at most once.
+	 *
+	 * @param conn Database connection
+	 * @param records Records to write
+	 * @return Number of rows written or -1 on error
+	 */
+	static long upsertMemberStatus(PGconn *conn,const std::vector<OnlineRecord> &records);
+
+	/**
+	 * @return Records waiting to be written by the commit threads
+	 */
+	inline unsigned long commitQueueDepth() const { return _commitQueue.size(); }
+
+	/**
+	 * @return Smoothed time in ms between save() and database commit
+	 */
+	inline int64_t commitLatency() const { return (int64_t)_commitLatency; }
+
 protected:
 	struct _PairHasher
 	{
@@ -92,7 +135,18 @@ private:
 	std::string _myAddressStr;
 	std::string _connString;
 
-	BlockingQueue< std::pair<nlohmann::json,bool> > _commitQueue;
+	struct _CommitQueueItem
+	{
+		_CommitQueueItem() : notify(false),enqueued(0) {}
+		_CommitQueueItem(const nlohmann::json &r,const bool n) : record(r),notify(n),enqueued(OSUtils::now()) {}
+
+		nlohmann::json record;
+		bool notify;
+		int64_t enqueued;
+	};
+
+	BlockingQueue<_CommitQueueItem> _commitQueue;
+	std::atomic<int64_t> _commitLatency;
 
 	std::thread _heartbeatThread;
 	std::thread _membersDbWatcher;
@@ -1,14 +1,18 @@
-#include "crypto_sign.h"
+#include <string.h>
+/*#include "crypto_sign.h"
 
 #include "crypto_verify_32.h"
 #include "crypto_hash_sha512.h"
-#include "randombytes.h"
+#include "randombytes.h"*/
 
 #include "ge25519.h"
 #include "hram.h"
 
 #define MAXBATCH 64
 
+/* Original */
+#if 0
+
 int crypto_sign_open_batch(
     unsigned char* const m[],unsigned long long mlen[],
     unsigned char* const sm[],const unsigned long long smlen[],
@@ -92,3 +96,52 @@ int crypto_sign_open_batch(
 
   return ret;
 }
+#endif
+
+/* Checks 2..MAXBATCH ZeroTier signatures (see open.c) with one multi-scalar
+ * multiplication: sum(z[i]*S[i])B - sum(z[i]*H[i]*A[i]) - sum(z[i]*R[i]) must
+ * be the neutral element, where z[i] are 128-bit random coefficients taken
+ * from rnd (16 bytes per signature). Returns 0 if every signature is valid.
+ * Nonzero means at least one is bad and the caller must check them one by
+ * one. The caller checks each message digest. */
+extern int ed25519_amd64_asm_verify_batch(const unsigned char *const *pk,const unsigned char *const *sig,const unsigned char *rnd,unsigned long num)
+{
+  shortsc25519 r[MAXBATCH];
+  sc25519 scalars[2*MAXBATCH+1];
+  ge25519 points[2*MAXBATCH+1];
+  unsigned char hram[64];
+  unsigned char playground[96];
+  unsigned long i;
+
+  if ((num < 2)||(num > MAXBATCH))
+    return -1;
+
+  memcpy(r,rnd,sizeof(shortsc25519) * num);
+
+  for(i=0;i<num;i++)
+  {
+    sc25519_from32bytes(&scalars[i], sig[i]+32);
+    sc25519_mul_shortsc(&scalars[i], &scalars[i], &r[i]);
+  }
+  for(i=1;i<num;i++)
+    sc25519_add(&scalars[0], &scalars[0], &scalars[i]);
+
+  for(i=0;i<num;i++)
+  {
+    get_hram(hram, sig[i], pk[i], playground, 96);
+    sc25519_from64bytes(&scalars[i+1],hram);
+    sc25519_mul_shortsc(&scalars[i+1],&scalars[i+1],&r[i]);
+  }
+  for(i=0;i<num;i++)
+    sc25519_from_shortsc(&scalars[num+i+1],&r[i]);
+
+  points[0] = ge25519_base;
+  for(i=0;i<num;i++)
+    if (ge25519_unpackneg_vartime(&points[i+1], pk[i])) return -1;
+  for(i=0;i<num;i++)
+    if (ge25519_unpackneg_vartime(&points[num+i+1], sig[i])) return -1;
+
+  ge25519_multi_scalarmult_vartime(points, points, scalars, 2*num+1);
+
+  return ge25519_isneutral_vartime(points) ? 0 : -1;
+}
@@ -1,8 +1,12 @@
 #include <string.h>
-#include "crypto_sign.h"
+/*#include "crypto_sign.h"
 #include "crypto_verify_32.h"
-#include "crypto_hash_sha512.h"
+#include "crypto_hash_sha512.h"*/
 #include "ge25519.h"
+#include "hram.h"
+
+/* Original */
+#if 0
 
 int crypto_sign_open(
     unsigned char *m,unsigned long long *mlen,
@@ -47,3 +51,32 @@ badsig:
   memset(m,0,smlen);
   return -1;
 }
+#endif
+
+/* ZeroTier signatures are R(32) | S(32) | first 32 bytes of SHA-512(msg), and
+ * H(R,A,M) is computed over R | A | digest. The caller checks the digest. This
+ * must accept exactly what the portable C25519::verify() accepts. */
+extern int ed25519_amd64_asm_verify(const unsigned char *pk,const unsigned char *sig)
+{
+  unsigned char hram[64];
+  unsigned char playground[96];
+  unsigned char rcheck[32];
+  ge25519 get1, get2;
+  sc25519 schram, scs;
+  unsigned int i;
+  unsigned char d = 0;
+
+  if (ge25519_unpackneg_vartime(&get1,pk))
+    return -1;
+
+  get_hram(hram,sig,pk,playground,96);
+  sc25519_from64bytes(&schram, hram);
+  sc25519_from32bytes(&scs, sig+32);
+
+  ge25519_double_scalarmult_vartime(&get2, &get1, &schram, &scs);
+  ge25519_pack(rcheck, &get2);
+
+  for(i=0;i<32;i++)
+    d |= rcheck[i] ^ sig[i];
+  return (d == 0) ? 0 : -1;
+}
@@ -94,6 +94,14 @@ extern "C" {
  */
 #define ZT_MAX_MTU 10000
 
+/**
+ * Writable space guaranteed to precede each frame passed to a ZT_VirtualNetworkFrameBatchFunction
+ *
+ * This is enough for a link-layer (e.g. Ethernet) header to be built in
+ * place in front of the frame so it can be written out without a copy.
+ */
+#define ZT_VIRTUAL_NETWORK_FRAME_HEADROOM 16
+
 /**
  * Minimum UDP payload size allowed
  */
@@ -455,6 +463,16 @@ enum ZT_MultipathMode
 	 * Will cease sending traffic over links that appear to be stale.
 	 */
 	ZT_MULTIPATH_PROPORTIONALLY_BALANCED = 2,
+
+	/**
+	 * Traffic flows are pinned to paths by a hash of their 5-tuple.
+	 *
+	 * Flows are only moved between paths at idle gaps (flowlets), at which
+	 * point a new path is chosen according to the same allocation used by
+	 * ZT_MULTIPATH_PROPORTIONALLY_BALANCED. This avoids reordering packets
+	 * within a flow across paths of differing latency.
+	 */
+	ZT_MULTIPATH_BALANCE_FLOW_HASH = 3,
 };
 
 /**
@@ -1507,6 +1525,71 @@ typedef void (*ZT_VirtualNetworkFrameFunction)(
 	const void *,                          /* Frame data */
 	unsigned int);                         /* Frame length */
 
+/**
+ * A frame to be sent out to a virtual network port as part of a batch
+ */
+typedef struct
+{
+	/**
+	 * Network ID
+	 */
+	uint64_t nwid;
+
+	/**
+	 * Network user PTR as it was when the frame was received
+	 *
+	 * The network may have been left since, so this is a copy of the value
+	 * and not the modifiable pointer passed to other callbacks. Don't assume
+	 * whatever it pointed to still exists without checking.
+	 */
+	void *nuptr;
+
+	/**
+	 * Source MAC
+	 */
+	uint64_t sourceMac;
+
+	/**
+	 * Destination MAC
+	 */
+	uint64_t destMac;
+
+	/**
+	 * Ethernet type
+	 */
+	unsigned int etherType;
+
+	/**
+	 * VLAN ID (0 for none)
+	 */
+	unsigned int vlanId;
+
+	/**
+	 * Frame data, preceded by ZT_VIRTUAL_NETWORK_FRAME_HEADROOM bytes of writable space
+	 */
+	void *data;
+
+	/**
+	 * Frame length
+	 */
+	unsigned int len;
+} ZT_VirtualNetworkFrame;
+
+/**
+ * Function to send a batch of frames out to virtual network ports
+ *
+ * Parameters: (1) node, (2) user ptr, (3) thread ptr, (4) array of
+ * frames, (5) number of frames. Frames may be for different networks
+ * but are given in the order in which they were received. Frame data
+ * is only valid for the duration of the call.
+ */
+typedef void (*ZT_VirtualNetworkFrameBatchFunction)(
+	ZT_Node *,                             /* Node */
+	void *,                                /* User ptr */
+	void *,                                /* Thread ptr */
+	ZT_VirtualNetworkFrame *,              /* Frames */
+	unsigned int);                         /* Number of frames */
+
 /**
  * Callback for events
  *
@@ -1653,7 +1736,7 @@ typedef int (*ZT_PathLookupFunction)(
 struct ZT_Node_Callbacks
 {
 	/**
-	 * Struct version -- must currently be 0
+	 * Struct version -- must currently be 0 or 1 (1 adds virtualNetworkFrameBatchFunction)
 	 */
 	long version;
 
@@ -1696,6 +1779,19 @@ struct ZT_Node_Callbacks
 	 * OPTIONAL: Function to get hints to physical paths to ZeroTier addresses
 	 */
 	ZT_PathLookupFunction pathLookupFunction;
+
+	/**
+	 * OPTIONAL (version 1+): Function to inject batches of frames into virtual networks' TAPs
+	 *
+	 * If this is set, frames decoded by ZT_Node_processWirePacket() are held
+	 * per calling thread and delivered through this function when that thread
+	 * calls ZT_Node_flushFrames() or the batch fills up. A batch is only ever
+	 * delivered by the node it belongs to, so a thread that serves several
+	 * nodes should flush each before moving on to the next; otherwise its
+	 * frames wait until it next runs on that thread. Frames generated in any
+	 * other context still go to virtualNetworkFrameFunction.
+	 */
+	ZT_VirtualNetworkFrameBatchFunction virtualNetworkFrameBatchFunction;
 };
 
 /**
@@ -1777,6 +1873,21 @@ ZT_SDK_API enum ZT_ResultCode ZT_Node_processVirtualNetworkFrame(
 	unsigned int frameLength,
 	volatile int64_t *nextBackgroundTaskDeadline);
 
+/**
+ * Deliver any frames batched by the calling thread
+ *
+ * This only does anything if virtualNetworkFrameBatchFunction was supplied,
+ * in which case it must be called by each thread that calls
+ * ZT_Node_processWirePacket() once it is done with its current group of
+ * packets (e.g. after each I/O poll iteration). HELLOs from new peers
+ * received in the same window are also finished here, after their key
+ * agreements are computed together.
+ *
+ * @param node Node instance
+ * @param tptr Thread pointer to pass to functions/callbacks resulting from this call
+ */
+ZT_SDK_API void ZT_Node_flushFrames(ZT_Node *node,void *tptr);
+
 /**
  * Perform periodic background operations
  *
@@ -0,0 +1,127 @@
+/*
+ * ZeroTier One - Network Virtualization Everywhere
+ * Copyright (C) 2011-2019  ZeroTier, Inc.  https://www.zerotier.com/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * --
+ *
+ * You can be released from the requirements of the license by purchasing
+ * a commercial license. Buying such a license is mandatory as soon as you
+ * develop commercial closed-source software that incorporates or links
+ * directly against ZeroTier software without disclosing the source code
+ * of your own application.
+ */
+
+
+#ifndef ZT_ADAPTIVECOMPRESSION_HPP
+#define ZT_ADAPTIVECOMPRESSION_HPP
+
+#include <stdint.h>
+
+#include <atomic>
+
+#include "Constants.hpp"
+
+namespace ZeroTier {
+
+/**
+ * Decides whether frames to a peer on a given network are worth compressing
+ *
+ * Compression results are sampled over windows of ZT_COMPRESSION_SAMPLE_WINDOW
+ * packets. If a window saves less than 1/ZT_COMPRESSION_MIN_SAVINGS_DIVISOR of
+ * its bytes (e.g. TLS or already-compressed traffic) compression is switched
+ * off for a back-off period that doubles each time compression is retried and
+ * still does not pay. Any window that does pay resets the back-off.
+ *
+ * All state is atomic so this can be shared by any number of sending threads.
+ * Concurrent updates may occasionally lose a sample, which only affects the
+ * heuristic, never correctness.
+ */
+class AdaptiveCompression
+{
+public:
+	AdaptiveCompression() :
+		_nwid(0),
+		_backoffUntil(0),
+		_backoff(0),
+		_samples(0),
+		_inBytes(0),
+		_outBytes(0)
+	{
+	}
+
+	/**
+	 * @param nwid Network ID
+	 * @param now Current time
+	 * @return True if the next packet on this network should be compressed
+	 */
+	inline bool shouldCompress(const uint64_t nwid,const int64_t now)
+	{
+		if (_nwid.load(std::memory_order_relaxed) != nwid) {
+			// Slot is being taken over by another network, so start over
+			_nwid.store(nwid,std::memory_order_relaxed);
+			_backoffUntil.store(0,std::memory_order_relaxed);
+			_backoff.store(0,std::memory_order_relaxed);
+			_samples.store(0,std::memory_order_relaxed);
+			_inBytes.store(0,std::memory_order_relaxed);
+			_outBytes.store(0,std::memory_order_relaxed);
+			return true;
+		}
+		return (now >= _backoffUntil.load(std::memory_order_relaxed));
+	}
+
+	/**
+	 * Record the result of compressing a packet
+	 *
+	 * @param inLen Payload length before compression
+	 * @param outLen Payload length after compression (inLen if it did not shrink)
+	 * @param now Current time
+	 */
+	inline void sample(const unsigned int inLen,const unsigned int outLen,const int64_t now)
+	{
+		_inBytes.fetch_add(inLen,std::memory_order_relaxed);
+		_outBytes.fetch_add(outLen,std::memory_order_relaxed);
+		if ((_samples.fetch_add(1,std::memory_order_relaxed) + 1) == ZT_COMPRESSION_SAMPLE_WINDOW) {
+			const uint64_t in = _inBytes.exchange(0,std::memory_order_relaxed);
+			const uint64_t out = _outBytes.exchange(0,std::memory_order_relaxed);
+			_samples.store(0,std::memory_order_relaxed);
+			if (((out < in) ? (in - out) : 0) * ZT_COMPRESSION_MIN_SAVINGS_DIVISOR < in) {
+				int64_t b = _backoff.load(std::memory_order_relaxed);
+				b = (b) ? ((b < (ZT_COMPRESSION_BACKOFF_MAX / 2)) ? (b * 2) : ZT_COMPRESSION_BACKOFF_MAX) : ZT_COMPRESSION_BACKOFF_MIN;
+				_backoff.store(b,std::memory_order_relaxed);
+				_backoffUntil.store(now + b,std::memory_order_relaxed);
+			} else {
+				_backoff.store(0,std::memory_order_relaxed);
+			}
+		}
+	}
+
+	/**
+	 * @return Current back-off period in milliseconds or 0 if compression is paying off
+	 */
+	inline int64_t backoff() const { return _backoff.load(std::memory_order_relaxed); }
+
+private:
+	std::atomic<uint64_t> _nwid;
+	std::atomic<int64_t> _backoffUntil;
+	std::atomic<int64_t> _backoff;
+	std::atomic<unsigned int> _samples;
+	std::atomic<uint64_t> _inBytes;
+	std::atomic<uint64_t> _outBytes;
+};
+
+} // namespace ZeroTier
+
+#endif
@@ -18,6 +18,10 @@ Derived from public domain code by D. J. Bernstein.
 #include "Hashtable.hpp"
 #include "Mutex.hpp"
 
+#if defined(__GNUC__) && (defined(__amd64) || defined(__amd64__) || defined(__x86_64) || defined(__x86_64__) || defined(__AMD64) || defined(__AMD64__)) && !defined(ZT_NO_AVX2)
+#include <immintrin.h>
+#endif
+
 #ifdef __WINDOWS__
 #pragma warning(disable: 4146)
 #endif
@@ -743,10 +747,572 @@ static void crypto_scalarmult(u8 *mypublic, const u8 *secret, const u8 *basepoin
   fcontract(mypublic, z);
 }
 
+
+//////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////
+
+// 64-bit radix 2^51 version, from curve25519-donna-c64 by Adam Langley (public
+// domain). Limbs hold 51 bits so a field multiply is 25 64x64->128 products
+// instead of 100 32x32->64 ones above. This is used wherever the compiler has
+// a 128-bit integer type.
+
+#if defined(__SIZEOF_INT128__)
+#define ZT_C25519_RADIX51 1
+
+namespace r51 {
+
+typedef uint64_t felem[5];
+typedef unsigned __int128 uint128_t;
+
+static const uint64_t MASK51 = 0x7ffffffffffffULL;
+
+static inline void fsum(felem output, const felem in) {
+  output[0] += in[0];
+  output[1] += in[1];
+  output[2] += in[2];
+  output[3] += in[3];
+  output[4] += in[4];
+}
+
+/* out = in - out. Assumes out[i] < 2^52, on return out[i] < 2^55 */
+static inline void fdifference_backwards(felem out, const felem in) {
+  /* 152 is 19 << 3 */
+  static const uint64_t two54m152 = (((uint64_t)1) << 54) - 152;
+  static const uint64_t two54m8 = (((uint64_t)1) << 54) - 8;
+  out[0] = in[0] + two54m152 - out[0];
+  out[1] = in[1] + two54m8 - out[1];
+  out[2] = in[2] + two54m8 - out[2];
+  out[3] = in[3] + two54m8 - out[3];
+  out[4] = in[4] + two54m8 - out[4];
+}
+
+static inline void fscalar_product(felem output, const felem in, const uint64_t scalar) {
+  uint128_t a;
+  a = ((uint128_t)in[0]) * scalar;
+  output[0] = ((uint64_t)a) & MASK51;
+  a = ((uint128_t)in[1]) * scalar + ((uint64_t)(a >> 51));
+  output[1] = ((uint64_t)a) & MASK51;
+  a = ((uint128_t)in[2]) * scalar + ((uint64_t)(a >> 51));
+  output[2] = ((uint64_t)a) & MASK51;
+  a = ((uint128_t)in[3]) * scalar + ((uint64_t)(a >> 51));
+  output[3] = ((uint64_t)a) & MASK51;
+  a = ((uint128_t)in[4]) * scalar + ((uint64_t)(a >> 51));
+  output[4] = ((uint64_t)a) & MASK51;
+  output[0] += ((uint64_t)(a >> 51)) * 19;
+}
+
+/* Inputs < 2^55 per limb, output < 2^52. Output may alias either input. */
+static inline void fmul(felem output, const felem in2, const felem in) {
+  uint128_t t[5];
+  uint64_t r0,r1,r2,r3,r4,s0,s1,s2,s3,s4,c;
+
+  r0 = in[0]; r1 = in[1]; r2 = in[2]; r3 = in[3]; r4 = in[4];
+  s0 = in2[0]; s1 = in2[1]; s2 = in2[2]; s3 = in2[3]; s4 = in2[4];
+
+  t[0] = ((uint128_t)r0) * s0;
+  t[1] = ((uint128_t)r0) * s1 + ((uint128_t)r1) * s0;
+  t[2] = ((uint128_t)r0) * s2 + ((uint128_t)r2) * s0 + ((uint128_t)r1) * s1;
+  t[3] = ((uint128_t)r0) * s3 + ((uint128_t)r3) * s0 + ((uint128_t)r1) * s2 + ((uint128_t)r2) * s1;
+  t[4] = ((uint128_t)r0) * s4 + ((uint128_t)r4) * s0 + ((uint128_t)r3) * s1 + ((uint128_t)r1) * s3 + ((uint128_t)r2) * s2;
+
+  r4 *= 19; r1 *= 19; r2 *= 19; r3 *= 19;
+
+  t[0] += ((uint128_t)r4) * s1 + ((uint128_t)r1) * s4 + ((uint128_t)r2) * s3 + ((uint128_t)r3) * s2;
+  t[1] += ((uint128_t)r4) * s2 + ((uint128_t)r2) * s4 + ((uint128_t)r3) * s3;
+  t[2] += ((uint128_t)r4) * s3 + ((uint128_t)r3) * s4;
+  t[3] += ((uint128_t)r4) * s4;
+
+  r0 = (uint64_t)t[0] & MASK51; c = (uint64_t)(t[0] >> 51);
+  t[1] += c; r1 = (uint64_t)t[1] & MASK51; c = (uint64_t)(t[1] >> 51);
+  t[2] += c; r2 = (uint64_t)t[2] & MASK51; c = (uint64_t)(t[2] >> 51);
+  t[3] += c; r3 = (uint64_t)t[3] & MASK51; c = (uint64_t)(t[3] >> 51);
+  t[4] += c; r4 = (uint64_t)t[4] & MASK51; c = (uint64_t)(t[4] >> 51);
+  r0 += c * 19; c = r0 >> 51; r0 = r0 & MASK51;
+  r1 += c; c = r1 >> 51; r1 = r1 & MASK51;
+  r2 += c;
+
+  output[0] = r0; output[1] = r1; output[2] = r2; output[3] = r3; output[4] = r4;
+}
+
+/* Square count times. Same bounds as fmul(). */
+static inline void fsquare_times(felem output, const felem in, unsigned int count) {
+  uint128_t t[5];
+  uint64_t r0,r1,r2,r3,r4,c;
+  uint64_t d0,d1,d2,d4,d419;
+
+  r0 = in[0]; r1 = in[1]; r2 = in[2]; r3 = in[3]; r4 = in[4];
+
+  do {
+    d0 = r0 * 2;
+    d1 = r1 * 2;
+    d2 = r2 * 2 * 19;
+    d419 = r4 * 19;
+    d4 = d419 * 2;
+
+    t[0] = ((uint128_t)r0) * r0 + ((uint128_t)d4) * r1 + (((uint128_t)d2) * (r3));
+    t[1] = ((uint128_t)d0) * r1 + ((uint128_t)d4) * r2 + (((uint128_t)r3) * (r3 * 19));
+    t[2] = ((uint128_t)d0) * r2 + ((uint128_t)r1) * r1 + (((uint128_t)d4) * (r3));
+    t[3] = ((uint128_t)d0) * r3 + ((uint128_t)d1) * r2 + (((uint128_t)r4) * (d419));
+    t[4] = ((uint128_t)d0) * r4 + ((uint128_t)d1) * r3 + (((uint128_t)r2) * (r2));
+
+    r0 = (uint64_t)t[0] & MASK51; c = (uint64_t)(t[0] >> 51);
+    t[1] += c; r1 = (uint64_t)t[1] & MASK51; c = (uint64_t)(t[1] >> 51);
+    t[2] += c; r2 = (uint64_t)t[2] & MASK51; c = (uint64_t)(t[2] >> 51);
+    t[3] += c; r3 = (uint64_t)t[3] & MASK51; c = (uint64_t)(t[3] >> 51);
+    t[4] += c; r4 = (uint64_t)t[4] & MASK51; c = (uint64_t)(t[4] >> 51);
+    r0 += c * 19; c = r0 >> 51; r0 = r0 & MASK51;
+    r1 += c; c = r1 >> 51; r1 = r1 & MASK51;
+    r2 += c;
+  } while (--count);
+
+  output[0] = r0; output[1] = r1; output[2] = r2; output[3] = r3; output[4] = r4;
+}
+
+static inline uint64_t load_limb(const u8 *in) {
+  return
+    ((uint64_t)in[0]) |
+    (((uint64_t)in[1]) << 8) |
+    (((uint64_t)in[2]) << 16) |
+    (((uint64_t)in[3]) << 24) |
+    (((uint64_t)in[4]) << 32) |
+    (((uint64_t)in[5]) << 40) |
+    (((uint64_t)in[6]) << 48) |
+    (((uint64_t)in[7]) << 56);
+}
+
+static inline void store_limb(u8 *out, uint64_t in) {
+  for (unsigned int i = 0; i < 8; ++i) {
+    out[i] = (u8)in;
+    in >>= 8;
+  }
+}
+
+/* Take a little-endian, 32-byte number and expand it into polynomial form */
+static inline void fexpand(felem output, const u8 *in) {
+  output[0] = load_limb(in) & MASK51;
+  output[1] = (load_limb(in + 6) >> 3) & MASK51;
+  output[2] = (load_limb(in + 12) >> 6) & MASK51;
+  output[3] = (load_limb(in + 19) >> 1) & MASK51;
+  output[4] = (load_limb(in + 24) >> 12) & MASK51;
+}
+
+/* Take a fully reduced polynomial form number and contract it into a
+ * little-endian, 32-byte array */
+static inline void fcontract(u8 *output, const felem input) {
+  uint64_t t[5];
+
+  t[0] = input[0]; t[1] = input[1]; t[2] = input[2]; t[3] = input[3]; t[4] = input[4];
+
+  for (unsigned int j = 0; j < 2; ++j) {
+    t[1] += t[0] >> 51; t[0] &= MASK51;
+    t[2] += t[1] >> 51; t[1] &= MASK51;
+    t[3] += t[2] >> 51; t[2] &= MASK51;
+    t[4] += t[3] >> 51; t[3] &= MASK51;
+    t[0] += 19 * (t[4] >> 51); t[4] &= MASK51;
+  }
+
+  /* now t is between 0 and 2^255-1, properly carried. */
+  /* case 1: between 0 and 2^255-20. case 2: between 2^255-19 and 2^255-1. */
+  t[0] += 19;
+
+  t[1] += t[0] >> 51; t[0] &= MASK51;
+  t[2] += t[1] >> 51; t[1] &= MASK51;
+  t[3] += t[2] >> 51; t[2] &= MASK51;
+  t[4] += t[3] >> 51; t[3] &= MASK51;
+  t[0] += 19 * (t[4] >> 51); t[4] &= MASK51;
+
+  /* now between 19 and 2^255-1 in both cases, and offset by 19. */
+  t[0] += 0x8000000000000ULL - 19;
+  t[1] += 0x8000000000000ULL - 1;
+  t[2] += 0x8000000000000ULL - 1;
+  t[3] += 0x8000000000000ULL - 1;
+  t[4] += 0x8000000000000ULL - 1;
+
+  /* now between 2^255 and 2^256-20, and offset by 2^255. */
+  t[1] += t[0] >> 51; t[0] &= MASK51;
+  t[2] += t[1] >> 51; t[1] &= MASK51;
+  t[3] += t[2] >> 51; t[2] &= MASK51;
+  t[4] += t[3] >> 51; t[3] &= MASK51;
+  t[4] &= MASK51;
+
+  store_limb(output, t[0] | (t[1] << 51));
+  store_limb(output + 8, (t[1] >> 13) | (t[2] << 38));
+  store_limb(output + 16, (t[2] >> 26) | (t[3] << 25));
+  store_limb(output + 24, (t[3] >> 39) | (t[4] << 12));
+}
+
+/* Input: Q, Q', Q-Q'. Output: 2Q, Q+Q'. Inputs are destroyed. */
+static inline void fmonty(felem x2, felem z2, /* output 2Q */
+                          felem x3, felem z3, /* output Q + Q' */
+                          felem x, felem z,   /* input Q */
+                          felem xprime, felem zprime, /* input Q' */
+                          const felem qmqp /* input Q - Q' */) {
+  felem origx, origxprime, zzz, xx, zz, xxprime, zzprime, zzzprime;
+
+  memcpy(origx, x, sizeof(felem));
+  fsum(x, z);
+  fdifference_backwards(z, origx);  // does x - z
+
+  memcpy(origxprime, xprime, sizeof(felem));
+  fsum(xprime, zprime);
+  fdifference_backwards(zprime, origxprime);
+  fmul(xxprime, xprime, z);
+  fmul(zzprime, x, zprime);
+  memcpy(origxprime, xxprime, sizeof(felem));
+  fsum(xxprime, zzprime);
+  fdifference_backwards(zzprime, origxprime);
+  fsquare_times(x3, xxprime, 1);
+  fsquare_times(zzzprime, zzprime, 1);
+  fmul(z3, zzzprime, qmqp);
+
+  fsquare_times(xx, x, 1);
+  fsquare_times(zz, z, 1);
+  fmul(x2, xx, zz);
+  fdifference_backwards(zz, xx);  // does zz = xx - zz
+  fscalar_product(zzz, zz, 121665);
+  fsum(zzz, xx);
+  fmul(z2, zz, zzz);
+}
+
+/* Swap a and b if iswap is 1, do nothing if it is 0, in constant time */
+static inline void swap_conditional(felem a, felem b, uint64_t iswap) {
+  const uint64_t swap = -iswap;
+  for (unsigned int i = 0; i < 5; ++i) {
+    const uint64_t x = swap & (a[i] ^ b[i]);
+    a[i] ^= x;
+    b[i] ^= x;
+  }
+}
+
+/* Calculates nQ where Q is the x-coordinate of a point on the curve */
+static inline void cmult(felem resultx, felem resultz, const u8 *n, const felem q) {
+  felem a = {0}, b = {1}, c = {1}, d = {0};
+  uint64_t *nqpqx = a, *nqpqz = b, *nqx = c, *nqz = d, *t;
+  felem e = {0}, f = {1}, g = {0}, h = {1};
+  uint64_t *nqpqx2 = e, *nqpqz2 = f, *nqx2 = g, *nqz2 = h;
+
+  memcpy(nqpqx, q, sizeof(felem));
+
+  for (unsigned int i = 0; i < 32; ++i) {
+    u8 byte = n[31 - i];
+    for (unsigned int j = 0; j < 8; ++j) {
+      const uint64_t bit = byte >> 7;
+
+      swap_conditional(nqx, nqpqx, bit);
+      swap_conditional(nqz, nqpqz, bit);
+      fmonty(nqx2, nqz2, nqpqx2, nqpqz2, nqx, nqz, nqpqx, nqpqz, q);
+      swap_conditional(nqx2, nqpqx2, bit);
+      swap_conditional(nqz2, nqpqz2, bit);
+
+      t = nqx; nqx = nqx2; nqx2 = t;
+      t = nqz; nqz = nqz2; nqz2 = t;
+      t = nqpqx; nqpqx = nqpqx2; nqpqx2 = t;
+      t = nqpqz; nqpqz = nqpqz2; nqpqz2 = t;
+
+      byte <<= 1;
+    }
+  }
+
+  memcpy(resultx, nqx, sizeof(felem));
+  memcpy(resultz, nqz, sizeof(felem));
+}
+
+/* out = z^(p-2) */
+static inline void crecip(felem out, const felem z) {
+  felem a, t0, b, c;
+
+  /* 2 */ fsquare_times(a, z, 1);
+  /* 8 */ fsquare_times(t0, a, 2);
+  /* 9 */ fmul(b, t0, z);
+  /* 11 */ fmul(a, b, a);
+  /* 22 */ fsquare_times(t0, a, 1);
+  /* 2^5 - 2^0 = 31 */ fmul(b, t0, b);
+  /* 2^10 - 2^5 */ fsquare_times(t0, b, 5);
+  /* 2^10 - 2^0 */ fmul(b, t0, b);
+  /* 2^20 - 2^10 */ fsquare_times(t0, b, 10);
+  /* 2^20 - 2^0 */ fmul(c, t0, b);
+  /* 2^40 - 2^20 */ fsquare_times(t0, c, 20);
+  /* 2^40 - 2^0 */ fmul(t0, t0, c);
+  /* 2^50 - 2^10 */ fsquare_times(t0, t0, 10);
+  /* 2^50 - 2^0 */ fmul(b, t0, b);
+  /* 2^100 - 2^50 */ fsquare_times(t0, b, 50);
+  /* 2^100 - 2^0 */ fmul(c, t0, b);
+  /* 2^200 - 2^100 */ fsquare_times(t0, c, 100);
+  /* 2^200 - 2^0 */ fmul(t0, t0, c);
+  /* 2^250 - 2^50 */ fsquare_times(t0, t0, 50);
+  /* 2^250 - 2^0 */ fmul(t0, t0, b);
+  /* 2^255 - 2^5 */ fsquare_times(t0, t0, 5);
+  /* 2^255 - 21 */ fmul(out, t0, a);
+}
+
+static void crypto_scalarmult(u8 *mypublic, const u8 *secret, const u8 *basepoint) {
+  felem bp, x, z, zmone;
+  uint8_t e[32];
+
+  for (unsigned int i = 0; i < 32; ++i) e[i] = secret[i];
+  e[0] &= 248;
+  e[31] &= 127;
+  e[31] |= 64;
+
+  fexpand(bp, basepoint);
+  cmult(x, z, e, bp);
+  crecip(zmone, z);
+  fmul(z, x, zmone);
+  fcontract(mypublic, z);
+}
+
+} // namespace r51
+
+#endif // __SIZEOF_INT128__
+
+//////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////
+
+// Four-lane AVX2 version for computing several agreements at once. Each
+// field element is ten radix 2^25.5 limbs like the 32-bit code above, and
+// each limb is a vector holding that limb for four independent ladders, so
+// one vpmuludq does four 32x32->64 products. Limbs stay non-negative
+// (subtraction adds 2p) so unsigned multiplies can be used, and the bounds
+// below keep every multiplicand under 2^32 and every column sum under 2^63.
+// The code is compiled for AVX2 via function attributes and is only called
+// if the CPU reports AVX2 at runtime.
+
+#if defined(__GNUC__) && (defined(__amd64) || defined(__amd64__) || defined(__x86_64) || defined(__x86_64__) || defined(__AMD64) || defined(__AMD64__)) && !defined(ZT_NO_AVX2)
+#define ZT_C25519_AVX2 1
+
+namespace avx2 {
+
+#define ZT_AVX2_FN static inline __attribute__((target("avx2")))
+
+typedef struct { __m256i v[10]; } fe4;
+
+#define M(a,b) _mm256_mul_epu32(a,b)
+#define A(a,b) _mm256_add_epi64(a,b)
+
+/* Carried: even limbs < 2^26, odd limbs < 2^25 + 2^18 */
+ZT_AVX2_FN void fe4_carry(fe4 *out, __m256i *h) {
+  const __m256i m26 = _mm256_set1_epi64x(0x3ffffff);
+  const __m256i m25 = _mm256_set1_epi64x(0x1ffffff);
+  __m256i c;
+#define ZT_AVX2_CARRY(i,bits) \
+  c = _mm256_srli_epi64(h[i],bits); h[i] = _mm256_and_si256(h[i],m##bits); h[i+1] = A(h[i+1],c);
+  ZT_AVX2_CARRY(0,26) ZT_AVX2_CARRY(1,25) ZT_AVX2_CARRY(2,26) ZT_AVX2_CARRY(3,25) ZT_AVX2_CARRY(4,26)
+  ZT_AVX2_CARRY(5,25) ZT_AVX2_CARRY(6,26) ZT_AVX2_CARRY(7,25) ZT_AVX2_CARRY(8,26)
+#undef ZT_AVX2_CARRY
+  c = _mm256_srli_epi64(h[9],25); h[9] = _mm256_and_si256(h[9],m25);
+  h[0] = A(h[0],A(A(c,_mm256_slli_epi64(c,1)),_mm256_slli_epi64(c,4))); /* 19c */
+  c = _mm256_srli_epi64(h[0],26); h[0] = _mm256_and_si256(h[0],m26); h[1] = A(h[1],c);
+  for (unsigned int i = 0; i < 10; ++i) out->v[i] = h[i];
+}
+
+ZT_AVX2_FN void fe4_add(fe4 *h, const fe4 *f, const fe4 *g) {
+  for (unsigned int i = 0; i < 10; ++i) h->v[i] = A(f->v[i],g->v[i]);
+}
+
+/* h = f - g + 2p, g must be carried */
+ZT_AVX2_FN void fe4_sub(fe4 *h, const fe4 *f, const fe4 *g) {
+  const __m256i twop0 = _mm256_set1_epi64x(0x7ffffda);
+  const __m256i twop_even = _mm256_set1_epi64x(0x7fffffe);
+  const __m256i twop_odd = _mm256_set1_epi64x(0x3fffffe);
+  h->v[0] = A(f->v[0],_mm256_sub_epi64(twop0,g->v[0]));
+  for (unsigned int i = 1; i < 10; ++i)
+    h->v[i] = A(f->v[i],_mm256_sub_epi64((i & 1) ? twop_odd : twop_even,g->v[i]));
+}
+
+/* Inputs are carried or one add/sub away from carried; output is carried */
+ZT_AVX2_FN void fe4_mul(fe4 *out, const fe4 *fin, const fe4 *gin) {
+  const __m256i n19 = _mm256_set1_epi64x(19);
+  __m256i f[10], f2[10], g[10], g19[10], h[10];
+  for (unsigned int i = 0; i < 10; ++i) {
+    f[i] = fin->v[i];
+    f2[i] = A(f[i],f[i]);
+    g[i] = gin->v[i];
+    g19[i] = M(g[i],n19);
+  }
+	h[0] = A(A(A(A(M(f[0],g[0]),M(f2[1],g19[9])),A(M(f[2],g19[8]),M(f2[3],g19[7]))),A(A(M(f[4],g19[6]),M(f2[5],g19[5])),A(M(f[6],g19[4]),M(f2[7],g19[3])))),A(M(f[8],g19[2]),M(f2[9],g19[1])));
+	h[1] = A(A(A(A(M(f[0],g[1]),M(f[1],g[0])),A(M(f[2],g19[9]),M(f[3],g19[8]))),A(A(M(f[4],g19[7]),M(f[5],g19[6])),A(M(f[6],g19[5]),M(f[7],g19[4])))),A(M(f[8],g19[3]),M(f[9],g19[2])));
+	h[2] = A(A(A(A(M(f[0],g[2]),M(f2[1],g[1])),A(M(f[2],g[0]),M(f2[3],g19[9]))),A(A(M(f[4],g19[8]),M(f2[5],g19[7])),A(M(f[6],g19[6]),M(f2[7],g19[5])))),A(M(f[8],g19[4]),M(f2[9],g19[3])));
+	h[3] = A(A(A(A(M(f[0],g[3]),M(f[1],g[2])),A(M(f[2],g[1]),M(f[3],g[0]))),A(A(M(f[4],g19[9]),M(f[5],g19[8])),A(M(f[6],g19[7]),M(f[7],g19[6])))),A(M(f[8],g19[5]),M(f[9],g19[4])));
+	h[4] = A(A(A(A(M(f[0],g[4]),M(f2[1],g[3])),A(M(f[2],g[2]),M(f2[3],g[1]))),A(A(M(f[4],g[0]),M(f2[5],g19[9])),A(M(f[6],g19[8]),M(f2[7],g19[7])))),A(M(f[8],g19[6]),M(f2[9],g19[5])));
+	h[5] = A(A(A(A(M(f[0],g[5]),M(f[1],g[4])),A(M(f[2],g[3]),M(f[3],g[2]))),A(A(M(f[4],g[1]),M(f[5],g[0])),A(M(f[6],g19[9]),M(f[7],g19[8])))),A(M(f[8],g19[7]),M(f[9],g19[6])));
+	h[6] = A(A(A(A(M(f[0],g[6]),M(f2[1],g[5])),A(M(f[2],g[4]),M(f2[3],g[3]))),A(A(M(f[4],g[2]),M(f2[5],g[1])),A(M(f[6],g[0]),M(f2[7],g19[9])))),A(M(f[8],g19[8]),M(f2[9],g19[7])));
+	h[7] = A(A(A(A(M(f[0],g[7]),M(f[1],g[6])),A(M(f[2],g[5]),M(f[3],g[4]))),A(A(M(f[4],g[3]),M(f[5],g[2])),A(M(f[6],g[1]),M(f[7],g[0])))),A(M(f[8],g19[9]),M(f[9],g19[8])));
+	h[8] = A(A(A(A(M(f[0],g[8]),M(f2[1],g[7])),A(M(f[2],g[6]),M(f2[3],g[5]))),A(A(M(f[4],g[4]),M(f2[5],g[3])),A(M(f[6],g[2]),M(f2[7],g[1])))),A(M(f[8],g[0]),M(f2[9],g19[9])));
+	h[9] = A(A(A(A(M(f[0],g[9]),M(f[1],g[8])),A(M(f[2],g[7]),M(f[3],g[6]))),A(A(M(f[4],g[5]),M(f[5],g[4])),A(M(f[6],g[3]),M(f[7],g[2])))),A(M(f[8],g[1]),M(f[9],g[0])));
+  fe4_carry(out,h);
+}
+
+ZT_AVX2_FN void fe4_sq(fe4 *out, const fe4 *fin) {
+  const __m256i n19 = _mm256_set1_epi64x(19);
+  const __m256i n38 = _mm256_set1_epi64x(38);
+  __m256i f[10], f2[10], f19[10], f38[10], h[10];
+  for (unsigned int i = 0; i < 10; ++i) {
+    f[i] = fin->v[i];
+    f2[i] = A(f[i],f[i]);
+    f19[i] = M(f[i],n19);
+    f38[i] = M(f[i],n38); /* only used for odd limbs, which are small enough */
+  }
+	h[0] = A(A(A(M(f[0],f[0]),M(f2[1],f38[9])),A(M(f2[2],f19[8]),M(f2[3],f38[7]))),A(M(f2[4],f19[6]),M(f38[5],f[5])));
+	h[1] = A(A(A(M(f2[0],f[1]),M(f2[2],f19[9])),A(M(f2[3],f19[8]),M(f2[4],f19[7]))),M(f2[5],f19[6]));
+	h[2] = A(A(A(M(f2[0],f[2]),M(f2[1],f[1])),A(M(f2[3],f38[9]),M(f2[4],f19[8]))),A(M(f2[5],f38[7]),M(f19[6],f[6])));
+	h[3] = A(A(A(M(f2[0],f[3]),M(f2[1],f[2])),A(M(f2[4],f19[9]),M(f2[5],f19[8]))),M(f2[6],f19[7]));
+	h[4] = A(A(A(M(f2[0],f[4]),M(f2[1],f2[3])),A(M(f[2],f[2]),M(f2[5],f38[9]))),A(M(f2[6],f19[8]),M(f38[7],f[7])));
+	h[5] = A(A(A(M(f2[0],f[5]),M(f2[1],f[4])),A(M(f2[2],f[3]),M(f2[6],f19[9]))),M(f2[7],f19[8]));
+	h[6] = A(A(A(M(f2[0],f[6]),M(f2[1],f2[5])),A(M(f2[2],f[4]),M(f2[3],f[3]))),A(M(f2[7],f38[9]),M(f19[8],f[8])));
+	h[7] = A(A(A(M(f2[0],f[7]),M(f2[1],f[6])),A(M(f2[2],f[5]),M(f2[3],f[4]))),M(f2[8],f19[9]));
+	h[8] = A(A(A(M(f2[0],f[8]),M(f2[1],f2[7])),A(M(f2[2],f[6]),M(f2[3],f2[5]))),A(M(f[4],f[4]),M(f38[9],f[9])));
+	h[9] = A(A(A(M(f2[0],f[9]),M(f2[1],f[8])),A(M(f2[2],f[7]),M(f2[3],f[6]))),M(f2[4],f[5]));
+  fe4_carry(out,h);
+}
+
+ZT_AVX2_FN void fe4_sq_times(fe4 *out, const fe4 *in, unsigned int count) {
+  fe4_sq(out,in);
+  while (--count)
+    fe4_sq(out,out);
+}
+
+ZT_AVX2_FN void fe4_mul121665(fe4 *out, const fe4 *f) {
+  const __m256i n = _mm256_set1_epi64x(121665);
+  __m256i h[10];
+  for (unsigned int i = 0; i < 10; ++i)
+    h[i] = M(f->v[i],n);
+  fe4_carry(out,h);
+}
+
+ZT_AVX2_FN void fe4_cswap(fe4 *a, fe4 *b, const __m256i mask) {
+  for (unsigned int i = 0; i < 10; ++i) {
+    const __m256i x = _mm256_and_si256(mask,_mm256_xor_si256(a->v[i],b->v[i]));
+    a->v[i] = _mm256_xor_si256(a->v[i],x);
+    b->v[i] = _mm256_xor_si256(b->v[i],x);
+  }
+}
+
+/* out = z^(p-2), same addition chain as r51::crecip() */
+ZT_AVX2_FN void fe4_invert(fe4 *out, const fe4 *z) {
+  fe4 a, t0, b, c;
+
+  /* 2 */ fe4_sq_times(&a, z, 1);
+  /* 8 */ fe4_sq_times(&t0, &a, 2);
+  /* 9 */ fe4_mul(&b, &t0, z);
+  /* 11 */ fe4_mul(&a, &b, &a);
+  /* 22 */ fe4_sq_times(&t0, &a, 1);
+  /* 2^5 - 2^0 = 31 */ fe4_mul(&b, &t0, &b);
+  /* 2^10 - 2^5 */ fe4_sq_times(&t0, &b, 5);
+  /* 2^10 - 2^0 */ fe4_mul(&b, &t0, &b);
+  /* 2^20 - 2^10 */ fe4_sq_times(&t0, &b, 10);
+  /* 2^20 - 2^0 */ fe4_mul(&c, &t0, &b);
+  /* 2^40 - 2^20 */ fe4_sq_times(&t0, &c, 20);
+  /* 2^40 - 2^0 */ fe4_mul(&t0, &t0, &c);
+  /* 2^50 - 2^10 */ fe4_sq_times(&t0, &t0, 10);
+  /* 2^50 - 2^0 */ fe4_mul(&b, &t0, &b);
+  /* 2^100 - 2^50 */ fe4_sq_times(&t0, &b, 50);
+  /* 2^100 - 2^0 */ fe4_mul(&c, &t0, &b);
+  /* 2^200 - 2^100 */ fe4_sq_times(&t0, &c, 100);
+  /* 2^200 - 2^0 */ fe4_mul(&t0, &t0, &c);
+  /* 2^250 - 2^50 */ fe4_sq_times(&t0, &t0, 50);
+  /* 2^250 - 2^0 */ fe4_mul(&t0, &t0, &b);
+  /* 2^255 - 2^5 */ fe4_sq_times(&t0, &t0, 5);
+  /* 2^255 - 21 */ fe4_mul(out, &t0, &a);
+}
+
+/* Four X25519 operations with the same secret and different points */
+__attribute__((target("avx2"))) static void crypto_scalarmult4(u8 mypublic[4][32], const u8 *secret, const u8 *const basepoint[4]) {
+  uint8_t e[32];
+  limb l[4][10];
+  fe4 x1, x2, z2, x3, z3, a, aa, b, bb, e4, c, d, da, cb, t;
+  uint64_t tmp[4];
+
+  for (unsigned int i = 0; i < 32; ++i) e[i] = secret[i];
+  e[0] &= 248;
+  e[31] &= 127;
+  e[31] |= 64;
+
+  for (unsigned int k = 0; k < 4; ++k)
+    fexpand(l[k], basepoint[k]);
+  for (unsigned int i = 0; i < 10; ++i) {
+    x1.v[i] = _mm256_set_epi64x(l[3][i],l[2][i],l[1][i],l[0][i]);
+    x2.v[i] = _mm256_setzero_si256();
+    z2.v[i] = _mm256_setzero_si256();
+    z3.v[i] = _mm256_setzero_si256();
+  }
+  x2.v[0] = _mm256_set1_epi64x(1);
+  z3.v[0] = _mm256_set1_epi64x(1);
+  x3 = x1;
+
+  uint64_t swap = 0;
+  for (int pos = 254; pos >= 0; --pos) {
+    const uint64_t bit = (e[pos >> 3] >> (pos & 7)) & 1;
+    swap ^= bit;
+    const __m256i mask = _mm256_set1_epi64x((long long)(0ULL - swap));
+    fe4_cswap(&x2, &x3, mask);
+    fe4_cswap(&z2, &z3, mask);
+    swap = bit;
+
+    fe4_add(&a, &x2, &z2);
+    fe4_sq(&aa, &a);
+    fe4_sub(&b, &x2, &z2);
+    fe4_sq(&bb, &b);
+    fe4_sub(&e4, &aa, &bb);
+    fe4_add(&c, &x3, &z3);
+    fe4_sub(&d, &x3, &z3);
+    fe4_mul(&da, &d, &a);
+    fe4_mul(&cb, &c, &b);
+    fe4_add(&t, &da, &cb);
+    fe4_sq(&x3, &t);
+    fe4_sub(&t, &da, &cb);
+    fe4_sq(&t, &t);
+    fe4_mul(&z3, &x1, &t);
+    fe4_mul(&x2, &aa, &bb);
+    fe4_mul121665(&t, &e4);
+    fe4_add(&t, &aa, &t);
+    fe4_mul(&z2, &e4, &t);
+  }
+  {
+    const __m256i mask = _mm256_set1_epi64x((long long)(0ULL - swap));
+    fe4_cswap(&x2, &x3, mask);
+    fe4_cswap(&z2, &z3, mask);
+  }
+
+  fe4_invert(&t, &z2);
+  fe4_mul(&x2, &x2, &t);
+
+  for (unsigned int i = 0; i < 10; ++i) {
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(tmp),x2.v[i]);
+    for (unsigned int k = 0; k < 4; ++k)
+      l[k][i] = (limb)tmp[k];
+  }
+  for (unsigned int k = 0; k < 4; ++k)
+    fcontract(mypublic[k], l[k]);
+}
+
+#undef M
+#undef A
+#undef ZT_AVX2_FN
+
+static inline bool available()
+{
+  static const bool a = (__builtin_cpu_supports("avx2") != 0);
+  return a;
+}
+
+} // namespace avx2
+
+#endif
+
+// Single agreements use the fastest scalar code for this platform
+static inline void x25519(u8 *mypublic, const u8 *secret, const u8 *basepoint)
+{
+#ifdef ZT_C25519_RADIX51
+	r51::crypto_scalarmult(mypublic,secret,basepoint);
+#else
+	crypto_scalarmult(mypublic,secret,basepoint);
+#endif
+}
+
 static const unsigned char base[32] = {9};
 static inline void crypto_scalarmult_base(unsigned char *q,const unsigned char *n)
 {
-	crypto_scalarmult(q,n,base);
+	x25519(q,n,base);
 }
 
 //////////////////////////////////////////////////////////////////////////////
@@ -2449,16 +3015,15 @@ static inline void get_hram(unsigned char *hram, const unsigned char *sm, const
 
 #ifdef ZT_USE_FAST_X64_ED25519
 extern "C" void ed25519_amd64_asm_sign(const unsigned char *sk,const unsigned char *pk,const unsigned char *digest,unsigned char *sig);
+extern "C" int ed25519_amd64_asm_verify(const unsigned char *pk,const unsigned char *sig);
+extern "C" int ed25519_amd64_asm_verify_batch(const unsigned char *const *pk,const unsigned char *const *sig,const unsigned char *rnd,unsigned long num);
 #endif
 
 namespace ZeroTier {
 
-void C25519::agree(const C25519::Private &mine,const C25519::Public &their,void *keybuf,unsigned int keylen)
+static inline void _expandAgreedKey(const unsigned char *rawkey,void *keybuf,unsigned int keylen)
 {
-	unsigned char rawkey[32];
 	unsigned char digest[64];
-
-	crypto_scalarmult(rawkey,mine.data,their.data);
 	SHA512::hash(digest,rawkey,32);
 	for(unsigned int i=0,k=0;i<keylen;) {
 		if (k == 64) {
@@ -2469,6 +3034,48 @@ void C25519::agree(const C25519::Private &mine,const C25519::Public &their,void
 	}
 }
 
+void C25519::agree(const C25519::Private &mine,const C25519::Public &their,void *keybuf,unsigned int keylen)
+{
+	unsigned char rawkey[32];
+	x25519(rawkey,mine.data,their.data);
+	_expandAgreedKey(rawkey,keybuf,keylen);
+}
+
+void C25519::agreeBatch(const C25519::Private &mine,const C25519::Public *const *their,unsigned int n,void *keybufs,unsigned int keylen)
+{
+	unsigned int i = 0;
+#ifdef ZT_C25519_AVX2
+	if ((n > 1)&&(avx2::available())) {
+		unsigned char rawkeys[4][32];
+		const unsigned char *bp[4];
+		while (i < n) {
+			const unsigned int lanes = ((n - i) < 4) ? (n - i) : 4;
+			for(unsigned int k=0;k<4;++k)
+				bp[k] = their[i + ((k < lanes) ? k : 0)]->data; // idle lanes repeat the first
+			avx2::crypto_scalarmult4(rawkeys,mine.data,bp);
+			for(unsigned int k=0;k<lanes;++k,++i)
+				_expandAgreedKey(rawkeys[k],reinterpret_cast<uint8_t *>(keybufs) + ((unsigned long)i * keylen),keylen);
+		}
+		return;
+	}
+#endif
+	for(;i<n;++i)
+		agree(mine,*(their[i]),reinterpret_cast<uint8_t *>(keybufs) + ((unsigned long)i * keylen),keylen);
+}
+
+const char *C25519::agreeBackend(const bool batch)
+{
+#ifdef ZT_C25519_AVX2
+	if ((batch)&&(avx2::available()))
+		return "avx2x4";
+#endif
+#ifdef ZT_C25519_RADIX51
+	return "radix51";
+#else
+	return "radix25.5";
+#endif
+}
+
 void C25519::sign(const C25519::Private &myPrivate,const C25519::Public &myPublic,const void *msg,unsigned int len,void *signature)
 {
 	unsigned char digest[64]; // we sign the first 32 bytes of SHA-512(msg)
@@ -2529,6 +3136,9 @@ bool C25519::verify(const C25519::Public &their,const void *msg,unsigned int len
 	if (!Utils::secureEq(sig + 64,digest,32))
 		return false;
 
+#ifdef ZT_USE_FAST_X64_ED25519
+	return (ed25519_amd64_asm_verify(their.data + 32,sig) == 0);
+#else
 	unsigned char t2[32];
 	ge25519 get1, get2;
 	sc25519 schram, scs;
@@ -2548,6 +3158,57 @@ bool C25519::verify(const C25519::Public &their,const void *msg,unsigned int len
 	ge25519_pack(t2, &get2);
 
 	return Utils::secureEq(sig,t2,32);
+#endif
+}
+
+bool C25519::verifyBatch(unsigned int n,const C25519::Public *const *their,const void *const *msg,const unsigned int *len,const void *const *signature,bool *valid)
+{
+	bool allValid = true;
+	unsigned int i = 0;
+
+#ifdef ZT_USE_FAST_X64_ED25519
+	const unsigned char *pk[ZT_C25519_MAX_BATCH];
+	const unsigned char *sig[ZT_C25519_MAX_BATCH];
+	unsigned int idx[ZT_C25519_MAX_BATCH];
+	uint64_t rnd[ZT_C25519_MAX_BATCH * 2];
+	unsigned char digest[64];
+
+	while (i < n) {
+		// Messages with a bad digest never enter the batch, so a batch failure
+		// means a bad curve equation and is resolved one signature at a time.
+		unsigned int cnt = 0;
+		for(;(i<n)&&(cnt<ZT_C25519_MAX_BATCH);++i) {
+			SHA512::hash(digest,msg[i],len[i]);
+			if (Utils::secureEq((const uint8_t *)signature[i] + 64,digest,32)) {
+				pk[cnt] = their[i]->data + 32;
+				sig[cnt] = (const unsigned char *)signature[i];
+				idx[cnt++] = i;
+			} else {
+				valid[i] = false;
+				allValid = false;
+			}
+		}
+		if (cnt == 0)
+			continue;
+		Utils::getSecureRandom(rnd,cnt * 16);
+		if ((cnt >= 2)&&(ed25519_amd64_asm_verify_batch(pk,sig,(const unsigned char *)rnd,cnt) == 0)) {
+			for(unsigned int k=0;k<cnt;++k)
+				valid[idx[k]] = true;
+		} else {
+			for(unsigned int k=0;k<cnt;++k) {
+				valid[idx[k]] = (ed25519_amd64_asm_verify(pk[k],sig[k]) == 0);
+				allValid &= valid[idx[k]];
+			}
+		}
+	}
+#else
+	for(;i<n;++i) {
+		valid[i] = verify(*(their[i]),msg[i],len[i],signature[i]);
+		allValid &= valid[i];
+	}
+#endif
+
+	return allValid;
 }
 
 void C25519::_calcPubDH(C25519::Pair &kp)
@@ -34,7 +34,7 @@
 
 namespace ZeroTier {
 
-int Capability::verify(const RuntimeEnvironment *RR,void *tPtr) const
+int Capability::verify(const RuntimeEnvironment *RR,void *tPtr,SignatureCache::Batch *batch) const
 {
 	try {
 		// There must be at least one entry, and sanity check for bad chain max length
@@ -57,7 +57,9 @@ int Capability::verify(const RuntimeEnvironment *RR,void *tPtr) const
 
 			const Identity id(RR->topology->getIdentity(tPtr,_custody[c].from));
 			if (id) {
-				if (!id.verify(tmp.data(),tmp.size(),_custody[c].signature))
+				if (batch)
+					batch->add(id,tmp.data(),tmp.size(),_custody[c].signature);
+				else if (!RR->sc->verify(id,tmp.data(),tmp.size(),_custody[c].signature))
 					return -1;
 			} else {
 				RR->sw->requestWhois(tPtr,RR->node->now(),_custody[c].from);
@@ -38,6 +38,7 @@
 #include "Utils.hpp"
 #include "Buffer.hpp"
 #include "Identity.hpp"
+#include "SignatureCache.hpp"
 #include "../include/ZeroTierOne.h"
 
 namespace ZeroTier {
@@ -175,9 +176,10 @@ public:
 	 * Verify this capability's chain of custody and signatures
 	 *
 	 * @param RR Runtime environment to provide for peer lookup, etc.
+	 * @param batch If non-NULL, signatures are queued here instead of checked and 0 means only that everything else checked out
 	 * @return 0 == OK, 1 == waiting for WHOIS, -1 == BAD signature or chain
 	 */
-	int verify(const RuntimeEnvironment *RR,void *tPtr) const;
+	int verify(const RuntimeEnvironment *RR,void *tPtr,SignatureCache::Batch *batch = (SignatureCache::Batch *)0) const;
 
 	template<unsigned int C>
 	static inline void serializeRules(Buffer<C> &b,const ZT_VirtualNetworkRule *rules,unsigned int ruleCount)
@@ -40,6 +40,7 @@
 #include "Address.hpp"
 #include "C25519.hpp"
 #include "Identity.hpp"
+#include "SignatureCache.hpp"
 #include "Utils.hpp"
 
 /**
@@ -254,9 +255,10 @@ public:
 	 *
 	 * @param RR Runtime environment for looking up peers
 	 * @param tPtr Thread pointer to be handed through to any callbacks called as a result of this call
+	 * @param batch If non-NULL, signatures are queued here instead of checked and 0 means only that everything else checked out
 	 * @return 0 == OK, 1 == waiting for WHOIS, -1 == BAD signature or credential
 	 */
-	int verify(const RuntimeEnvironment *RR,void *tPtr) const;
+	int verify(const RuntimeEnvironment *RR,void *tPtr,SignatureCache::Batch *batch = (SignatureCache::Batch *)0) const;
 
 	/**
 	 * @return True if signed
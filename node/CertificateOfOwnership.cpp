@@ -34,7 +34,7 @@
 
 namespace ZeroTier {
 
-int CertificateOfOwnership::verify(const RuntimeEnvironment *RR,void *tPtr) const
+int CertificateOfOwnership::verify(const RuntimeEnvironment *RR,void *tPtr,SignatureCache::Batch *batch) const
 {
 	if ((!_signedBy)||(_signedBy != Network::controllerFor(_networkId)))
 		return -1;
@@ -46,7 +46,11 @@ int CertificateOfOwnership::verify(const RuntimeEnvironment *RR,void *tPtr) cons
 	try {
 		Buffer<(sizeof(CertificateOfOwnership) + 64)> tmp;
 		this->serialize(tmp,true);
-		return (id.verify(tmp.data(),tmp.size(),_signature) ? 0 : -1);
+		if (batch) {
+			batch->add(id,tmp.data(),tmp.size(),_signature);
+			return 0;
+		}
+		return (RR->sc->verify(id,tmp.data(),tmp.size(),_signature) ? 0 : -1);
 	} catch ( ... ) {
 		return -1;
 	}
@@ -37,6 +37,7 @@
 #include "C25519.hpp"
 #include "Address.hpp"
 #include "Identity.hpp"
+#include "SignatureCache.hpp"
 #include "Buffer.hpp"
 #include "InetAddress.hpp"
 #include "MAC.hpp"
@@ -148,9 +149,10 @@ public:
 	/**
 	 * @param RR Runtime environment to allow identity lookup for signedBy
 	 * @param tPtr Thread pointer to be handed through to any callbacks called as a result of this call
+	 * @param batch If non-NULL, signatures are queued here instead of checked and 0 means only that everything else checked out
 	 * @return 0 == OK, 1 == waiting for WHOIS, -1 == BAD signature
 	 */
-	int verify(const RuntimeEnvironment *RR,void *tPtr) const;
+	int verify(const RuntimeEnvironment *RR,void *tPtr,SignatureCache::Batch *batch = (SignatureCache::Batch *)0) const;
 
 	template<unsigned int C>
 	inline void serialize(Buffer<C> &b,const bool forSign = false) const
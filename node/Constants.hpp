@@ -192,6 +192,42 @@
  */
 #define ZT_RX_QUEUE_SIZE 32
 
+/**
+ * Number of compressed packets per sample window for adaptive compression
+ */
+#define ZT_COMPRESSION_SAMPLE_WINDOW 32
+
+/**
+ * Compression is backed off if a window saves less than 1/this of its bytes
+ */
+#define ZT_COMPRESSION_MIN_SAVINGS_DIVISOR 16
+
+/**
+ * Initial and maximum time compression stays off after an incompressible window
+ */
+#define ZT_COMPRESSION_BACKOFF_MIN 1000
+#define ZT_COMPRESSION_BACKOFF_MAX 60000
+
+/**
+ * Number of per-network adaptive compression slots per peer (power of two)
+ */
+#define ZT_PEER_COMPRESSION_SLOTS 4
+
+/**
+ * Maximum number of decoded frames held per thread before a batch is delivered
+ */
+#define ZT_FRAME_BATCH_MAX_FRAMES 64
+
+/**
+ * Size of the per-thread buffer holding batched frame data and headroom
+ */
+#define ZT_FRAME_BATCH_BUFFER_SIZE 131072
+
+/**
+ * Maximum number of HELLOs from unknown peers held per thread for batched key agreement
+ */
+#define ZT_HELLO_BATCH_MAX 16
+
 /**
  * Size of TX queue
  */
@@ -309,6 +345,19 @@
  */
 #define ZT_MULTIPATH_PROPORTION_WIN_SZ 128
 
+/**
+ * Number of flow slots per peer in ZT_MULTIPATH_BALANCE_FLOW_HASH mode (power of two)
+ */
+#define ZT_MULTIPATH_FLOW_TABLE_SIZE 256
+
+/**
+ * Idle time after which a flow may be moved to another path (flowlet gap)
+ *
+ * This should exceed the largest latency difference between a peer's paths
+ * so that a flow's packets on the old path are delivered before any on the new.
+ */
+#define ZT_MULTIPATH_FLOWLET_TIMEOUT 500
+
 /**
  * How often we will sample packet latency. Should be at least greater than ZT_PING_CHECK_INVERVAL
  * since we will record a 0 bit/s measurement if no valid latency measurement was made within this
@@ -383,6 +432,12 @@
  */
 #define ZT_PATH_MAX_OUTSTANDING_QOS_RECORDS 128
 
+/**
+ * Number of slots in each per-path QoS sample table (must be a power of two
+ * and comfortably larger than ZT_PATH_QOS_TABLE_SIZE)
+ */
+#define ZT_PATH_QOS_SAMPLE_TABLE_SIZE 256
+
 /**
  * Timeout for QoS records
  */
@@ -575,6 +630,14 @@
  */
 #define ZT_PEER_CREDEITIALS_CUTOFF_LIMIT 15
 
+/**
+ * Number of recently checked credential signatures to remember
+ *
+ * Entries are 128 bytes and valid and forged signatures each get a table of
+ * this size, so this costs 128KiB per node.
+ */
+#define ZT_SIGNATURE_CACHE_SIZE 512
+
 /**
  * WHOIS rate limit (we allow these to be pretty fast)
  */
@@ -0,0 +1,480 @@
+/*
+ * ZeroTier One - Network Virtualization Everywhere
+ * Copyright (C) 2011-2019  ZeroTier, Inc.  https://www.zerotier.com/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * --
+ *
+ * You can be released from the requirements of the license by purchasing
+ * a commercial license. Buying such a license is mandatory as soon as you
+ * develop commercial closed-source software that incorporates or links
+ * directly against ZeroTier software without disclosing the source code
+ * of your own application.
+ */
+
+#ifndef ZT_FLATHASHTABLE_HPP
+#define ZT_FLATHASHTABLE_HPP
+
+#include "Constants.hpp"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <new>
+#include <vector>
+#include <utility>
+#include <algorithm>
+
+/**
+ * Maximum load factor of a FlatHashtable in percent before it grows
+ */
+#define ZT_FLATHASHTABLE_MAX_LOAD 70
+
+namespace ZeroTier {
+
+/**
+ * Open addressing hash table for hot lookups in the ZeroTier core
+ *
+ * This has the same interface as Hashtable but stores entries inline in a
+ * single power of two sized array using Robin Hood linear probing. A
+ * separate array of one byte probe distances (zero for empty) lets a lookup
+ * stop as soon as it reaches an entry closer to its home slot than the key
+ * being sought would be, so misses are as cheap as hits. Erase uses
+ * backward shift deletion so there are no tombstones and the table never
+ * needs to be rebuilt after churn.
+ *
+ * Hash codes from keys are run through a 64-bit finalizer before masking,
+ * so weak hashCode() implementations still spread across the table.
+ *
+ * Unlike Hashtable, entries move when other entries are added or removed.
+ * Pointers and references returned by get(), set(), or operator[] are only
+ * valid until the next call to set(), operator[], or erase(). Use Hashtable
+ * for large values or where callers hold pointers into the table.
+ */
+template<typename K,typename V>
+class FlatHashtable
+{
+private:
+	struct _Slot
+	{
+		_Slot(const K &k,const V &v) : k(k),v(v) {}
+		_Slot(const K &k) : k(k),v() {}
+		K k;
+		V v;
+	};
+
+public:
+	/**
+	 * A simple forward iterator (different from STL)
+	 *
+	 * As with Hashtable it's safe to erase the last key returned by next(),
+	 * but not others, and set() must not be called while iterating. This
+	 * starts at an empty slot and wraps around so that entries shifted back
+	 * by an erase are never returned twice.
+	 */
+	class Iterator
+	{
+	public:
+		/**
+		 * @param ht Hash table to iterate over
+		 */
+		Iterator(FlatHashtable &ht) :
+			_ht(&ht),
+			_i(0),
+			_left(ht._c - 1),
+			_n(ht._n)
+		{
+			while (ht._d[_i]) // load factor guarantees at least one empty slot
+				++_i;
+		}
+
+		/**
+		 * @param kptr Pointer to set to point to next key
+		 * @param vptr Pointer to set to point to next value
+		 * @return True if kptr and vptr are set, false if no more entries
+		 */
+		inline bool next(K *&kptr,V *&vptr)
+		{
+			for(;;) {
+				if (_n == _ht->_n) {
+					if (!_left)
+						return false;
+					_i = (_i + 1) & (_ht->_c - 1);
+					--_left;
+				} else {
+					// Last key was erased, so its successor may have shifted into its slot
+					_n = _ht->_n;
+				}
+				if (_ht->_d[_i]) {
+					kptr = &(_ht->_s[_i].k);
+					vptr = &(_ht->_s[_i].v);
+					return true;
+				}
+			}
+		}
+
+	private:
+		FlatHashtable *_ht;
+		unsigned long _i;
+		unsigned long _left;
+		unsigned long _n;
+	};
+
+	/**
+	 * @param bc Initial capacity in slots (default: 64, rounded up to a power of two)
+	 */
+	FlatHashtable(unsigned long bc = 64) :
+		_s((_Slot *)0),
+		_d((uint8_t *)0),
+		_c(8),
+		_n(0)
+	{
+		while (_c < bc)
+			_c <<= 1;
+		_alloc();
+	}
+
+	FlatHashtable(const FlatHashtable<K,V> &ht) :
+		_s((_Slot *)0),
+		_d((uint8_t *)0),
+		_c(ht._c),
+		_n(0)
+	{
+		_alloc();
+		_copy(ht);
+	}
+
+	~FlatHashtable()
+	{
+		this->clear();
+		::free(_s);
+		::free(_d);
+	}
+
+	inline FlatHashtable &operator=(const FlatHashtable<K,V> &ht)
+	{
+		if (&ht != this) {
+			this->clear();
+			if (_c != ht._c) {
+				::free(_s);
+				::free(_d);
+				_c = ht._c;
+				_alloc();
+			}
+			_copy(ht);
+		}
+		return *this;
+	}
+
+	/**
+	 * Erase all entries
+	 */
+	inline void clear()
+	{
+		if (_n) {
+			for(unsigned long i=0;i<_c;++i) {
+				if (_d[i])
+					_s[i].~_Slot();
+			}
+			memset(_d,0,_c);
+			_n = 0;
+		}
+	}
+
+	/**
+	 * @return Vector of all keys
+	 */
+	inline typename std::vector<K> keys() const
+	{
+		typename std::vector<K> k;
+		if (_n) {
+			k.reserve(_n);
+			for(unsigned long i=0;i<_c;++i) {
+				if (_d[i])
+					k.push_back(_s[i].k);
+			}
+		}
+		return k;
+	}
+
+	/**
+	 * Append all keys (in unspecified order) to the supplied vector or list
+	 *
+	 * @param v Vector, list, or other compliant container
+	 * @tparam Type of V (generally inferred)
+	 */
+	template<typename C>
+	inline void appendKeys(C &v) const
+	{
+		if (_n) {
+			for(unsigned long i=0;i<_c;++i) {
+				if (_d[i])
+					v.push_back(_s[i].k);
+			}
+		}
+	}
+
+	/**
+	 * @return Vector of all entries (pairs of K,V)
+	 */
+	inline typename std::vector< std::pair<K,V> > entries() const
+	{
+		typename std::vector< std::pair<K,V> > k;
+		if (_n) {
+			k.reserve(_n);
+			for(unsigned long i=0;i<_c;++i) {
+				if (_d[i])
+					k.push_back(std::pair<K,V>(_s[i].k,_s[i].v));
+			}
+		}
+		return k;
+	}
+
+	/**
+	 * @param k Key
+	 * @return Pointer to value or NULL if not found
+	 */
+	inline V *get(const K &k)
+	{
+		const unsigned long i = _find(k);
+		return ((i < _c) ? &(_s[i].v) : (V *)0);
+	}
+	inline const V *get(const K &k) const { return const_cast<FlatHashtable *>(this)->get(k); }
+
+	/**
+	 * @param k Key
+	 * @param v Value to fill with result
+	 * @return True if value was found and set (if false, v is not modified)
+	 */
+	inline bool get(const K &k,V &v) const
+	{
+		const unsigned long i = _find(k);
+		if (i < _c) {
+			v = _s[i].v;
+			return true;
+		}
+		return false;
+	}
+
+	/**
+	 * @param k Key to check
+	 * @return True if key is present
+	 */
+	inline bool contains(const K &k) const { return (_find(k) < _c); }
+
+	/**
+	 * @param k Key
+	 * @return True if value was present
+	 */
+	inline bool erase(const K &k)
+	{
+		unsigned long i = _find(k);
+		if (i >= _c)
+			return false;
+		const unsigned long m = _c - 1;
+		for(;;) {
+			const unsigned long ni = (i + 1) & m;
+			if (_d[ni] <= 1) // empty or already in its home slot
+				break;
+			_s[i] = std::move(_s[ni]);
+			_d[i] = _d[ni] - 1;
+			i = ni;
+		}
+		_s[i].~_Slot();
+		_d[i] = 0;
+		--_n;
+		return true;
+	}
+
+	/**
+	 * @param k Key
+	 * @param v Value
+	 * @return Reference to value in table
+	 */
+	inline V &set(const K &k,const V &v)
+	{
+		const uint64_t h = _mix(_hc(k));
+		unsigned long i = _find(k,h);
+		if (i < _c) {
+			_s[i].v = v;
+		} else {
+			i = _place(h);
+			new (_s + i) _Slot(k,v);
+		}
+		return _s[i].v;
+	}
+
+	/**
+	 * @param k Key
+	 * @return Value, possibly newly created
+	 */
+	inline V &operator[](const K &k)
+	{
+		const uint64_t h = _mix(_hc(k));
+		unsigned long i = _find(k,h);
+		if (i >= _c) {
+			i = _place(h);
+			new (_s + i) _Slot(k);
+		}
+		return _s[i].v;
+	}
+
+	/**
+	 * @return Number of entries
+	 */
+	inline unsigned long size() const { return _n; }
+
+	/**
+	 * @return True if table is empty
+	 */
+	inline bool empty() const { return (_n == 0); }
+
+private:
+	template<typename O>
+	static inline uint64_t _hc(const O &obj)
+	{
+		return (uint64_t)obj.hashCode();
+	}
+	static inline uint64_t _hc(const uint64_t i) { return i; }
+	static inline uint64_t _hc(const uint32_t i) { return (uint64_t)i; }
+	static inline uint64_t _hc(const uint16_t i) { return (uint64_t)i; }
+	static inline uint64_t _hc(const int i) { return (uint64_t)i; }
+
+	// 64-bit finalizer from MurmurHash3
+	static inline uint64_t _mix(uint64_t h)
+	{
+		h ^= h >> 33;
+		h *= 0xff51afd7ed558ccdULL;
+		h ^= h >> 33;
+		h *= 0xc4ceb9fe1a85ec53ULL;
+		h ^= h >> 33;
+		return h;
+	}
+
+	// Returns index of key or _c if not found
+	inline unsigned long _find(const K &k) const { return _find(k,_mix(_hc(k))); }
+	inline unsigned long _find(const K &k,const uint64_t h) const
+	{
+		const unsigned long m = _c - 1;
+		unsigned long i = (unsigned long)h & m;
+		for(unsigned int d=1;;++d) {
+			const unsigned int sd = _d[i];
+			if (sd < d) // empty, or an entry closer to home than k would be
+				return _c;
+			if ((sd == d)&&(_s[i].k == k))
+				return i;
+			i = (i + 1) & m;
+		}
+	}
+
+	// Makes room for a new entry with hash h, returning the index of an
+	// uninitialized slot in which the caller must construct it.
+	inline unsigned long _place(const uint64_t h)
+	{
+		for(;;) {
+			if (((_n + 1) * 100) > (_c * ZT_FLATHASHTABLE_MAX_LOAD)) {
+				_grow();
+				continue;
+			}
+
+			const unsigned long m = _c - 1;
+			unsigned long i = (unsigned long)h & m;
+			unsigned int d = 1;
+			while (_d[i] >= d) {
+				i = (i + 1) & m;
+				++d;
+			}
+
+			// Entries from i up to the next empty slot shift forward by one,
+			// which fails only if a probe distance would no longer fit in a byte.
+			unsigned long e = i;
+			while ((_d[e])&&(_d[e] < 255))
+				e = (e + 1) & m;
+			if ((d > 255)||(_d[e])) {
+				_grow();
+				continue;
+			}
+
+			if (e != i) {
+				unsigned long p = (e - 1) & m;
+				new (_s + e) _Slot(std::move(_s[p]));
+				_d[e] = _d[p] + 1;
+				while (p != i) {
+					const unsigned long pp = (p - 1) & m;
+					_s[p] = std::move(_s[pp]);
+					_d[p] = _d[pp] + 1;
+					p = pp;
+				}
+				_s[i].~_Slot();
+			}
+			_d[i] = (uint8_t)d;
+			++_n;
+			return i;
+		}
+	}
+
+	// Entries are moved into the new arrays one at a time using _place(),
+	// which may itself grow again in the (pathological) case that the
+	// larger table still overflows a probe distance.
+	inline void _grow()
+	{
+		_Slot *const os = _s;
+		uint8_t *const od = _d;
+		const unsigned long oc = _c;
+		_c <<= 1;
+		_alloc();
+		_n = 0;
+		for(unsigned long i=0;i<oc;++i) {
+			if (od[i]) {
+				const unsigned long ni = _place(_mix(_hc(os[i].k)));
+				new (_s + ni) _Slot(std::move(os[i]));
+				os[i].~_Slot();
+			}
+		}
+		::free(os);
+		::free(od);
+	}
+
+	inline void _alloc()
+	{
+		_s = reinterpret_cast<_Slot *>(::malloc(sizeof(_Slot) * _c));
+		_d = reinterpret_cast<uint8_t *>(::malloc(_c));
+		if ((!_s)||(!_d))
+			throw ZT_EXCEPTION_OUT_OF_MEMORY;
+		memset(_d,0,_c);
+	}
+
+	// Assumes this is empty and has the same capacity as ht
+	inline void _copy(const FlatHashtable<K,V> &ht)
+	{
+		for(unsigned long i=0;i<_c;++i) {
+			if (ht._d[i])
+				new (_s + i) _Slot(ht._s[i]);
+		}
+		memcpy(_d,ht._d,_c);
+		_n = ht._n;
+	}
+
+	_Slot *_s;
+	uint8_t *_d;
+	unsigned long _c;
+	unsigned long _n;
+};
+
+} // namespace ZeroTier
+
+#endif
@@ -0,0 +1,129 @@
+/*
+ * ZeroTier One - Network Virtualization Everywhere
+ * Copyright (C) 2011-2019  ZeroTier, Inc.  https://www.zerotier.com/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * --
+ *
+ * You can be released from the requirements of the license by purchasing
+ * a commercial license. Buying such a license is mandatory as soon as you
+ * develop commercial closed-source software that incorporates or links
+ * directly against ZeroTier software without disclosing the source code
+ * of your own application.
+ */
+
+
+#ifndef ZT_FLOWTABLE_HPP
+#define ZT_FLOWTABLE_HPP
+
+#include <stdint.h>
+#include <string.h>
+
+namespace ZeroTier {
+
+/**
+ * Direct-mapped table pinning traffic flows to paths
+ *
+ * Each flow (identified by a nonzero hash of its 5-tuple) stays on the
+ * path it was last assigned to for as long as it keeps sending. Once a
+ * flow has been idle for longer than the flowlet timeout it may be moved
+ * to another path without reordering its packets at the receiver, since
+ * everything sent before the gap has already drained out of the old path.
+ * Colliding flows simply evict each other, which at worst costs one early
+ * rebalance. This class is not thread-safe.
+ *
+ * @tparam P Path handle type (pointer or index, must be comparable)
+ * @tparam S Number of slots (must be a power of two)
+ */
+template<typename P,unsigned int S>
+class FlowTable
+{
+	static_assert((S & (S - 1)) == 0,"FlowTable size must be a power of two");
+
+public:
+	FlowTable()
+	{
+		memset(_f,0,sizeof(_f));
+	}
+
+	/**
+	 * Look up the path a flow is pinned to
+	 *
+	 * If the flow is found and is still within its current flowlet its
+	 * last activity time is refreshed.
+	 *
+	 * @param flowId Nonzero flow ID
+	 * @param now Current time
+	 * @param flowletTimeout Idle time after which a flow may change paths
+	 * @param path Result parameter: pinned path
+	 * @return True if flow is pinned and should stay on 'path' (if it is still usable)
+	 */
+	inline bool get(const uint64_t flowId,const int64_t now,const int64_t flowletTimeout,P &path)
+	{
+		_Flow &f = _f[_slot(flowId)];
+		if ((f.id == flowId)&&((now - f.lastSend) < flowletTimeout)) {
+			f.lastSend = now;
+			path = f.path;
+			return true;
+		}
+		return false;
+	}
+
+	/**
+	 * Pin a flow to a path, starting a new flowlet
+	 *
+	 * @param flowId Nonzero flow ID
+	 * @param now Current time
+	 * @param path Path to pin flow to
+	 */
+	inline void set(const uint64_t flowId,const int64_t now,const P &path)
+	{
+		_Flow &f = _f[_slot(flowId)];
+		f.id = flowId;
+		f.lastSend = now;
+		f.path = path;
+	}
+
+	/**
+	 * @param now Current time
+	 * @param flowletTimeout Flowlet timeout
+	 * @return Number of flows active within the last flowlet timeout
+	 */
+	inline unsigned int activeFlows(const int64_t now,const int64_t flowletTimeout) const
+	{
+		unsigned int n = 0;
+		for(unsigned int i=0;i<S;++i) {
+			if ((_f[i].id)&&((now - _f[i].lastSend) < flowletTimeout))
+				++n;
+		}
+		return n;
+	}
+
+private:
+	static inline unsigned int _slot(const uint64_t flowId) { return (unsigned int)((flowId ^ (flowId >> 32)) & (uint64_t)(S - 1)); }
+
+	struct _Flow
+	{
+		uint64_t id;
+		int64_t lastSend;
+		P path;
+	};
+
+	_Flow _f[S];
+};
+
+} // namespace ZeroTier
+
+#endif
@@ -29,11 +29,15 @@
 #include <string.h>
 #include <stdint.h>
 
+#include <thread>
+#include <atomic>
+
 #include "Constants.hpp"
 #include "Identity.hpp"
 #include "SHA512.hpp"
 #include "Salsa20.hpp"
 #include "Utils.hpp"
+#include "Mutex.hpp"
 
 // These can't be changed without a new identity type. They define the
 // parameters of the hashcash hashing/searching algorithm.
@@ -41,6 +45,9 @@
 #define ZT_IDENTITY_GEN_HASHCASH_FIRST_BYTE_LESS_THAN 17
 #define ZT_IDENTITY_GEN_MEMORY 2097152
 
+// Keystream blocks generated at once while rendering the final digest
+#define ZT_IDENTITY_GEN_KEYSTREAM_CHUNK 64
+
 namespace ZeroTier {
 
 // A memory-hard composition of SHA-512 and Salsa20 for hashcash hashing
@@ -51,31 +58,30 @@ static inline void _computeMemoryHardHash(const void *publicKey,unsigned int pub
 
 	// Initialize genmem[] using Salsa20 in a CBC-like configuration since
 	// ordinary Salsa20 is randomly seek-able. This is good for a cipher
-	// but is not what we want for sequential memory-hardness.
-	memset(genmem,0,ZT_IDENTITY_GEN_MEMORY);
+	// but is not what we want for sequential memory-hardness. Each block is
+	// the previous block XORed with the next keystream block, so the whole
+	// keystream is generated in bulk first and the chaining applied after.
 	Salsa20 s20(digest,(char *)digest + 32);
-	s20.crypt20((char *)genmem,(char *)genmem,64);
-	for(unsigned long i=64;i<ZT_IDENTITY_GEN_MEMORY;i+=64) {
-		unsigned long k = i - 64;
-		*((uint64_t *)((char *)genmem + i)) = *((uint64_t *)((char *)genmem + k));
-		*((uint64_t *)((char *)genmem + i + 8)) = *((uint64_t *)((char *)genmem + k + 8));
-		*((uint64_t *)((char *)genmem + i + 16)) = *((uint64_t *)((char *)genmem + k + 16));
-		*((uint64_t *)((char *)genmem + i + 24)) = *((uint64_t *)((char *)genmem + k + 24));
-		*((uint64_t *)((char *)genmem + i + 32)) = *((uint64_t *)((char *)genmem + k + 32));
-		*((uint64_t *)((char *)genmem + i + 40)) = *((uint64_t *)((char *)genmem + k + 40));
-		*((uint64_t *)((char *)genmem + i + 48)) = *((uint64_t *)((char *)genmem + k + 48));
-		*((uint64_t *)((char *)genmem + i + 56)) = *((uint64_t *)((char *)genmem + k + 56));
-		s20.crypt20((char *)genmem + i,(char *)genmem + i,64);
-	}
+	s20.keystream20(genmem,ZT_IDENTITY_GEN_MEMORY / 64);
+	uint64_t *const gm = (uint64_t *)genmem;
+	for(unsigned long i=8;i<(ZT_IDENTITY_GEN_MEMORY / sizeof(uint64_t));++i)
+		gm[i] ^= gm[i - 8];
 
-	// Render final digest using genmem as a lookup table
+	// Render final digest using genmem as a lookup table. The keystream that
+	// is XORed into digest after each swap doesn't depend on the swaps, so
+	// it's also computed ahead in chunks of ZT_IDENTITY_GEN_KEYSTREAM_CHUNK
+	// blocks (which evenly divides the number of swaps).
+	uint8_t ks[ZT_IDENTITY_GEN_KEYSTREAM_CHUNK * 64];
 	for(unsigned long i=0;i<(ZT_IDENTITY_GEN_MEMORY / sizeof(uint64_t));) {
-		unsigned long idx1 = (unsigned long)(Utils::ntoh(((uint64_t *)genmem)[i++]) % (64 / sizeof(uint64_t)));
-		unsigned long idx2 = (unsigned long)(Utils::ntoh(((uint64_t *)genmem)[i++]) % (ZT_IDENTITY_GEN_MEMORY / sizeof(uint64_t)));
-		uint64_t tmp = ((uint64_t *)genmem)[idx2];
-		((uint64_t *)genmem)[idx2] = ((uint64_t *)digest)[idx1];
-		((uint64_t *)digest)[idx1] = tmp;
-		s20.crypt20(digest,digest,64);
+		s20.keystream20(ks,ZT_IDENTITY_GEN_KEYSTREAM_CHUNK);
+		for(unsigned int b=0;b<ZT_IDENTITY_GEN_KEYSTREAM_CHUNK;++b) {
+			unsigned long idx1 = (unsigned long)(Utils::ntoh(gm[i++]) % (64 / sizeof(uint64_t)));
+			unsigned long idx2 = (unsigned long)(Utils::ntoh(gm[i++]) % (ZT_IDENTITY_GEN_MEMORY / sizeof(uint64_t)));
+			uint64_t tmp = gm[idx2];
+			gm[idx2] = ((uint64_t *)digest)[idx1];
+			((uint64_t *)digest)[idx1] = tmp;
+			Salsa20::memxor((uint8_t *)digest,ks + (b * 64),64);
+		}
 	}
 }
 
@@ -113,6 +119,83 @@ void Identity::generate()
 	delete [] genmem;
 }
 
+// State shared by the threads of a multi-threaded generate()
+struct _Identity_generate_search
+{
+	_Identity_generate_search(uint64_t p,unsigned int pb) : done(false),prefix(p),prefixBits(pb) {}
+	std::atomic<bool> done;
+	Mutex lock;
+	C25519::Pair kp;
+	Address address;
+	const uint64_t prefix;
+	const unsigned int prefixBits;
+};
+
+// Like _Identity_generate_cond but also halts as soon as another thread wins
+struct _Identity_generate_cond_mt
+{
+	_Identity_generate_cond_mt() {}
+	_Identity_generate_cond_mt(unsigned char *sb,char *gm,const std::atomic<bool> *d) : digest(sb),genmem(gm),done(d) {}
+	inline bool operator()(const C25519::Pair &kp) const
+	{
+		if (done->load(std::memory_order_relaxed))
+			return true;
+		_computeMemoryHardHash(kp.pub.data,ZT_C25519_PUBLIC_KEY_LEN,digest,genmem);
+		return (digest[0] < ZT_IDENTITY_GEN_HASHCASH_FIRST_BYTE_LESS_THAN);
+	}
+	unsigned char *digest;
+	char *genmem;
+	const std::atomic<bool> *done;
+};
+
+static void _Identity_generate_thread(_Identity_generate_search *s)
+{
+	unsigned char digest[64];
+	char *genmem = new char[ZT_IDENTITY_GEN_MEMORY];
+	while (!s->done.load(std::memory_order_relaxed)) {
+		const C25519::Pair kp(C25519::generateSatisfying(_Identity_generate_cond_mt(digest,genmem,&s->done)));
+		if (s->done.load(std::memory_order_relaxed))
+			break;
+		const Address a(digest + 59,ZT_ADDRESS_LENGTH);
+		if (a.isReserved())
+			continue;
+		if ((s->prefixBits)&&((a.toInt() >> (40 - s->prefixBits)) != s->prefix))
+			continue;
+		Mutex::Lock _l(s->lock);
+		if (!s->done.load()) {
+			s->kp = kp;
+			s->address = a;
+			s->done.store(true);
+		}
+	}
+	delete [] genmem;
+}
+
+void Identity::generate(unsigned int threads,uint64_t prefix,unsigned int prefixBits)
+{
+	if (!threads)
+		threads = std::thread::hardware_concurrency();
+	if (!threads)
+		threads = 1;
+	if (prefixBits > 40)
+		prefixBits = 40;
+
+	_Identity_generate_search s(prefix & (0xffffffffffULL >> (40 - prefixBits)),prefixBits);
+	std::vector<std::thread> t;
+	for(unsigned int i=1;i<threads;++i)
+		t.push_back(std::thread(_Identity_generate_thread,&s));
+	_Identity_generate_thread(&s);
+	for(std::vector<std::thread>::iterator i(t.begin());i!=t.end();++i)
+		i->join();
+
+	_address = s.address;
+	_publicKey = s.kp.pub;
+	if (!_privateKey)
+		_privateKey = new C25519::Private();
+	*_privateKey = s.kp.priv;
+	Utils::burn(&(s.kp.priv),sizeof(s.kp.priv));
+}
+
 bool Identity::locallyValidate() const
 {
 	if (_address.isReserved())
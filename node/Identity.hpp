@@ -30,6 +30,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include <vector>
+
 #include "Constants.hpp"
 #include "Utils.hpp"
 #include "Address.hpp"
@@ -110,6 +112,18 @@ public:
 	 */
 	void generate();
 
+	/**
+	 * Generate a new identity using several threads
+	 *
+	 * Each thread searches its own random key pairs and the first to meet
+	 * the hashcash condition (and address prefix, if any) wins.
+	 *
+	 * @param threads Number of threads, or 0 for one per core
+	 * @param prefix Required leading address bits, right-aligned (e.g. 0xdead for "dead")
+	 * @param prefixBits Number of leading address bits that must match prefix (0-40)
+	 */
+	void generate(unsigned int threads,uint64_t prefix = 0,unsigned int prefixBits = 0);
+
 	/**
 	 * Check the validity of this identity's pairing of key to address
 	 *
@@ -198,6 +212,29 @@ public:
 		return false;
 	}
 
+	/**
+	 * Perform key agreement with several identities at once
+	 *
+	 * This identity must have a private key. (Check hasPrivate())
+	 *
+	 * @param ids Identities to agree with
+	 * @param n Number of identities
+	 * @param keys Result parameter to fill with n keys of klen bytes each, one after another
+	 * @param klen Length of each key in bytes
+	 * @return Was agreement successful?
+	 */
+	inline bool agree(const Identity *ids,unsigned int n,void *keys,unsigned int klen) const
+	{
+		if (_privateKey) {
+			std::vector<const C25519::Public *> pubs(n);
+			for(unsigned int i=0;i<n;++i)
+				pubs[i] = &(ids[i]._publicKey);
+			C25519::agreeBatch(*_privateKey,pubs.data(),n,keys,klen);
+			return true;
+		}
+		return false;
+	}
+
 	/**
 	 * @return This identity's address
 	 */
@@ -48,6 +48,7 @@
 #include "Tag.hpp"
 #include "Revocation.hpp"
 #include "Trace.hpp"
+#include "SignatureCache.hpp"
 
 namespace ZeroTier {
 
@@ -84,6 +85,7 @@ bool IncomingPacket::tryDecode(const RuntimeEnvironment *RR,void *tPtr)
 					return true;
 				}
 			}
+			_authenticatedPath(RR);
 
 			if (!uncompress()) {
 				RR->t->incomingPacketInvalid(tPtr,_path,packetId(),sourceAddress,hops(),Packet::VERB_NOP,"LZ4 decompression failed");
@@ -178,7 +180,7 @@ bool IncomingPacket::_doERROR(const RuntimeEnvironment *RR,void *tPtr,const Shar
 			networkId = at<uint64_t>(ZT_PROTO_VERB_ERROR_IDX_PAYLOAD);
 			const SharedPtr<Network> network(RR->node->network(networkId));
 			const int64_t now = RR->node->now();
-			if ((network)&&(network->config().com))
+			if ((network)&&(network->config()->com))
 				network->pushCredentialsNow(tPtr,peer->address(),now);
 		}	break;
 
@@ -331,14 +333,20 @@ bool IncomingPacket::_doHELLO(const RuntimeEnvironment *RR,void *tPtr,const bool
 			return true;
 		}
 
-		// Check rate limits
-		if (!RR->node->rateGateIdentityVerification(now,_path->address())) {
-			RR->t->incomingPacketDroppedHELLO(tPtr,_path,pid,fromAddress,"rate limit exceeded");
-			return true;
+		// Check rate limits and, if the caller allows it, defer key agreement
+		// so that it can be done in parallel with other new peers' HELLOs.
+		// A deferred HELLO comes back here with _helloKey set.
+		if (!_helloKey) {
+			if (!RR->node->rateGateIdentityVerification(now,_path->address())) {
+				RR->t->incomingPacketDroppedHELLO(tPtr,_path,pid,fromAddress,"rate limit exceeded");
+				return true;
+			}
+			if (RR->node->deferHello(tPtr,*this,id))
+				return true;
 		}
 
 		// Check packet integrity and MAC (this is faster than locallyValidate() so do it first to filter out total crap)
-		SharedPtr<Peer> newPeer(new Peer(RR,RR->identity,id));
+		SharedPtr<Peer> newPeer(new Peer(RR,RR->identity,id,_helloKey));
 		if (!dearmor(newPeer->key())) {
 			RR->t->incomingPacketMessageAuthenticationFailure(tPtr,_path,pid,fromAddress,hops(),"invalid MAC");
 			return true;
@@ -356,6 +364,7 @@ bool IncomingPacket::_doHELLO(const RuntimeEnvironment *RR,void *tPtr,const bool
 	}
 
 	// VALID -- if we made it here, packet passed identity and authenticity checks!
+	_authenticatedPath(RR);
 
 	// Get external surface address if present (was not in old versions)
 	InetAddress externalSurfaceAddress;
@@ -635,14 +644,15 @@ bool IncomingPacket::_doFRAME(const RuntimeEnvironment *RR,void *tPtr,const Shar
 	const SharedPtr<Network> network(RR->node->network(nwid));
 	bool trustEstablished = false;
 	if (network) {
-		if (network->gate(tPtr,peer)) {
+		const SharedPtr<const Network::Config> nconf(network->config());
+		if (network->gate(tPtr,*nconf,peer)) {
 			trustEstablished = true;
 			if (size() > ZT_PROTO_VERB_FRAME_IDX_PAYLOAD) {
 				const unsigned int etherType = at<uint16_t>(ZT_PROTO_VERB_FRAME_IDX_ETHERTYPE);
 				const MAC sourceMac(peer->address(),nwid);
 				const unsigned int frameLen = size() - ZT_PROTO_VERB_FRAME_IDX_PAYLOAD;
 				const uint8_t *const frameData = reinterpret_cast<const uint8_t *>(data()) + ZT_PROTO_VERB_FRAME_IDX_PAYLOAD;
-				if (network->filterIncomingPacket(tPtr,peer,RR->identity.address(),sourceMac,network->mac(),frameData,frameLen,etherType,0) > 0)
+				if (network->filterIncomingPacket(tPtr,*nconf,peer,RR->identity.address(),sourceMac,network->mac(),frameData,frameLen,etherType,0) > 0)
 					RR->node->putFrame(tPtr,nwid,network->userPtr(),sourceMac,network->mac(),etherType,0,(const void *)frameData,frameLen);
 			}
 		} else {
@@ -671,7 +681,8 @@ bool IncomingPacket::_doEXT_FRAME(const RuntimeEnvironment *RR,void *tPtr,const
 				network->addCredential(tPtr,com);
 		}
 
-		if (!network->gate(tPtr,peer)) {
+		const SharedPtr<const Network::Config> nconf(network->config());
+		if (!network->gate(tPtr,*nconf,peer)) {
 			RR->t->incomingNetworkAccessDenied(tPtr,network,_path,packetId(),size(),peer->address(),Packet::VERB_EXT_FRAME,true);
 			_sendErrorNeedCredentials(RR,tPtr,peer,nwid);
 			return false;
@@ -689,10 +700,10 @@ bool IncomingPacket::_doEXT_FRAME(const RuntimeEnvironment *RR,void *tPtr,const
 				return true;
 			}
 
-			switch (network->filterIncomingPacket(tPtr,peer,RR->identity.address(),from,to,frameData,frameLen,etherType,0)) {
+			switch (network->filterIncomingPacket(tPtr,*nconf,peer,RR->identity.address(),from,to,frameData,frameLen,etherType,0)) {
 				case 1:
 					if (from != MAC(peer->address(),nwid)) {
-						if (network->config().permitsBridging(peer->address())) {
+						if (nconf->permitsBridging(peer->address())) {
 							network->learnBridgeRoute(from,peer->address());
 						} else {
 							RR->t->incomingNetworkFrameDropped(tPtr,network,_path,packetId(),size(),peer->address(),Packet::VERB_EXT_FRAME,from,to,"bridging not allowed (remote)");
@@ -701,12 +712,12 @@ bool IncomingPacket::_doEXT_FRAME(const RuntimeEnvironment *RR,void *tPtr,const
 						}
 					} else if (to != network->mac()) {
 						if (to.isMulticast()) {
-							if (network->config().multicastLimit == 0) {
+							if (nconf->multicastLimit == 0) {
 								RR->t->incomingNetworkFrameDropped(tPtr,network,_path,packetId(),size(),peer->address(),Packet::VERB_EXT_FRAME,from,to,"multicast disabled");
 								peer->received(tPtr,_path,hops(),packetId(),payloadLength(),Packet::VERB_EXT_FRAME,0,Packet::VERB_NOP,true,nwid); // trustEstablished because COM is okay
 								return true;
 							}
-						} else if (!network->config().permitsBridging(RR->identity.address())) {
+						} else if (!nconf->permitsBridging(RR->identity.address())) {
 							RR->t->incomingNetworkFrameDropped(tPtr,network,_path,packetId(),size(),peer->address(),Packet::VERB_EXT_FRAME,from,to,"bridging not allowed (local)");
 							peer->received(tPtr,_path,hops(),packetId(),payloadLength(),Packet::VERB_EXT_FRAME,0,Packet::VERB_NOP,true,nwid); // trustEstablished because COM is okay
 							return true;
@@ -785,6 +796,8 @@ bool IncomingPacket::_doNETWORK_CREDENTIALS(const RuntimeEnvironment *RR,void *t
 	if (!peer->rateGateCredentialsReceived(RR->node->now()))
 		return true;
 
+	_batchVerifyCredentials(RR,tPtr);
+
 	CertificateOfMembership com;
 	Capability cap;
 	Tag tag;
@@ -1016,7 +1029,8 @@ bool IncomingPacket::_doMULTICAST_FRAME(const RuntimeEnvironment *RR,void *tPtr,
 				network->addCredential(tPtr,com);
 		}
 
-		if (!network->gate(tPtr,peer)) {
+		const SharedPtr<const Network::Config> nconf(network->config());
+		if (!network->gate(tPtr,*nconf,peer)) {
 			_sendErrorNeedCredentials(RR,tPtr,peer,nwid);
 			return false;
 		}
@@ -1039,7 +1053,7 @@ bool IncomingPacket::_doMULTICAST_FRAME(const RuntimeEnvironment *RR,void *tPtr,
 		const unsigned int etherType = at<uint16_t>(offset + ZT_PROTO_VERB_MULTICAST_FRAME_IDX_ETHERTYPE);
 		const unsigned int frameLen = size() - (offset + ZT_PROTO_VERB_MULTICAST_FRAME_IDX_FRAME);
 
-		if (network->config().multicastLimit == 0) {
+		if (nconf->multicastLimit == 0) {
 			RR->t->incomingNetworkFrameDropped(tPtr,network,_path,packetId(),size(),peer->address(),Packet::VERB_MULTICAST_FRAME,from,to.mac(),"multicast disabled");
 			peer->received(tPtr,_path,hops(),packetId(),payloadLength(),Packet::VERB_MULTICAST_FRAME,0,Packet::VERB_NOP,false,nwid);
 			return true;
@@ -1059,11 +1073,11 @@ bool IncomingPacket::_doMULTICAST_FRAME(const RuntimeEnvironment *RR,void *tPtr,
 
 			const uint8_t *const frameData = (const uint8_t *)field(offset + ZT_PROTO_VERB_MULTICAST_FRAME_IDX_FRAME,frameLen);
 
-			if ((flags & 0x08)&&(network->config().isMulticastReplicator(RR->identity.address())))
+			if ((flags & 0x08)&&(nconf->isMulticastReplicator(RR->identity.address())))
 				RR->mc->send(tPtr,RR->node->now(),network,peer->address(),to,from,etherType,frameData,frameLen);
 
 			if (from != MAC(peer->address(),nwid)) {
-				if (network->config().permitsBridging(peer->address())) {
+				if (nconf->permitsBridging(peer->address())) {
 					network->learnBridgeRoute(from,peer->address());
 				} else {
 					RR->t->incomingNetworkFrameDropped(tPtr,network,_path,packetId(),size(),peer->address(),Packet::VERB_MULTICAST_FRAME,from,to.mac(),"bridging not allowed (remote)");
@@ -1072,7 +1086,7 @@ bool IncomingPacket::_doMULTICAST_FRAME(const RuntimeEnvironment *RR,void *tPtr,
 				}
 			}
 
-			if (network->filterIncomingPacket(tPtr,peer,RR->identity.address(),from,to.mac(),frameData,frameLen,etherType,0) > 0)
+			if (network->filterIncomingPacket(tPtr,*nconf,peer,RR->identity.address(),from,to.mac(),frameData,frameLen,etherType,0) > 0)
 				RR->node->putFrame(tPtr,nwid,network->userPtr(),from,to.mac(),etherType,0,(const void *)frameData,frameLen);
 		}
 
@@ -1203,6 +1217,66 @@ bool IncomingPacket::_doREMOTE_TRACE(const RuntimeEnvironment *RR,void *tPtr,con
 	return true;
 }
 
+void IncomingPacket::_batchVerifyCredentials(const RuntimeEnvironment *RR,void *tPtr) const
+{
+	// Credential pushes usually carry several signatures from the same
+	// controller. Check them all at once up front so that every result is in
+	// RR->sc by the time each credential is verified and added on its own.
+	// Anything odd is left for _doNETWORK_CREDENTIALS() to deal with.
+	SignatureCache::Batch batch;
+	try {
+		CertificateOfMembership com;
+		Capability cap;
+		Tag tag;
+		Revocation revocation;
+		CertificateOfOwnership coo;
+
+		unsigned int p = ZT_PACKET_IDX_PAYLOAD;
+		while ((p < size())&&((*this)[p] != 0)) {
+			p += com.deserialize(*this,p);
+			if ((com)&&(RR->node->network(com.networkId())))
+				com.verify(RR,tPtr,&batch);
+		}
+		++p;
+
+		if (p < size()) {
+			const unsigned int numCapabilities = at<uint16_t>(p); p += 2;
+			for(unsigned int i=0;i<numCapabilities;++i) {
+				p += cap.deserialize(*this,p);
+				if (RR->node->network(cap.networkId()))
+					cap.verify(RR,tPtr,&batch);
+			}
+			if (p < size()) {
+				const unsigned int numTags = at<uint16_t>(p); p += 2;
+				for(unsigned int i=0;i<numTags;++i) {
+					p += tag.deserialize(*this,p);
+					if (RR->node->network(tag.networkId()))
+						tag.verify(RR,tPtr,&batch);
+				}
+			}
+			if (p < size()) {
+				const unsigned int numRevocations = at<uint16_t>(p); p += 2;
+				for(unsigned int i=0;i<numRevocations;++i) {
+					p += revocation.deserialize(*this,p);
+					if (RR->node->network(revocation.networkId()))
+						revocation.verify(RR,tPtr,&batch);
+				}
+			}
+			if (p < size()) {
+				const unsigned int numCoos = at<uint16_t>(p); p += 2;
+				for(unsigned int i=0;i<numCoos;++i) {
+					p += coo.deserialize(*this,p);
+					if (RR->node->network(coo.networkId()))
+						coo.verify(RR,tPtr,&batch);
+				}
+			}
+		}
+	} catch ( ... ) {}
+
+	if (batch.size() >= 2)
+		RR->sc->verify(batch);
+}
+
 void IncomingPacket::_sendErrorNeedCredentials(const RuntimeEnvironment *RR,void *tPtr,const SharedPtr<Peer> &peer,const uint64_t nwid)
 {
 	Packet outp(source(),RR->identity.address(),Packet::VERB_ERROR);
@@ -1214,4 +1288,15 @@ void IncomingPacket::_sendErrorNeedCredentials(const RuntimeEnvironment *RR,void
 	_path->send(RR,tPtr,outp.data(),outp.size(),RR->node->now());
 }
 
+void IncomingPacket::_authenticatedPath(const RuntimeEnvironment *RR)
+{
+	// A packet from a new physical address arrives on a pre-auth handle, and
+	// only now that it has authenticated does that address get a real Path.
+	if (_path->preAuth()) {
+		const int64_t lastIn = _path->lastIn();
+		_path = RR->topology->getPath(_path->localSocket(),_path->address());
+		_path->received(lastIn);
+	}
+}
+
 } // namespace ZeroTier
@@ -64,7 +64,8 @@ class IncomingPacket : public Packet
 public:
 	IncomingPacket() :
 		Packet(),
-		_receiveTime(0)
+		_receiveTime(0),
+		_helloKey((const uint8_t *)0)
 	{
 	}
 
@@ -80,7 +81,8 @@ public:
 	IncomingPacket(const void *data,unsigned int len,const SharedPtr<Path> &path,int64_t now) :
 		Packet(data,len),
 		_receiveTime(now),
-		_path(path)
+		_path(path),
+		_helloKey((const uint8_t *)0)
 	{
 	}
 
@@ -98,6 +100,7 @@ public:
 		copyFrom(data,len);
 		_receiveTime = now;
 		_path = path;
+		_helloKey = (const uint8_t *)0;
 	}
 
 	/**
@@ -115,6 +118,22 @@ public:
 	 */
 	bool tryDecode(const RuntimeEnvironment *RR,void *tPtr);
 
+	/**
+	 * Finish decoding a HELLO that was handed to Node::deferHello()
+	 *
+	 * @param RR Runtime environment
+	 * @param tPtr Thread pointer to be handed through to any callbacks called as a result of this call
+	 * @param key Key agreed with the identity in this HELLO (ZT_PEER_SECRET_KEY_LENGTH bytes)
+	 * @return True if decoding and processing is complete, false if caller should try again
+	 */
+	inline bool tryDecode(const RuntimeEnvironment *RR,void *tPtr,const uint8_t *key)
+	{
+		_helloKey = key;
+		const bool r = tryDecode(RR,tPtr);
+		_helloKey = (const uint8_t *)0;
+		return r;
+	}
+
 	/**
 	 * @return Time of packet receipt / start of decode
 	 */
@@ -144,9 +163,12 @@ private:
 	bool _doREMOTE_TRACE(const RuntimeEnvironment *RR,void *tPtr,const SharedPtr<Peer> &peer);
 
 	void _sendErrorNeedCredentials(const RuntimeEnvironment *RR,void *tPtr,const SharedPtr<Peer> &peer,const uint64_t nwid);
+	void _authenticatedPath(const RuntimeEnvironment *RR);
+	void _batchVerifyCredentials(const RuntimeEnvironment *RR,void *tPtr) const;
 
 	uint64_t _receiveTime;
 	SharedPtr<Path> _path;
+	const uint8_t *_helloKey; // set while finishing a deferred HELLO
 };
 
 } // namespace ZeroTier
@@ -38,6 +38,9 @@
 #include "Tag.hpp"
 #include "Revocation.hpp"
 #include "NetworkConfig.hpp"
+#include "Mutex.hpp"
+#include "SharedPtr.hpp"
+#include "AtomicCounter.hpp"
 
 #define ZT_MEMBERSHIP_CRED_ID_UNUSED 0xffffffffffffffffULL
 
@@ -51,10 +54,13 @@ class Network;
  *
  * This is essentially a relational join between Peer and Network.
  *
- * This class is not thread safe. It must be locked externally.
+ * This class is not thread safe. Network holds lock() while using it, so
+ * frames from different members never wait on each other.
  */
 class Membership
 {
+	friend class SharedPtr<Membership>;
+
 public:
 	enum AddCredentialResult
 	{
@@ -66,6 +72,11 @@ public:
 
 	Membership();
 
+	/**
+	 * @return Lock that must be held while calling any other method
+	 */
+	inline const Mutex &lock() const { return _lock; }
+
 	/**
 	 * Send COM and other credentials to this peer
 	 *
@@ -243,6 +254,10 @@ private:
 	Hashtable< uint32_t,Capability > _remoteCaps;
 	Hashtable< uint32_t,CertificateOfOwnership > _remoteCoos;
 
+	Mutex _lock;
+
+	AtomicCounter __refCount;
+
 public:
 	class CapabilityIterator
 	{
@@ -169,6 +169,7 @@ void Multicaster::send(
 {
 	unsigned long idxbuf[4096];
 	unsigned long *indexes = idxbuf;
+	const SharedPtr<const Network::Config> nconf(network->config());
 
 	// If we're in hub-and-spoke designated multicast replication mode, see if we
 	// have a multicast replicator active. If so, pick the best and send it
@@ -178,9 +179,9 @@ void Multicaster::send(
 	// the current protocol and could be fixed, but fixing it would add more
 	// complexity than the fix is probably worth. Bridges are generally high
 	// bandwidth nodes.
-	if (!network->config().isActiveBridge(RR->identity.address())) {
+	if (!nconf->isActiveBridge(RR->identity.address())) {
 		Address multicastReplicators[ZT_MAX_NETWORK_SPECIALISTS];
-		const unsigned int multicastReplicatorCount = network->config().multicastReplicators(multicastReplicators);
+		const unsigned int multicastReplicatorCount = nconf->multicastReplicators(multicastReplicators);
 		if (multicastReplicatorCount) {
 			if (std::find(multicastReplicators,multicastReplicators + multicastReplicatorCount,RR->identity.address()) == (multicastReplicators + multicastReplicatorCount)) {
 				SharedPtr<Peer> bestMulticastReplicator;
@@ -206,7 +207,7 @@ void Multicaster::send(
 					outp.append((uint32_t)mg.adi());
 					outp.append((uint16_t)etherType);
 					outp.append(data,len);
-					if (!network->config().disableCompression()) outp.compress();
+					if (!nconf->disableCompression()) outp.compress();
 					outp.armor(bestMulticastReplicator->key(),true);
 					bestMulticastReplicatorPath->send(RR,tPtr,outp.data(),outp.size(),now);
 					return;
@@ -236,8 +237,8 @@ void Multicaster::send(
 		}
 
 		Address activeBridges[ZT_MAX_NETWORK_SPECIALISTS];
-		const unsigned int activeBridgeCount = network->config().activeBridges(activeBridges);
-		const unsigned int limit = network->config().multicastLimit;
+		const unsigned int activeBridgeCount = nconf->activeBridges(activeBridges);
+		const unsigned int limit = nconf->multicastLimit;
 
 		if (gs.members.size() >= limit) {
 			// Skip queue if we already have enough members to complete the send operation
@@ -247,7 +248,7 @@ void Multicaster::send(
 				RR,
 				now,
 				network->id(),
-				network->config().disableCompression(),
+				nconf->disableCompression(),
 				limit,
 				1, // we'll still gather a little from peers to keep multicast list fresh
 				src,
@@ -290,7 +291,7 @@ void Multicaster::send(
 				explicitGatherPeers[numExplicitGatherPeers++] = network->controller();
 
 				Address ac[ZT_MAX_NETWORK_SPECIALISTS];
-				const unsigned int accnt = network->config().alwaysContactAddresses(ac);
+				const unsigned int accnt = nconf->alwaysContactAddresses(ac);
 				unsigned int shuffled[ZT_MAX_NETWORK_SPECIALISTS];
 				for(unsigned int i=0;i<accnt;++i)
 					shuffled[i] = i;
@@ -308,7 +309,7 @@ void Multicaster::send(
 						break;
 				}
 
-				std::vector<Address> anchors(network->config().anchors());
+				std::vector<Address> anchors(nconf->anchors());
 				for(std::vector<Address>::const_iterator a(anchors.begin());a!=anchors.end();++a) {
 					if (*a != RR->identity.address()) {
 						explicitGatherPeers[numExplicitGatherPeers++] = *a;
@@ -318,7 +319,7 @@ void Multicaster::send(
 				}
 
 				for(unsigned int k=0;k<numExplicitGatherPeers;++k) {
-					const CertificateOfMembership *com = (network) ? ((network->config().com) ? &(network->config().com) : (const CertificateOfMembership *)0) : (const CertificateOfMembership *)0;
+					const CertificateOfMembership *com = (network) ? ((nconf->com) ? &(nconf->com) : (const CertificateOfMembership *)0) : (const CertificateOfMembership *)0;
 					Packet outp(explicitGatherPeers[k],RR->identity.address(),Packet::VERB_MULTICAST_GATHER);
 					outp.append(network->id());
 					outp.append((uint8_t)((com) ? 0x01 : 0x00));
@@ -339,7 +340,7 @@ void Multicaster::send(
 				RR,
 				now,
 				network->id(),
-				network->config().disableCompression(),
+				nconf->disableCompression(),
 				limit,
 				gatherLimit,
 				src,
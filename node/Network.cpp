@@ -81,6 +81,16 @@ static bool _ipv6GetPayload(const uint8_t *frameData,unsigned int frameLen,unsig
 	return false; // overflow == invalid
 }
 
+// Holds a Membership's lock for the life of this object, if there is a Membership
+class _MembershipLock
+{
+public:
+	_MembershipLock(const Membership *m) : _m(m) { if (m) m->lock().lock(); }
+	~_MembershipLock() { if (_m) _m->lock().unlock(); }
+private:
+	const Membership *const _m;
+};
+
 enum _doZtFilterResult
 {
 	DOZTFILTER_NO_MATCH,
@@ -92,7 +102,7 @@ enum _doZtFilterResult
 
 static _doZtFilterResult _doZtFilter(
 	const RuntimeEnvironment *RR,
-	Trace::RuleResultLog &rrl,
+	Trace::RuleResultLog *const rrl, // NULL unless rule tracing is enabled
 	const NetworkConfig &nconf,
 	const Membership *membership, // can be NULL
 	const bool inbound,
@@ -118,7 +128,8 @@ static _doZtFilterResult _doZtFilter(
 	// ACTION with no MATCH entries preceding it is always taken.
 	uint8_t thisSetMatches = 1;
 
-	rrl.clear();
+	if (rrl)
+		rrl->clear();
 
 	for(unsigned int rn=0;rn<ruleCount;++rn) {
 		const ZT_VirtualNetworkRuleType rt = (ZT_VirtualNetworkRuleType)(rules[rn].t & 0x3f);
@@ -194,7 +205,8 @@ static _doZtFilterResult _doZtFilter(
 		// Circuit breaker: no need to evaluate an AND if the set's match state
 		// is currently false since anything AND false is false.
 		if ((!thisSetMatches)&&(!(rules[rn].t & 0x40))) {
-			rrl.logSkipped(rn,thisSetMatches);
+			if (rrl)
+				rrl->logSkipped(rn,thisSetMatches);
 			continue;
 		}
 
@@ -539,7 +551,8 @@ static _doZtFilterResult _doZtFilter(
 				break;
 		}
 
-		rrl.log(rn,thisRuleMatches,thisSetMatches);
+		if (rrl)
+			rrl->log(rn,thisRuleMatches,thisSetMatches);
 
 		if ((rules[rn].t & 0x40))
 			thisSetMatches |= (thisRuleMatches ^ ((rules[rn].t >> 7) & 1));
@@ -560,7 +573,9 @@ Network::Network(const RuntimeEnvironment *renv,void *tPtr,uint64_t nwid,void *u
 	_lastAnnouncedMulticastGroupsUpstream(0),
 	_mac(renv->identity.address(),nwid),
 	_portInitialized(false),
+	_config(new Config()),
 	_lastConfigUpdate(0),
+	_traceLevel(-1),
 	_destroyed(false),
 	_netconfFailure(NETCONF_FAILURE_NONE),
 	_portError(0)
@@ -616,10 +631,12 @@ Network::~Network()
 	} else {
 		RR->node->configureVirtualNetworkPort((void *)0,_id,&_uPtr,ZT_VIRTUAL_NETWORK_CONFIG_OPERATION_DOWN,&ctmp);
 	}
+
 }
 
 bool Network::filterOutgoingPacket(
 	void *tPtr,
+	const NetworkConfig &nconf,
 	const bool noTee,
 	const Address &ztSource,
 	const Address &ztDest,
@@ -639,19 +656,19 @@ bool Network::filterOutgoingPacket(
 	unsigned int ccLength = 0;
 	bool ccWatch = false;
 
-	Mutex::Lock _l(_lock);
-
-	Membership *const membership = (ztDest) ? _memberships.get(ztDest) : (Membership *)0;
+	const bool traceRules = (traceLevel() >= (int)Trace::LEVEL_RULES); // rule logs are only kept if they will be sent
+	const SharedPtr<Membership> membership((ztDest) ? _existingMembership(ztDest) : SharedPtr<Membership>());
+	_MembershipLock _ml(membership.ptr());
 
-	switch(_doZtFilter(RR,rrl,_config,membership,false,ztSource,ztFinalDest,macSource,macDest,frameData,frameLen,etherType,vlanId,_config.rules,_config.ruleCount,cc,ccLength,ccWatch,qosBucket)) {
+	switch(_doZtFilter(RR,(traceRules) ? &rrl : (Trace::RuleResultLog *)0,nconf,membership.ptr(),false,ztSource,ztFinalDest,macSource,macDest,frameData,frameLen,etherType,vlanId,nconf.rules,nconf.ruleCount,cc,ccLength,ccWatch,qosBucket)) {
 
 		case DOZTFILTER_NO_MATCH: {
-			for(unsigned int c=0;c<_config.capabilityCount;++c) {
+			for(unsigned int c=0;c<nconf.capabilityCount;++c) {
 				ztFinalDest = ztDest; // sanity check, shouldn't be possible if there was no match
 				Address cc2;
 				unsigned int ccLength2 = 0;
 				bool ccWatch2 = false;
-				switch (_doZtFilter(RR,crrl,_config,membership,false,ztSource,ztFinalDest,macSource,macDest,frameData,frameLen,etherType,vlanId,_config.capabilities[c].rules(),_config.capabilities[c].ruleCount(),cc2,ccLength2,ccWatch2,qosBucket)) {
+				switch (_doZtFilter(RR,(traceRules) ? &crrl : (Trace::RuleResultLog *)0,nconf,membership.ptr(),false,ztSource,ztFinalDest,macSource,macDest,frameData,frameLen,etherType,vlanId,nconf.capabilities[c].rules(),nconf.capabilities[c].ruleCount(),cc2,ccLength2,ccWatch2,qosBucket)) {
 					case DOZTFILTER_NO_MATCH:
 					case DOZTFILTER_DROP: // explicit DROP in a capability just terminates its evaluation and is an anti-pattern
 						break;
@@ -682,7 +699,7 @@ bool Network::filterOutgoingPacket(
 		}	break;
 
 		case DOZTFILTER_DROP:
-			if (_config.remoteTraceTarget)
+			if (traceRules)
 				RR->t->networkFilter(tPtr,*this,rrl,(Trace::RuleResultLog *)0,(Capability *)0,ztSource,ztDest,macSource,macDest,frameData,frameLen,etherType,vlanId,noTee,false,0);
 			return false;
 
@@ -720,23 +737,24 @@ bool Network::filterOutgoingPacket(
 			outp.compress();
 			RR->sw->send(tPtr,outp,true);
 
-			if (_config.remoteTraceTarget)
-				RR->t->networkFilter(tPtr,*this,rrl,(localCapabilityIndex >= 0) ? &crrl : (Trace::RuleResultLog *)0,(localCapabilityIndex >= 0) ? &(_config.capabilities[localCapabilityIndex]) : (Capability *)0,ztSource,ztDest,macSource,macDest,frameData,frameLen,etherType,vlanId,noTee,false,0);
+			if (traceRules)
+				RR->t->networkFilter(tPtr,*this,rrl,(localCapabilityIndex >= 0) ? &crrl : (Trace::RuleResultLog *)0,(localCapabilityIndex >= 0) ? &(nconf.capabilities[localCapabilityIndex]) : (Capability *)0,ztSource,ztDest,macSource,macDest,frameData,frameLen,etherType,vlanId,noTee,false,0);
 			return false; // DROP locally, since we redirected
 		} else {
-			if (_config.remoteTraceTarget)
-				RR->t->networkFilter(tPtr,*this,rrl,(localCapabilityIndex >= 0) ? &crrl : (Trace::RuleResultLog *)0,(localCapabilityIndex >= 0) ? &(_config.capabilities[localCapabilityIndex]) : (Capability *)0,ztSource,ztDest,macSource,macDest,frameData,frameLen,etherType,vlanId,noTee,false,1);
+			if (traceRules)
+				RR->t->networkFilter(tPtr,*this,rrl,(localCapabilityIndex >= 0) ? &crrl : (Trace::RuleResultLog *)0,(localCapabilityIndex >= 0) ? &(nconf.capabilities[localCapabilityIndex]) : (Capability *)0,ztSource,ztDest,macSource,macDest,frameData,frameLen,etherType,vlanId,noTee,false,1);
 			return true;
 		}
 	} else {
-		if (_config.remoteTraceTarget)
-			RR->t->networkFilter(tPtr,*this,rrl,(localCapabilityIndex >= 0) ? &crrl : (Trace::RuleResultLog *)0,(localCapabilityIndex >= 0) ? &(_config.capabilities[localCapabilityIndex]) : (Capability *)0,ztSource,ztDest,macSource,macDest,frameData,frameLen,etherType,vlanId,noTee,false,0);
+		if (traceRules)
+			RR->t->networkFilter(tPtr,*this,rrl,(localCapabilityIndex >= 0) ? &crrl : (Trace::RuleResultLog *)0,(localCapabilityIndex >= 0) ? &(nconf.capabilities[localCapabilityIndex]) : (Capability *)0,ztSource,ztDest,macSource,macDest,frameData,frameLen,etherType,vlanId,noTee,false,0);
 		return false;
 	}
 }
 
 int Network::filterIncomingPacket(
 	void *tPtr,
+	const NetworkConfig &nconf,
 	const SharedPtr<Peer> &sourcePeer,
 	const Address &ztDest,
 	const MAC &macSource,
@@ -756,20 +774,20 @@ int Network::filterIncomingPacket(
 
 	uint8_t qosBucket = 255; // For incoming packets this is a dummy value
 
-	Mutex::Lock _l(_lock);
-
-	Membership &membership = _membership(sourcePeer->address());
+	const bool traceRules = (traceLevel() >= (int)Trace::LEVEL_RULES);
+	const SharedPtr<Membership> membership(_membership(sourcePeer->address()));
+	Mutex::Lock _ml(membership->lock()); // held while c points into membership
 
-	switch (_doZtFilter(RR,rrl,_config,&membership,true,sourcePeer->address(),ztFinalDest,macSource,macDest,frameData,frameLen,etherType,vlanId,_config.rules,_config.ruleCount,cc,ccLength,ccWatch,qosBucket)) {
+	switch (_doZtFilter(RR,(traceRules) ? &rrl : (Trace::RuleResultLog *)0,nconf,membership.ptr(),true,sourcePeer->address(),ztFinalDest,macSource,macDest,frameData,frameLen,etherType,vlanId,nconf.rules,nconf.ruleCount,cc,ccLength,ccWatch,qosBucket)) {
 
 		case DOZTFILTER_NO_MATCH: {
-			Membership::CapabilityIterator mci(membership,_config);
+			Membership::CapabilityIterator mci(*membership,nconf);
 			while ((c = mci.next())) {
 				ztFinalDest = ztDest; // sanity check, should be unmodified if there was no match
 				Address cc2;
 				unsigned int ccLength2 = 0;
 				bool ccWatch2 = false;
-				switch(_doZtFilter(RR,crrl,_config,&membership,true,sourcePeer->address(),ztFinalDest,macSource,macDest,frameData,frameLen,etherType,vlanId,c->rules(),c->ruleCount(),cc2,ccLength2,ccWatch2,qosBucket)) {
+				switch(_doZtFilter(RR,(traceRules) ? &crrl : (Trace::RuleResultLog *)0,nconf,membership.ptr(),true,sourcePeer->address(),ztFinalDest,macSource,macDest,frameData,frameLen,etherType,vlanId,c->rules(),c->ruleCount(),cc2,ccLength2,ccWatch2,qosBucket)) {
 					case DOZTFILTER_NO_MATCH:
 					case DOZTFILTER_DROP: // explicit DROP in a capability just terminates its evaluation and is an anti-pattern
 						break;
@@ -800,7 +818,7 @@ int Network::filterIncomingPacket(
 		}	break;
 
 		case DOZTFILTER_DROP:
-			if (_config.remoteTraceTarget)
+			if (traceRules)
 				RR->t->networkFilter(tPtr,*this,rrl,(Trace::RuleResultLog *)0,(Capability *)0,sourcePeer->address(),ztDest,macSource,macDest,frameData,frameLen,etherType,vlanId,false,true,0);
 			return 0; // DROP
 
@@ -837,13 +855,13 @@ int Network::filterIncomingPacket(
 			outp.compress();
 			RR->sw->send(tPtr,outp,true);
 
-			if (_config.remoteTraceTarget)
+			if (traceRules)
 				RR->t->networkFilter(tPtr,*this,rrl,(c) ? &crrl : (Trace::RuleResultLog *)0,c,sourcePeer->address(),ztDest,macSource,macDest,frameData,frameLen,etherType,vlanId,false,true,0);
 			return 0; // DROP locally, since we redirected
 		}
 	}
 
-	if (_config.remoteTraceTarget)
+	if (traceRules)
 		RR->t->networkFilter(tPtr,*this,rrl,(c) ? &crrl : (Trace::RuleResultLog *)0,c,sourcePeer->address(),ztDest,macSource,macDest,frameData,frameLen,etherType,vlanId,false,true,accept);
 	return accept;
 }
@@ -935,10 +953,12 @@ uint64_t Network::handleConfigChunk(void *tPtr,const uint64_t packetId,const Add
 
 			// New properly verified chunks can be flooded "virally" through the network
 			if (fastPropagate) {
-				Address *a = (Address *)0;
-				Membership *m = (Membership *)0;
-				Hashtable<Address,Membership>::Iterator i(_memberships);
-				while (i.next(a,m)) {
+				std::vector<Address> members;
+				{
+					Mutex::Lock _ml(_memberships_m);
+					_memberships.appendKeys(members);
+				}
+				for(std::vector<Address>::const_iterator a(members.begin());a!=members.end();++a) {
 					if ((*a != source)&&(*a != controller())) {
 						Packet outp(*a,RR->identity.address(),Packet::VERB_NETWORK_CONFIG);
 						outp.append(reinterpret_cast<const uint8_t *>(chunk.data()) + start,chunk.size() - start);
@@ -1015,15 +1035,23 @@ int Network::setConfiguration(void *tPtr,const NetworkConfig &nconf,bool saveToD
 	try {
 		if ((nconf.issuedTo != RR->identity.address())||(nconf.networkId != _id))
 			return 0; // invalid config that is not for us or not for this network
-		if (_config == nconf)
+		if (*config() == nconf)
 			return 1; // OK config, but duplicate of what we already have
 
+		SharedPtr<const Config> newConfig(new Config(nconf));
 		ZT_VirtualNetworkConfig ctmp;
 		bool oldPortInitialized;
 		{	// do things that require lock here, but unlock before calling callbacks
 			Mutex::Lock _l(_lock);
 
-			_config = nconf;
+			// After the swap newConfig holds the old config. Readers that copied
+			// it keep it alive, and it's freed when the last of them lets go.
+			_traceLevel.store(RR->t->networkTraceLevel(*newConfig),std::memory_order_relaxed);
+			{
+				Mutex::Lock _cl(_config_m);
+				_config.swap(newConfig);
+			}
+
 			_lastConfigUpdate = RR->node->now();
 			_netconfFailure = NETCONF_FAILURE_NONE;
 
@@ -1220,9 +1248,10 @@ void Network::requestConfiguration(void *tPtr)
 	const unsigned int rmdSize = rmd.sizeBytes();
 	outp.append((uint16_t)rmdSize);
 	outp.append((const void *)rmd.data(),rmdSize);
-	if (_config) {
-		outp.append((uint64_t)_config.revision);
-		outp.append((uint64_t)_config.timestamp);
+	const SharedPtr<const Config> nconf(config());
+	if (*nconf) {
+		outp.append((uint64_t)nconf->revision);
+		outp.append((uint64_t)nconf->timestamp);
 	} else {
 		outp.append((unsigned char)0,16);
 	}
@@ -1231,17 +1260,24 @@ void Network::requestConfiguration(void *tPtr)
 	RR->sw->send(tPtr,outp,true);
 }
 
-bool Network::gate(void *tPtr,const SharedPtr<Peer> &peer)
+bool Network::gate(void *tPtr,const NetworkConfig &nconf,const SharedPtr<Peer> &peer)
 {
 	const int64_t now = RR->node->now();
-	Mutex::Lock _l(_lock);
 	try {
-		if (_config) {
-			Membership *m = _memberships.get(peer->address());
-			if ( (_config.isPublic()) || ((m)&&(m->isAllowedOnNetwork(_config))) ) {
-				if (!m)
-					m = &(_membership(peer->address()));
-				if (m->multicastLikeGate(now)) {
+		if (nconf) {
+			SharedPtr<Membership> m(_existingMembership(peer->address()));
+			if ((!m)&&(nconf.isPublic()))
+				m = _membership(peer->address());
+			if (m) {
+				bool announce;
+				{
+					Mutex::Lock _ml(m->lock());
+					if ((!nconf.isPublic())&&(!m->isAllowedOnNetwork(nconf)))
+						return false;
+					announce = m->multicastLikeGate(now);
+				}
+				if (announce) {
+					Mutex::Lock _l(_lock);
 					_announceMulticastGroupsTo(tPtr,peer->address(),_allMulticastGroups());
 				}
 				return true;
@@ -1253,9 +1289,11 @@ bool Network::gate(void *tPtr,const SharedPtr<Peer> &peer)
 
 bool Network::recentlyAssociatedWith(const Address &addr)
 {
-	Mutex::Lock _l(_lock);
-	const Membership *m = _memberships.get(addr);
-	return ((m)&&(m->recentlyAssociated(RR->node->now())));
+	const SharedPtr<Membership> m(_existingMembership(addr));
+	if (!m)
+		return false;
+	Mutex::Lock _ml(m->lock());
+	return m->recentlyAssociated(RR->node->now());
 }
 
 void Network::clean()
@@ -1277,13 +1315,19 @@ void Network::clean()
 	}
 
 	{
+		const SharedPtr<const Config> cfg(config());
+		const NetworkConfig &nconf = *cfg;
+		Mutex::Lock _ml(_memberships_m);
 		Address *a = (Address *)0;
-		Membership *m = (Membership *)0;
-		Hashtable<Address,Membership>::Iterator i(_memberships);
+		SharedPtr<Membership> *m = (SharedPtr<Membership> *)0;
+		Hashtable< Address,SharedPtr<Membership> >::Iterator i(_memberships);
 		while (i.next(a,m)) {
-			if (!RR->topology->getPeerNoCache(*a))
+			if (!RR->topology->getPeerNoCache(*a)) {
 				_memberships.erase(*a);
-			else m->clean(now,_config);
+			} else {
+				Mutex::Lock _l2((*m)->lock());
+				(*m)->clean(now,nconf);
+			}
 		}
 	}
 }
@@ -1338,8 +1382,9 @@ Membership::AddCredentialResult Network::addCredential(void *tPtr,const Certific
 {
 	if (com.networkId() != _id)
 		return Membership::ADD_REJECTED;
-	Mutex::Lock _l(_lock);
-	return _membership(com.issuedTo()).addCredential(RR,tPtr,_config,com);
+	const SharedPtr<Membership> m(_membership(com.issuedTo()));
+	Mutex::Lock _ml(m->lock());
+	return m->addCredential(RR,tPtr,*config(),com);
 }
 
 Membership::AddCredentialResult Network::addCredential(void *tPtr,const Address &sentFrom,const Revocation &rev)
@@ -1347,16 +1392,20 @@ Membership::AddCredentialResult Network::addCredential(void *tPtr,const Address
 	if (rev.networkId() != _id)
 		return Membership::ADD_REJECTED;
 
-	Mutex::Lock _l(_lock);
-	Membership &m = _membership(rev.target());
-
-	const Membership::AddCredentialResult result = m.addCredential(RR,tPtr,_config,rev);
+	const SharedPtr<Membership> m(_membership(rev.target()));
+	Membership::AddCredentialResult result;
+	{
+		Mutex::Lock _ml(m->lock());
+		result = m->addCredential(RR,tPtr,*config(),rev);
+	}
 
 	if ((result == Membership::ADD_ACCEPTED_NEW)&&(rev.fastPropagate())) {
-		Address *a = (Address *)0;
-		Membership *m = (Membership *)0;
-		Hashtable<Address,Membership>::Iterator i(_memberships);
-		while (i.next(a,m)) {
+		std::vector<Address> members;
+		{
+			Mutex::Lock _ml(_memberships_m);
+			_memberships.appendKeys(members);
+		}
+		for(std::vector<Address>::const_iterator a(members.begin());a!=members.end();++a) {
 			if ((*a != sentFrom)&&(*a != rev.signer())) {
 				Packet outp(*a,RR->identity.address(),Packet::VERB_NETWORK_CREDENTIALS);
 				outp.append((uint8_t)0x00); // no COM
@@ -1390,7 +1439,7 @@ ZT_VirtualNetworkStatus Network::_status() const
 		case NETCONF_FAILURE_NOT_FOUND:
 			return ZT_NETWORK_STATUS_NOT_FOUND;
 		case NETCONF_FAILURE_NONE:
-			return ((_config) ? ZT_NETWORK_STATUS_OK : ZT_NETWORK_STATUS_REQUESTING_CONFIGURATION);
+			return ((*config()) ? ZT_NETWORK_STATUS_OK : ZT_NETWORK_STATUS_REQUESTING_CONFIGURATION);
 		default:
 			return ZT_NETWORK_STATUS_PORT_ERROR;
 	}
@@ -1399,25 +1448,27 @@ ZT_VirtualNetworkStatus Network::_status() const
 void Network::_externalConfig(ZT_VirtualNetworkConfig *ec) const
 {
 	// assumes _lock is locked
+	const SharedPtr<const Config> cfg(config());
+	const NetworkConfig &nconf = *cfg;
 	ec->nwid = _id;
 	ec->mac = _mac.toInt();
-	if (_config)
-		Utils::scopy(ec->name,sizeof(ec->name),_config.name);
+	if (nconf)
+		Utils::scopy(ec->name,sizeof(ec->name),nconf.name);
 	else ec->name[0] = (char)0;
 	ec->status = _status();
-	ec->type = (_config) ? (_config.isPrivate() ? ZT_NETWORK_TYPE_PRIVATE : ZT_NETWORK_TYPE_PUBLIC) : ZT_NETWORK_TYPE_PRIVATE;
-	ec->mtu = (_config) ? _config.mtu : ZT_DEFAULT_MTU;
+	ec->type = (nconf) ? (nconf.isPrivate() ? ZT_NETWORK_TYPE_PRIVATE : ZT_NETWORK_TYPE_PUBLIC) : ZT_NETWORK_TYPE_PRIVATE;
+	ec->mtu = (nconf) ? nconf.mtu : ZT_DEFAULT_MTU;
 	ec->dhcp = 0;
-	std::vector<Address> ab(_config.activeBridges());
+	std::vector<Address> ab(nconf.activeBridges());
 	ec->bridge = (std::find(ab.begin(),ab.end(),RR->identity.address()) != ab.end()) ? 1 : 0;
-	ec->broadcastEnabled = (_config) ? (_config.enableBroadcast() ? 1 : 0) : 0;
+	ec->broadcastEnabled = (nconf) ? (nconf.enableBroadcast() ? 1 : 0) : 0;
 	ec->portError = _portError;
-	ec->netconfRevision = (_config) ? (unsigned long)_config.revision : 0;
+	ec->netconfRevision = (nconf) ? (unsigned long)nconf.revision : 0;
 
 	ec->assignedAddressCount = 0;
 	for(unsigned int i=0;i<ZT_MAX_ZT_ASSIGNED_ADDRESSES;++i) {
-		if (i < _config.staticIpCount) {
-			memcpy(&(ec->assignedAddresses[i]),&(_config.staticIps[i]),sizeof(struct sockaddr_storage));
+		if (i < nconf.staticIpCount) {
+			memcpy(&(ec->assignedAddresses[i]),&(nconf.staticIps[i]),sizeof(struct sockaddr_storage));
 			++ec->assignedAddressCount;
 		} else {
 			memset(&(ec->assignedAddresses[i]),0,sizeof(struct sockaddr_storage));
@@ -1426,8 +1477,8 @@ void Network::_externalConfig(ZT_VirtualNetworkConfig *ec) const
 
 	ec->routeCount = 0;
 	for(unsigned int i=0;i<ZT_MAX_NETWORK_ROUTES;++i) {
-		if (i < _config.routeCount) {
-			memcpy(&(ec->routes[i]),&(_config.routes[i]),sizeof(ZT_VirtualNetworkRoute));
+		if (i < nconf.routeCount) {
+			memcpy(&(ec->routes[i]),&(nconf.routes[i]),sizeof(ZT_VirtualNetworkRoute));
 			++ec->routeCount;
 		} else {
 			memset(&(ec->routes[i]),0,sizeof(ZT_VirtualNetworkRoute));
@@ -1457,7 +1508,7 @@ void Network::_sendUpdatesToMembers(void *tPtr,const MulticastGroup *const newMu
 		if (!newMulticastGroup)
 			_lastAnnouncedMulticastGroupsUpstream = now;
 
-		alwaysAnnounceTo = _config.alwaysContactAddresses();
+		alwaysAnnounceTo = config()->alwaysContactAddresses();
 		if (std::find(alwaysAnnounceTo.begin(),alwaysAnnounceTo.end(),controller()) == alwaysAnnounceTo.end())
 			alwaysAnnounceTo.push_back(controller());
 		const std::vector<Address> upstreams(RR->topology->upstreamAddresses());
@@ -1470,9 +1521,9 @@ void Network::_sendUpdatesToMembers(void *tPtr,const MulticastGroup *const newMu
 		for(std::vector<Address>::const_iterator a(alwaysAnnounceTo.begin());a!=alwaysAnnounceTo.end();++a) {
 			/*
 			// push COM to non-members so they can do multicast request auth
-			if ( (_config.com) && (!_memberships.contains(*a)) && (*a != RR->identity.address()) ) {
+			if ( (config()->com) && (!_memberships.contains(*a)) && (*a != RR->identity.address()) ) {
 				Packet outp(*a,RR->identity.address(),Packet::VERB_NETWORK_CREDENTIALS);
-				_config.com.serialize(outp);
+				config()->com.serialize(outp);
 				outp.append((uint8_t)0x00);
 				outp.append((uint16_t)0); // no capabilities
 				outp.append((uint16_t)0); // no tags
@@ -1486,12 +1537,21 @@ void Network::_sendUpdatesToMembers(void *tPtr,const MulticastGroup *const newMu
 	}
 
 	{
-		Address *a = (Address *)0;
-		Membership *m = (Membership *)0;
-		Hashtable<Address,Membership>::Iterator i(_memberships);
-		while (i.next(a,m)) {
-			if ( ( m->multicastLikeGate(now) || (newMulticastGroup) ) && (m->isAllowedOnNetwork(_config)) && (!std::binary_search(alwaysAnnounceTo.begin(),alwaysAnnounceTo.end(),*a)) )
-				_announceMulticastGroupsTo(tPtr,*a,groups);
+		const SharedPtr<const Config> cfg(config());
+		const NetworkConfig &nconf = *cfg;
+		std::vector< std::pair< Address,SharedPtr<Membership> > > members;
+		{
+			Mutex::Lock _ml(_memberships_m);
+			members = _memberships.entries();
+		}
+		for(std::vector< std::pair< Address,SharedPtr<Membership> > >::iterator m(members.begin());m!=members.end();++m) {
+			bool announce;
+			{
+				Mutex::Lock _ml(m->second->lock());
+				announce = ( ( m->second->multicastLikeGate(now) || (newMulticastGroup) ) && (m->second->isAllowedOnNetwork(nconf)) );
+			}
+			if ((announce)&&(!std::binary_search(alwaysAnnounceTo.begin(),alwaysAnnounceTo.end(),m->first)))
+				_announceMulticastGroupsTo(tPtr,m->first,groups);
 		}
 	}
 }
@@ -1529,17 +1589,28 @@ std::vector<MulticastGroup> Network::_allMulticastGroups() const
 	mgs.reserve(_myMulticastGroups.size() + _multicastGroupsBehindMe.size() + 1);
 	mgs.insert(mgs.end(),_myMulticastGroups.begin(),_myMulticastGroups.end());
 	_multicastGroupsBehindMe.appendKeys(mgs);
-	if ((_config)&&(_config.enableBroadcast()))
+	const SharedPtr<const Config> nconf(config());
+	if ((*nconf)&&(nconf->enableBroadcast()))
 		mgs.push_back(Network::BROADCAST);
 	std::sort(mgs.begin(),mgs.end());
 	mgs.erase(std::unique(mgs.begin(),mgs.end()),mgs.end());
 	return mgs;
 }
 
-Membership &Network::_membership(const Address &a)
+SharedPtr<Membership> Network::_membership(const Address &a)
 {
-	// assumes _lock is locked
-	return _memberships[a];
+	Mutex::Lock _l(_memberships_m);
+	SharedPtr<Membership> &m = _memberships[a];
+	if (!m)
+		m.set(new Membership());
+	return m;
+}
+
+SharedPtr<Membership> Network::_existingMembership(const Address &a) const
+{
+	Mutex::Lock _l(_memberships_m);
+	const SharedPtr<Membership> *const m = _memberships.get(a);
+	return ((m) ? *m : SharedPtr<Membership>());
 }
 
 } // namespace ZeroTier
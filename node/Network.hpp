@@ -36,6 +36,7 @@
 #include <vector>
 #include <algorithm>
 #include <stdexcept>
+#include <atomic>
 
 #include "Constants.hpp"
 #include "Hashtable.hpp"
@@ -77,6 +78,22 @@ public:
 	 */
 	static inline Address controllerFor(uint64_t nwid) { return Address(nwid >> 24); }
 
+	/**
+	 * An applied network config, reference counted so that readers can keep
+	 * using it after setConfiguration() has replaced it
+	 */
+	class Config : public NetworkConfig
+	{
+		friend class SharedPtr<const Config>;
+
+	public:
+		Config() {}
+		Config(const NetworkConfig &nc) : NetworkConfig(nc) {}
+
+	private:
+		mutable AtomicCounter __refCount;
+	};
+
 	/**
 	 * Construct a new network
 	 *
@@ -95,13 +112,43 @@ public:
 
 	inline uint64_t id() const { return _id; }
 	inline Address controller() const { return Address(_id >> 24); }
-	inline bool multicastEnabled() const { return (_config.multicastLimit > 0); }
-	inline bool hasConfig() const { return (_config); }
+	inline bool multicastEnabled() const { return (config()->multicastLimit > 0); }
+	inline bool hasConfig() const { return ((bool)*config()); }
 	inline uint64_t lastConfigUpdate() const { return _lastConfigUpdate; }
 	inline ZT_VirtualNetworkStatus status() const { Mutex::Lock _l(_lock); return _status(); }
-	inline const NetworkConfig &config() const { return _config; }
 	inline const MAC &mac() const { return _mac; }
 
+	/**
+	 * Get the current network config
+	 *
+	 * Configs are immutable once applied. setConfiguration() publishes a new
+	 * one and the old one is freed when the last reader drops it, so hold
+	 * the returned pointer for as long as anything from it is used.
+	 *
+	 * Each call takes _config_m and bumps a reference count. Per-frame code
+	 * should call this once per packet and pass the snapshot down to gate()
+	 * and the filter methods rather than using their convenience overloads.
+	 *
+	 * @return Current config, never NULL (empty/false if none yet)
+	 */
+	inline SharedPtr<const Config> config() const
+	{
+		Mutex::Lock _l(_config_m);
+		return _config;
+	}
+
+	/**
+	 * @return Highest level at which anything traces this network, or -1 if nothing does (see Trace::networkTraceLevel())
+	 */
+	inline int traceLevel() const { return _traceLevel.load(std::memory_order_relaxed); }
+
+	/**
+	 * Update the cached trace level (called by Trace when trace settings are memoized)
+	 *
+	 * @param level New trace level or -1 for none
+	 */
+	inline void setTraceLevel(const int level) { _traceLevel.store(level,std::memory_order_relaxed); }
+
 	/**
 	 * Apply filters to an outgoing packet
 	 *
@@ -111,6 +158,7 @@ public:
 	 * side-effect-free. It's basically step one in sending something over VL2.
 	 *
 	 * @param tPtr Thread pointer to be handed through to any callbacks called as a result of this call
+	 * @param nconf Config snapshot the caller is already holding for this packet
 	 * @param noTee If true, do not TEE anything anywhere (for two-pass filtering as done with multicast and bridging)
 	 * @param ztSource Source ZeroTier address
 	 * @param ztDest Destination ZeroTier address
@@ -124,6 +172,7 @@ public:
 	 */
 	bool filterOutgoingPacket(
 		void *tPtr,
+		const NetworkConfig &nconf,
 		const bool noTee,
 		const Address &ztSource,
 		const Address &ztDest,
@@ -134,6 +183,21 @@ public:
 		const unsigned int etherType,
 		const unsigned int vlanId,
 		uint8_t &qosBucket);
+	inline bool filterOutgoingPacket(
+		void *tPtr,
+		const bool noTee,
+		const Address &ztSource,
+		const Address &ztDest,
+		const MAC &macSource,
+		const MAC &macDest,
+		const uint8_t *frameData,
+		const unsigned int frameLen,
+		const unsigned int etherType,
+		const unsigned int vlanId,
+		uint8_t &qosBucket)
+	{
+		return filterOutgoingPacket(tPtr,*config(),noTee,ztSource,ztDest,macSource,macDest,frameData,frameLen,etherType,vlanId,qosBucket);
+	}
 
 	/**
 	 * Apply filters to an incoming packet
@@ -144,6 +208,7 @@ public:
 	 * to a TEE or REDIRECT target.
 	 *
 	 * @param tPtr Thread pointer to be handed through to any callbacks called as a result of this call
+	 * @param nconf Config snapshot the caller is already holding for this packet
 	 * @param sourcePeer Source Peer
 	 * @param ztDest Destination ZeroTier address
 	 * @param macSource Ethernet layer source address
@@ -156,6 +221,7 @@ public:
 	 */
 	int filterIncomingPacket(
 		void *tPtr,
+		const NetworkConfig &nconf,
 		const SharedPtr<Peer> &sourcePeer,
 		const Address &ztDest,
 		const MAC &macSource,
@@ -164,6 +230,19 @@ public:
 		const unsigned int frameLen,
 		const unsigned int etherType,
 		const unsigned int vlanId);
+	inline int filterIncomingPacket(
+		void *tPtr,
+		const SharedPtr<Peer> &sourcePeer,
+		const Address &ztDest,
+		const MAC &macSource,
+		const MAC &macDest,
+		const uint8_t *frameData,
+		const unsigned int frameLen,
+		const unsigned int etherType,
+		const unsigned int vlanId)
+	{
+		return filterIncomingPacket(tPtr,*config(),sourcePeer,ztDest,macSource,macDest,frameData,frameLen,etherType,vlanId);
+	}
 
 	/**
 	 * Check whether we are subscribed to a multicast group
@@ -244,9 +323,11 @@ public:
 	 * Determine whether this peer is permitted to communicate on this network
 	 *
 	 * @param tPtr Thread pointer to be handed through to any callbacks called as a result of this call
+	 * @param nconf Config snapshot the caller is already holding for this packet
 	 * @param peer Peer to check
 	 */
-	bool gate(void *tPtr,const SharedPtr<Peer> &peer);
+	bool gate(void *tPtr,const NetworkConfig &nconf,const SharedPtr<Peer> &peer);
+	inline bool gate(void *tPtr,const SharedPtr<Peer> &peer) { return gate(tPtr,*config(),peer); }
 
 	/**
 	 * Check whether a given peer has recently had an association with this network
@@ -324,8 +405,9 @@ public:
 	{
 		if (cap.networkId() != _id)
 			return Membership::ADD_REJECTED;
-		Mutex::Lock _l(_lock);
-		return _membership(cap.issuedTo()).addCredential(RR,tPtr,_config,cap);
+		const SharedPtr<Membership> m(_membership(cap.issuedTo()));
+		Mutex::Lock _l(m->lock());
+		return m->addCredential(RR,tPtr,*config(),cap);
 	}
 
 	/**
@@ -335,8 +417,9 @@ public:
 	{
 		if (tag.networkId() != _id)
 			return Membership::ADD_REJECTED;
-		Mutex::Lock _l(_lock);
-		return _membership(tag.issuedTo()).addCredential(RR,tPtr,_config,tag);
+		const SharedPtr<Membership> m(_membership(tag.issuedTo()));
+		Mutex::Lock _l(m->lock());
+		return m->addCredential(RR,tPtr,*config(),tag);
 	}
 
 	/**
@@ -351,8 +434,9 @@ public:
 	{
 		if (coo.networkId() != _id)
 			return Membership::ADD_REJECTED;
-		Mutex::Lock _l(_lock);
-		return _membership(coo.issuedTo()).addCredential(RR,tPtr,_config,coo);
+		const SharedPtr<Membership> m(_membership(coo.issuedTo()));
+		Mutex::Lock _l(m->lock());
+		return m->addCredential(RR,tPtr,*config(),coo);
 	}
 
 	/**
@@ -364,8 +448,9 @@ public:
 	 */
 	inline void pushCredentialsNow(void *tPtr,const Address &to,const int64_t now)
 	{
-		Mutex::Lock _l(_lock);
-		_membership(to).pushCredentials(RR,tPtr,now,to,_config);
+		const SharedPtr<Membership> m(_membership(to));
+		Mutex::Lock _l(m->lock());
+		m->pushCredentials(RR,tPtr,now,to,*config());
 	}
 
 	/**
@@ -377,10 +462,10 @@ public:
 	 */
 	inline void pushCredentialsIfNeeded(void *tPtr,const Address &to,const int64_t now)
 	{
-		Mutex::Lock _l(_lock);
-		Membership &m = _membership(to);
-		if (m.shouldPushCredentials(now))
-			m.pushCredentials(RR,tPtr,now,to,_config);
+		const SharedPtr<Membership> m(_membership(to));
+		Mutex::Lock _l(m->lock());
+		if (m->shouldPushCredentials(now))
+			m->pushCredentials(RR,tPtr,now,to,*config());
 	}
 
 	/**
@@ -414,7 +499,8 @@ private:
 	void _sendUpdatesToMembers(void *tPtr,const MulticastGroup *const newMulticastGroup);
 	void _announceMulticastGroupsTo(void *tPtr,const Address &peer,const std::vector<MulticastGroup> &allMulticastGroups);
 	std::vector<MulticastGroup> _allMulticastGroups() const;
-	Membership &_membership(const Address &a);
+	SharedPtr<Membership> _membership(const Address &a);
+	SharedPtr<Membership> _existingMembership(const Address &a) const;
 
 	const RuntimeEnvironment *const RR;
 	void *_uPtr;
@@ -427,8 +513,10 @@ private:
 	Hashtable< MulticastGroup,uint64_t > _multicastGroupsBehindMe; // multicast groups that seem to be behind us and when we last saw them (if we are a bridge)
 	Hashtable< MAC,Address > _remoteBridgeRoutes; // remote addresses where given MACs are reachable (for tracking devices behind remote bridges)
 
-	NetworkConfig _config;
+	SharedPtr<const Config> _config; // never NULL, replaced (not modified) by setConfiguration()
+	Mutex _config_m; // guards _config itself and is held only to copy or swap it
 	uint64_t _lastConfigUpdate;
+	std::atomic<int> _traceLevel; // cached so filters can skip tracing without locking Trace
 
 	struct _IncomingConfigChunk
 	{
@@ -452,7 +540,8 @@ private:
 	} _netconfFailure;
 	int _portError; // return value from port config callback
 
-	Hashtable<Address,Membership> _memberships;
+	Hashtable< Address,SharedPtr<Membership> > _memberships;
+	Mutex _memberships_m; // guards only the table, each Membership has its own lock
 
 	Mutex _lock;
 
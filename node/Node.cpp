@@ -29,6 +29,10 @@
 #include <stdarg.h>
 #include <string.h>
 #include <stdint.h>
+#include <stddef.h>
+
+#include <memory>
+#include <atomic>
 
 #include "../version.h"
 
@@ -42,11 +46,13 @@
 #include "Topology.hpp"
 #include "Buffer.hpp"
 #include "Packet.hpp"
+#include "IncomingPacket.hpp"
 #include "Address.hpp"
 #include "Identity.hpp"
 #include "SelfAwareness.hpp"
 #include "Network.hpp"
 #include "Trace.hpp"
+#include "SignatureCache.hpp"
 
 namespace ZeroTier {
 
@@ -54,19 +60,53 @@ namespace ZeroTier {
 /* Public Node interface (C++, exposed via CAPI bindings)                   */
 /****************************************************************************/
 
+namespace {
+
+// Frames and HELLOs from unknown peers decoded by processWirePacket() for one
+// node on one thread, held until that node's flushFrames() on that thread
+struct _ThreadBatch
+{
+	_ThreadBatch() : count(0),used(0) {}
+
+	std::weak_ptr<const Node> owner; // empty if not batching, expires with the node
+	unsigned int count;
+	unsigned int used;
+	ZT_VirtualNetworkFrame frames[ZT_FRAME_BATCH_MAX_FRAMES];
+	uint8_t buf[ZT_FRAME_BATCH_BUFFER_SIZE];
+	std::vector<IncomingPacket> packets;
+	std::vector<Identity> ids;
+};
+
+// The batch this thread is filling, and batches parked by nodes that were
+// not flushed before this thread moved on to another node
+thread_local std::unique_ptr<_ThreadBatch> s_batch;
+thread_local std::vector< std::unique_ptr<_ThreadBatch> > s_parkedBatches;
+
+// Compares control blocks, so a new node at a dead node's address never matches
+static inline bool _batchOwnedBy(const _ThreadBatch *b,const std::shared_ptr<const Node> &n)
+{
+	return ((b)&&(!b->owner.owner_before(n))&&(!n.owner_before(b->owner)));
+}
+
+} // anonymous namespace
+
 Node::Node(void *uptr,void *tptr,const struct ZT_Node_Callbacks *callbacks,int64_t now) :
 	_RR(this),
 	RR(&_RR),
 	_uPtr(uptr),
 	_networks(8),
+	_multipathMode(ZT_MULTIPATH_NONE),
 	_now(now),
 	_lastPingCheck(0),
 	_lastHousekeepingRun(0),
-	_lastMemoizedTraceSettings(0)
+	_lastMemoizedTraceSettings(0),
+	_lastPathQualityCompute(0),
+	_lifetime(this,[](const Node *) {})
 {
-	if (callbacks->version != 0)
+	if ((callbacks->version < 0)||(callbacks->version > 1))
 		throw ZT_EXCEPTION_INVALID_ARGUMENT;
-	memcpy(&_cb,callbacks,sizeof(ZT_Node_Callbacks));
+	memset(&_cb,0,sizeof(ZT_Node_Callbacks));
+	memcpy(&_cb,callbacks,(callbacks->version >= 1) ? sizeof(ZT_Node_Callbacks) : offsetof(ZT_Node_Callbacks,virtualNetworkFrameBatchFunction));
 
 	// Initialize non-cryptographic PRNG from a good random source
 	Utils::getSecureRandom((void *)_prngState,sizeof(_prngState));
@@ -115,8 +155,9 @@ Node::Node(void *uptr,void *tptr,const struct ZT_Node_Callbacks *callbacks,int64
 		const unsigned long mcs = sizeof(Multicaster) + (((sizeof(Multicaster) & 0xf) != 0) ? (16 - (sizeof(Multicaster) & 0xf)) : 0);
 		const unsigned long topologys = sizeof(Topology) + (((sizeof(Topology) & 0xf) != 0) ? (16 - (sizeof(Topology) & 0xf)) : 0);
 		const unsigned long sas = sizeof(SelfAwareness) + (((sizeof(SelfAwareness) & 0xf) != 0) ? (16 - (sizeof(SelfAwareness) & 0xf)) : 0);
+		const unsigned long scs = sizeof(SignatureCache) + (((sizeof(SignatureCache) & 0xf) != 0) ? (16 - (sizeof(SignatureCache) & 0xf)) : 0);
 
-		m = reinterpret_cast<char *>(::malloc(16 + ts + sws + mcs + topologys + sas));
+		m = reinterpret_cast<char *>(::malloc(16 + ts + sws + mcs + topologys + sas + scs));
 		if (!m)
 			throw std::bad_alloc();
 		RR->rtmem = m;
@@ -131,7 +172,10 @@ Node::Node(void *uptr,void *tptr,const struct ZT_Node_Callbacks *callbacks,int64
 		RR->topology = new (m) Topology(RR,tptr);
 		m += topologys;
 		RR->sa = new (m) SelfAwareness(RR);
+		m += sas;
+		RR->sc = new (m) SignatureCache();
 	} catch ( ... ) {
+		if (RR->sc) RR->sc->~SignatureCache();
 		if (RR->sa) RR->sa->~SelfAwareness();
 		if (RR->topology) RR->topology->~Topology();
 		if (RR->mc) RR->mc->~Multicaster();
@@ -146,10 +190,20 @@ Node::Node(void *uptr,void *tptr,const struct ZT_Node_Callbacks *callbacks,int64
 
 Node::~Node()
 {
+	// Batches this node left on other threads are freed by those threads
+	// once _lifetime is gone.
+	if (_batchOwnedBy(s_batch.get(),_lifetime)) {
+		s_batch->owner.reset();
+		s_batch->count = 0;
+		s_batch->used = 0;
+		s_batch->packets.clear();
+		s_batch->ids.clear();
+	}
 	{
 		Mutex::Lock _l(_networks_m);
 		_networks.clear(); // destroy all networks before shutdown
 	}
+	if (RR->sc) RR->sc->~SignatureCache();
 	if (RR->sa) RR->sa->~SelfAwareness();
 	if (RR->topology) RR->topology->~Topology();
 	if (RR->mc) RR->mc->~Multicaster();
@@ -168,10 +222,131 @@ ZT_ResultCode Node::processWirePacket(
 	volatile int64_t *nextBackgroundTaskDeadline)
 {
 	_now = now;
+	if (_cb.virtualNetworkFrameBatchFunction)
+		_activateBatch(true);
 	RR->sw->onRemotePacket(tptr,localSocket,*(reinterpret_cast<const InetAddress *>(remoteAddress)),packetData,packetLength);
 	return ZT_RESULT_OK;
 }
 
+void Node::flushFrames(void *tptr)
+{
+	if (!_activateBatch(false))
+		return;
+	_flushHellos(tptr);
+	_ThreadBatch *const b = s_batch.get();
+	if (b->count)
+		_cb.virtualNetworkFrameBatchFunction(reinterpret_cast<ZT_Node *>(this),_uPtr,tptr,b->frames,b->count);
+	b->owner.reset();
+	b->count = 0;
+	b->used = 0;
+}
+
+bool Node::_activateBatch(const bool create)
+{
+	if (_batchOwnedBy(s_batch.get(),_lifetime))
+		return true;
+
+	// Another node on this thread wasn't flushed before we were called. Its
+	// batch is parked for it to deliver itself, with its own thread pointer,
+	// when it next runs here. Batches of nodes that no longer exist are freed.
+	if ((s_batch)&&((s_batch->count)||(!s_batch->packets.empty()))&&(!s_batch->owner.expired()))
+		s_parkedBatches.push_back(std::move(s_batch));
+	std::unique_ptr<_ThreadBatch> mine;
+	for(std::vector< std::unique_ptr<_ThreadBatch> >::iterator p(s_parkedBatches.begin());p!=s_parkedBatches.end();) {
+		if ((!mine)&&(_batchOwnedBy(p->get(),_lifetime))) {
+			mine = std::move(*p);
+			p = s_parkedBatches.erase(p);
+		} else if ((*p)->owner.expired()) {
+			p = s_parkedBatches.erase(p);
+		} else ++p;
+	}
+
+	if (!mine) {
+		if (!create)
+			return false;
+		if (s_batch)
+			mine = std::move(s_batch);
+		else mine.reset(new _ThreadBatch());
+		mine->owner = _lifetime;
+		mine->count = 0;
+		mine->used = 0;
+		mine->packets.clear();
+		mine->ids.clear();
+	}
+	s_batch = std::move(mine);
+	return true;
+}
+
+bool Node::deferHello(void *tPtr,const IncomingPacket &pkt,const Identity &id)
+{
+	_ThreadBatch *const b = s_batch.get();
+	if (!_batchOwnedBy(b,_lifetime))
+		return false;
+	b->packets.push_back(pkt);
+	b->ids.push_back(id);
+	if (b->packets.size() >= ZT_HELLO_BATCH_MAX)
+		_flushHellos(tPtr);
+	return true;
+}
+
+void Node::_flushHellos(void *tPtr)
+{
+	_ThreadBatch *const b = s_batch.get();
+	if ((!_batchOwnedBy(b,_lifetime))||(b->packets.empty()))
+		return;
+
+	// Swap the batch out so it is empty while these are being finished
+	std::vector<IncomingPacket> packets;
+	std::vector<Identity> ids;
+	packets.swap(b->packets);
+	ids.swap(b->ids);
+
+	const unsigned int n = (unsigned int)ids.size();
+	std::vector<uint8_t> keys((unsigned long)n * ZT_PEER_SECRET_KEY_LENGTH);
+	if (RR->identity.agree(ids.data(),n,keys.data(),ZT_PEER_SECRET_KEY_LENGTH)) {
+		for(unsigned int i=0;i<n;++i) {
+			try {
+				packets[i].tryDecode(RR,tPtr,keys.data() + ((unsigned long)i * ZT_PEER_SECRET_KEY_LENGTH));
+			} catch ( ... ) {}
+		}
+	}
+	Utils::burn(keys.data(),(unsigned int)keys.size());
+}
+
+bool Node::_batchFrame(void *tPtr,uint64_t nwid,void **nuptr,const MAC &source,const MAC &dest,unsigned int etherType,unsigned int vlanId,const void *data,unsigned int len)
+{
+	_ThreadBatch *const b = s_batch.get();
+	if (!_batchOwnedBy(b,_lifetime))
+		return false;
+
+	const unsigned int slot = (ZT_VIRTUAL_NETWORK_FRAME_HEADROOM + len + 15) & ~((unsigned int)15);
+	if (slot > ZT_FRAME_BATCH_BUFFER_SIZE)
+		return false;
+	if ((b->count >= ZT_FRAME_BATCH_MAX_FRAMES)||((b->used + slot) > ZT_FRAME_BATCH_BUFFER_SIZE)) {
+		_cb.virtualNetworkFrameBatchFunction(reinterpret_cast<ZT_Node *>(this),_uPtr,tPtr,b->frames,b->count);
+		b->count = 0;
+		b->used = 0;
+	}
+
+	// The decrypted packet this came from doesn't outlive the call, so this
+	// copy is the one a tap's put() would otherwise make. Batching saves the
+	// per-frame callback, not the copy, and taps still write frame by frame.
+	uint8_t *const fd = b->buf + b->used + ZT_VIRTUAL_NETWORK_FRAME_HEADROOM;
+	memcpy(fd,data,len);
+	b->used += slot;
+
+	ZT_VirtualNetworkFrame &f = b->frames[b->count++];
+	f.nwid = nwid;
+	f.nuptr = *nuptr; // read now, the network may be gone by the time this is delivered
+	f.sourceMac = source.toInt();
+	f.destMac = dest.toInt();
+	f.etherType = etherType;
+	f.vlanId = vlanId;
+	f.data = fd;
+	f.len = len;
+	return true;
+}
+
 ZT_ResultCode Node::processVirtualNetworkFrame(
 	void *tptr,
 	int64_t now,
@@ -254,9 +429,26 @@ private:
 	const SharedPtr<Peer> _bestCurrentUpstream;
 };
 
+// Closure used to recompute multipath QoS measurements outside the packet path
+class _ProcessPathMeasurements
+{
+public:
+	_ProcessPathMeasurements(int64_t now) : _now(now) {}
+
+	inline void operator()(Topology &t,const SharedPtr<Peer> &p)
+	{
+		if (p->canUseMultipath())
+			p->processBackgroundPathMeasurements(_now);
+	}
+
+private:
+	const int64_t _now;
+};
+
 ZT_ResultCode Node::processBackgroundTasks(void *tptr,int64_t now,volatile int64_t *nextBackgroundTaskDeadline)
 {
 	_now = now;
+	flushFrames(tptr);
 	Mutex::Lock bl(_backgroundTasksLock);
 
 	unsigned long timeUntilNextPingCheck = ZT_PING_CHECK_INVERVAL;
@@ -313,7 +505,7 @@ ZT_ResultCode Node::processBackgroundTasks(void *tptr,int64_t now,volatile int64
 				uint64_t *nwid = (uint64_t *)0;
 				SharedPtr<Network> *network = (SharedPtr<Network> *)0;
 				while (i.next(nwid,network)) {
-					(*network)->config().alwaysContactAddresses(alwaysContact);
+					(*network)->config()->alwaysContactAddresses(alwaysContact);
 					networkConfigNeeded.push_back( std::pair< SharedPtr<Network>,bool >(*network,(((now - (*network)->lastConfigUpdate()) >= ZT_NETWORK_AUTOCONF_DELAY)||(!(*network)->hasConfig()))) );
 				}
 			}
@@ -350,10 +542,24 @@ ZT_ResultCode Node::processBackgroundTasks(void *tptr,int64_t now,volatile int64
 		timeUntilNextPingCheck -= (unsigned long)timeSinceLastPingCheck;
 	}
 
+	if (_multipathMode != ZT_MULTIPATH_NONE) {
+		if ((now - _lastPathQualityCompute) >= ZT_PATH_QUALITY_COMPUTE_INTERVAL) {
+			_lastPathQualityCompute = now;
+			try {
+				_ProcessPathMeasurements ppm(now);
+				RR->topology->eachPeer<_ProcessPathMeasurements &>(ppm);
+			} catch ( ... ) {
+				return ZT_RESULT_FATAL_ERROR_INTERNAL;
+			}
+		}
+		timeUntilNextPingCheck = std::min(timeUntilNextPingCheck,(unsigned long)ZT_PATH_QUALITY_COMPUTE_INTERVAL);
+	}
+
 	if ((now - _lastMemoizedTraceSettings) >= (ZT_HOUSEKEEPING_PERIOD / 4)) {
 		_lastMemoizedTraceSettings = now;
 		RR->t->updateMemoizedSettings();
 	}
+	RR->t->flush(tptr);
 
 	if ((now - _lastHousekeepingRun) >= ZT_HOUSEKEEPING_PERIOD) {
 		_lastHousekeepingRun = now;
@@ -614,9 +820,10 @@ bool Node::shouldUsePathForZeroTierTraffic(void *tPtr,const Address &ztaddr,cons
 		uint64_t *k = (uint64_t *)0;
 		SharedPtr<Network> *v = (SharedPtr<Network> *)0;
 		while (i.next(k,v)) {
-			if ((*v)->hasConfig()) {
-				for(unsigned int k=0;k<(*v)->config().staticIpCount;++k) {
-					if ((*v)->config().staticIps[k].containsAddress(remoteAddress))
+			const SharedPtr<const Network::Config> nconf((*v)->config());
+			if (*nconf) {
+				for(unsigned int k=0;k<nconf->staticIpCount;++k) {
+					if (nconf->staticIps[k].containsAddress(remoteAddress))
 						return false;
 				}
 			}
@@ -833,6 +1040,13 @@ enum ZT_ResultCode ZT_Node_processVirtualNetworkFrame(
 	}
 }
 
+void ZT_Node_flushFrames(ZT_Node *node,void *tptr)
+{
+	try {
+		reinterpret_cast<ZeroTier::Node *>(node)->flushFrames(tptr);
+	} catch ( ... ) {}
+}
+
 enum ZT_ResultCode ZT_Node_processBackgroundTasks(ZT_Node *node,void *tptr,int64_t now,volatile int64_t *nextBackgroundTaskDeadline)
 {
 	try {
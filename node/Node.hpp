@@ -33,6 +33,7 @@
 
 #include <map>
 #include <vector>
+#include <memory>
 
 #include "Constants.hpp"
 
@@ -55,6 +56,7 @@
 namespace ZeroTier {
 
 class World;
+class IncomingPacket;
 
 /**
  * Implementation of Node object as defined in CAPI
@@ -94,6 +96,7 @@ public:
 		const void *frameData,
 		unsigned int frameLength,
 		volatile int64_t *nextBackgroundTaskDeadline);
+	void flushFrames(void *tptr);
 	ZT_ResultCode processBackgroundTasks(void *tptr,int64_t now,volatile int64_t *nextBackgroundTaskDeadline);
 	ZT_ResultCode join(uint64_t nwid,void *uptr,void *tptr);
 	ZT_ResultCode leave(uint64_t nwid,void **uptr,void *tptr);
@@ -131,6 +134,8 @@ public:
 
 	inline void putFrame(void *tPtr,uint64_t nwid,void **nuptr,const MAC &source,const MAC &dest,unsigned int etherType,unsigned int vlanId,const void *data,unsigned int len)
 	{
+		if ((_cb.virtualNetworkFrameBatchFunction)&&(_batchFrame(tPtr,nwid,nuptr,source,dest,etherType,vlanId,data,len)))
+			return;
 		_cb.virtualNetworkFrameFunction(
 			reinterpret_cast<ZT_Node *>(this),
 			_uPtr,
@@ -253,6 +258,21 @@ public:
 		return false;
 	}
 
+	/**
+	 * Hold a HELLO from an unknown peer so its key agreement can be batched
+	 *
+	 * This only takes the packet while the calling thread is inside a
+	 * processWirePacket() ... flushFrames() window. Held HELLOs are finished
+	 * with one parallel key agreement by flushFrames() or when
+	 * ZT_HELLO_BATCH_MAX are waiting.
+	 *
+	 * @param tPtr Thread pointer to be handed through to any callbacks called as a result of this call
+	 * @param pkt HELLO packet (copied)
+	 * @param id Identity from HELLO
+	 * @return True if packet was taken and will be finished later
+	 */
+	bool deferHello(void *tPtr,const IncomingPacket &pkt,const Identity &id);
+
 	virtual void ncSendConfig(uint64_t nwid,uint64_t requestPacketId,const Address &destination,const NetworkConfig &nc,bool sendLegacyFormatConfig);
 	virtual void ncSendRevocation(const Address &destination,const Revocation &rev);
 	virtual void ncSendError(uint64_t nwid,uint64_t requestPacketId,const Address &destination,NetworkController::ErrorCode errorCode);
@@ -280,6 +300,10 @@ public:
 	}
 
 private:
+	bool _batchFrame(void *tPtr,uint64_t nwid,void **nuptr,const MAC &source,const MAC &dest,unsigned int etherType,unsigned int vlanId,const void *data,unsigned int len);
+	void _flushHellos(void *tPtr);
+	bool _activateBatch(const bool create);
+
 	RuntimeEnvironment _RR;
 	RuntimeEnvironment *RR;
 	void *_uPtr; // _uptr (lower case) is reserved in Visual Studio :P
@@ -325,6 +349,8 @@ private:
 	int64_t _lastPingCheck;
 	int64_t _lastHousekeepingRun;
 	int64_t _lastMemoizedTraceSettings;
+	int64_t _lastPathQualityCompute;
+	const std::shared_ptr<const Node> _lifetime; // owns nothing, lets batches on other threads see that this node is gone
 	volatile int64_t _prngState[2];
 	bool _online;
 };
@@ -985,11 +985,12 @@ void Packet::cryptField(const void *key,unsigned int start,unsigned int len)
 bool Packet::compress()
 {
 	char *const data = reinterpret_cast<char *>(unsafeData());
-	char buf[ZT_PROTO_MAX_PACKET_LENGTH * 2];
+	char buf[ZT_PROTO_MAX_PACKET_LENGTH];
 
 	if ((!compressed())&&(size() > (ZT_PACKET_IDX_PAYLOAD + 64))) { // don't bother compressing tiny packets
 		int pl = (int)(size() - ZT_PACKET_IDX_PAYLOAD);
-		int cl = LZ4_compress_fast(data + ZT_PACKET_IDX_PAYLOAD,buf,pl,ZT_PROTO_MAX_PACKET_LENGTH * 2,1);
+		// Limiting output to one byte less than the input lets LZ4 give up early on data that won't shrink
+		int cl = LZ4_compress_fast(data + ZT_PACKET_IDX_PAYLOAD,buf,pl,pl - 1,1);
 		if ((cl > 0)&&(cl < pl)) {
 			data[ZT_PACKET_IDX_VERB] |= (char)ZT_PROTO_VERB_FLAG_COMPRESSED;
 			setSize((unsigned int)cl + ZT_PACKET_IDX_PAYLOAD);
@@ -1004,6 +1005,9 @@ bool Packet::compress()
 
 bool Packet::uncompress()
 {
+	// Decoding in place would save the copy back, but it needs a margin past
+	// the decoded payload that a full-size packet doesn't leave, and the
+	// bundled LZ4 (1.7.5) doesn't support overlapping input and output.
 	char *const data = reinterpret_cast<char *>(unsafeData());
 	char buf[ZT_PROTO_MAX_PACKET_LENGTH];
 
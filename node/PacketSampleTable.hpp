@@ -0,0 +1,203 @@
+/*
+ * ZeroTier One - Network Virtualization Everywhere
+ * Copyright (C) 2011-2019  ZeroTier, Inc.  https://www.zerotier.com/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * --
+ *
+ * You can be released from the requirements of the license by purchasing
+ * a commercial license. Buying such a license is mandatory as soon as you
+ * develop commercial closed-source software that incorporates or links
+ * directly against ZeroTier software without disclosing the source code
+ * of your own application.
+ */
+
+#ifndef ZT_PACKETSAMPLETABLE_HPP
+#define ZT_PACKETSAMPLETABLE_HPP
+
+#include <stdint.h>
+
+#include <atomic>
+
+namespace ZeroTier {
+
+/**
+ * Fixed-size open-addressed table of packet ID to value samples
+ *
+ * This is used to track sampled packets for QoS and ACK accounting without
+ * taking a lock or allocating on the packet path. Each slot is claimed with
+ * a compare-and-swap on its state word, so any number of threads may add,
+ * take, drain, or expire concurrently. Lookups probe a short bounded window
+ * instead of stopping at the first empty slot, so removing an entry never
+ * needs tombstones. If no free slot exists in the window the sample is
+ * simply dropped, which is fine for statistical telemetry.
+ *
+ * @tparam S Number of slots (must be a power of two)
+ */
+template<unsigned int S>
+class PacketSampleTable
+{
+	static_assert((S & (S - 1)) == 0,"PacketSampleTable size must be a power of two");
+
+public:
+	enum { PROBE_WINDOW = 8 };
+
+	PacketSampleTable() :
+		_count(0)
+	{
+		for(unsigned int i=0;i<S;++i) {
+			_s[i].state.store(SLOT_EMPTY,std::memory_order_relaxed);
+			_s[i].id.store(0,std::memory_order_relaxed);
+			_s[i].v.store(0,std::memory_order_relaxed);
+		}
+	}
+
+	/**
+	 * Add a sample
+	 *
+	 * @param id Packet ID
+	 * @param v Value (e.g. a timestamp or a length)
+	 * @return True if a slot was available
+	 */
+	inline bool add(const uint64_t id,const int64_t v)
+	{
+		const unsigned int h = _hash(id);
+		for(unsigned int k=0;k<PROBE_WINDOW;++k) {
+			_Slot &s = _s[(h + k) & (S - 1)];
+			unsigned int st = SLOT_EMPTY;
+			if (s.state.compare_exchange_strong(st,SLOT_BUSY,std::memory_order_acquire)) {
+				s.id.store(id,std::memory_order_relaxed);
+				s.v.store(v,std::memory_order_relaxed);
+				s.state.store(SLOT_READY,std::memory_order_release);
+				++_count;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	/**
+	 * Remove a sample by packet ID
+	 *
+	 * @param id Packet ID
+	 * @param v Value result parameter (unchanged if not found)
+	 * @return True if sample was found and removed
+	 */
+	inline bool take(const uint64_t id,int64_t &v)
+	{
+		const unsigned int h = _hash(id);
+		for(unsigned int k=0;k<PROBE_WINDOW;++k) {
+			_Slot &s = _s[(h + k) & (S - 1)];
+			if ((s.state.load(std::memory_order_acquire) == SLOT_READY)&&(s.id.load(std::memory_order_relaxed) == id)) {
+				unsigned int st = SLOT_READY;
+				if (s.state.compare_exchange_strong(st,SLOT_BUSY,std::memory_order_acquire)) {
+					// The slot may have been taken and refilled with another ID
+					// between the check above and our claim (READY -> EMPTY ->
+					// READY), so check the ID again now that we own it.
+					if (s.id.load(std::memory_order_relaxed) == id) {
+						v = s.v.load(std::memory_order_relaxed);
+						s.state.store(SLOT_EMPTY,std::memory_order_release);
+						--_count;
+						return true;
+					}
+					s.state.store(SLOT_READY,std::memory_order_release);
+				}
+			}
+		}
+		return false;
+	}
+
+	/**
+	 * Remove up to max samples, writing them to the supplied arrays
+	 *
+	 * @param ids Packet IDs result buffer
+	 * @param vs Values result buffer
+	 * @param max Capacity of ids[] and vs[]
+	 * @return Number of samples removed
+	 */
+	inline unsigned int drain(uint64_t *ids,int64_t *vs,const unsigned int max)
+	{
+		unsigned int n = 0;
+		for(unsigned int i=0;((i<S)&&(n<max));++i) {
+			_Slot &s = _s[i];
+			unsigned int st = SLOT_READY;
+			if (s.state.compare_exchange_strong(st,SLOT_BUSY,std::memory_order_acquire)) {
+				ids[n] = s.id.load(std::memory_order_relaxed);
+				vs[n] = s.v.load(std::memory_order_relaxed);
+				s.state.store(SLOT_EMPTY,std::memory_order_release);
+				--_count;
+				++n;
+			}
+		}
+		return n;
+	}
+
+	/**
+	 * Remove all samples whose value is less than a cutoff
+	 *
+	 * @param cutoff Minimum value to keep (e.g. now - timeout)
+	 * @return Number of samples removed
+	 */
+	inline unsigned int expire(const int64_t cutoff)
+	{
+		unsigned int n = 0;
+		for(unsigned int i=0;i<S;++i) {
+			_Slot &s = _s[i];
+			if ((s.state.load(std::memory_order_acquire) == SLOT_READY)&&(s.v.load(std::memory_order_relaxed) < cutoff)) {
+				unsigned int st = SLOT_READY;
+				if (s.state.compare_exchange_strong(st,SLOT_BUSY,std::memory_order_acquire)) {
+					if (s.v.load(std::memory_order_relaxed) < cutoff) {
+						s.state.store(SLOT_EMPTY,std::memory_order_release);
+						--_count;
+						++n;
+					} else {
+						s.state.store(SLOT_READY,std::memory_order_release);
+					}
+				}
+			}
+		}
+		return n;
+	}
+
+	/**
+	 * @return Approximate number of samples in table
+	 */
+	inline unsigned int count() const { return _count.load(std::memory_order_relaxed); }
+
+private:
+	enum {
+		SLOT_EMPTY = 0,
+		SLOT_BUSY = 1,
+		SLOT_READY = 2
+	};
+
+	struct _Slot
+	{
+		std::atomic<unsigned int> state;
+		std::atomic<uint64_t> id;
+		std::atomic<int64_t> v;
+	};
+
+	// Sampled packet IDs have their low bits fixed (see ZT_PATH_QOS_ACK_PROTOCOL_DIVISOR)
+	// so use the high bits of a multiplicative hash to pick the home slot.
+	static inline unsigned int _hash(const uint64_t id) { return (unsigned int)((id * 0x9e3779b97f4a7c15ULL) >> 40); }
+
+	_Slot _s[S];
+	std::atomic<unsigned int> _count;
+};
+
+} // namespace ZeroTier
+
+#endif
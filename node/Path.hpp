@@ -33,14 +33,17 @@
 
 #include <stdexcept>
 #include <algorithm>
+#include <atomic>
 
 #include "Constants.hpp"
 #include "InetAddress.hpp"
 #include "SharedPtr.hpp"
 #include "AtomicCounter.hpp"
 #include "Utils.hpp"
-#include "RingBuffer.hpp"
+#include "PacketSampleTable.hpp"
+#include "RunningStatistics.hpp"
 #include "Packet.hpp"
+#include "Mutex.hpp"
 
 #include "../osdep/Phy.hpp"
 
@@ -85,7 +88,7 @@ public:
 			}
 		}
 
-		inline unsigned long hashCode() const { return (unsigned long)(_k[0] + _k[1] + _k[2]); }
+		inline unsigned long hashCode() const { return (unsigned long)((_k[0] * 0x9e3779b97f4a7c15ULL) ^ (_k[1] * 0xc2b2ae3d27d4eb4fULL) ^ _k[2]); }
 
 		inline bool operator==(const HashKey &k) const { return ( (_k[0] == k._k[0]) && (_k[1] == k._k[1]) && (_k[2] == k._k[2]) ); }
 		inline bool operator!=(const HashKey &k) const { return (!(*this == k)); }
@@ -103,14 +106,18 @@ public:
 		_latency(0xffff),
 		_addr(),
 		_ipScope(InetAddress::IP_SCOPE_NONE),
+		_qos((_QoSSamples *)0),
+		_stats((_Statistics *)0),
 		_lastAck(0),
 		_lastThroughputEstimation(0),
 		_lastQoSMeasurement(0),
-		_lastQoSRecordPurge(0),
 		_unackedBytes(0),
 		_expectingAckAsOf(0),
+		_bytesToAck(0),
 		_packetsReceivedSinceLastAck(0),
 		_packetsReceivedSinceLastQoS(0),
+		_validPacketCount(0),
+		_invalidPacketCount(0),
 		_maxLifetimeThroughput(0),
 		_lastComputedMeanThroughput(0),
 		_bytesAckedSinceLastThroughputEstimation(0),
@@ -121,13 +128,19 @@ public:
 		_lastComputedStability(0.0),
 		_lastComputedRelativeQuality(0),
 		_lastComputedThroughputDistCoeff(0.0),
-		_lastAllocation(0)
+		_lastAllocation(0),
+		_preAuth(false)
 	{
 		memset(_ifname, 0, 16);
 		memset(_addrString, 0, sizeof(_addrString));
 	}
 
-	Path(const int64_t localSocket,const InetAddress &addr) :
+	/**
+	 * @param localSocket Local socket as specified by external code
+	 * @param addr Remote physical address
+	 * @param preAuth If true this is a handle for traffic that has not yet been authenticated (see preAuth())
+	 */
+	Path(const int64_t localSocket,const InetAddress &addr,const bool preAuth = false) :
 		_lastOut(0),
 		_lastIn(0),
 		_lastTrustEstablishedPacketReceived(0),
@@ -136,14 +149,18 @@ public:
 		_latency(0xffff),
 		_addr(addr),
 		_ipScope(addr.ipScope()),
+		_qos((_QoSSamples *)0),
+		_stats((_Statistics *)0),
 		_lastAck(0),
 		_lastThroughputEstimation(0),
 		_lastQoSMeasurement(0),
-		_lastQoSRecordPurge(0),
 		_unackedBytes(0),
 		_expectingAckAsOf(0),
+		_bytesToAck(0),
 		_packetsReceivedSinceLastAck(0),
 		_packetsReceivedSinceLastQoS(0),
+		_validPacketCount(0),
+		_invalidPacketCount(0),
 		_maxLifetimeThroughput(0),
 		_lastComputedMeanThroughput(0),
 		_bytesAckedSinceLastThroughputEstimation(0),
@@ -154,15 +171,35 @@ public:
 		_lastComputedStability(0.0),
 		_lastComputedRelativeQuality(0),
 		_lastComputedThroughputDistCoeff(0.0),
-		_lastAllocation(0)
+		_lastAllocation(0),
+		_preAuth(preAuth)
 	{
 		memset(_ifname, 0, 16);
 		memset(_addrString, 0, sizeof(_addrString));
 		if (_localSocket != -1) {
 			_phy->getIfName((PhySocket *) ((uintptr_t) _localSocket), _ifname, 16);
 		}
+		// The address never changes, so format it for tracing once here
+		_addr.toString(_addrString);
+	}
+
+	~Path()
+	{
+		delete _qos.load();
+		delete _stats;
 	}
 
+	/**
+	 * A pre-auth path is a short-lived handle created for a packet from a
+	 * physical address we have no path to yet. It's not registered in
+	 * Topology and is replaced by the canonical Path (via Topology::getPath())
+	 * only once a packet from it authenticates, so unauthenticated traffic
+	 * can't grow the path table.
+	 *
+	 * @return True if this is a pre-auth handle rather than a canonical path
+	 */
+	inline bool preAuth() const { return _preAuth; }
+
 	/**
 	 * Called when a packet is received from this remote path, regardless of content
 	 *
@@ -208,7 +245,8 @@ public:
 		else {
 			_latency = l;
 		}
-		_latencySamples.push(l);
+		Mutex::Lock _l(_statistics_m);
+		_statistics()->latencySamples.push(l);
 	}
 
 	/**
@@ -299,6 +337,8 @@ public:
 	/**
 	 * Record statistics on outgoing packets. Used later to estimate QoS metrics.
 	 *
+	 * This does not lock and is safe to call from any thread.
+	 *
 	 * @param now Current time
 	 * @param packetId ID of packet
 	 * @param payloadLength Length of payload
@@ -306,15 +346,12 @@ public:
 	 */
 	inline void recordOutgoingPacket(int64_t now, int64_t packetId, uint16_t payloadLength, Packet::Verb verb)
 	{
-		Mutex::Lock _l(_statistics_m);
 		if (verb != Packet::VERB_ACK && verb != Packet::VERB_QOS_MEASUREMENT) {
 			if ((packetId & (ZT_PATH_QOS_ACK_PROTOCOL_DIVISOR - 1)) == 0) {
 				_unackedBytes += payloadLength;
 				// Take note that we're expecting a VERB_ACK on this path as of a specific time
 				_expectingAckAsOf = ackAge(now) > ZT_PATH_ACK_INTERVAL ? _expectingAckAsOf : now;
-				if (_outQoSRecords.size() < ZT_PATH_MAX_OUTSTANDING_QOS_RECORDS) {
-					_outQoSRecords[packetId] = now;
-				}
+				_samples()->outQoS.add((uint64_t)packetId,now);
 			}
 		}
 	}
@@ -322,6 +359,8 @@ public:
 	/**
 	 * Record statistics on incoming packets. Used later to estimate QoS metrics.
 	 *
+	 * This does not lock and is safe to call from any thread.
+	 *
 	 * @param now Current time
 	 * @param packetId ID of packet
 	 * @param payloadLength Length of payload
@@ -329,15 +368,14 @@ public:
 	 */
 	inline void recordIncomingPacket(int64_t now, int64_t packetId, uint16_t payloadLength, Packet::Verb verb)
 	{
-		Mutex::Lock _l(_statistics_m);
 		if (verb != Packet::VERB_ACK && verb != Packet::VERB_QOS_MEASUREMENT) {
 			if ((packetId & (ZT_PATH_QOS_ACK_PROTOCOL_DIVISOR - 1)) == 0) {
-				_inACKRecords[packetId] = payloadLength;
-				_packetsReceivedSinceLastAck++;
-				_inQoSRecords[packetId] = now;
-				_packetsReceivedSinceLastQoS++;
+				_bytesToAck += payloadLength;
+				++_packetsReceivedSinceLastAck;
+				if (_samples()->inQoS.add((uint64_t)packetId,now))
+					++_packetsReceivedSinceLastQoS;
 			}
-			_packetValiditySamples.push(true);
+			++_validPacketCount;
 		}
 	}
 
@@ -350,11 +388,15 @@ public:
 	inline void receivedAck(int64_t now, int32_t ackedBytes)
 	{
 		_expectingAckAsOf = 0;
-		_unackedBytes = (ackedBytes > _unackedBytes) ? 0 : _unackedBytes - ackedBytes;
+		int64_t ub = _unackedBytes.load();
+		while (!_unackedBytes.compare_exchange_weak(ub,(ackedBytes > ub) ? 0 : ub - ackedBytes)) {}
 		int64_t timeSinceThroughputEstimate = (now - _lastThroughputEstimation);
 		if (timeSinceThroughputEstimate >= ZT_PATH_THROUGHPUT_MEASUREMENT_INTERVAL) {
 			uint64_t throughput = (uint64_t)((float)(_bytesAckedSinceLastThroughputEstimation * 8) / ((float)timeSinceThroughputEstimate / (float)1000));
-			_throughputSamples.push(throughput);
+			{
+				Mutex::Lock _l(_statistics_m);
+				_statistics()->throughputSamples.push(throughput);
+			}
 			_maxLifetimeThroughput = throughput > _maxLifetimeThroughput ? throughput : _maxLifetimeThroughput;
 			_lastThroughputEstimation = now;
 			_bytesAckedSinceLastThroughputEstimation = 0;
@@ -366,35 +408,25 @@ public:
 	/**
 	 * @return Number of bytes this peer is responsible for ACKing since last ACK
 	 */
-	inline int32_t bytesToAck()
-	{
-		Mutex::Lock _l(_statistics_m);
-		int32_t bytesToAck = 0;
-		std::map<uint64_t,uint16_t>::iterator it = _inACKRecords.begin();
-		while (it != _inACKRecords.end()) {
-			bytesToAck += it->second;
-			it++;
-		}
-		return bytesToAck;
-	}
+	inline int32_t bytesToAck() const { return _bytesToAck.load(); }
 
 	/**
 	 * @return Number of bytes thus far sent that have not been acknowledged by the remote peer
 	 */
-	inline int64_t unackedSentBytes()
-	{
-		return _unackedBytes;
-	}
+	inline int64_t unackedSentBytes() const { return _unackedBytes.load(); }
 
 	/**
-	 * Account for the fact that an ACK was just sent. Reset counters, timers, and clear statistics buffers
+	 * Account for the fact that an ACK was just sent. Reset counters and timers.
 	 *
-	 * @param Current time
+	 * Only the bytes actually reported are subtracted, so samples recorded by
+	 * other threads while the ACK was being built are carried into the next one.
+	 *
+	 * @param now Current time
+	 * @param ackedBytes Value returned by bytesToAck() and sent in the ACK
 	 */
-	inline void sentAck(int64_t now)
+	inline void sentAck(int64_t now, int32_t ackedBytes)
 	{
-		Mutex::Lock _l(_statistics_m);
-		_inACKRecords.clear();
+		_bytesToAck -= ackedBytes;
 		_packetsReceivedSinceLastAck = 0;
 		_lastAck = now;
 	}
@@ -410,17 +442,15 @@ public:
 	 */
 	inline void receivedQoS(int64_t now, int count, uint64_t *rx_id, uint16_t *rx_ts)
 	{
-		Mutex::Lock _l(_statistics_m);
+		_QoSSamples *const q = _samples();
 		// Look up egress times and compute latency values for each record
-		std::map<uint64_t,uint64_t>::iterator it;
 		for (int j=0; j<count; j++) {
-			it = _outQoSRecords.find(rx_id[j]);
-			if (it != _outQoSRecords.end()) {
-				uint16_t rtt = (uint16_t)(now - it->second);
+			int64_t egress;
+			if (q->outQoS.take(rx_id[j],egress)) {
+				uint16_t rtt = (uint16_t)(now - egress);
 				uint16_t rtt_compensated = rtt - rx_ts[j];
 				uint16_t latency = rtt_compensated / 2;
 				updateLatency(latency, now);
-				_outQoSRecords.erase(it);
 			}
 		}
 	}
@@ -429,25 +459,22 @@ public:
 	 * Generate the contents of a VERB_QOS_MEASUREMENT packet.
 	 *
 	 * @param now Current time
-	 * @param qosBuffer destination buffer
+	 * @param qosBuffer destination buffer (at least ZT_PATH_MAX_QOS_PACKET_SZ bytes)
 	 * @return Size of payload
 	 */
 	inline int32_t generateQoSPacket(int64_t now, char *qosBuffer)
 	{
-		Mutex::Lock _l(_statistics_m);
+		uint64_t ids[ZT_PATH_QOS_TABLE_SIZE];
+		int64_t ts[ZT_PATH_QOS_TABLE_SIZE];
+		const unsigned int n = _samples()->inQoS.drain(ids,ts,ZT_PATH_QOS_TABLE_SIZE);
 		int32_t len = 0;
-		std::map<uint64_t,uint64_t>::iterator it = _inQoSRecords.begin();
-		int i=0;
-		while (i<_packetsReceivedSinceLastQoS && it != _inQoSRecords.end()) {
-			uint64_t id = it->first;
-			memcpy(qosBuffer, &id, sizeof(uint64_t));
+		for(unsigned int i=0;i<n;++i) {
+			memcpy(qosBuffer, &(ids[i]), sizeof(uint64_t));
 			qosBuffer+=sizeof(uint64_t);
-			uint16_t holdingTime = (uint16_t)(now - it->second);
+			uint16_t holdingTime = (uint16_t)(now - ts[i]);
 			memcpy(qosBuffer, &holdingTime, sizeof(uint16_t));
 			qosBuffer+=sizeof(uint16_t);
 			len+=sizeof(uint64_t)+sizeof(uint16_t);
-			_inQoSRecords.erase(it++);
-			i++;
 		}
 		return len;
 	}
@@ -467,8 +494,9 @@ public:
 	 * @return Whether an ACK (VERB_ACK) packet needs to be emitted at this time
 	 */
 	inline bool needsToSendAck(int64_t now) {
+		const int pr = _packetsReceivedSinceLastAck.load();
 		return ((now - _lastAck) >= ZT_PATH_ACK_INTERVAL ||
-			(_packetsReceivedSinceLastAck == ZT_PATH_QOS_TABLE_SIZE)) && _packetsReceivedSinceLastAck;
+			(pr >= ZT_PATH_QOS_TABLE_SIZE)) && pr;
 	}
 
 	/**
@@ -476,8 +504,9 @@ public:
 	 * @return Whether a QoS (VERB_QOS_MEASUREMENT) packet needs to be emitted at this time
 	 */
 	inline bool needsToSendQoS(int64_t now) {
-		return ((_packetsReceivedSinceLastQoS >= ZT_PATH_QOS_TABLE_SIZE) ||
-			((now - _lastQoSMeasurement) > ZT_PATH_QOS_INTERVAL)) && _packetsReceivedSinceLastQoS;
+		const int pr = _packetsReceivedSinceLastQoS.load();
+		return ((pr >= ZT_PATH_QOS_TABLE_SIZE) ||
+			((now - _lastQoSMeasurement) > ZT_PATH_QOS_INTERVAL)) && pr;
 	}
 
 	/**
@@ -556,7 +585,7 @@ public:
 	 * Record an invalid incoming packet. This packet failed MAC/compression/cipher checks and will now
 	 * contribute to a Packet Error Ratio (PER).
 	 */
-	inline void recordInvalidPacket() { _packetValiditySamples.push(false); }
+	inline void recordInvalidPacket() { ++_invalidPacketCount; }
 
 	/**
 	 * @return A pointer to a cached copy of the address string for this Path (For debugging only)
@@ -572,26 +601,40 @@ public:
 	 * Compute and cache stability and performance metrics. The resultant stability coefficient is a measure of how "well behaved"
 	 * this path is. This figure is substantially different from (but required for the estimation of the path's overall "quality".
 	 *
+	 * This is called from the background task loop, not the packet path. All statistics it reads
+	 * are maintained incrementally so this is O(1) apart from QoS sample expiration.
+	 *
 	 * @param now Current time
 	 */
 	inline void processBackgroundPathMeasurements(const int64_t now)
 	{
 		if (now - _lastPathQualityComputeTime > ZT_PATH_QUALITY_COMPUTE_INTERVAL) {
-			Mutex::Lock _l(_statistics_m);
 			_lastPathQualityComputeTime = now;
-			address().toString(_addrString);
-			_lastComputedMeanLatency = _latencySamples.mean();
-			_lastComputedPacketDelayVariance = _latencySamples.stddev(); // Similar to "jitter" (SEE: RFC 3393, RFC 4689)
-			_lastComputedMeanThroughput = (uint64_t)_throughputSamples.mean();
 
+			// Packet validity is counted with atomics on the packet path. Decay the counts here
+			// so that the error ratio reflects roughly the last window's worth of packets.
+			const unsigned int valid = _validPacketCount.load();
+			const unsigned int invalid = _invalidPacketCount.load();
+			const unsigned int total = valid + invalid;
 			// If no packet validity samples, assume PER==0
-			_lastComputedPacketErrorRatio = 1 - (_packetValiditySamples.count() ? _packetValiditySamples.mean() : 1);
+			_lastComputedPacketErrorRatio = (total) ? ((float)invalid / (float)total) : 0.0f;
+			if (total > ZT_PATH_QUALITY_METRIC_WIN_SZ) {
+				_validPacketCount -= valid / 2;
+				_invalidPacketCount -= invalid / 2;
+			}
+
+			Mutex::Lock _l(_statistics_m);
+			_Statistics *const st = _statistics();
+			_lastComputedMeanLatency = st->latencySamples.mean();
+			_lastComputedPacketDelayVariance = st->latencySamples.stddev(); // Similar to "jitter" (SEE: RFC 3393, RFC 4689)
+			const float meanThroughput = st->throughputSamples.mean();
+			_lastComputedMeanThroughput = (uint64_t)meanThroughput;
 
 			// Compute path stability
 			// Normalize measurements with wildly different ranges into a reasonable range
 			float normalized_pdv = Utils::normalize(_lastComputedPacketDelayVariance, 0, ZT_PATH_MAX_PDV, 0, 10);
 			float normalized_la = Utils::normalize(_lastComputedMeanLatency, 0, ZT_PATH_MAX_MEAN_LATENCY, 0, 10);
-			float throughput_cv = _throughputSamples.mean() > 0 ? _throughputSamples.stddev() / _throughputSamples.mean() : 1;
+			float throughput_cv = meanThroughput > 0 ? st->throughputSamples.stddev() / meanThroughput : 1;
 
 			// Form an exponential cutoff and apply contribution weights
 			float pdv_contrib = expf((-1.0f)*normalized_pdv) * (float)ZT_PATH_CONTRIB_PDV;
@@ -599,8 +642,8 @@ public:
 
 			// Throughput Disturbance Coefficient
 			float throughput_disturbance_contrib = expf((-1.0f)*throughput_cv) * (float)ZT_PATH_CONTRIB_THROUGHPUT_DISTURBANCE;
-			_throughputDisturbanceSamples.push(throughput_cv);
-			_lastComputedThroughputDistCoeff = _throughputDisturbanceSamples.mean();
+			st->throughputDisturbanceSamples.push(throughput_cv);
+			_lastComputedThroughputDistCoeff = st->throughputDisturbanceSamples.mean();
 
 			// Obey user-defined ignored contributions
 			pdv_contrib = ZT_PATH_CONTRIB_PDV > 0.0 ? pdv_contrib : 1;
@@ -612,12 +655,10 @@ public:
 			_lastComputedStability *= 1 - _lastComputedPacketErrorRatio;
 
 			// Prevent QoS records from sticking around for too long
-			std::map<uint64_t,uint64_t>::iterator it = _outQoSRecords.begin();
-			while (it != _outQoSRecords.end()) {
-				// Time since egress of tracked packet
-				if ((now - it->second) >= ZT_PATH_QOS_TIMEOUT) {
-					_outQoSRecords.erase(it++);
-				} else { it++; }
+			_QoSSamples *const q = _qos.load();
+			if (q) {
+				q->outQoS.expire(now - ZT_PATH_QOS_TIMEOUT);
+				q->inQoS.expire(now - ZT_PATH_QOS_TIMEOUT);
 			}
 		}
 	}
@@ -648,6 +689,46 @@ public:
 	inline int64_t lastTrustEstablishedPacketReceived() const { return _lastTrustEstablishedPacketReceived; }
 
 private:
+	/**
+	 * QoS sample tables, allocated only once a path is actually used in a multipath link
+	 */
+	struct _QoSSamples
+	{
+		PacketSampleTable<ZT_PATH_QOS_SAMPLE_TABLE_SIZE> outQoS; // id:egress_time
+		PacketSampleTable<ZT_PATH_QOS_SAMPLE_TABLE_SIZE> inQoS; // id:now
+	};
+
+	inline _QoSSamples *_samples()
+	{
+		_QoSSamples *q = _qos.load();
+		if (!q) {
+			_QoSSamples *const nq = new _QoSSamples();
+			if (_qos.compare_exchange_strong(q,nq)) {
+				q = nq;
+			} else {
+				delete nq; // another thread beat us to it, q now holds its table
+			}
+		}
+		return q;
+	}
+
+	/**
+	 * Windowed link statistics, allocated the first time a path is measured (_statistics_m must be locked)
+	 */
+	struct _Statistics
+	{
+		RunningStatistics<uint64_t,ZT_PATH_QUALITY_METRIC_WIN_SZ> throughputSamples;
+		RunningStatistics<uint32_t,ZT_PATH_QUALITY_METRIC_WIN_SZ> latencySamples;
+		RunningStatistics<float,ZT_PATH_QUALITY_METRIC_WIN_SZ> throughputDisturbanceSamples;
+	};
+
+	inline _Statistics *_statistics()
+	{
+		if (!_stats)
+			_stats = new _Statistics();
+		return _stats;
+	}
+
 	Mutex _statistics_m;
 
 	volatile int64_t _lastOut;
@@ -660,19 +741,20 @@ private:
 	InetAddress::IpScope _ipScope; // memoize this since it's a computed value checked often
 	AtomicCounter __refCount;
 
-	std::map<uint64_t,uint64_t> _outQoSRecords; // id:egress_time
-	std::map<uint64_t,uint64_t> _inQoSRecords; // id:now
-	std::map<uint64_t,uint16_t> _inACKRecords; // id:len
+	std::atomic<_QoSSamples *> _qos;
+	_Statistics *_stats; // guarded by _statistics_m
 
-	int64_t _lastAck;
+	volatile int64_t _lastAck;
 	int64_t _lastThroughputEstimation;
-	int64_t _lastQoSMeasurement;
-	int64_t _lastQoSRecordPurge;
+	volatile int64_t _lastQoSMeasurement;
 
-	int64_t _unackedBytes;
-	int64_t _expectingAckAsOf;
-	int16_t _packetsReceivedSinceLastAck;
-	int16_t _packetsReceivedSinceLastQoS;
+	std::atomic<int64_t> _unackedBytes;
+	volatile int64_t _expectingAckAsOf;
+	std::atomic<int32_t> _bytesToAck;
+	std::atomic<int> _packetsReceivedSinceLastAck;
+	std::atomic<int> _packetsReceivedSinceLastQoS;
+	std::atomic<unsigned int> _validPacketCount;
+	std::atomic<unsigned int> _invalidPacketCount;
 
 	uint64_t _maxLifetimeThroughput;
 	uint64_t _lastComputedMeanThroughput;
@@ -689,15 +771,11 @@ private:
 	float _lastComputedRelativeQuality;
 	float _lastComputedThroughputDistCoeff;
 	unsigned char _lastAllocation;
+	bool _preAuth;
 
 	// cached human-readable strings for tracing purposes
 	char _ifname[16];
 	char _addrString[256];
-
-	RingBuffer<uint64_t,ZT_PATH_QUALITY_METRIC_WIN_SZ> _throughputSamples;
-	RingBuffer<uint32_t,ZT_PATH_QUALITY_METRIC_WIN_SZ> _latencySamples;
-	RingBuffer<bool,ZT_PATH_QUALITY_METRIC_WIN_SZ> _packetValiditySamples;
-	RingBuffer<float,ZT_PATH_QUALITY_METRIC_WIN_SZ> _throughputDisturbanceSamples;
 };
 
 } // namespace ZeroTier
@@ -41,7 +41,7 @@ namespace ZeroTier {
 
 static unsigned char s_freeRandomByteCounter = 0;
 
-Peer::Peer(const RuntimeEnvironment *renv,const Identity &myIdentity,const Identity &peerIdentity) :
+Peer::Peer(const RuntimeEnvironment *renv,const Identity &myIdentity,const Identity &peerIdentity,const uint8_t *key) :
 	RR(renv),
 	_lastReceive(0),
 	_lastNontrivialReceive(0),
@@ -69,13 +69,16 @@ Peer::Peer(const RuntimeEnvironment *renv,const Identity &myIdentity,const Ident
 	_id(peerIdentity),
 	_directPathPushCutoffCount(0),
 	_credentialsCutoffCount(0),
+	_flows((FlowTable<const Path *,ZT_MULTIPATH_FLOW_TABLE_SIZE> *)0),
 	_linkIsBalanced(false),
 	_linkIsRedundant(false),
 	_remotePeerMultipathEnabled(false),
 	_lastAggregateStatsReport(0),
 	_lastAggregateAllocation(0)
 {
-	if (!myIdentity.agree(peerIdentity,_key,ZT_PEER_SECRET_KEY_LENGTH))
+	if (key)
+		memcpy(_key,key,ZT_PEER_SECRET_KEY_LENGTH);
+	else if (!myIdentity.agree(peerIdentity,_key,ZT_PEER_SECRET_KEY_LENGTH))
 		throw ZT_EXCEPTION_INVALID_ARGUMENT;
 }
 
@@ -111,20 +114,12 @@ void Peer::received(
 		path->trustedPacketReceived(now);
 	}
 
-	{
-		Mutex::Lock _l(_paths_m);
-
+	// Path statistics are recorded without locks here. The measurements derived
+	// from them are recomputed in processBackgroundPathMeasurements().
+	if (_canUseMultipath) {
 		recordIncomingPacket(tPtr, path, packetId, payloadLength, verb, now);
-
-		if (_canUseMultipath) {
-			if (path->needsToSendQoS(now)) {
-				sendQOS_MEASUREMENT(tPtr, path, path->localSocket(), path->address(), now);
-			}
-			for(unsigned int i=0;i<ZT_MAX_PEER_NETWORK_PATHS;++i) {
-				if (_paths[i].p) {
-					_paths[i].p->processBackgroundPathMeasurements(now);
-				}
-			}
+		if (path->needsToSendQoS(now)) {
+			sendQOS_MEASUREMENT(tPtr, path, path->localSocket(), path->address(), now);
 		}
 	}
 
@@ -273,6 +268,23 @@ void Peer::recordIncomingPacket(void *tPtr, const SharedPtr<Path> &path, const u
 	}
 }
 
+void Peer::processBackgroundPathMeasurements(const int64_t now)
+{
+	Mutex::Lock _l(_paths_m);
+	if (!_canUseMultipath)
+		return;
+	for(unsigned int i=0;i<ZT_MAX_PEER_NETWORK_PATHS;++i) {
+		if (_paths[i].p) {
+			_paths[i].p->processBackgroundPathMeasurements(now);
+		}
+	}
+	const unsigned int mpMode = RR->node->getMultipathMode();
+	if (((mpMode == ZT_MULTIPATH_PROPORTIONALLY_BALANCED)||(mpMode == ZT_MULTIPATH_BALANCE_FLOW_HASH))&&((now - _lastAggregateAllocation) >= ZT_PATH_QUALITY_COMPUTE_INTERVAL)) {
+		_lastAggregateAllocation = now;
+		computeAggregateProportionalAllocation(now);
+	}
+}
+
 void Peer::computeAggregateProportionalAllocation(int64_t now)
 {
 	float maxStability = 0;
@@ -373,7 +385,7 @@ int Peer::aggregateLinkLogicalPathCount()
 	return pathCount;
 }
 
-SharedPtr<Path> Peer::getAppropriatePath(int64_t now, bool includeExpired)
+SharedPtr<Path> Peer::getAppropriatePath(int64_t now, bool includeExpired, uint64_t flowId)
 {
 	Mutex::Lock _l(_paths_m);
 	unsigned int bestPath = ZT_MAX_PEER_NETWORK_PATHS;
@@ -401,12 +413,6 @@ SharedPtr<Path> Peer::getAppropriatePath(int64_t now, bool includeExpired)
 		return SharedPtr<Path>();
 	}
 
-	for(unsigned int i=0;i<ZT_MAX_PEER_NETWORK_PATHS;++i) {
-		if (_paths[i].p) {
-			_paths[i].p->processBackgroundPathMeasurements(now);
-		}
-	}
-
 	/**
 	 * Randomly distribute traffic across all paths
 	 */
@@ -445,10 +451,7 @@ SharedPtr<Path> Peer::getAppropriatePath(int64_t now, bool includeExpired)
 	 * Proportionally allocate traffic according to dynamic path quality measurements
 	 */
 	if (RR->node->getMultipathMode() == ZT_MULTIPATH_PROPORTIONALLY_BALANCED) {
-		if ((now - _lastAggregateAllocation) >= ZT_PATH_QUALITY_COMPUTE_INTERVAL) {
-			_lastAggregateAllocation = now;
-			computeAggregateProportionalAllocation(now);
-		}
+		// Allocations are recomputed in processBackgroundPathMeasurements()
 		// Randomly choose path according to their allocations
 		float rf = _freeRandomByte;
 		for(int i=0;i<ZT_MAX_PEER_NETWORK_PATHS;++i) {
@@ -465,6 +468,63 @@ SharedPtr<Path> Peer::getAppropriatePath(int64_t now, bool includeExpired)
 			return _paths[bestPath].p;
 		}
 	}
+
+	/**
+	 * Pin each flow to one path and only move it at idle gaps (flowlets) so that
+	 * its packets are never reordered across paths of differing latency.
+	 */
+	if (RR->node->getMultipathMode() == ZT_MULTIPATH_BALANCE_FLOW_HASH) {
+		if (!flowId) // not an IP flow, e.g. ARP: any alive path will do
+			flowId = 0xffffffffffffffffULL;
+		if (!_flows)
+			_flows = new FlowTable<const Path *,ZT_MULTIPATH_FLOW_TABLE_SIZE>();
+
+		const Path *pinned = (const Path *)0;
+		if (_flows->get(flowId,now,ZT_MULTIPATH_FLOWLET_TIMEOUT,pinned)) {
+			for(unsigned int i=0;i<ZT_MAX_PEER_NETWORK_PATHS;++i) {
+				if ((_paths[i].p.ptr() == pinned)&&(_paths[i].p->alive(now)))
+					return _paths[i].p;
+			}
+		}
+
+		// New flowlet (or pinned path died): choose according to current allocations
+		unsigned int totalAllocation = 0;
+		for(unsigned int i=0;i<ZT_MAX_PEER_NETWORK_PATHS;++i) {
+			if ((_paths[i].p)&&(_paths[i].p->alive(now))) {
+				bestPath = (bestPath == ZT_MAX_PEER_NETWORK_PATHS) ? i : bestPath;
+				++numAlivePaths;
+				totalAllocation += _paths[i].p->allocation();
+			}
+		}
+		if (bestPath == ZT_MAX_PEER_NETWORK_PATHS)
+			return SharedPtr<Path>();
+		unsigned int r = (unsigned int)(((flowId >> 8) ^ (uint64_t)_freeRandomByte) & 0xff);
+		if (totalAllocation) {
+			r = (r * totalAllocation) >> 8;
+			for(unsigned int i=0;i<ZT_MAX_PEER_NETWORK_PATHS;++i) {
+				if ((_paths[i].p)&&(_paths[i].p->alive(now))) {
+					if (r < _paths[i].p->allocation()) {
+						bestPath = i;
+						break;
+					}
+					r -= _paths[i].p->allocation();
+				}
+			}
+		} else {
+			// No allocation computed yet, spread flowlets evenly
+			r %= (unsigned int)numAlivePaths;
+			for(unsigned int i=0;i<ZT_MAX_PEER_NETWORK_PATHS;++i) {
+				if ((_paths[i].p)&&(_paths[i].p->alive(now))&&(r-- == 0)) {
+					bestPath = i;
+					break;
+				}
+			}
+		}
+		_pathChoiceHist.push(bestPath);
+		_flows->set(flowId,now,_paths[bestPath].p.ptr());
+		return _paths[bestPath].p;
+	}
+
 	return SharedPtr<Path>();
 }
 
@@ -672,15 +732,15 @@ inline void Peer::processBackgroundPeerTasks(const int64_t now)
 void Peer::sendACK(void *tPtr,const SharedPtr<Path> &path,const int64_t localSocket,const InetAddress &atAddress,int64_t now)
 {
 	Packet outp(_id.address(),RR->identity.address(),Packet::VERB_ACK);
-	uint32_t bytesToAck = path->bytesToAck();
-	outp.append<uint32_t>(bytesToAck);
+	const int32_t bytesToAck = path->bytesToAck();
+	outp.append<uint32_t>((uint32_t)bytesToAck);
 	if (atAddress) {
 		outp.armor(_key,false);
 		RR->node->putPacket(tPtr,localSocket,atAddress,outp.data(),outp.size());
 	} else {
 		RR->sw->send(tPtr,outp,false);
 	}
-	path->sentAck(now);
+	path->sentAck(now,bytesToAck);
 }
 
 void Peer::sendQOS_MEASUREMENT(void *tPtr,const SharedPtr<Path> &path,const int64_t localSocket,const InetAddress &atAddress,int64_t now)
@@ -44,6 +44,9 @@
 #include "AtomicCounter.hpp"
 #include "Hashtable.hpp"
 #include "Mutex.hpp"
+#include "RingBuffer.hpp"
+#include "FlowTable.hpp"
+#include "AdaptiveCompression.hpp"
 
 #define ZT_PEER_MAX_SERIALIZED_STATE_SIZE (sizeof(Peer) + 32 + (sizeof(Path) * 2))
 
@@ -60,7 +63,11 @@ private:
 	Peer() {} // disabled to prevent bugs -- should not be constructed uninitialized
 
 public:
-	~Peer() { Utils::burn(_key,sizeof(_key)); }
+	~Peer()
+	{
+		Utils::burn(_key,sizeof(_key));
+		delete _flows;
+	}
 
 	/**
 	 * Construct a new peer
@@ -68,9 +75,10 @@ public:
 	 * @param renv Runtime environment
 	 * @param myIdentity Identity of THIS node (for key agreement)
 	 * @param peerIdentity Identity of peer
+	 * @param key Key already agreed with peerIdentity (ZT_PEER_SECRET_KEY_LENGTH bytes) or NULL to compute it here
 	 * @throws std::runtime_error Key agreement with peer's identity failed
 	 */
-	Peer(const RuntimeEnvironment *renv,const Identity &myIdentity,const Identity &peerIdentity);
+	Peer(const RuntimeEnvironment *renv,const Identity &myIdentity,const Identity &peerIdentity,const uint8_t *key = (const uint8_t *)0);
 
 	/**
 	 * @return This peer's ZT address (short for identity().address())
@@ -189,6 +197,16 @@ public:
 	 */
 	void sendQOS_MEASUREMENT(void *tPtr, const SharedPtr<Path> &path, const int64_t localSocket,const InetAddress &atAddress,int64_t now);
 
+	/**
+	 * Recompute QoS measurements for all paths and, if needed, the aggregate link allocation
+	 *
+	 * This is called periodically from Node's background task loop so that none of this
+	 * work is done on the packet path.
+	 *
+	 * @param now Current time
+	 */
+	void processBackgroundPathMeasurements(const int64_t now);
+
 	/**
 	 * Compute relative quality values and allocations for the components of the aggregate link
 	 *
@@ -221,9 +239,10 @@ public:
 	 *
 	 * @param now Current time
 	 * @param includeExpired If true, include even expired paths
+	 * @param flowId Hash of the traffic flow's 5-tuple or 0 if none (only used in ZT_MULTIPATH_BALANCE_FLOW_HASH mode)
 	 * @return Best current path or NULL if none
 	 */
-	SharedPtr<Path> getAppropriatePath(int64_t now, bool includeExpired);
+	SharedPtr<Path> getAppropriatePath(int64_t now, bool includeExpired, uint64_t flowId = 0);
 
 	/**
 	 * Generate a human-readable string of interface names making up the aggregate link, also include
@@ -444,6 +463,12 @@ public:
 	 */
 	inline bool canUseMultipath() { return _canUseMultipath; }
 
+	/**
+	 * @param nwid Network ID
+	 * @return Adaptive compression state for frames sent to this peer on this network
+	 */
+	inline AdaptiveCompression &compression(const uint64_t nwid) { return _compression[(unsigned int)(nwid ^ (nwid >> 32)) & (ZT_PEER_COMPRESSION_SLOTS - 1)]; }
+
 	/**
 	 * @return True if peer has received a trust established packet (e.g. common network membership) in the past ZT_TRUST_EXPIRATION ms
 	 */
@@ -672,6 +697,11 @@ private:
 
 	RingBuffer<int,ZT_MULTIPATH_PROPORTION_WIN_SZ> _pathChoiceHist;
 
+	AdaptiveCompression _compression[ZT_PEER_COMPRESSION_SLOTS];
+
+	// Flow to path pinning for ZT_MULTIPATH_BALANCE_FLOW_HASH, allocated on first use (guarded by _paths_m)
+	FlowTable<const Path *,ZT_MULTIPATH_FLOW_TABLE_SIZE> *_flows;
+
 	bool _linkIsBalanced;
 	bool _linkIsRedundant;
 	bool _remotePeerMultipathEnabled;
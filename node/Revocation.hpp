@@ -40,6 +40,7 @@
 #include "Utils.hpp"
 #include "Buffer.hpp"
 #include "Identity.hpp"
+#include "SignatureCache.hpp"
 
 /**
  * Flag: fast propagation via rumor mill algorithm
@@ -124,9 +125,10 @@ public:
 	 *
 	 * @param RR Runtime environment to provide for peer lookup, etc.
 	 * @param tPtr Thread pointer to be handed through to any callbacks called as a result of this call
+	 * @param batch If non-NULL, signatures are queued here instead of checked and 0 means only that everything else checked out
 	 * @return 0 == OK, 1 == waiting for WHOIS, -1 == BAD signature or chain
 	 */
-	int verify(const RuntimeEnvironment *RR,void *tPtr) const;
+	int verify(const RuntimeEnvironment *RR,void *tPtr,SignatureCache::Batch *batch = (SignatureCache::Batch *)0) const;
 
 	template<unsigned int C>
 	inline void serialize(Buffer<C> &b,const bool forSign = false) const
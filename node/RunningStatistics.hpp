@@ -0,0 +1,144 @@
+/*
+ * ZeroTier One - Network Virtualization Everywhere
+ * Copyright (C) 2011-2019  ZeroTier, Inc.  https://www.zerotier.com/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * --
+ *
+ * You can be released from the requirements of the license by purchasing
+ * a commercial license. Buying such a license is mandatory as soon as you
+ * develop commercial closed-source software that incorporates or links
+ * directly against ZeroTier software without disclosing the source code
+ * of your own application.
+ */
+
+#ifndef ZT_RUNNINGSTATISTICS_HPP
+#define ZT_RUNNINGSTATISTICS_HPP
+
+#include <math.h>
+
+namespace ZeroTier {
+
+/**
+ * Sliding window of samples with incrementally maintained mean and variance
+ *
+ * Unlike RingBuffer::mean() and stddev(), which walk the whole window, these
+ * are O(1). The window sums are recomputed exactly once per full trip around
+ * the window to keep floating point drift from accumulating.
+ *
+ * This is not thread safe. Callers must provide their own locking.
+ *
+ * @tparam T Sample type
+ * @tparam S Window size
+ */
+template<typename T,unsigned int S>
+class RunningStatistics
+{
+public:
+	RunningStatistics() :
+		_next(0),
+		_count(0),
+		_sum(0.0),
+		_sumSquares(0.0)
+	{
+		for(unsigned int i=0;i<S;++i)
+			_buf[i] = (T)0;
+	}
+
+	/**
+	 * Add a sample, evicting the oldest one if the window is full
+	 *
+	 * @param v Sample value
+	 */
+	inline void push(const T v)
+	{
+		const double d = (double)v;
+		if (_count == S) {
+			const double old = (double)_buf[_next];
+			_sum -= old;
+			_sumSquares -= old * old;
+		} else {
+			++_count;
+		}
+		_buf[_next] = v;
+		_sum += d;
+		_sumSquares += d * d;
+		if (++_next == S) {
+			_next = 0;
+			_resum();
+		}
+	}
+
+	/**
+	 * @return Number of samples in window
+	 */
+	inline unsigned int count() const { return _count; }
+
+	/**
+	 * @return Arithmetic mean of window or 0 if empty
+	 */
+	inline float mean() const { return (_count) ? (float)(_sum / (double)_count) : 0.0f; }
+
+	/**
+	 * @return Sample variance of window or 0 if fewer than two samples
+	 */
+	inline float variance() const
+	{
+		if (_count < 2)
+			return 0.0f;
+		const double n = (double)_count;
+		const double v = (_sumSquares - ((_sum * _sum) / n)) / (n - 1.0);
+		return (v > 0.0) ? (float)v : 0.0f;
+	}
+
+	/**
+	 * @return Sample standard deviation of window
+	 */
+	inline float stddev() const { return sqrtf(variance()); }
+
+	/**
+	 * Empty the window
+	 */
+	inline void reset()
+	{
+		_next = 0;
+		_count = 0;
+		_sum = 0.0;
+		_sumSquares = 0.0;
+	}
+
+private:
+	inline void _resum()
+	{
+		double s = 0.0,ss = 0.0;
+		for(unsigned int i=0;i<_count;++i) {
+			const double d = (double)_buf[i];
+			s += d;
+			ss += d * d;
+		}
+		_sum = s;
+		_sumSquares = ss;
+	}
+
+	T _buf[S];
+	unsigned int _next;
+	unsigned int _count;
+	double _sum;
+	double _sumSquares;
+};
+
+} // namespace ZeroTier
+
+#endif
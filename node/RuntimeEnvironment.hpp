@@ -42,6 +42,7 @@ class Node;
 class Multicaster;
 class NetworkController;
 class SelfAwareness;
+class SignatureCache;
 class Trace;
 
 /**
@@ -58,6 +59,7 @@ public:
 		,mc((Multicaster *)0)
 		,topology((Topology *)0)
 		,sa((SelfAwareness *)0)
+		,sc((SignatureCache *)0)
 	{
 		publicIdentityStr[0] = (char)0;
 		secretIdentityStr[0] = (char)0;
@@ -88,6 +90,7 @@ public:
 	Multicaster *mc;
 	Topology *topology;
 	SelfAwareness *sa;
+	SignatureCache *sc;
 
 	// This node's identity and string representations thereof
 	Identity identity;
@@ -10,6 +10,11 @@
 #include "Constants.hpp"
 #include "Salsa20.hpp"
 
+#if defined(ZT_SALSA20_SSE) && defined(__GNUC__) && (defined(__amd64) || defined(__amd64__) || defined(__x86_64) || defined(__x86_64__) || defined(__AMD64) || defined(__AMD64__)) && !defined(ZT_NO_AVX2)
+#define ZT_SALSA20_AVX2 1
+#include <immintrin.h>
+#endif
+
 #define ROTATE(v,c) (((v) << (c)) | ((v) >> (32 - (c))))
 #define XOR(v,w) ((v) ^ (w))
 #define PLUS(v,w) ((uint32_t)((v) + (w)))
@@ -1338,4 +1343,167 @@ void Salsa20::crypt20(const void *in,void *out,unsigned int bytes)
 	}
 }
 
+// Multi-block keystream kernels. These work on the canonical (non-permuted)
+// state with one block per vector lane: each of the 16 state words is a
+// vector holding that word for N consecutive block counters.
+
+#define ZT_S20_QR(a,b,c,d) \
+	b = XORV(b,ROTV(ADDV(a,d),7)); \
+	c = XORV(c,ROTV(ADDV(b,a),9)); \
+	d = XORV(d,ROTV(ADDV(c,b),13)); \
+	a = XORV(a,ROTV(ADDV(d,c),18))
+#define ZT_S20_DOUBLEROUND(x) \
+	ZT_S20_QR(x[0],x[4],x[8],x[12]); \
+	ZT_S20_QR(x[5],x[9],x[13],x[1]); \
+	ZT_S20_QR(x[10],x[14],x[2],x[6]); \
+	ZT_S20_QR(x[15],x[3],x[7],x[11]); \
+	ZT_S20_QR(x[0],x[1],x[2],x[3]); \
+	ZT_S20_QR(x[5],x[6],x[7],x[4]); \
+	ZT_S20_QR(x[10],x[11],x[8],x[9]); \
+	ZT_S20_QR(x[15],x[12],x[13],x[14])
+
+#ifdef ZT_SALSA20_SSE
+
+#define ADDV(a,b) _mm_add_epi32(a,b)
+#define XORV(a,b) _mm_xor_si128(a,b)
+#define ROTV(v,c) _mm_or_si128(_mm_slli_epi32(v,c),_mm_srli_epi32(v,32 - (c)))
+
+// Four blocks starting at counter ctr, 256 bytes of output
+static void _s20KeystreamSSE4(const uint32_t st[16],uint64_t ctr,uint8_t *out)
+{
+	__m128i j[16],x[16];
+	for(unsigned int k=0;k<16;++k)
+		j[k] = _mm_set1_epi32((int)st[k]);
+	j[8] = _mm_set_epi32((int)(uint32_t)(ctr + 3),(int)(uint32_t)(ctr + 2),(int)(uint32_t)(ctr + 1),(int)(uint32_t)ctr);
+	j[9] = _mm_set_epi32((int)(uint32_t)((ctr + 3) >> 32),(int)(uint32_t)((ctr + 2) >> 32),(int)(uint32_t)((ctr + 1) >> 32),(int)(uint32_t)(ctr >> 32));
+	for(unsigned int k=0;k<16;++k)
+		x[k] = j[k];
+	for(unsigned int r=0;r<10;++r) {
+		ZT_S20_DOUBLEROUND(x);
+	}
+	for(unsigned int g=0;g<16;g+=4) {
+		const __m128i a = _mm_add_epi32(x[g],j[g]);
+		const __m128i b = _mm_add_epi32(x[g + 1],j[g + 1]);
+		const __m128i c = _mm_add_epi32(x[g + 2],j[g + 2]);
+		const __m128i d = _mm_add_epi32(x[g + 3],j[g + 3]);
+		const __m128i t0 = _mm_unpacklo_epi32(a,b);
+		const __m128i t1 = _mm_unpacklo_epi32(c,d);
+		const __m128i t2 = _mm_unpackhi_epi32(a,b);
+		const __m128i t3 = _mm_unpackhi_epi32(c,d);
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(out + (g * 4)),_mm_unpacklo_epi64(t0,t1));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(out + 64 + (g * 4)),_mm_unpackhi_epi64(t0,t1));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(out + 128 + (g * 4)),_mm_unpacklo_epi64(t2,t3));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(out + 192 + (g * 4)),_mm_unpackhi_epi64(t2,t3));
+	}
+}
+
+#undef ADDV
+#undef XORV
+#undef ROTV
+
+#endif // ZT_SALSA20_SSE
+
+#ifdef ZT_SALSA20_AVX2
+
+#define ADDV(a,b) _mm256_add_epi32(a,b)
+#define XORV(a,b) _mm256_xor_si256(a,b)
+#define ROTV(v,c) _mm256_or_si256(_mm256_slli_epi32(v,c),_mm256_srli_epi32(v,32 - (c)))
+
+// Eight blocks starting at counter ctr, 512 bytes of output
+__attribute__((target("avx2"))) static void _s20KeystreamAVX2x8(const uint32_t st[16],uint64_t ctr,uint8_t *out)
+{
+	__m256i j[16],x[16];
+	for(unsigned int k=0;k<16;++k)
+		j[k] = _mm256_set1_epi32((int)st[k]);
+	uint32_t lo[8],hi[8];
+	for(unsigned int l=0;l<8;++l) {
+		lo[l] = (uint32_t)(ctr + l);
+		hi[l] = (uint32_t)((ctr + l) >> 32);
+	}
+	j[8] = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(lo));
+	j[9] = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(hi));
+	for(unsigned int k=0;k<16;++k)
+		x[k] = j[k];
+	for(unsigned int r=0;r<10;++r) {
+		ZT_S20_DOUBLEROUND(x);
+	}
+	// The 4x4 transpose works within each 128-bit half, so the low half
+	// yields blocks 0-3 and the high half blocks 4-7.
+	for(unsigned int g=0;g<16;g+=4) {
+		const __m256i a = _mm256_add_epi32(x[g],j[g]);
+		const __m256i b = _mm256_add_epi32(x[g + 1],j[g + 1]);
+		const __m256i c = _mm256_add_epi32(x[g + 2],j[g + 2]);
+		const __m256i d = _mm256_add_epi32(x[g + 3],j[g + 3]);
+		const __m256i t0 = _mm256_unpacklo_epi32(a,b);
+		const __m256i t1 = _mm256_unpacklo_epi32(c,d);
+		const __m256i t2 = _mm256_unpackhi_epi32(a,b);
+		const __m256i t3 = _mm256_unpackhi_epi32(c,d);
+		const __m256i r0 = _mm256_unpacklo_epi64(t0,t1);
+		const __m256i r1 = _mm256_unpackhi_epi64(t0,t1);
+		const __m256i r2 = _mm256_unpacklo_epi64(t2,t3);
+		const __m256i r3 = _mm256_unpackhi_epi64(t2,t3);
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(out + (g * 4)),_mm256_castsi256_si128(r0));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(out + 64 + (g * 4)),_mm256_castsi256_si128(r1));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(out + 128 + (g * 4)),_mm256_castsi256_si128(r2));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(out + 192 + (g * 4)),_mm256_castsi256_si128(r3));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(out + 256 + (g * 4)),_mm256_extracti128_si256(r0,1));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(out + 320 + (g * 4)),_mm256_extracti128_si256(r1,1));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(out + 384 + (g * 4)),_mm256_extracti128_si256(r2,1));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(out + 448 + (g * 4)),_mm256_extracti128_si256(r3,1));
+	}
+}
+
+#undef ADDV
+#undef XORV
+#undef ROTV
+
+static inline bool _s20HaveAVX2()
+{
+	static const bool a = (__builtin_cpu_supports("avx2") != 0);
+	return a;
+}
+
+#endif // ZT_SALSA20_AVX2
+
+#undef ZT_S20_QR
+#undef ZT_S20_DOUBLEROUND
+
+void Salsa20::keystream20(void *out,unsigned int blocks)
+{
+	uint8_t *o = (uint8_t *)out;
+
+#ifdef ZT_SALSA20_SSE
+	// The SSE state is stored permuted: canonical word (5 * k) % 16 lives at k
+	uint32_t st[16];
+	for(unsigned int k=0;k<16;++k)
+		st[(k * 5) & 15] = _state.i[k];
+	uint64_t ctr = ((uint64_t)st[8]) | (((uint64_t)st[9]) << 32);
+
+#ifdef ZT_SALSA20_AVX2
+	if (_s20HaveAVX2()) {
+		while (blocks >= 8) {
+			_s20KeystreamAVX2x8(st,ctr,o);
+			ctr += 8;
+			o += 512;
+			blocks -= 8;
+		}
+	}
+#endif
+	while (blocks >= 4) {
+		_s20KeystreamSSE4(st,ctr,o);
+		ctr += 4;
+		o += 256;
+		blocks -= 4;
+	}
+
+	_state.i[8] = (uint32_t)ctr;
+	_state.i[5] = (uint32_t)(ctr >> 32);
+#endif // ZT_SALSA20_SSE
+
+	if (blocks) {
+		memset(o,0,blocks * 64);
+		crypt20(o,o,blocks * 64);
+	}
+}
+
 } // namespace ZeroTier
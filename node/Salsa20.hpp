@@ -145,6 +145,18 @@ public:
 	 */
 	void crypt20(const void *in,void *out,unsigned int bytes);
 
+	/**
+	 * Generate raw Salsa20/20 keystream
+	 *
+	 * Output is identical to crypt20() over zero bytes and advances the
+	 * block counter the same way, but several blocks are computed at once
+	 * with SSE2 (4-way) or AVX2 (8-way, detected at runtime) when available.
+	 *
+	 * @param out Output buffer of at least blocks * 64 bytes
+	 * @param blocks Number of 64-byte blocks to generate
+	 */
+	void keystream20(void *out,unsigned int blocks);
+
 private:
 	union {
 #ifdef ZT_SALSA20_SSE
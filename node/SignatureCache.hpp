@@ -0,0 +1,209 @@
+/*
+ * ZeroTier One - Network Virtualization Everywhere
+ * Copyright (C) 2011-2019  ZeroTier, Inc.  https://www.zerotier.com/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * --
+ *
+ * You can be released from the requirements of the license by purchasing
+ * a commercial license. Buying such a license is mandatory as soon as you
+ * develop commercial closed-source software that incorporates or links
+ * directly against ZeroTier software without disclosing the source code
+ * of your own application.
+ */
+
+
+#ifndef ZT_SIGNATURECACHE_HPP
+#define ZT_SIGNATURECACHE_HPP
+
+#include <stdint.h>
+#include <string.h>
+
+#include <vector>
+
+#include "Constants.hpp"
+#include "C25519.hpp"
+#include "Identity.hpp"
+#include "SHA512.hpp"
+#include "Mutex.hpp"
+
+namespace ZeroTier {
+
+/**
+ * Cache of recently verified credential signatures
+ *
+ * Members re-push the same credentials to each other all the time. A
+ * signature that was already checked against a given key is remembered here
+ * so checking it again costs one SHA-512 of the message and no curve math.
+ * Valid and forged signatures are kept in separate tables so a flood of
+ * forgeries cannot evict good entries. Entries are direct mapped by
+ * signature and replaced on collision.
+ */
+class SignatureCache
+{
+public:
+	/**
+	 * Signatures collected to be checked together
+	 */
+	class Batch
+	{
+		friend class SignatureCache;
+
+	public:
+		Batch() {}
+
+		inline void add(const Identity &id,const void *msg,unsigned int len,const C25519::Signature &sig)
+		{
+			_e.push_back(_Item());
+			_e.back().key = id.publicKey();
+			_e.back().sig = sig;
+			_e.back().ptr = (unsigned int)_msgs.size();
+			_e.back().len = len;
+			_msgs.insert(_msgs.end(),reinterpret_cast<const uint8_t *>(msg),reinterpret_cast<const uint8_t *>(msg) + len);
+		}
+
+		inline unsigned int size() const { return (unsigned int)_e.size(); }
+
+	private:
+		struct _Item
+		{
+			C25519::Public key;
+			C25519::Signature sig;
+			unsigned int ptr;
+			unsigned int len;
+		};
+		std::vector<_Item> _e;
+		std::vector<uint8_t> _msgs;
+	};
+
+	SignatureCache()
+	{
+		memset(_good,0,sizeof(_good));
+		memset(_bad,0,sizeof(_bad));
+	}
+
+	/**
+	 * Verify a signature, using and updating the cache
+	 *
+	 * @param id Signing identity
+	 * @param msg Message
+	 * @param len Length of message
+	 * @param sig Signature
+	 * @return True if signature is valid
+	 */
+	inline bool verify(const Identity &id,const void *msg,unsigned int len,const C25519::Signature &sig)
+	{
+		if (!_digestMatches(msg,len,sig))
+			return false;
+		if (_cached(_good,id.publicKey(),sig))
+			return true;
+		if (_cached(_bad,id.publicKey(),sig))
+			return false;
+		if (!C25519::verify(id.publicKey(),msg,len,sig)) {
+			_add(_bad,id.publicKey(),sig);
+			return false;
+		}
+		_add(_good,id.publicKey(),sig);
+		return true;
+	}
+
+	/**
+	 * Check every signature in a batch and remember the results
+	 *
+	 * Signatures already cached either way are skipped, as are those whose
+	 * message digest does not match. The rest are checked together with
+	 * C25519::verifyBatch(). Callers verify each credential as usual
+	 * afterwards and hit the cache for good and forged signatures alike.
+	 *
+	 * @param b Batch to check
+	 * @return Number of signatures that needed curve math
+	 */
+	inline unsigned int verify(const Batch &b)
+	{
+		std::vector<const C25519::Public *> keys;
+		std::vector<const void *> msgs;
+		std::vector<unsigned int> lens;
+		std::vector<const void *> sigs;
+		for(std::vector<Batch::_Item>::const_iterator i(b._e.begin());i!=b._e.end();++i) {
+			const void *const msg = (i->len) ? reinterpret_cast<const void *>(&(b._msgs[i->ptr])) : reinterpret_cast<const void *>(b._msgs.data());
+			if ((_digestMatches(msg,i->len,i->sig))&&(!_cached(_good,i->key,i->sig))&&(!_cached(_bad,i->key,i->sig))) {
+				keys.push_back(&(i->key));
+				msgs.push_back(msg);
+				lens.push_back(i->len);
+				sigs.push_back(i->sig.data);
+			}
+		}
+
+		const unsigned int n = (unsigned int)keys.size();
+		if (n) {
+			bool *const valid = new bool[n];
+			C25519::verifyBatch(n,keys.data(),msgs.data(),lens.data(),sigs.data(),valid);
+			for(unsigned int k=0;k<n;++k)
+				_add((valid[k]) ? _good : _bad,*(keys[k]),*reinterpret_cast<const C25519::Signature *>(sigs[k]));
+			delete [] valid;
+		}
+		return n;
+	}
+
+private:
+	struct _Entry
+	{
+		uint8_t key[32]; // Ed25519 half of the public key
+		uint8_t sig[ZT_C25519_SIGNATURE_LEN];
+	};
+
+	static inline unsigned int _slot(const C25519::Signature &sig)
+	{
+		// R is a hash output for honestly generated signatures
+		uint32_t h;
+		memcpy(&h,sig.data,sizeof(h));
+		return (unsigned int)(h % ZT_SIGNATURE_CACHE_SIZE);
+	}
+
+	// The signature covers the first 32 bytes of SHA-512(msg) and the curve
+	// math covers only the signature, so once this matches the outcome for a
+	// key and signature is fixed. A mismatch says nothing about the signature
+	// and is never cached, or a replay with the wrong message could poison
+	// the bad table for the right one.
+	static inline bool _digestMatches(const void *msg,unsigned int len,const C25519::Signature &sig)
+	{
+		uint8_t digest[64];
+		SHA512::hash(digest,msg,len);
+		return Utils::secureEq(digest,sig.data + 64,32);
+	}
+
+	inline bool _cached(const _Entry *const t,const C25519::Public &key,const C25519::Signature &sig) const
+	{
+		const unsigned int s = _slot(sig);
+		Mutex::Lock _l(_lock);
+		return ((memcmp(t[s].sig,sig.data,ZT_C25519_SIGNATURE_LEN) == 0)&&(memcmp(t[s].key,key.data + 32,32) == 0));
+	}
+
+	inline void _add(_Entry *const t,const C25519::Public &key,const C25519::Signature &sig)
+	{
+		const unsigned int s = _slot(sig);
+		Mutex::Lock _l(_lock);
+		memcpy(t[s].key,key.data + 32,32);
+		memcpy(t[s].sig,sig.data,ZT_C25519_SIGNATURE_LEN);
+	}
+
+	_Entry _good[ZT_SIGNATURE_CACHE_SIZE];
+	_Entry _bad[ZT_SIGNATURE_CACHE_SIZE];
+	Mutex _lock;
+};
+
+} // namespace ZeroTier
+
+#endif
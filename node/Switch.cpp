@@ -47,6 +47,61 @@
 
 namespace ZeroTier {
 
+static inline uint64_t _flowBE32(const uint8_t *const p) { return (((uint64_t)p[0] << 24) | ((uint64_t)p[1] << 16) | ((uint64_t)p[2] << 8) | (uint64_t)p[3]); }
+
+static inline uint64_t _flowHashMix(uint64_t h,const uint64_t v)
+{
+	h ^= v;
+	h *= 0xff51afd7ed558ccdULL;
+	return h ^ (h >> 32);
+}
+
+// Hash an IPv4 or IPv6 frame's 5-tuple (protocol, addresses, and TCP/UDP/SCTP ports
+// if present in an unfragmented packet) to a nonzero flow ID, or return 0 if not IP.
+static uint64_t _flowIdForFrame(const unsigned int etherType,const uint8_t *const d,const unsigned int len)
+{
+	uint64_t h = 0;
+	unsigned int proto,ports = 0;
+	if ((etherType == ZT_ETHERTYPE_IPV4)&&(len >= 20)&&((d[0] >> 4) == 4)) {
+		const unsigned int ihl = (d[0] & 0xf) * 4;
+		proto = d[9];
+		h = _flowHashMix(h,(_flowBE32(d + 12) << 32) | _flowBE32(d + 16));
+		if (((d[6] & 0x3f) == 0)&&(d[7] == 0)&&(len >= (ihl + 4))) // not a fragment
+			ports = ihl;
+	} else if ((etherType == ZT_ETHERTYPE_IPV6)&&(len >= 40)&&((d[0] >> 4) == 6)) {
+		proto = d[6];
+		for(unsigned int i=8;i<40;i+=8)
+			h = _flowHashMix(h,(_flowBE32(d + i) << 32) | _flowBE32(d + i + 4));
+		if (len >= 44)
+			ports = 40;
+	} else {
+		return 0;
+	}
+	if ((ports)&&((proto == 0x06)||(proto == 0x11)||(proto == 0x84)))
+		h = _flowHashMix(h,((uint64_t)proto << 32) | _flowBE32(d + ports));
+	else h = _flowHashMix(h,(uint64_t)proto << 32);
+	return (h) ? h : 1;
+}
+
+// Compress a frame unless compression to this peer on this network has stopped paying off
+static inline void _compressFrame(const SharedPtr<Network> &network,const NetworkConfig &nconf,Peer *const peer,Packet &outp,const int64_t now)
+{
+	if (nconf.disableCompression())
+		return;
+	if (!peer) {
+		outp.compress();
+		return;
+	}
+	AdaptiveCompression &ac = peer->compression(network->id());
+	if (ac.shouldCompress(network->id(),now)) {
+		const unsigned int before = outp.payloadLength();
+		if (before > 64) { // Packet::compress() skips tiny packets, so don't count them
+			outp.compress();
+			ac.sample(before,outp.payloadLength(),now);
+		}
+	}
+}
+
 Switch::Switch(const RuntimeEnvironment *renv) :
 	RR(renv),
 	_lastBeaconResponse(0),
@@ -60,7 +115,11 @@ void Switch::onRemotePacket(void *tPtr,const int64_t localSocket,const InetAddre
 	try {
 		const int64_t now = RR->node->now();
 
-		const SharedPtr<Path> path(RR->topology->getPath(localSocket,fromAddr));
+		// Unknown addresses get a pre-auth handle so that unauthenticated
+		// traffic never allocates or registers a canonical Path.
+		SharedPtr<Path> path(RR->topology->findPath(localSocket,fromAddr));
+		if (!path)
+			path.set(new Path(localSocket,fromAddr,true));
 		path->received(now);
 
 		if (len == 13) {
@@ -257,13 +316,14 @@ void Switch::onRemotePacket(void *tPtr,const int64_t localSocket,const InetAddre
 
 void Switch::onLocalEthernet(void *tPtr,const SharedPtr<Network> &network,const MAC &from,const MAC &to,unsigned int etherType,unsigned int vlanId,const void *data,unsigned int len)
 {
-	if (!network->hasConfig())
+	const SharedPtr<const Network::Config> nconf(network->config());
+	if (!*nconf)
 		return;
 
 	// Check if this packet is from someone other than the tap -- i.e. bridged in
 	bool fromBridged;
 	if ((fromBridged = (from != network->mac()))) {
-		if (!network->config().permitsBridging(RR->identity.address())) {
+		if (!nconf->permitsBridging(RR->identity.address())) {
 			RR->t->outgoingNetworkFrameDropped(tPtr,network,from,to,etherType,vlanId,len,"not a bridge");
 			return;
 		}
@@ -286,14 +346,14 @@ void Switch::onLocalEthernet(void *tPtr,const SharedPtr<Network> &network,const
 				 * the 32-bit ADI field. In practice this uses our multicast pub/sub
 				 * system to implement a kind of extended/distributed ARP table. */
 				multicastGroup = MulticastGroup::deriveMulticastGroupForAddressResolution(InetAddress(((const unsigned char *)data) + 24,4,0));
-			} else if (!network->config().enableBroadcast()) {
+			} else if (!nconf->enableBroadcast()) {
 				// Don't transmit broadcasts if this network doesn't want them
 				RR->t->outgoingNetworkFrameDropped(tPtr,network,from,to,etherType,vlanId,len,"broadcast disabled");
 				return;
 			}
 		} else if ((etherType == ZT_ETHERTYPE_IPV6)&&(len >= (40 + 8 + 16))) {
 			// IPv6 NDP emulation for certain very special patterns of private IPv6 addresses -- if enabled
-			if ((network->config().ndpEmulation())&&(reinterpret_cast<const uint8_t *>(data)[6] == 0x3a)&&(reinterpret_cast<const uint8_t *>(data)[40] == 0x87)) { // ICMPv6 neighbor solicitation
+			if ((nconf->ndpEmulation())&&(reinterpret_cast<const uint8_t *>(data)[6] == 0x3a)&&(reinterpret_cast<const uint8_t *>(data)[40] == 0x87)) { // ICMPv6 neighbor solicitation
 				Address v6EmbeddedAddress;
 				const uint8_t *const pkt6 = reinterpret_cast<const uint8_t *>(data) + 40 + 8;
 				const uint8_t *my6 = (const uint8_t *)0;
@@ -305,8 +365,8 @@ void Switch::onLocalEthernet(void *tPtr,const SharedPtr<Network> &network,const
 
 				// For these to work, we must have a ZT-managed address assigned in one of the
 				// above formats, and the query must match its prefix.
-				for(unsigned int sipk=0;sipk<network->config().staticIpCount;++sipk) {
-					const InetAddress *const sip = &(network->config().staticIps[sipk]);
+				for(unsigned int sipk=0;sipk<nconf->staticIpCount;++sipk) {
+					const InetAddress *const sip = &(nconf->staticIps[sipk]);
 					if (sip->ss_family == AF_INET6) {
 						my6 = reinterpret_cast<const uint8_t *>(reinterpret_cast<const struct sockaddr_in6 *>(&(*sip))->sin6_addr.s6_addr);
 						const unsigned int sipNetmaskBits = Utils::ntoh((uint16_t)reinterpret_cast<const struct sockaddr_in6 *>(&(*sip))->sin6_port);
@@ -375,7 +435,7 @@ void Switch::onLocalEthernet(void *tPtr,const SharedPtr<Network> &network,const
 		}
 
 		// Check this after NDP emulation, since that has to be allowed in exactly this case
-		if (network->config().multicastLimit == 0) {
+		if (nconf->multicastLimit == 0) {
 			RR->t->outgoingNetworkFrameDropped(tPtr,network,from,to,etherType,vlanId,len,"multicast disabled");
 			return;
 		}
@@ -388,7 +448,7 @@ void Switch::onLocalEthernet(void *tPtr,const SharedPtr<Network> &network,const
 			network->learnBridgedMulticastGroup(tPtr,multicastGroup,RR->node->now());
 
 		// First pass sets noTee to false, but noTee is set to true in OutboundMulticast to prevent duplicates.
-		if (!network->filterOutgoingPacket(tPtr,false,RR->identity.address(),Address(),from,to,(const uint8_t *)data,len,etherType,vlanId,qosBucket)) {
+		if (!network->filterOutgoingPacket(tPtr,*nconf,false,RR->identity.address(),Address(),from,to,(const uint8_t *)data,len,etherType,vlanId,qosBucket)) {
 			RR->t->outgoingNetworkFrameDropped(tPtr,network,from,to,etherType,vlanId,len,"filter blocked");
 			return;
 		}
@@ -412,13 +472,15 @@ void Switch::onLocalEthernet(void *tPtr,const SharedPtr<Network> &network,const
 		Address toZT(to.toAddress(network->id())); // since in-network MACs are derived from addresses and network IDs, we can reverse this
 		SharedPtr<Peer> toPeer(RR->topology->getPeer(tPtr,toZT));
 
-		if (!network->filterOutgoingPacket(tPtr,false,RR->identity.address(),toZT,from,to,(const uint8_t *)data,len,etherType,vlanId,qosBucket)) {
+		if (!network->filterOutgoingPacket(tPtr,*nconf,false,RR->identity.address(),toZT,from,to,(const uint8_t *)data,len,etherType,vlanId,qosBucket)) {
 			RR->t->outgoingNetworkFrameDropped(tPtr,network,from,to,etherType,vlanId,len,"filter blocked");
 			return;
 		}
 
 		network->pushCredentialsIfNeeded(tPtr,toZT,RR->node->now());
 
+		const uint64_t flowId = (RR->node->getMultipathMode() == ZT_MULTIPATH_BALANCE_FLOW_HASH) ? _flowIdForFrame(etherType,(const uint8_t *)data,len) : 0;
+
 		if (fromBridged) {
 			Packet outp(toZT,RR->identity.address(),Packet::VERB_EXT_FRAME);
 			outp.append(network->id());
@@ -427,17 +489,15 @@ void Switch::onLocalEthernet(void *tPtr,const SharedPtr<Network> &network,const
 			from.appendTo(outp);
 			outp.append((uint16_t)etherType);
 			outp.append(data,len);
-			if (!network->config().disableCompression())
-				outp.compress();
-			aqm_enqueue(tPtr,network,outp,true,qosBucket);
+			_compressFrame(network,*nconf,toPeer.ptr(),outp,RR->node->now());
+			aqm_enqueue(tPtr,network,outp,true,qosBucket,flowId);
 		} else {
 			Packet outp(toZT,RR->identity.address(),Packet::VERB_FRAME);
 			outp.append(network->id());
 			outp.append((uint16_t)etherType);
 			outp.append(data,len);
-			if (!network->config().disableCompression())
-				outp.compress();
-			aqm_enqueue(tPtr,network,outp,true,qosBucket);
+			_compressFrame(network,*nconf,toPeer.ptr(),outp,RR->node->now());
+			aqm_enqueue(tPtr,network,outp,true,qosBucket,flowId);
 		}
 	} else {
 		// Destination is bridged behind a remote peer
@@ -445,7 +505,7 @@ void Switch::onLocalEthernet(void *tPtr,const SharedPtr<Network> &network,const
 		// We filter with a NULL destination ZeroTier address first. Filtrations
 		// for each ZT destination are also done below. This is the same rationale
 		// and design as for multicast.
-		if (!network->filterOutgoingPacket(tPtr,false,RR->identity.address(),Address(),from,to,(const uint8_t *)data,len,etherType,vlanId,qosBucket)) {
+		if (!network->filterOutgoingPacket(tPtr,*nconf,false,RR->identity.address(),Address(),from,to,(const uint8_t *)data,len,etherType,vlanId,qosBucket)) {
 			RR->t->outgoingNetworkFrameDropped(tPtr,network,from,to,etherType,vlanId,len,"filter blocked");
 			return;
 		}
@@ -455,8 +515,8 @@ void Switch::onLocalEthernet(void *tPtr,const SharedPtr<Network> &network,const
 
 		/* Create an array of up to ZT_MAX_BRIDGE_SPAM recipients for this bridged frame. */
 		bridges[0] = network->findBridgeTo(to);
-		std::vector<Address> activeBridges(network->config().activeBridges());
-		if ((bridges[0])&&(bridges[0] != RR->identity.address())&&(network->config().permitsBridging(bridges[0]))) {
+		std::vector<Address> activeBridges(nconf->activeBridges());
+		if ((bridges[0])&&(bridges[0] != RR->identity.address())&&(nconf->permitsBridging(bridges[0]))) {
 			/* We have a known bridge route for this MAC, send it there. */
 			++numBridges;
 		} else if (!activeBridges.empty()) {
@@ -482,8 +542,9 @@ void Switch::onLocalEthernet(void *tPtr,const SharedPtr<Network> &network,const
 			}
 		}
 
+		const uint64_t flowId = ((numBridges)&&(RR->node->getMultipathMode() == ZT_MULTIPATH_BALANCE_FLOW_HASH)) ? _flowIdForFrame(etherType,(const uint8_t *)data,len) : 0;
 		for(unsigned int b=0;b<numBridges;++b) {
-			if (network->filterOutgoingPacket(tPtr,true,RR->identity.address(),bridges[b],from,to,(const uint8_t *)data,len,etherType,vlanId,qosBucket)) {
+			if (network->filterOutgoingPacket(tPtr,*nconf,true,RR->identity.address(),bridges[b],from,to,(const uint8_t *)data,len,etherType,vlanId,qosBucket)) {
 				Packet outp(bridges[b],RR->identity.address(),Packet::VERB_EXT_FRAME);
 				outp.append(network->id());
 				outp.append((uint8_t)0x00);
@@ -491,9 +552,8 @@ void Switch::onLocalEthernet(void *tPtr,const SharedPtr<Network> &network,const
 				from.appendTo(outp);
 				outp.append((uint16_t)etherType);
 				outp.append(data,len);
-				if (!network->config().disableCompression())
-					outp.compress();
-				aqm_enqueue(tPtr,network,outp,true,qosBucket);
+				_compressFrame(network,*nconf,RR->topology->getPeerNoCache(bridges[b]).ptr(),outp,RR->node->now());
+				aqm_enqueue(tPtr,network,outp,true,qosBucket,flowId);
 			} else {
 				RR->t->outgoingNetworkFrameDropped(tPtr,network,from,to,etherType,vlanId,len,"filter blocked (bridge replication)");
 			}
@@ -501,10 +561,10 @@ void Switch::onLocalEthernet(void *tPtr,const SharedPtr<Network> &network,const
 	}
 }
 
-void Switch::aqm_enqueue(void *tPtr, const SharedPtr<Network> &network, Packet &packet,bool encrypt,int qosBucket)
+void Switch::aqm_enqueue(void *tPtr, const SharedPtr<Network> &network, Packet &packet,bool encrypt,int qosBucket,uint64_t flowId)
 {
 	if(!network->qosEnabled()) {
-		send(tPtr, packet, encrypt);
+		send(tPtr, packet, encrypt, flowId);
 		return;
 	}
 	NetworkQoSControlBlock *nqcb = _netQueueControlBlock[network->id()];
@@ -522,7 +582,7 @@ void Switch::aqm_enqueue(void *tPtr, const SharedPtr<Network> &network, Packet &
 	if (packet.verb() != Packet::VERB_FRAME && packet.verb() != Packet::VERB_EXT_FRAME) {
 		// DEBUG_INFO("skipping, no QoS for this packet, verb=%x", packet.verb());
 		// just send packet normally, no QoS for ZT protocol traffic
-		send(tPtr, packet, encrypt);
+		send(tPtr, packet, encrypt, flowId);
 	} 
 
 	_aqm_m.lock();
@@ -530,7 +590,7 @@ void Switch::aqm_enqueue(void *tPtr, const SharedPtr<Network> &network, Packet &
 	// Enqueue packet and move queue to appropriate list
 
 	const Address dest(packet.destination());
-	TXQueueEntry *txEntry = new TXQueueEntry(dest,RR->node->now(),packet,encrypt);
+	TXQueueEntry *txEntry = new TXQueueEntry(dest,RR->node->now(),packet,encrypt,flowId);
 	
 	ManagedQueue *selectedQueue = nullptr;
 	for (size_t i=0; i<ZT_QOS_NUM_BUCKETS; i++) {
@@ -702,7 +762,7 @@ void Switch::aqm_dequeue(void *tPtr)
 					queueAtFrontOfList->byteCredit -= len;
 					// Send the packet!
 					queueAtFrontOfList->q.pop_front();
-					send(tPtr, entryToEmit->packet, entryToEmit->encrypt);
+					send(tPtr, entryToEmit->packet, entryToEmit->encrypt, entryToEmit->flowId);
 					(*nqcb).second->_currEnqueuedPackets--;
 				}
 				if (queueAtFrontOfList) {
@@ -734,7 +794,7 @@ void Switch::aqm_dequeue(void *tPtr)
 					queueAtFrontOfList->byteLength -= len;
 					queueAtFrontOfList->byteCredit -= len;
 					queueAtFrontOfList->q.pop_front();
-					send(tPtr, entryToEmit->packet, entryToEmit->encrypt);
+					send(tPtr, entryToEmit->packet, entryToEmit->encrypt, entryToEmit->flowId);
 					(*nqcb).second->_currEnqueuedPackets--;
 				}
 				if (queueAtFrontOfList) {
@@ -758,18 +818,18 @@ void Switch::removeNetworkQoSControlBlock(uint64_t nwid)
 	}
 }
 
-void Switch::send(void *tPtr,Packet &packet,bool encrypt)
+void Switch::send(void *tPtr,Packet &packet,bool encrypt,uint64_t flowId)
 {
 	const Address dest(packet.destination());
 	if (dest == RR->identity.address())
 		return;
-	if (!_trySend(tPtr,packet,encrypt)) {
+	if (!_trySend(tPtr,packet,encrypt,flowId)) {
 		{
 			Mutex::Lock _l(_txQueue_m);
 			if (_txQueue.size() >= ZT_TX_QUEUE_SIZE) {
 				_txQueue.pop_front();
 			}
-			_txQueue.push_back(TXQueueEntry(dest,RR->node->now(),packet,encrypt));
+			_txQueue.push_back(TXQueueEntry(dest,RR->node->now(),packet,encrypt,flowId));
 		}
 		if (!RR->topology->getPeer(tPtr,dest))
 			requestWhois(tPtr,RR->node->now(),dest);
@@ -819,7 +879,7 @@ void Switch::doAnythingWaitingForPeer(void *tPtr,const SharedPtr<Peer> &peer)
 		Mutex::Lock _l(_txQueue_m);
 		for(std::list< TXQueueEntry >::iterator txi(_txQueue.begin());txi!=_txQueue.end();) {
 			if (txi->dest == peer->address()) {
-				if (_trySend(tPtr,txi->packet,txi->encrypt)) {
+				if (_trySend(tPtr,txi->packet,txi->encrypt,txi->flowId)) {
 					_txQueue.erase(txi++);
 				} else {
 					++txi;
@@ -843,7 +903,7 @@ unsigned long Switch::doTimerTasks(void *tPtr,int64_t now)
 		Mutex::Lock _l(_txQueue_m);
 
 		for(std::list< TXQueueEntry >::iterator txi(_txQueue.begin());txi!=_txQueue.end();) {
-			if (_trySend(tPtr,txi->packet,txi->encrypt)) {
+			if (_trySend(tPtr,txi->packet,txi->encrypt,txi->flowId)) {
 				_txQueue.erase(txi++);
 			} else if ((now - txi->creationTime) > ZT_TRANSMIT_QUEUE_TIMEOUT) {
 				_txQueue.erase(txi++);
@@ -873,7 +933,7 @@ unsigned long Switch::doTimerTasks(void *tPtr,int64_t now)
 
 	{
 		Mutex::Lock _l(_lastUniteAttempt_m);
-		Hashtable< _LastUniteKey,uint64_t >::Iterator i(_lastUniteAttempt);
+		FlatHashtable< _LastUniteKey,uint64_t >::Iterator i(_lastUniteAttempt);
 		_LastUniteKey *k = (_LastUniteKey *)0;
 		uint64_t *v = (uint64_t *)0;
 		while (i.next(k,v)) {
@@ -884,7 +944,7 @@ unsigned long Switch::doTimerTasks(void *tPtr,int64_t now)
 
 	{
 		Mutex::Lock _l(_lastSentWhoisRequest_m);
-		Hashtable< Address,int64_t >::Iterator i(_lastSentWhoisRequest);
+		FlatHashtable< Address,int64_t >::Iterator i(_lastSentWhoisRequest);
 		Address *a = (Address *)0;
 		int64_t *ts = (int64_t *)0;
 		while (i.next(a,ts)) {
@@ -907,7 +967,7 @@ bool Switch::_shouldUnite(const int64_t now,const Address &source,const Address
 	return false;
 }
 
-bool Switch::_trySend(void *tPtr,Packet &packet,bool encrypt)
+bool Switch::_trySend(void *tPtr,Packet &packet,bool encrypt,uint64_t flowId)
 {
 	SharedPtr<Path> viaPath;
 	const int64_t now = RR->node->now();
@@ -915,7 +975,7 @@ bool Switch::_trySend(void *tPtr,Packet &packet,bool encrypt)
 
 	const SharedPtr<Peer> peer(RR->topology->getPeer(tPtr,destination));
 	if (peer) {
-		viaPath = peer->getAppropriatePath(now,false);
+		viaPath = peer->getAppropriatePath(now,false,flowId);
 		if (!viaPath) {
 			peer->tryMemorizedPath(tPtr,now); // periodically attempt memorized or statically defined paths, if any are known
 			const SharedPtr<Peer> relay(RR->topology->getUpstreamPeer());
@@ -33,8 +33,43 @@
 #include "Buffer.hpp"
 #include "Switch.hpp"
 
+#include <atomic>
+#include <memory>
+
 namespace ZeroTier {
 
+namespace {
+
+std::atomic<uint64_t> s_topologyIds(0);
+
+// Recent (local socket, remote address) to Path lookups on one thread, shared by all Topology instances
+struct _PathCache
+{
+	_PathCache()
+	{
+		for(unsigned int i=0;i<ZT_TOPOLOGY_PATH_CACHE_SIZE;++i)
+			entries[i].topology = 0;
+	}
+
+	struct Entry
+	{
+		uint64_t topology; // Topology::_id of owner, 0 if unused
+		Path::HashKey key;
+		SharedPtr<Path> path;
+	};
+
+	inline Entry &entry(const Path::HashKey &k)
+	{
+		return entries[(unsigned int)(((uint64_t)k.hashCode() * 0x9e3779b97f4a7c15ULL) >> 58) & (ZT_TOPOLOGY_PATH_CACHE_SIZE - 1)];
+	}
+
+	Entry entries[ZT_TOPOLOGY_PATH_CACHE_SIZE];
+};
+
+thread_local std::unique_ptr<_PathCache> s_pathCache;
+
+} // anonymous namespace
+
 /*
  * 2018-07-26 ZeroTier planet definition for the third planet of Sol:
  *
@@ -65,6 +100,7 @@ static const unsigned char ZT_DEFAULT_WORLD[ZT_DEFAULT_WORLD_LENGTH] = {0x01,0x0
 
 Topology::Topology(const RuntimeEnvironment *renv,void *tPtr) :
 	RR(renv),
+	_id(++s_topologyIds),
 	_numConfiguredPhysicalPaths(0),
 	_amUpstream(false)
 {
@@ -90,7 +126,7 @@ Topology::Topology(const RuntimeEnvironment *renv,void *tPtr) :
 
 Topology::~Topology()
 {
-	Hashtable< Address,SharedPtr<Peer> >::Iterator i(_peers);
+	FlatHashtable< Address,SharedPtr<Peer> >::Iterator i(_peers);
 	Address *a = (Address *)0;
 	SharedPtr<Peer> *p = (SharedPtr<Peer> *)0;
 	while (i.next(a,p))
@@ -143,6 +179,52 @@ SharedPtr<Peer> Topology::getPeer(void *tPtr,const Address &zta)
 	return SharedPtr<Peer>();
 }
 
+SharedPtr<Path> Topology::getPath(const int64_t l,const InetAddress &r)
+{
+	const Path::HashKey k(l,r);
+	if (!s_pathCache)
+		s_pathCache.reset(new _PathCache());
+	_PathCache::Entry &e = s_pathCache->entry(k);
+	if ((e.topology == _id)&&(e.key == k))
+		return e.path;
+
+	SharedPtr<Path> np;
+	{
+		Mutex::Lock _l(_paths_m);
+		SharedPtr<Path> &p = _paths[k];
+		if (!p)
+			p.set(new Path(l,r));
+		np = p;
+	}
+	e.topology = _id;
+	e.key = k;
+	e.path = np;
+	return np;
+}
+
+SharedPtr<Path> Topology::findPath(const int64_t l,const InetAddress &r)
+{
+	const Path::HashKey k(l,r);
+	if (!s_pathCache)
+		s_pathCache.reset(new _PathCache());
+	_PathCache::Entry &e = s_pathCache->entry(k);
+	if ((e.topology == _id)&&(e.key == k))
+		return e.path;
+
+	SharedPtr<Path> np;
+	{
+		Mutex::Lock _l(_paths_m);
+		const SharedPtr<Path> *const p = _paths.get(k);
+		if (!p)
+			return np;
+		np = *p;
+	}
+	e.topology = _id;
+	e.key = k;
+	e.path = np;
+	return np;
+}
+
 Identity Topology::getIdentity(void *tPtr,const Address &zta)
 {
 	if (zta == RR->identity.address()) {
@@ -369,22 +451,29 @@ void Topology::removeMoon(void *tPtr,const uint64_t id)
 void Topology::doPeriodicTasks(void *tPtr,int64_t now)
 {
 	{
-		Mutex::Lock _l1(_peers_m);
-		Mutex::Lock _l2(_upstreams_m);
-		Hashtable< Address,SharedPtr<Peer> >::Iterator i(_peers);
-		Address *a = (Address *)0;
-		SharedPtr<Peer> *p = (SharedPtr<Peer> *)0;
-		while (i.next(a,p)) {
-			if ( (!(*p)->isAlive(now)) && (std::find(_upstreamAddresses.begin(),_upstreamAddresses.end(),*a) == _upstreamAddresses.end()) ) {
-				_savePeer(tPtr,*p);
-				_peers.erase(*a);
+		// Expired peers are saved after _peers_m is released so state
+		// storage I/O never stalls packet processing threads.
+		std::vector< SharedPtr<Peer> > expired;
+		{
+			Mutex::Lock _l1(_peers_m);
+			Mutex::Lock _l2(_upstreams_m);
+			FlatHashtable< Address,SharedPtr<Peer> >::Iterator i(_peers);
+			Address *a = (Address *)0;
+			SharedPtr<Peer> *p = (SharedPtr<Peer> *)0;
+			while (i.next(a,p)) {
+				if ( (!(*p)->isAlive(now)) && (std::find(_upstreamAddresses.begin(),_upstreamAddresses.end(),*a) == _upstreamAddresses.end()) ) {
+					expired.push_back(*p);
+					_peers.erase(*a);
+				}
 			}
 		}
+		for(std::vector< SharedPtr<Peer> >::const_iterator p(expired.begin());p!=expired.end();++p)
+			_savePeer(tPtr,*p);
 	}
 
 	{
 		Mutex::Lock _l(_paths_m);
-		Hashtable< Path::HashKey,SharedPtr<Path> >::Iterator i(_paths);
+		FlatHashtable< Path::HashKey,SharedPtr<Path> >::Iterator i(_paths);
 		Path::HashKey *k = (Path::HashKey *)0;
 		SharedPtr<Path> *p = (SharedPtr<Path> *)0;
 		while (i.next(k,p)) {
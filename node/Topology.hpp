@@ -45,8 +45,18 @@
 #include "Mutex.hpp"
 #include "InetAddress.hpp"
 #include "Hashtable.hpp"
+#include "FlatHashtable.hpp"
 #include "World.hpp"
 
+/**
+ * Entries in each thread's direct-mapped cache of recent path lookups (must be a power of two)
+ *
+ * Each entry holds a reference to its Path, so a path that is only cached
+ * is not expired until its entry is reused. This bounds that retention to
+ * this many paths per thread.
+ */
+#define ZT_TOPOLOGY_PATH_CACHE_SIZE 64
+
 namespace ZeroTier {
 
 class RuntimeEnvironment;
@@ -114,14 +124,21 @@ public:
 	 * @param r Remote address
 	 * @return Pointer to canonicalized Path object
 	 */
-	inline SharedPtr<Path> getPath(const int64_t l,const InetAddress &r)
-	{
-		Mutex::Lock _l(_paths_m);
-		SharedPtr<Path> &p = _paths[Path::HashKey(l,r)];
-		if (!p)
-			p.set(new Path(l,r));
-		return p;
-	}
+	SharedPtr<Path> getPath(const int64_t l,const InetAddress &r);
+
+	/**
+	 * Get an existing Path object for a given local and remote physical address
+	 *
+	 * Recent lookups are remembered in a small per-thread cache, so in the
+	 * steady state this doesn't need to take the path table lock. This is
+	 * used on the receive path, where a packet from an unknown address gets
+	 * a pre-auth Path instead (see Path::preAuth()).
+	 *
+	 * @param l Local socket
+	 * @param r Remote address
+	 * @return Pointer to canonicalized Path object or NULL if none
+	 */
+	SharedPtr<Path> findPath(const int64_t l,const InetAddress &r);
 
 	/**
 	 * Get the current best upstream peer
@@ -295,7 +312,7 @@ public:
 	{
 		unsigned long cnt = 0;
 		Mutex::Lock _l(_peers_m);
-		Hashtable< Address,SharedPtr<Peer> >::Iterator i(const_cast<Topology *>(this)->_peers);
+		FlatHashtable< Address,SharedPtr<Peer> >::Iterator i(const_cast<Topology *>(this)->_peers);
 		Address *a = (Address *)0;
 		SharedPtr<Peer> *p = (SharedPtr<Peer> *)0;
 		while (i.next(a,p)) {
@@ -316,7 +333,7 @@ public:
 	inline void eachPeer(F f)
 	{
 		Mutex::Lock _l(_peers_m);
-		Hashtable< Address,SharedPtr<Peer> >::Iterator i(_peers);
+		FlatHashtable< Address,SharedPtr<Peer> >::Iterator i(_peers);
 		Address *a = (Address *)0;
 		SharedPtr<Peer> *p = (SharedPtr<Peer> *)0;
 		while (i.next(a,p)) {
@@ -446,14 +463,15 @@ private:
 	void _savePeer(void *tPtr,const SharedPtr<Peer> &peer);
 
 	const RuntimeEnvironment *const RR;
+	const uint64_t _id; // unique per instance, tags this instance's entries in per-thread path caches
 
 	std::pair<InetAddress,ZT_PhysicalPathConfiguration> _physicalPathConfig[ZT_MAX_CONFIGURABLE_PATHS];
 	volatile unsigned int _numConfiguredPhysicalPaths;
 
-	Hashtable< Address,SharedPtr<Peer> > _peers;
+	FlatHashtable< Address,SharedPtr<Peer> > _peers;
 	Mutex _peers_m;
 
-	Hashtable< Path::HashKey,SharedPtr<Path> > _paths;
+	FlatHashtable< Path::HashKey,SharedPtr<Path> > _paths;
 	Mutex _paths_m;
 
 	World _planet;
@@ -189,11 +189,11 @@ void Trace::outgoingNetworkFrameDropped(void *const tPtr,const SharedPtr<Network
 
 	ZT_LOCAL_TRACE(tPtr,RR,"%.16llx DROP frame %s -> %s etherType %.4x size %u (%s)",network->id(),sourceMac.toString(tmp),destMac.toString(tmp2),etherType,frameLen,(reason) ? reason : "unknown reason");
 
-	std::pair<Address,Trace::Level> byn;
-	{ Mutex::Lock l(_byNet_m); _byNet.get(network->id(),byn); }
-
-	if ( ((_globalTarget)&&((int)_globalLevel >= (int)Trace::LEVEL_VERBOSE)) || ((byn.first)&&((int)byn.second >= (int)Trace::LEVEL_VERBOSE)) ) {
-		Dictionary<ZT_MAX_REMOTE_TRACE_SIZE> d;
+	if (network->traceLevel() < (int)Trace::LEVEL_VERBOSE)
+		return;
+	_QueuedEvent *const e = _claim(*network,Trace::LEVEL_VERBOSE);
+	if (e) {
+		Dictionary<ZT_MAX_REMOTE_TRACE_SIZE> &d = e->d;
 		d.add(ZT_REMOTE_TRACE_FIELD__EVENT,ZT_REMOTE_TRACE_EVENT__OUTGOING_NETWORK_FRAME_DROPPED_S);
 		d.add(ZT_REMOTE_TRACE_FIELD__NETWORK_ID,network->id());
 		d.add(ZT_REMOTE_TRACE_FIELD__SOURCE_MAC,sourceMac.toInt());
@@ -204,10 +204,7 @@ void Trace::outgoingNetworkFrameDropped(void *const tPtr,const SharedPtr<Network
 		if (reason)
 			d.add(ZT_REMOTE_TRACE_FIELD__REASON,reason);
 
-		if ((_globalTarget)&&((int)_globalLevel >= (int)Trace::LEVEL_VERBOSE))
-			_send(tPtr,d,_globalTarget);
-		if ((byn.first)&&((int)byn.second >= (int)Trace::LEVEL_VERBOSE))
-			_send(tPtr,d,byn.first);
+		_commit(e);
 	}
 }
 
@@ -218,11 +215,11 @@ void Trace::incomingNetworkAccessDenied(void *const tPtr,const SharedPtr<Network
 
 	ZT_LOCAL_TRACE(tPtr,RR,"%.16llx DENIED packet from %.10llx(%s) verb %d size %u%s",network->id(),source.toInt(),(path) ? (path->address().toString(tmp)) : "???",(int)verb,packetLength,credentialsRequested ? " (credentials requested)" : " (credentials not requested)");
 
-	std::pair<Address,Trace::Level> byn;
-	{ Mutex::Lock l(_byNet_m); _byNet.get(network->id(),byn); }
-
-	if ( ((_globalTarget)&&((int)_globalLevel >= (int)Trace::LEVEL_VERBOSE)) || ((byn.first)&&((int)byn.second >= (int)Trace::LEVEL_VERBOSE)) ) {
-		Dictionary<ZT_MAX_REMOTE_TRACE_SIZE> d;
+	if (network->traceLevel() < (int)Trace::LEVEL_VERBOSE)
+		return;
+	_QueuedEvent *const e = _claim(*network,Trace::LEVEL_VERBOSE);
+	if (e) {
+		Dictionary<ZT_MAX_REMOTE_TRACE_SIZE> &d = e->d;
 		d.add(ZT_REMOTE_TRACE_FIELD__EVENT,ZT_REMOTE_TRACE_EVENT__INCOMING_NETWORK_ACCESS_DENIED_S);
 		d.add(ZT_REMOTE_TRACE_FIELD__PACKET_ID,packetId);
 		d.add(ZT_REMOTE_TRACE_FIELD__PACKET_VERB,(uint64_t)verb);
@@ -233,10 +230,7 @@ void Trace::incomingNetworkAccessDenied(void *const tPtr,const SharedPtr<Network
 		}
 		d.add(ZT_REMOTE_TRACE_FIELD__NETWORK_ID,network->id());
 
-		if ((_globalTarget)&&((int)_globalLevel >= (int)Trace::LEVEL_VERBOSE))
-			_send(tPtr,d,_globalTarget);
-		if ((byn.first)&&((int)byn.second >= (int)Trace::LEVEL_VERBOSE))
-			_send(tPtr,d,byn.first);
+		_commit(e);
 	}
 }
 
@@ -247,11 +241,11 @@ void Trace::incomingNetworkFrameDropped(void *const tPtr,const SharedPtr<Network
 
 	ZT_LOCAL_TRACE(tPtr,RR,"%.16llx DROPPED frame from %.10llx(%s) verb %d size %u",network->id(),source.toInt(),(path) ? (path->address().toString(tmp)) : "???",(int)verb,packetLength);
 
-	std::pair<Address,Trace::Level> byn;
-	{ Mutex::Lock l(_byNet_m); _byNet.get(network->id(),byn); }
-
-	if ( ((_globalTarget)&&((int)_globalLevel >= (int)Trace::LEVEL_VERBOSE)) || ((byn.first)&&((int)byn.second >= (int)Trace::LEVEL_VERBOSE)) ) {
-		Dictionary<ZT_MAX_REMOTE_TRACE_SIZE> d;
+	if (network->traceLevel() < (int)Trace::LEVEL_VERBOSE)
+		return;
+	_QueuedEvent *const e = _claim(*network,Trace::LEVEL_VERBOSE);
+	if (e) {
+		Dictionary<ZT_MAX_REMOTE_TRACE_SIZE> &d = e->d;
 		d.add(ZT_REMOTE_TRACE_FIELD__EVENT,ZT_REMOTE_TRACE_EVENT__INCOMING_NETWORK_FRAME_DROPPED_S);
 		d.add(ZT_REMOTE_TRACE_FIELD__PACKET_ID,packetId);
 		d.add(ZT_REMOTE_TRACE_FIELD__PACKET_VERB,(uint64_t)verb);
@@ -266,10 +260,7 @@ void Trace::incomingNetworkFrameDropped(void *const tPtr,const SharedPtr<Network
 		if (reason)
 			d.add(ZT_REMOTE_TRACE_FIELD__REASON,reason);
 
-		if ((_globalTarget)&&((int)_globalLevel >= (int)Trace::LEVEL_VERBOSE))
-			_send(tPtr,d,_globalTarget);
-		if ((byn.first)&&((int)byn.second >= (int)Trace::LEVEL_VERBOSE))
-			_send(tPtr,d,byn.first);
+		_commit(e);
 	}
 }
 
@@ -372,11 +363,9 @@ void Trace::networkFilter(
 	const bool inbound,
 	const int accept)
 {
-	std::pair<Address,Trace::Level> byn;
-	{ Mutex::Lock l(_byNet_m); _byNet.get(network.id(),byn); }
-
-	if ( ((_globalTarget)&&((int)_globalLevel >= (int)Trace::LEVEL_RULES)) || ((byn.first)&&((int)byn.second >= (int)Trace::LEVEL_RULES)) ) {
-		Dictionary<ZT_MAX_REMOTE_TRACE_SIZE> d;
+	_QueuedEvent *const e = _claim(network,Trace::LEVEL_RULES);
+	if (e) {
+		Dictionary<ZT_MAX_REMOTE_TRACE_SIZE> &d = e->d;
 		d.add(ZT_REMOTE_TRACE_FIELD__EVENT,ZT_REMOTE_TRACE_EVENT__NETWORK_FILTER_TRACE_S);
 		d.add(ZT_REMOTE_TRACE_FIELD__NETWORK_ID,network.id());
 		d.add(ZT_REMOTE_TRACE_FIELD__SOURCE_ZTADDR,ztSource);
@@ -397,10 +386,7 @@ void Trace::networkFilter(
 		if (frameLen > 0)
 			d.add(ZT_REMOTE_TRACE_FIELD__FRAME_DATA,(const char *)frameData,(frameLen > 256) ? (int)256 : (int)frameLen);
 
-		if ((_globalTarget)&&((int)_globalLevel >= (int)Trace::LEVEL_RULES))
-			_send(tPtr,d,_globalTarget);
-		if ((byn.first)&&((int)byn.second >= (int)Trace::LEVEL_RULES))
-			_send(tPtr,d,byn.first);
+		_commit(e);
 	}
 }
 
@@ -524,20 +510,76 @@ void Trace::updateMemoizedSettings()
 	_globalTarget = RR->node->remoteTraceTarget();
 	_globalLevel = RR->node->remoteTraceLevel();
 	const std::vector< SharedPtr<Network> > nws(RR->node->allNetworks());
+	for(std::vector< SharedPtr<Network> >::const_iterator n(nws.begin());n!=nws.end();++n)
+		(*n)->setTraceLevel(networkTraceLevel(*(*n)->config()));
 	{
 		Mutex::Lock l(_byNet_m);
 		_byNet.clear();
 		for(std::vector< SharedPtr<Network> >::const_iterator n(nws.begin());n!=nws.end();++n) {
-			const Address dest((*n)->config().remoteTraceTarget);
-			if (dest) {
+			const SharedPtr<const Network::Config> nconf((*n)->config());
+			if (nconf->remoteTraceTarget) {
 				std::pair<Address,Trace::Level> &m = _byNet[(*n)->id()];
-				m.first = dest;
-				m.second = (*n)->config().remoteTraceLevel;
+				m.first = nconf->remoteTraceTarget;
+				m.second = nconf->remoteTraceLevel;
 			}
 		}
 	}
 }
 
+int Trace::networkTraceLevel(const NetworkConfig &nconf)
+{
+	int level = -1;
+	if (_globalTarget)
+		level = (int)_globalLevel;
+	if ((nconf.remoteTraceTarget)&&((int)nconf.remoteTraceLevel > level))
+		level = (int)nconf.remoteTraceLevel;
+
+	if ((level >= 0)&&(!_queue.load(std::memory_order_acquire))) {
+		_QueuedEvent *const q = new _QueuedEvent[ZT_TRACE_QUEUE_SIZE];
+		_QueuedEvent *expected = (_QueuedEvent *)0;
+		if (!_queue.compare_exchange_strong(expected,q,std::memory_order_acq_rel))
+			delete [] q;
+	}
+
+	return level;
+}
+
+void Trace::flush(void *const tPtr)
+{
+	_QueuedEvent *const q = _queue.load(std::memory_order_acquire);
+	if (!q)
+		return;
+	const unsigned int oldest = _queueNext.load(std::memory_order_relaxed);
+	for(unsigned int k=0;k<ZT_TRACE_QUEUE_SIZE;++k) {
+		_QueuedEvent &e = q[(oldest + k) & (ZT_TRACE_QUEUE_SIZE - 1)];
+		unsigned int st = _QueuedEvent::READY;
+		if (e.state.compare_exchange_strong(st,_QueuedEvent::BUSY,std::memory_order_acquire)) {
+			for(unsigned int i=0;i<2;++i) {
+				if (e.dest[i])
+					_send(tPtr,e.d,e.dest[i]);
+			}
+			e.state.store(_QueuedEvent::EMPTY,std::memory_order_release);
+		}
+	}
+}
+
+Trace::_QueuedEvent *Trace::_claim(const Network &network,const Level level)
+{
+	_QueuedEvent *const q = _queue.load(std::memory_order_acquire);
+	if (!q)
+		return (_QueuedEvent *)0;
+	_QueuedEvent &e = q[_queueNext.fetch_add(1,std::memory_order_relaxed) & (ZT_TRACE_QUEUE_SIZE - 1)];
+	unsigned int st = _QueuedEvent::EMPTY;
+	if (!e.state.compare_exchange_strong(st,_QueuedEvent::BUSY,std::memory_order_acquire))
+		return (_QueuedEvent *)0; // queue is full, drop this event
+
+	const SharedPtr<const Network::Config> nconf(network.config());
+	e.dest[0] = ((_globalTarget)&&((int)_globalLevel >= (int)level)) ? _globalTarget : Address();
+	e.dest[1] = ((nconf->remoteTraceTarget)&&((int)nconf->remoteTraceLevel >= (int)level)) ? nconf->remoteTraceTarget : Address();
+	e.d.clear();
+	return &e;
+}
+
 void Trace::_send(void *const tPtr,const Dictionary<ZT_MAX_REMOTE_TRACE_SIZE> &d,const Address &dest)
 {
 	Packet outp(dest,RR->identity.address(),Packet::VERB_REMOTE_TRACE);
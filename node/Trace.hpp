@@ -32,6 +32,8 @@
 #include <string.h>
 #include <stdlib.h>
 
+#include <atomic>
+
 #include "../include/ZeroTierOne.h"
 
 #include "Constants.hpp"
@@ -43,6 +45,11 @@
 #include "Mutex.hpp"
 #include "Hashtable.hpp"
 
+/**
+ * Number of per-frame trace events that can be waiting to be sent (must be a power of two)
+ */
+#define ZT_TRACE_QUEUE_SIZE 64
+
 namespace ZeroTier {
 
 class RuntimeEnvironment;
@@ -114,8 +121,15 @@ public:
 
 	Trace(const RuntimeEnvironment *renv) :
 		RR(renv),
-		_byNet(8)
+		_byNet(8),
+		_queue((_QueuedEvent *)0),
+		_queueNext(0)
+	{
+	}
+
+	~Trace()
 	{
+		delete [] _queue.load();
 	}
 
 	void resettingPathsInScope(void *const tPtr,const Address &reporter,const InetAddress &reporterPhysicalAddress,const InetAddress &myPhysicalAddress,const InetAddress::IpScope scope);
@@ -165,9 +179,51 @@ public:
 
 	void updateMemoizedSettings();
 
+	/**
+	 * Compute the level at which anything wants trace events for a network
+	 *
+	 * Network caches this so the frame path can skip tracing without taking
+	 * a lock. If the result is not -1 the per-frame event queue is allocated.
+	 *
+	 * @param nconf Network configuration
+	 * @return Highest level of the global or the network's own trace target, or -1 if neither is set
+	 */
+	int networkTraceLevel(const NetworkConfig &nconf);
+
+	/**
+	 * Send per-frame trace events queued since the last call
+	 *
+	 * This is called from Node::processBackgroundTasks().
+	 *
+	 * @param tPtr Thread pointer to be handed through to any callbacks
+	 */
+	void flush(void *const tPtr);
+
 private:
 	const RuntimeEnvironment *const RR;
 
+	/**
+	 * A per-frame trace event waiting for flush()
+	 *
+	 * Slots move from EMPTY to BUSY to READY and back to EMPTY by way of
+	 * BUSY again, always claimed with a compare-and-swap, so any number of
+	 * frame path threads can queue while flush() drains. If the slot a
+	 * producer lands on is not free the event is dropped.
+	 */
+	struct _QueuedEvent
+	{
+		enum { EMPTY = 0,BUSY = 1,READY = 2 };
+
+		_QueuedEvent() : state(EMPTY) {}
+
+		std::atomic<unsigned int> state;
+		Address dest[2];
+		Dictionary<ZT_MAX_REMOTE_TRACE_SIZE> d;
+	};
+
+	_QueuedEvent *_claim(const Network &network,const Level level);
+	inline void _commit(_QueuedEvent *const e) { e->state.store(_QueuedEvent::READY,std::memory_order_release); }
+
 	void _send(void *const tPtr,const Dictionary<ZT_MAX_REMOTE_TRACE_SIZE> &d,const Address &dest);
 	void _spamToAllNetworks(void *const tPtr,const Dictionary<ZT_MAX_REMOTE_TRACE_SIZE> &d,const Level level);
 
@@ -175,6 +231,9 @@ private:
 	Trace::Level _globalLevel;
 	Hashtable< uint64_t,std::pair< Address,Trace::Level > > _byNet;
 	Mutex _byNet_m;
+
+	std::atomic<_QueuedEvent *> _queue; // allocated the first time anything is traced
+	std::atomic<unsigned int> _queueNext;
 };
 
 } // namespace ZeroTier
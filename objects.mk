@@ -38,6 +38,8 @@ ONE_OBJS=\
 	osdep/ManagedRoute.o \
 	osdep/Http.o \
 	osdep/OSUtils.o \
+	osdep/StateStore.o \
+	osdep/TestEthernetTap.o \
 	service/SoftwareUpdater.o \
 	service/OneService.o
 
@@ -70,6 +70,7 @@
 #include <iostream>
 #include <sstream>
 #include <algorithm>
+#include <thread>
 
 #include "version.h"
 #include "include/ZeroTierOne.h"
@@ -824,13 +825,34 @@ static void idtoolPrintHelp(FILE *out,const char *pn)
 		COPYRIGHT_NOTICE ZT_EOL_S
 		LICENSE_GRANT ZT_EOL_S);
 	fprintf(out,"Usage: %s <command> [<args>]" ZT_EOL_S"" ZT_EOL_S"Commands:" ZT_EOL_S,pn);
-	fprintf(out,"  generate [<identity.secret>] [<identity.public>] [<vanity>]" ZT_EOL_S);
+	fprintf(out,"  generate [-t<threads>] [<identity.secret>] [<identity.public>] [<vanity>]" ZT_EOL_S);
 	fprintf(out,"  validate <identity.secret/public>" ZT_EOL_S);
 	fprintf(out,"  getpublic <identity.secret>" ZT_EOL_S);
 	fprintf(out,"  sign <identity.secret> <file>" ZT_EOL_S);
 	fprintf(out,"  verify <identity.secret/public> <file> <signature>" ZT_EOL_S);
 	fprintf(out,"  initmoon <identity.public of first seed>" ZT_EOL_S);
 	fprintf(out,"  genmoon <moon json>" ZT_EOL_S);
+	fprintf(out,"  benchmark [-t<threads>] [<seconds>]" ZT_EOL_S);
+	fprintf(out,"" ZT_EOL_S"Threads default to one per core." ZT_EOL_S);
+}
+
+// Removes -t<threads> from argv for generate and benchmark, returns 0 (all cores) if absent
+#ifdef __WINDOWS__
+static unsigned int idtoolThreadsArg(int &argc,_TCHAR* argv[])
+#else
+static unsigned int idtoolThreadsArg(int &argc,char **argv)
+#endif
+{
+	unsigned int threads = 0;
+	for(int i=2;i<argc;) {
+		if ((argv[i][0] == '-')&&(argv[i][1] == 't')) {
+			threads = (unsigned int)Utils::strToUInt(argv[i] + 2);
+			for(int j=i;j<(argc-1);++j)
+				argv[j] = argv[j + 1];
+			--argc;
+		} else ++i;
+	}
+	return threads;
 }
 
 static Identity getIdFromArg(char *arg)
@@ -861,6 +883,7 @@ static int idtool(int argc,char **argv)
 	}
 
 	if (!strcmp(argv[1],"generate")) {
+		const unsigned int threads = idtoolThreadsArg(argc,argv);
 		uint64_t vanity = 0;
 		int vanityBits = 0;
 		if (argc >= 5) {
@@ -868,20 +891,13 @@ static int idtool(int argc,char **argv)
 			vanityBits = 4 * (int)strlen(argv[4]);
 			if (vanityBits > 40)
 				vanityBits = 40;
+			fprintf(stderr,"vanity address: looking for first %d bits of %.10llx\n",vanityBits,(unsigned long long)(vanity << (40 - vanityBits)));
 		}
 
 		Identity id;
-		for(;;) {
-			id.generate();
-			if ((id.address().toInt() >> (40 - vanityBits)) == vanity) {
-				if (vanityBits > 0) {
-					fprintf(stderr,"vanity address: found %.10llx !\n",(unsigned long long)id.address().toInt());
-				}
-				break;
-			} else {
-				fprintf(stderr,"vanity address: tried %.10llx looking for first %d bits of %.10llx\n",(unsigned long long)id.address().toInt(),vanityBits,(unsigned long long)(vanity << (40 - vanityBits)));
-			}
-		}
+		id.generate(threads,vanity,(unsigned int)vanityBits);
+		if (vanityBits > 0)
+			fprintf(stderr,"vanity address: found %.10llx !\n",(unsigned long long)id.address().toInt());
 
 		char idtmp[1024];
 		std::string idser = id.toString(true,idtmp);
@@ -1078,6 +1094,27 @@ static int idtool(int argc,char **argv)
 			OSUtils::writeFile(fn,wbuf.data(),wbuf.size());
 			printf("wrote %s (signed world with timestamp %llu)" ZT_EOL_S,fn,(unsigned long long)now);
 		}
+	} else if (!strcmp(argv[1],"benchmark")) {
+		const unsigned int threads = idtoolThreadsArg(argc,argv);
+		const int64_t seconds = (argc >= 3) ? (int64_t)Utils::strToUInt(argv[2]) : 10;
+
+		Identity id;
+		id.generate(threads);
+		int64_t start = OSUtils::now();
+		unsigned long hashes = 0;
+		do {
+			id.locallyValidate();
+			++hashes;
+		} while ((OSUtils::now() - start) < 1000);
+		printf("memory-hard hash: %.2f/second (one thread)" ZT_EOL_S,(double)hashes * 1000.0 / (double)(OSUtils::now() - start));
+
+		start = OSUtils::now();
+		unsigned long identities = 0;
+		do {
+			id.generate(threads);
+			++identities;
+		} while ((OSUtils::now() - start) < (seconds * 1000));
+		printf("identity generation: %.2f/second (%u threads)" ZT_EOL_S,(double)identities * 1000.0 / (double)(OSUtils::now() - start),(threads) ? threads : std::max(std::thread::hardware_concurrency(),1U));
 	} else {
 		idtoolPrintHelp(stdout,argv[0]);
 		return 1;
@@ -49,6 +49,7 @@
 #ifdef __LINUX__
 #include <sys/ioctl.h>
 #include <net/if.h>
+#include <linux/filter.h>
 #endif
 #endif
 
@@ -73,6 +74,17 @@
 // Max number of bindings
 #define ZT_BINDER_MAX_BINDINGS 256
 
+// Max number of SO_REUSEPORT UDP sockets per binding when sharding
+#define ZT_BINDER_MAX_UDP_SHARDS 16
+
+// Size of the UDP socket index (power of two, at least twice max bindings * max shards)
+#define ZT_BINDER_UDP_INDEX_SIZE 8192
+
+// Sharded UDP listeners need SO_REUSEPORT groups with classic BPF steering
+#if defined(__LINUX__) && defined(SO_REUSEPORT) && defined(SO_ATTACH_REUSEPORT_CBPF)
+#define ZT_BINDER_UDP_SHARDING 1
+#endif
+
 namespace ZeroTier {
 
 /**
@@ -91,14 +103,22 @@ class Binder
 private:
 	struct _Binding
 	{
-		_Binding() : udpSock((PhySocket *)0),tcpListenSock((PhySocket *)0) {}
+		_Binding() : udpSock((PhySocket *)0),tcpListenSock((PhySocket *)0),udpShardCount(0) {}
 		PhySocket *udpSock;
 		PhySocket *tcpListenSock;
+		PhySocket *udpShardSocks[ZT_BINDER_MAX_UDP_SHARDS - 1]; // udpShardSocks[i] belongs to shard Phy i
+		unsigned int udpShardCount;
 		InetAddress address;
 	};
 
 public:
-	Binder() : _bindingCount(0) {}
+	Binder() :
+		_bindingCount(0),
+		_udpIndexGeneration(0)
+	{
+		for(unsigned int i=0;i<ZT_BINDER_UDP_INDEX_SIZE;++i)
+			_udpIndex[i] = (PhySocket *)0;
+	}
 
 	/**
 	 * Close all bound ports, should be called on shutdown
@@ -107,13 +127,29 @@ public:
 	 */
 	template<typename PHY_HANDLER_TYPE>
 	void closeAll(Phy<PHY_HANDLER_TYPE> &phy)
+	{
+		closeAll(phy,(Phy<PHY_HANDLER_TYPE> *const *)0,0);
+	}
+
+	/**
+	 * Close all bound ports including UDP shard sockets
+	 *
+	 * @param phy Physical interface
+	 * @param shardPhys Phy instances of UDP shards as passed to refresh()
+	 * @param shardCount Number of shard Phy instances
+	 */
+	template<typename PHY_HANDLER_TYPE>
+	void closeAll(Phy<PHY_HANDLER_TYPE> &phy,Phy<PHY_HANDLER_TYPE> *const *shardPhys,unsigned int shardCount)
 	{
 		Mutex::Lock _l(_lock);
+		_beginUdpIndexUpdate();
 		for(unsigned int b=0,c=_bindingCount;b<c;++b) {
+			_closeShards(_bindings[b],shardPhys,shardCount);
 			phy.close(_bindings[b].udpSock,false);
 			phy.close(_bindings[b].tcpListenSock,false);
 		}
 		_bindingCount = 0;
+		_rebuildUdpIndex();
 	}
 
 	/**
@@ -133,6 +169,37 @@ public:
 	template<typename PHY_HANDLER_TYPE,typename INTERFACE_CHECKER>
 	void refresh(Phy<PHY_HANDLER_TYPE> &phy,unsigned int *ports,unsigned int portCount,const std::vector<InetAddress> explicitBind,INTERFACE_CHECKER &ifChecker)
 	{
+		refresh(phy,(Phy<PHY_HANDLER_TYPE> *const *)0,0,ports,portCount,explicitBind,ifChecker);
+	}
+
+	/**
+	 * Scan local devices and addresses and rebind, sharding UDP across several Phy loops
+	 *
+	 * When shardCount is nonzero each new UDP binding gets one SO_REUSEPORT
+	 * socket in phy plus one in each shard Phy, and a classic BPF program
+	 * makes the kernel pick the socket by the packet's source ZeroTier
+	 * address. Packets from one peer therefore always land on the same
+	 * loop. Fragments carry no source address and fall back to the
+	 * kernel's flow hash. Shard Phy loops must not be polling while this
+	 * runs. Sharding only applies to bindings created while it's enabled.
+	 *
+	 * @param phy Physical interface (TCP listeners and shard 0 of UDP)
+	 * @param shardPhys Phy instances of additional UDP shards
+	 * @param shardCount Number of additional shards (0 to disable, max ZT_BINDER_MAX_UDP_SHARDS-1)
+	 * @param ports Ports to bind on all interfaces
+	 * @param portCount Number of ports
+	 * @param explicitBind If present, override interface IP detection and bind to these (if possible)
+	 * @param ifChecker Interface checker function to see if an interface should be used
+	 */
+	template<typename PHY_HANDLER_TYPE,typename INTERFACE_CHECKER>
+	void refresh(Phy<PHY_HANDLER_TYPE> &phy,Phy<PHY_HANDLER_TYPE> *const *shardPhys,unsigned int shardCount,unsigned int *ports,unsigned int portCount,const std::vector<InetAddress> explicitBind,INTERFACE_CHECKER &ifChecker)
+	{
+#ifdef ZT_BINDER_UDP_SHARDING
+		if (shardCount > (ZT_BINDER_MAX_UDP_SHARDS - 1))
+			shardCount = ZT_BINDER_MAX_UDP_SHARDS - 1;
+#else
+		shardCount = 0;
+#endif
 		std::map<InetAddress,std::string> localIfAddrs;
 		PhySocket *udps,*tcps;
 		Mutex::Lock _l(_lock);
@@ -341,6 +408,9 @@ public:
 			}
 		}
 
+		// Readers of the UDP socket index fall back to locking until it's rebuilt below
+		_beginUdpIndexUpdate();
+
 		const unsigned int oldBindingCount = _bindingCount;
 		_bindingCount = 0;
 
@@ -355,6 +425,7 @@ public:
 				PhySocket *const tcps = _bindings[b].tcpListenSock;
 				_bindings[b].udpSock = (PhySocket *)0;
 				_bindings[b].tcpListenSock = (PhySocket *)0;
+				_closeShards(_bindings[b],shardPhys,shardCount);
 				phy.close(udps,false);
 				phy.close(tcps,false);
 			}
@@ -369,12 +440,14 @@ public:
 				++bi;
 			}
 			if (bi == _bindingCount) {
-				udps = phy.udpBind(reinterpret_cast<const struct sockaddr *>(&(ii->first)),(void *)0,ZT_UDP_DESIRED_BUF_SIZE);
+				// Shard sockets must share the device binding of the first socket at bind time to join its SO_REUSEPORT group
+				const char *const dev = ((shardCount)&&(ii->second.length() > 0)) ? ii->second.c_str() : (const char *)0;
+				udps = phy.udpBind(reinterpret_cast<const struct sockaddr *>(&(ii->first)),(void *)0,ZT_UDP_DESIRED_BUF_SIZE,(shardCount > 0),dev);
 				tcps = phy.tcpListen(reinterpret_cast<const struct sockaddr *>(&(ii->first)),(void *)0);
 				if ((udps)&&(tcps)) {
 #ifdef __LINUX__
 					// Bind Linux sockets to their device so routes that we manage do not override physical routes (wish all platforms had this!)
-					if (ii->second.length() > 0) {
+					if ((ii->second.length() > 0)&&(!dev)) {
 						char tmp[256];
 						Utils::scopy(tmp,sizeof(tmp),ii->second.c_str());
 						int fd = (int)Phy<PHY_HANDLER_TYPE>::getDescriptor(udps);
@@ -384,13 +457,34 @@ public:
 						if (fd >= 0)
 							setsockopt(fd,SOL_SOCKET,SO_BINDTODEVICE,tmp,strlen(tmp));
 					}
+#endif // __LINUX__
+#ifdef __LINUX__
+					if (dev) {
+						const int fd = (int)Phy<PHY_HANDLER_TYPE>::getDescriptor(tcps);
+						if (fd >= 0)
+							setsockopt(fd,SOL_SOCKET,SO_BINDTODEVICE,dev,strlen(dev));
+					}
 #endif // __LINUX__
 					if (_bindingCount < ZT_BINDER_MAX_BINDINGS) {
-						_bindings[_bindingCount].udpSock = udps;
-						_bindings[_bindingCount].tcpListenSock = tcps;
-						_bindings[_bindingCount].address = ii->first;
+						_Binding &nb = _bindings[_bindingCount];
+						nb.udpSock = udps;
+						nb.tcpListenSock = tcps;
+						nb.address = ii->first;
+						nb.udpShardCount = 0;
 						phy.setIfName(udps,(char*)ii->second.c_str(),(int)ii->second.length());
+						for(unsigned int s=0;s<shardCount;++s) {
+							PhySocket *const ss = shardPhys[s]->udpBind(reinterpret_cast<const struct sockaddr *>(&(ii->first)),(void *)0,ZT_UDP_DESIRED_BUF_SIZE,true,dev);
+							if (!ss)
+								break;
+							shardPhys[s]->setIfName(ss,(char*)ii->second.c_str(),(int)ii->second.length());
+							nb.udpShardSocks[nb.udpShardCount++] = ss;
+						}
+						if (nb.udpShardCount)
+							attachShardSteering((int)Phy<PHY_HANDLER_TYPE>::getDescriptor(udps),nb.udpShardCount + 1);
 						++_bindingCount;
+					} else {
+						phy.close(udps,false);
+						phy.close(tcps,false);
 					}
 				} else {
 					phy.close(udps,false);
@@ -398,6 +492,8 @@ public:
 				}
 			}
 		}
+
+		_rebuildUdpIndex();
 	}
 
 	/**
@@ -413,19 +509,22 @@ public:
 	}
 
 	/**
-	 * Send from all bound UDP sockets
+	 * Send from all bound UDP sockets of the destination's address family
+	 *
+	 * Bindings of the other family can't reach addr, so they're skipped
+	 * rather than left to fail in the kernel.
 	 */
 	template<typename PHY_HANDLER_TYPE>
 	inline bool udpSendAll(Phy<PHY_HANDLER_TYPE> &phy,const struct sockaddr_storage *addr,const void *data,unsigned int len,unsigned int ttl)
 	{
-		bool r = false;
+		PhySocket *socks[ZT_BINDER_MAX_BINDINGS];
+		unsigned int count = 0;
 		Mutex::Lock _l(_lock);
 		for(unsigned int b=0,c=_bindingCount;b<c;++b) {
-			if (ttl) phy.setIp4UdpTtl(_bindings[b].udpSock,ttl);
-			if (phy.udpSend(_bindings[b].udpSock,(const struct sockaddr *)addr,data,len)) r = true;
-			if (ttl) phy.setIp4UdpTtl(_bindings[b].udpSock,255);
+			if (_bindings[b].address.ss_family == addr->ss_family)
+				socks[count++] = _bindings[b].udpSock;
 		}
-		return r;
+		return phy.udpSendMulti(socks,count,(const struct sockaddr *)addr,data,len,ttl);
 	}
 
 	/**
@@ -445,21 +544,126 @@ public:
 	/**
 	 * Quickly check that a UDP socket is valid
 	 *
+	 * This is a lock-free O(1) lookup in an index of bound UDP sockets. The
+	 * index carries a generation counter that is odd while refresh() is
+	 * rebuilding it, so a lookup that overlaps a rebuild redoes itself
+	 * under the lock.
+	 *
 	 * @param udpSock UDP socket to check
 	 * @return True if socket is currently bound/allocated
 	 */
 	inline bool isUdpSocketValid(PhySocket *const udpSock)
 	{
-		for(unsigned int b=0,c=_bindingCount;b<c;++b) {
-			if (_bindings[b].udpSock == udpSock)
-				return (b < _bindingCount); // double check atomic which may have changed
+		const unsigned int g = _udpIndexGeneration.load(std::memory_order_acquire);
+		if ((g & 1) == 0) {
+			const bool found = _udpIndexContains(udpSock);
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (_udpIndexGeneration.load(std::memory_order_relaxed) == g)
+				return found;
 		}
+		Mutex::Lock _l(_lock);
+		return _udpIndexContains(udpSock);
+	}
+
+	/**
+	 * Attach a classic BPF program steering a SO_REUSEPORT group by source ZeroTier address
+	 *
+	 * The program returns (low 32 bits of source address) % shards for
+	 * packet heads. Fragments (byte 13 is 0xff) and runts return an out of
+	 * range index, which makes the kernel fall back to its flow hash.
+	 *
+	 * @param fd Any UDP socket in the group
+	 * @param shards Number of sockets in the group
+	 * @return True if program was attached
+	 */
+	static inline bool attachShardSteering(const int fd,const unsigned int shards)
+	{
+#ifdef ZT_BINDER_UDP_SHARDING
+		if ((fd < 0)||(shards < 2))
+			return false;
+		// Offsets are into the UDP payload: 13 is the source address or fragment indicator
+		struct sock_filter code[8] = {
+			{ BPF_LD|BPF_W|BPF_LEN,0,0,0 },           // A = payload length
+			{ BPF_JMP|BPF_JGE|BPF_K,0,5,18 },         // if A < 18 goto 7
+			{ BPF_LD|BPF_B|BPF_ABS,0,0,13 },          // A = payload[13]
+			{ BPF_JMP|BPF_JEQ|BPF_K,3,0,0xff },       // if fragment goto 7
+			{ BPF_LD|BPF_W|BPF_ABS,0,0,14 },          // A = source address bits 0-31
+			{ BPF_ALU|BPF_MOD|BPF_K,0,0,shards },     // A %= shards
+			{ BPF_RET|BPF_A,0,0,0 },                  // return A
+			{ BPF_RET|BPF_K,0,0,shards }              // return out of range index
+		};
+		struct sock_fprog prog;
+		prog.len = 8;
+		prog.filter = code;
+		return (setsockopt(fd,SOL_SOCKET,SO_ATTACH_REUSEPORT_CBPF,&prog,sizeof(prog)) == 0);
+#else
 		return false;
+#endif
 	}
 
 private:
+	template<typename PHY_HANDLER_TYPE>
+	static inline void _closeShards(_Binding &b,Phy<PHY_HANDLER_TYPE> *const *shardPhys,unsigned int shardCount)
+	{
+		for(unsigned int s=0;s<b.udpShardCount;++s) {
+			if (s < shardCount)
+				shardPhys[s]->close(b.udpShardSocks[s],false);
+		}
+		b.udpShardCount = 0;
+	}
+
+	static inline unsigned int _udpIndexBucket(const PhySocket *const s)
+	{
+		const uint64_t h = (uint64_t)((uintptr_t)s) * 0x9e3779b97f4a7c15ULL;
+		return (unsigned int)(h >> 32) & (ZT_BINDER_UDP_INDEX_SIZE - 1);
+	}
+
+	inline bool _udpIndexContains(PhySocket *const udpSock) const
+	{
+		if (!udpSock)
+			return false;
+		for(unsigned int i=_udpIndexBucket(udpSock),p=0;p<ZT_BINDER_UDP_INDEX_SIZE;++p,i=(i + 1) & (ZT_BINDER_UDP_INDEX_SIZE - 1)) {
+			PhySocket *const s = _udpIndex[i].load(std::memory_order_relaxed);
+			if (s == udpSock)
+				return true;
+			if (!s)
+				return false;
+		}
+		return false;
+	}
+
+	inline void _udpIndexAdd(PhySocket *const udpSock)
+	{
+		unsigned int i = _udpIndexBucket(udpSock);
+		while (_udpIndex[i].load(std::memory_order_relaxed))
+			i = (i + 1) & (ZT_BINDER_UDP_INDEX_SIZE - 1);
+		_udpIndex[i].store(udpSock,std::memory_order_relaxed);
+	}
+
+	// Must be called with _lock held, makes the generation odd
+	inline void _beginUdpIndexUpdate()
+	{
+		_udpIndexGeneration.fetch_add(1,std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+	}
+
+	// Must be called with _lock held after _beginUdpIndexUpdate()
+	inline void _rebuildUdpIndex()
+	{
+		for(unsigned int i=0;i<ZT_BINDER_UDP_INDEX_SIZE;++i)
+			_udpIndex[i].store((PhySocket *)0,std::memory_order_relaxed);
+		for(unsigned int b=0,c=_bindingCount;b<c;++b) {
+			_udpIndexAdd(_bindings[b].udpSock);
+			for(unsigned int s=0;s<_bindings[b].udpShardCount;++s)
+				_udpIndexAdd(_bindings[b].udpShardSocks[s]);
+		}
+		_udpIndexGeneration.fetch_add(1,std::memory_order_release);
+	}
+
 	_Binding _bindings[ZT_BINDER_MAX_BINDINGS];
 	std::atomic<unsigned int> _bindingCount;
+	std::atomic<PhySocket *> _udpIndex[ZT_BINDER_UDP_INDEX_SIZE];
+	std::atomic<unsigned int> _udpIndexGeneration;
 	Mutex _lock;
 };
 
@@ -28,6 +28,7 @@
 #define ZT_BLOCKINGQUEUE_HPP
 
 #include <queue>
+#include <vector>
 #include <mutex>
 #include <condition_variable>
 #include <chrono>
@@ -94,6 +95,41 @@ public:
 		return true;
 	}
 
+	/**
+	 * Block until at least one item is queued, then take up to max items
+	 *
+	 * @param values Vector to which items are appended
+	 * @param max Maximum number of items to take
+	 * @return False if the queue has been stopped
+	 */
+	inline bool getBatch(std::vector<T> &values,const unsigned long max)
+	{
+		std::unique_lock<std::mutex> lock(m);
+		if (!r) return false;
+		while (q.empty()) {
+			c.wait(lock);
+			if (!r) {
+				gc.notify_all();
+				return false;
+			}
+		}
+		for(unsigned long i=0;((i<max)&&(!q.empty()));++i) {
+			values.push_back(std::move(q.front()));
+			q.pop();
+		}
+		gc.notify_all();
+		return true;
+	}
+
+	/**
+	 * @return Number of items currently queued
+	 */
+	inline unsigned long size() const
+	{
+		std::lock_guard<std::mutex> lock(m);
+		return (unsigned long)q.size();
+	}
+
 	enum TimedWaitResult
 	{
 		OK,
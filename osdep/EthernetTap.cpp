@@ -30,6 +30,10 @@
 #include <stdlib.h>
 #include <string.h>
 
+#ifdef ZT_USE_TEST_TAP
+#include "TestEthernetTap.hpp"
+#endif
+
 #ifdef ZT_SDK
 
 #include "../controller/EmbeddedNetworkController.hpp"
@@ -80,6 +84,10 @@ std::shared_ptr<EthernetTap> EthernetTap::newInstance(
 	void *arg)
 {
 
+#ifdef ZT_USE_TEST_TAP
+	return std::shared_ptr<EthernetTap>(new TestEthernetTap(homePath,mac,mtu,metric,nwid,friendlyName,handler,arg));
+#endif
+
 #ifdef ZT_SDK
 
 	return std::shared_ptr<EthernetTap>(new VirtualTap(homePath,mac,mtu,metric,nwid,friendlyName,handler,arg));
@@ -132,4 +140,22 @@ std::shared_ptr<EthernetTap> EthernetTap::newInstance(
 EthernetTap::EthernetTap() {}
 EthernetTap::~EthernetTap() {}
 
+void EthernetTap::scanAllMulticastGroups(const std::vector<EthernetTap *> &taps,std::vector< std::pair< std::vector<MulticastGroup>,std::vector<MulticastGroup> > > &changes)
+{
+#if defined(__LINUX__) && !defined(ZT_SDK) && !defined(ZT_USE_TEST_TAP)
+	LinuxEthernetTap::scanAllMulticastGroups(taps,changes); // newInstance() only creates LinuxEthernetTap here
+#else
+	changes.clear();
+	changes.resize(taps.size());
+	for(unsigned long i=0;i<taps.size();++i)
+		taps[i]->scanMulticastGroups(changes[i].first,changes[i].second);
+#endif
+}
+
+void EthernetTap::putBatch(ZT_VirtualNetworkFrame *frames,unsigned int count)
+{
+	for(unsigned int i=0;i<count;++i)
+		put(MAC(frames[i].sourceMac),MAC(frames[i].destMac),frames[i].etherType,frames[i].data,frames[i].len);
+}
+
 } // namespace ZeroTier
@@ -35,6 +35,7 @@
 #include <string>
 #include <memory>
 #include <vector>
+#include <utility>
 
 namespace ZeroTier {
 
@@ -61,10 +62,22 @@ public:
 	virtual bool removeIp(const InetAddress &ip) = 0;
 	virtual std::vector<InetAddress> ips() const = 0;
 	virtual void put(const MAC &from,const MAC &to,unsigned int etherType,const void *data,unsigned int len) = 0;
+	virtual void putBatch(ZT_VirtualNetworkFrame *frames,unsigned int count); // frames have ZT_VIRTUAL_NETWORK_FRAME_HEADROOM, default calls put()
 	virtual std::string deviceName() const = 0;
 	virtual void setFriendlyName(const char *friendlyName) = 0;
 	virtual void scanMulticastGroups(std::vector<MulticastGroup> &added,std::vector<MulticastGroup> &removed) = 0;
 	virtual void setMtu(unsigned int mtu) = 0;
+
+	/**
+	 * Scan multicast groups of several taps
+	 *
+	 * On Linux the kernel's group lists are read once for all taps. Elsewhere
+	 * this just calls each tap's scanMulticastGroups().
+	 *
+	 * @param taps Taps created by newInstance()
+	 * @param changes Resized to taps.size() and filled with (added,removed) for each tap
+	 */
+	static void scanAllMulticastGroups(const std::vector<EthernetTap *> &taps,std::vector< std::pair< std::vector<MulticastGroup>,std::vector<MulticastGroup> > > &changes);
 };
 
 } // namespace ZeroTier
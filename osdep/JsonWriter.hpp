@@ -0,0 +1,183 @@
+/*
+ * ZeroTier One - Network Virtualization Everywhere
+ * Copyright (C) 2011-2019  ZeroTier, Inc.  https://www.zerotier.com/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * --
+ *
+ * You can be released from the requirements of the license by purchasing
+ * a commercial license. Buying such a license is mandatory as soon as you
+ * develop commercial closed-source software that incorporates or links
+ * directly against ZeroTier software without disclosing the source code
+ * of your own application.
+ */
+
+#ifndef ZT_JSONWRITER_HPP
+#define ZT_JSONWRITER_HPP
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include <string>
+#include <set>
+#include <vector>
+
+namespace ZeroTier {
+
+/**
+ * Appends compact JSON to a string without building a document first
+ *
+ * This is used where the API emits large arrays (e.g. GET /peer) and
+ * building an nlohmann::json tree for every element would cost far more
+ * than writing it out. Objects may be given a set of wanted keys, in which
+ * case key() returns false for any other key and the caller skips its value.
+ * Nothing is validated beyond what's needed to place commas, so callers
+ * must balance begin and end calls and follow each key() with one value.
+ */
+class JsonWriter
+{
+public:
+	/**
+	 * @param out String to append to
+	 */
+	JsonWriter(std::string &out) : _out(out),_afterKey(false) {}
+
+	/**
+	 * @param fields If non-NULL and non-empty, only these keys are written (must outlive the object)
+	 */
+	inline void beginObject(const std::set<std::string> *fields = (const std::set<std::string> *)0)
+	{
+		_beginValue();
+		_out.push_back('{');
+		_stack.push_back(_Level(((fields)&&(!fields->empty())) ? fields : (const std::set<std::string> *)0));
+	}
+	inline void endObject()
+	{
+		_stack.pop_back();
+		_out.push_back('}');
+	}
+
+	inline void beginArray()
+	{
+		_beginValue();
+		_out.push_back('[');
+		_stack.push_back(_Level((const std::set<std::string> *)0));
+	}
+	inline void endArray()
+	{
+		_stack.pop_back();
+		_out.push_back(']');
+	}
+
+	/**
+	 * @param k Key within the current object
+	 * @return False if this key was filtered out and its value must not be written
+	 */
+	inline bool key(const char *k)
+	{
+		if ((!_stack.empty())&&(_stack.back().fields)&&(_stack.back().fields->find(k) == _stack.back().fields->end()))
+			return false;
+		_beginValue();
+		_string(k);
+		_out.push_back(':');
+		_afterKey = true;
+		return true;
+	}
+
+	inline void value(const char *s) { _beginValue(); _string(s); }
+	inline void value(const std::string &s) { _beginValue(); _string(s.c_str()); }
+	inline void value(const bool b) { _beginValue(); _out.append((b) ? "true" : "false"); }
+	inline void value(const int i) { _signed((long long)i); }
+	inline void value(const long i) { _signed((long long)i); }
+	inline void value(const long long i) { _signed(i); }
+	inline void value(const unsigned int i) { _unsigned((unsigned long long)i); }
+	inline void value(const unsigned long i) { _unsigned((unsigned long long)i); }
+	inline void value(const unsigned long long i) { _unsigned(i); }
+	inline void null() { _beginValue(); _out.append("null"); }
+
+	/**
+	 * Write a value that's already valid JSON text
+	 */
+	inline void raw(const std::string &json) { _beginValue(); _out.append(json); }
+
+private:
+	struct _Level
+	{
+		_Level(const std::set<std::string> *f) : fields(f),first(true) {}
+		const std::set<std::string> *fields;
+		bool first;
+	};
+
+	inline void _beginValue()
+	{
+		if (_afterKey) {
+			_afterKey = false;
+		} else if (!_stack.empty()) {
+			if (!_stack.back().first)
+				_out.push_back(',');
+			_stack.back().first = false;
+		}
+	}
+
+	inline void _signed(const long long i)
+	{
+		char tmp[32];
+		_beginValue();
+		_out.append(tmp,(size_t)snprintf(tmp,sizeof(tmp),"%lld",i));
+	}
+
+	inline void _unsigned(const unsigned long long i)
+	{
+		char tmp[32];
+		_beginValue();
+		_out.append(tmp,(size_t)snprintf(tmp,sizeof(tmp),"%llu",i));
+	}
+
+	inline void _string(const char *s)
+	{
+		static const char *const HEXCHARS = "0123456789abcdef";
+		_out.push_back('"');
+		for(;*s;++s) {
+			const unsigned char c = (unsigned char)*s;
+			switch(c) {
+				case '"': _out.append("\\\""); break;
+				case '\\': _out.append("\\\\"); break;
+				case '\b': _out.append("\\b"); break;
+				case '\f': _out.append("\\f"); break;
+				case '\n': _out.append("\\n"); break;
+				case '\r': _out.append("\\r"); break;
+				case '\t': _out.append("\\t"); break;
+				default:
+					if (c < 0x20) {
+						_out.append("\\u00");
+						_out.push_back(HEXCHARS[c >> 4]);
+						_out.push_back(HEXCHARS[c & 0xf]);
+					} else {
+						_out.push_back((char)c);
+					}
+					break;
+			}
+		}
+		_out.push_back('"');
+	}
+
+	std::string &_out;
+	std::vector<_Level> _stack;
+	bool _afterKey;
+};
+
+} // namespace ZeroTier
+
+#endif
@@ -31,6 +31,7 @@
 #include "../node/Utils.hpp"
 #include "../node/Mutex.hpp"
 #include "../node/Dictionary.hpp"
+#include "../node/Hashtable.hpp"
 #include "OSUtils.hpp"
 #include "LinuxEthernetTap.hpp"
 #include "LinuxNetLink.hpp"
@@ -48,6 +49,7 @@
 #include <sys/ioctl.h>
 #include <sys/wait.h>
 #include <sys/select.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
 #include <net/if_arp.h>
 #include <arpa/inet.h>
@@ -95,6 +97,7 @@ LinuxEthernetTap::LinuxEthernetTap(
 	_nwid(nwid),
 	_homePath(homePath),
 	_mtu(mtu),
+	_ifindex(0),
 	_fd(0),
 	_enabled(true)
 {
@@ -190,6 +193,10 @@ LinuxEthernetTap::LinuxEthernetTap(
 		throw std::runtime_error("unable to open netlink socket");
 	}
 
+	// Interface index is used to find our groups in /proc/net/dev_mcast
+	if (ioctl(sock,SIOCGIFINDEX,(void *)&ifr) == 0)
+		_ifindex = ifr.ifr_ifindex;
+
 	// Set MAC address
 	ifr.ifr_ifru.ifru_hwaddr.sa_family = ARPHRD_ETHER;
 	mac.copyTo(ifr.ifr_ifru.ifru_hwaddr.sa_data,6);
@@ -385,14 +392,36 @@ std::vector<InetAddress> LinuxEthernetTap::ips() const
 
 void LinuxEthernetTap::put(const MAC &from,const MAC &to,unsigned int etherType,const void *data,unsigned int len)
 {
-	char putBuf[ZT_MAX_MTU + 64];
 	if ((_fd > 0)&&(len <= _mtu)&&(_enabled)) {
-		to.copyTo(putBuf,6);
-		from.copyTo(putBuf + 6,6);
-		*((uint16_t *)(putBuf + 12)) = htons((uint16_t)etherType);
-		memcpy(putBuf + 14,data,len);
-		len += 14;
-		(void)::write(_fd,putBuf,len);
+		uint8_t eh[14];
+		to.copyTo(eh,6);
+		from.copyTo(eh + 6,6);
+		eh[12] = (uint8_t)(etherType >> 8);
+		eh[13] = (uint8_t)etherType;
+		struct iovec iov[2];
+		iov[0].iov_base = eh;
+		iov[0].iov_len = 14;
+		iov[1].iov_base = const_cast<void *>(data);
+		iov[1].iov_len = len;
+		(void)::writev(_fd,iov,2);
+	}
+}
+
+void LinuxEthernetTap::putBatch(ZT_VirtualNetworkFrame *frames,unsigned int count)
+{
+	// A tap fd takes exactly one frame per write(), so the batch is written in
+	// a tight loop with each Ethernet header built in the frame's headroom.
+	if ((_fd > 0)&&(_enabled)) {
+		for(unsigned int i=0;i<count;++i) {
+			if (frames[i].len <= _mtu) {
+				uint8_t *const eh = reinterpret_cast<uint8_t *>(frames[i].data) - 14;
+				MAC(frames[i].destMac).copyTo(eh,6);
+				MAC(frames[i].sourceMac).copyTo(eh + 6,6);
+				eh[12] = (uint8_t)(frames[i].etherType >> 8);
+				eh[13] = (uint8_t)frames[i].etherType;
+				(void)::write(_fd,eh,frames[i].len + 14);
+			}
+		}
 	}
 }
 
@@ -407,51 +436,85 @@ void LinuxEthernetTap::setFriendlyName(const char *friendlyName)
 
 void LinuxEthernetTap::scanMulticastGroups(std::vector<MulticastGroup> &added,std::vector<MulticastGroup> &removed)
 {
-	char *ptr,*ptr2;
-	unsigned char mac[6];
-	std::vector<MulticastGroup> newGroups;
+	std::vector<EthernetTap *> taps(1,this);
+	std::vector< std::pair< std::vector<MulticastGroup>,std::vector<MulticastGroup> > > changes;
+	scanAllMulticastGroups(taps,changes);
+	added.insert(added.end(),changes[0].first.begin(),changes[0].first.end());
+	removed.insert(removed.end(),changes[0].second.begin(),changes[0].second.end());
+}
+
+void LinuxEthernetTap::scanAllMulticastGroups(const std::vector<EthernetTap *> &taps,std::vector< std::pair< std::vector<MulticastGroup>,std::vector<MulticastGroup> > > &changes)
+{
+	changes.clear();
+	changes.resize(taps.size());
+	std::vector< std::vector<MulticastGroup> > newGroups(taps.size());
+
+	Hashtable<int,unsigned long> byIndex;
+	for(unsigned long i=0;i<taps.size();++i) {
+		LinuxEthernetTap *const t = static_cast<LinuxEthernetTap *>(taps[i]);
+		if (t->_ifindex > 0)
+			byIndex[t->_ifindex] = i;
+	}
 
+	// Lines are: ifindex devname refcount global-use hwaddr
+	std::string mc;
 	int fd = ::open("/proc/net/dev_mcast",O_RDONLY);
 	if (fd > 0) {
-		char buf[131072];
-		int n = (int)::read(fd,buf,sizeof(buf));
-		if ((n > 0)&&(n < (int)sizeof(buf))) {
-			buf[n] = (char)0;
-			for(char *l=strtok_r(buf,"\r\n",&ptr);(l);l=strtok_r((char *)0,"\r\n",&ptr)) {
-				int fno = 0;
-				char *devname = (char *)0;
-				char *mcastmac = (char *)0;
-				for(char *f=strtok_r(l," \t",&ptr2);(f);f=strtok_r((char *)0," \t",&ptr2)) {
-					if (fno == 1)
-						devname = f;
-					else if (fno == 4)
-						mcastmac = f;
-					++fno;
-				}
-				if ((devname)&&(!strcmp(devname,_dev.c_str()))&&(mcastmac)&&(Utils::unhex(mcastmac,mac,6) == 6))
-					newGroups.push_back(MulticastGroup(MAC(mac,6),0));
-			}
+		char buf[16384];
+		for(;;) {
+			const int n = (int)::read(fd,buf,sizeof(buf));
+			if (n <= 0)
+				break;
+			mc.append(buf,n);
 		}
 		::close(fd);
 	}
+	const char *l = mc.c_str();
+	const char *const eof = l + mc.length();
+	while (l < eof) {
+		const char *eol = (const char *)memchr(l,'\n',eof - l);
+		if (!eol)
+			eol = eof;
+		char *f = (char *)0;
+		const unsigned long *const i = byIndex.get((int)strtol(l,&f,10));
+		if ((i)&&(f != l)) {
+			for(int fno=1;fno<4;++fno) {
+				while ((f < eol)&&((*f == ' ')||(*f == '\t'))) ++f;
+				while ((f < eol)&&(*f != ' ')&&(*f != '\t')) ++f;
+			}
+			while ((f < eol)&&((*f == ' ')||(*f == '\t'))) ++f;
+			unsigned char mac[6];
+			if (Utils::unhex(f,(unsigned int)(eol - f),mac,6) == 6)
+				newGroups[*i].push_back(MulticastGroup(MAC(mac,6),0));
+		}
+		l = eol + 1;
+	}
 
-	std::vector<InetAddress> allIps(ips());
-	for(std::vector<InetAddress>::iterator ip(allIps.begin());ip!=allIps.end();++ip)
-		newGroups.push_back(MulticastGroup::deriveMulticastGroupForAddressResolution(*ip));
+	std::vector<InetAddress> allIps;
+	for(unsigned long i=0;i<taps.size();++i) {
+		LinuxEthernetTap *const t = static_cast<LinuxEthernetTap *>(taps[i]);
+		std::vector<MulticastGroup> &ng = newGroups[i];
 
-	std::sort(newGroups.begin(),newGroups.end());
-	newGroups.erase(std::unique(newGroups.begin(),newGroups.end()),newGroups.end());
+		allIps.clear();
+		if ((t->_ifindex <= 0)||(!LinuxNetLink::getInstance().interfaceAddresses(t->_ifindex,allIps)))
+			allIps = t->ips();
+		for(std::vector<InetAddress>::iterator ip(allIps.begin());ip!=allIps.end();++ip)
+			ng.push_back(MulticastGroup::deriveMulticastGroupForAddressResolution(*ip));
 
-	for(std::vector<MulticastGroup>::iterator m(newGroups.begin());m!=newGroups.end();++m) {
-		if (!std::binary_search(_multicastGroups.begin(),_multicastGroups.end(),*m))
-			added.push_back(*m);
-	}
-	for(std::vector<MulticastGroup>::iterator m(_multicastGroups.begin());m!=_multicastGroups.end();++m) {
-		if (!std::binary_search(newGroups.begin(),newGroups.end(),*m))
-			removed.push_back(*m);
-	}
+		std::sort(ng.begin(),ng.end());
+		ng.erase(std::unique(ng.begin(),ng.end()),ng.end());
 
-	_multicastGroups.swap(newGroups);
+		for(std::vector<MulticastGroup>::iterator m(ng.begin());m!=ng.end();++m) {
+			if (!std::binary_search(t->_multicastGroups.begin(),t->_multicastGroups.end(),*m))
+				changes[i].first.push_back(*m);
+		}
+		for(std::vector<MulticastGroup>::iterator m(t->_multicastGroups.begin());m!=t->_multicastGroups.end();++m) {
+			if (!std::binary_search(ng.begin(),ng.end(),*m))
+				changes[i].second.push_back(*m);
+		}
+
+		t->_multicastGroups.swap(ng);
+	}
 }
 
 void LinuxEthernetTap::setMtu(unsigned int mtu)
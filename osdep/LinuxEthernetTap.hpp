@@ -65,11 +65,20 @@ public:
 	virtual bool removeIp(const InetAddress &ip);
 	virtual std::vector<InetAddress> ips() const;
 	virtual void put(const MAC &from,const MAC &to,unsigned int etherType,const void *data,unsigned int len);
+	virtual void putBatch(ZT_VirtualNetworkFrame *frames,unsigned int count);
 	virtual std::string deviceName() const;
 	virtual void setFriendlyName(const char *friendlyName);
 	virtual void scanMulticastGroups(std::vector<MulticastGroup> &added,std::vector<MulticastGroup> &removed);
 	virtual void setMtu(unsigned int mtu);
 
+	/**
+	 * Scan multicast groups of many taps with one read of /proc/net/dev_mcast
+	 *
+	 * @param taps Taps to scan (must all be LinuxEthernetTap)
+	 * @param changes Resized to taps.size() and filled with (added,removed) for each tap
+	 */
+	static void scanAllMulticastGroups(const std::vector<EthernetTap *> &taps,std::vector< std::pair< std::vector<MulticastGroup>,std::vector<MulticastGroup> > > &changes);
+
 	void threadMain()
 		throw();
 
@@ -82,6 +91,7 @@ private:
 	std::string _dev;
 	std::vector<MulticastGroup> _multicastGroups;
 	unsigned int _mtu;
+	int _ifindex;
 	int _fd;
 	int _shutdownSignalPipe[2];
 	std::atomic_bool _enabled;
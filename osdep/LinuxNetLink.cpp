@@ -29,8 +29,21 @@
 #include <unistd.h>
 #include <linux/if_tun.h>
 
+#include <algorithm>
+
 namespace ZeroTier {
 
+static InetAddress _ifaAddress(const struct ifaddrmsg *ifap, const void *a)
+{
+	if (a) {
+		if (ifap->ifa_family == AF_INET)
+			return InetAddress(a, 4, (unsigned int)ifap->ifa_prefixlen);
+		else if (ifap->ifa_family == AF_INET6)
+			return InetAddress(a, 16, (unsigned int)ifap->ifa_prefixlen);
+	}
+	return InetAddress();
+}
+
 struct nl_route_req {
 	struct nlmsghdr nl;
 	struct rtmsg rt;
@@ -59,6 +72,9 @@ LinuxNetLink::LinuxNetLink()
 	, _seq(0)
 	, _interfaces()
 	, _if_m()
+	, _addresses()
+	, _addr_m()
+	, _addressesValid(false)
 	, _fd(socket(AF_NETLINK, SOCK_RAW, NETLINK_ROUTE))
 	, _la({0})
 {
@@ -76,6 +92,7 @@ LinuxNetLink::LinuxNetLink()
 	_requestIPv4Routes();
 	_requestIPv6Routes();
 	_requestInterfaceList();
+	_requestAddressList();
 
 	_running = true;
 	_t = Thread::start(this);
@@ -166,6 +183,9 @@ int LinuxNetLink::_doRecv(int fd)
 			nll = 0;
 			break;
 		} else {
+			// The kernel drops events when our socket buffer fills up
+			if ((rtn < 0)&&(errno == ENOBUFS)&&(fd == _fd))
+				_addressesValid = false;
 			break;
 		}
 	}
@@ -181,6 +201,8 @@ void LinuxNetLink::threadMain() throw()
 
 	while(_running) {
 		rtn = _doRecv(_fd);
+		if (!_addressesValid)
+			_requestAddressList();
 		if (rtn <= 0) {
 			Thread::sleep(100);
 			continue;
@@ -228,15 +250,19 @@ void LinuxNetLink::_ipAddressAdded(struct nlmsghdr *nlp)
 	char local[40] = {0};
 	char label[40] = {0};
 	char bcast[40] = {0};
+	const void *addrBin = (const void *)0;
+	const void *localBin = (const void *)0;
 	
 	for(;RTA_OK(rtap, ifal); rtap=RTA_NEXT(rtap,ifal))
 	{
 		switch(rtap->rta_type) {
 		case IFA_ADDRESS:
 			inet_ntop(ifap->ifa_family, RTA_DATA(rtap), addr, 40);
+			addrBin = RTA_DATA(rtap);
 			break;
 		case IFA_LOCAL:
 			inet_ntop(ifap->ifa_family, RTA_DATA(rtap), local, 40);
+			localBin = RTA_DATA(rtap);
 			break;
 		case IFA_LABEL:
 			memcpy(label, RTA_DATA(rtap), 40);
@@ -247,6 +273,15 @@ void LinuxNetLink::_ipAddressAdded(struct nlmsghdr *nlp)
 		}
 	}
 
+	// IFA_LOCAL is our own address on point-to-point links where IFA_ADDRESS is the peer
+	const InetAddress ip(_ifaAddress(ifap,(localBin) ? localBin : addrBin));
+	if (ip) {
+		Mutex::Lock l(_addr_m);
+		std::vector<InetAddress> &ips = _addresses[(int)ifap->ifa_index];
+		if (std::find(ips.begin(), ips.end(), ip) == ips.end())
+			ips.push_back(ip);
+	}
+
 #ifdef ZT_TRACE
 	//fprintf(stderr,"Added IP Address %s local: %s label: %s broadcast: %s\n", addr, local, label, bcast);
 #endif
@@ -262,15 +297,19 @@ void LinuxNetLink::_ipAddressDeleted(struct nlmsghdr *nlp)
 	char local[40] = {0};
 	char label[40] = {0};
 	char bcast[40] = {0};
+	const void *addrBin = (const void *)0;
+	const void *localBin = (const void *)0;
 
 	for(;RTA_OK(rtap, ifal); rtap=RTA_NEXT(rtap,ifal))
 	{
 		switch(rtap->rta_type) {
 		case IFA_ADDRESS:
 			inet_ntop(ifap->ifa_family, RTA_DATA(rtap), addr, 40);
+			addrBin = RTA_DATA(rtap);
 			break;
 		case IFA_LOCAL:
 			inet_ntop(ifap->ifa_family, RTA_DATA(rtap), local, 40);
+			localBin = RTA_DATA(rtap);
 			break;
 		case IFA_LABEL:
 			memcpy(label, RTA_DATA(rtap), 40);
@@ -281,6 +320,17 @@ void LinuxNetLink::_ipAddressDeleted(struct nlmsghdr *nlp)
 		}
 	}
 
+	const InetAddress ip(_ifaAddress(ifap,(localBin) ? localBin : addrBin));
+	if (ip) {
+		Mutex::Lock l(_addr_m);
+		std::vector<InetAddress> *const ips = _addresses.get((int)ifap->ifa_index);
+		if (ips) {
+			std::vector<InetAddress>::iterator i(std::find(ips->begin(), ips->end(), ip));
+			if (i != ips->end())
+				ips->erase(i);
+		}
+	}
+
 #ifdef ZT_TRACE
 	//fprintf(stderr, "Removed IP Address %s local: %s label: %s broadcast: %s\n", addr, local, label, bcast);
 #endif
@@ -428,6 +478,10 @@ void LinuxNetLink::_linkDeleted(struct nlmsghdr *nlp)
 			_interfaces.erase(ifip->ifi_index);
 		}
 	}
+	{
+		Mutex::Lock l(_addr_m);
+		_addresses.erase(ifip->ifi_index);
+	}
 }
 
 void LinuxNetLink::_requestIPv4Routes()
@@ -587,6 +641,78 @@ void LinuxNetLink::_requestInterfaceList()
 	close(fd);
 }
 
+void LinuxNetLink::_requestAddressList()
+{
+	int fd = socket(AF_NETLINK, SOCK_RAW, NETLINK_ROUTE);
+	if (fd == -1) {
+		fprintf(stderr, "Error opening RTNETLINK socket: %s\n", strerror(errno));
+		return;
+	}
+
+	_setSocketTimeout(fd);
+
+	struct nl_adr_req req;
+	bzero(&req, sizeof(req));
+	req.nl.nlmsg_len = NLMSG_LENGTH(sizeof(struct ifaddrmsg));
+	req.nl.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+	req.nl.nlmsg_type = RTM_GETADDR;
+	req.nl.nlmsg_pid = 0;
+	req.nl.nlmsg_seq = ++_seq;
+	req.ifa.ifa_family = AF_UNSPEC;
+
+	struct sockaddr_nl pa;
+	bzero(&pa, sizeof(pa));
+	pa.nl_family = AF_NETLINK;
+
+	{
+		Mutex::Lock l(_addr_m);
+		_addressesValid = false;
+		_addresses.clear();
+	}
+
+	if (sendto(fd, (const void *)&req, req.nl.nlmsg_len, 0, (const struct sockaddr *)&pa, sizeof(pa)) < 0) {
+		close(fd);
+		return;
+	}
+
+	// Unlike _doRecv() this reads every datagram of a multi-part dump, since
+	// hosts with many interfaces can have more addresses than fit in one.
+	uint32_t buf[ZT_NL_BUF_SIZE / 4];
+	bool done = false,failed = false;
+	while ((!done)&&(!failed)) {
+		int n = (int)recv(fd, (void *)buf, sizeof(buf), 0);
+		if (n <= 0)
+			break;
+		for(struct nlmsghdr *nlp=(struct nlmsghdr *)buf;NLMSG_OK(nlp, n);nlp=NLMSG_NEXT(nlp, n)) {
+			if (nlp->nlmsg_type == NLMSG_DONE) {
+				done = true;
+				break;
+			} else if (nlp->nlmsg_type == NLMSG_ERROR) {
+				failed = true;
+				break;
+			} else if (nlp->nlmsg_type == RTM_NEWADDR) {
+				_ipAddressAdded(nlp);
+			}
+		}
+	}
+
+	close(fd);
+
+	if (done)
+		_addressesValid = true;
+}
+
+bool LinuxNetLink::interfaceAddresses(int ifindex, std::vector<InetAddress> &addrs)
+{
+	Mutex::Lock l(_addr_m);
+	if (!_addressesValid)
+		return false;
+	const std::vector<InetAddress> *const ips = _addresses.get(ifindex);
+	if (ips)
+		addrs.insert(addrs.end(), ips->begin(), ips->end());
+	return true;
+}
+
 void LinuxNetLink::addRoute(const InetAddress &target, const InetAddress &via, const InetAddress &src, const char *ifaceName)
 {
 	if (!target) return;
@@ -28,6 +28,7 @@
 #define ZT_LINUX_NETLINK_HPP
 
 #include <vector>
+#include <atomic>
 
 #include <sys/socket.h>
 #include <asm/types.h>
@@ -79,6 +80,15 @@ public:
     void addAddress(const InetAddress &addr, const char *iface);
     void removeAddress(const InetAddress &addr, const char *iface);
 
+    /**
+     * Get an interface's addresses from the cache kept current by RTNETLINK
+     *
+     * @param ifindex Interface index
+     * @param addrs Addresses are appended to this vector
+     * @return False if the cache is not valid (yet) and getifaddrs() should be used instead
+     */
+    bool interfaceAddresses(int ifindex, std::vector<InetAddress> &addrs);
+
     void threadMain() throw();
 private:
     int _doRecv(int fd);
@@ -92,6 +102,7 @@ private:
     void _ipAddressDeleted(struct nlmsghdr *nlp);
 
     void _requestInterfaceList();
+    void _requestAddressList();
     void _requestIPv4Routes();
     void _requestIPv6Routes();
 
@@ -119,6 +130,10 @@ private:
     Hashtable<int, iface_entry> _interfaces;
     Mutex _if_m;
 
+    Hashtable<int, std::vector<InetAddress> > _addresses;
+    Mutex _addr_m;
+    std::atomic_bool _addressesValid; // false until a dump completes and after events are lost
+
     // socket communication vars;
     int _fd;
     struct sockaddr_nl _la;
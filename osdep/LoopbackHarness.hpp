@@ -0,0 +1,733 @@
+/*
+ * ZeroTier One - Network Virtualization Everywhere
+ * Copyright (C) 2011-2019  ZeroTier, Inc.  https://www.zerotier.com/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * --
+ *
+ * You can be released from the requirements of the license by purchasing
+ * a commercial license. Buying such a license is mandatory as soon as you
+ * develop commercial closed-source software that incorporates or links
+ * directly against ZeroTier software without disclosing the source code
+ * of your own application.
+ */
+
+
+#ifndef ZT_LOOPBACKHARNESS_HPP
+#define ZT_LOOPBACKHARNESS_HPP
+
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+#include <map>
+#include <queue>
+#include <memory>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+
+#include "../include/ZeroTierOne.h"
+#include "../node/Constants.hpp"
+#include "../node/Identity.hpp"
+#include "../node/C25519.hpp"
+#include "../node/World.hpp"
+#include "../node/NetworkConfig.hpp"
+#include "../node/NetworkController.hpp"
+#include "OSUtils.hpp"
+#include "TestEthernetTap.hpp"
+
+/**
+ * Maximum number of nodes in one harness
+ */
+#define ZT_LOOPBACK_MAX_NODES 64
+
+/**
+ * UDP port every simulated node "listens" on
+ */
+#define ZT_LOOPBACK_PORT 9993
+
+/**
+ * Ethernet type of benchmark frames (IEEE local experimental)
+ */
+#define ZT_LOOPBACK_ETHERTYPE 0x88b5
+
+/**
+ * Benchmark frame header: send time in microseconds and sender index
+ */
+#define ZT_LOOPBACK_FRAME_HEADER_LENGTH 12
+
+namespace ZeroTier {
+
+/**
+ * Several complete nodes in one process joined by a simulated wire
+ *
+ * Node 0 is the rendezvous point and network controller: it is the sole
+ * root of a moon every node orbits and answers config requests for one
+ * public network with an accept-all rule. Nodes 1..N-1 are endpoints that
+ * join that network through TestEthernetTap ports. Node i sits at physical
+ * address 10.0.i.1/9993, each in its own /24 so the core's per-subnet rate
+ * limit on new identity verification does not hold up bring-up. Anything
+ * sent elsewhere (e.g. the default planet's roots) is silently dropped, so
+ * no real network is touched.
+ *
+ * The wire is a single event queue ordered by delivery time, which lets it
+ * add latency and jitter, drop packets, reorder them by holding some back,
+ * and drop packets larger than its MTU. Everything runs on the calling
+ * thread in real time, so results are directly comparable to throughput of
+ * the core on one CPU.
+ *
+ * This is a test and benchmark fixture. It is not thread safe.
+ */
+class LoopbackHarness
+{
+public:
+	/**
+	 * Simulated wire characteristics
+	 */
+	struct Wire
+	{
+		Wire() :
+			latencyUs(0),
+			jitterUs(0),
+			lossPpm(0),
+			reorderPpm(0),
+			mtu(ZT_DEFAULT_PHYSMTU),
+			seed(1) {}
+
+		unsigned int latencyUs; // one-way base latency
+		unsigned int jitterUs; // uniformly distributed extra delay
+		unsigned int lossPpm; // packets dropped per million
+		unsigned int reorderPpm; // packets held back behind later ones per million
+		unsigned int mtu; // physical MTU, also configured on every node; larger packets are dropped
+		uint64_t seed; // PRNG seed for loss, jitter and reordering
+	};
+
+	/**
+	 * Outcome of one run()
+	 */
+	struct Result
+	{
+		Result() { memset(this,0,sizeof(Result)); }
+
+		unsigned int endpoints; // number of sending/receiving nodes
+		unsigned int frameSize; // Ethernet payload bytes per frame
+		uint64_t framesSent;
+		uint64_t framesReceived;
+		uint64_t wirePackets; // physical packets put on the wire
+		uint64_t wireDrops; // dropped by loss or MTU
+		double seconds;
+		double framesPerSecond; // received
+		double gbps; // received Ethernet payload
+		int64_t p50Us; // one-way frame latency, tap to tap
+		int64_t p99Us;
+	};
+
+	/**
+	 * @param nodeCount Total nodes including the root/controller (2 to ZT_LOOPBACK_MAX_NODES)
+	 * @param wire Wire characteristics
+	 */
+	LoopbackHarness(unsigned int nodeCount,const Wire &wire) :
+		_wireConfig(wire),
+		_prng(wire.seed ? wire.seed : 1),
+		_seq(0),
+		_nwid(0),
+		_measuring(false),
+		_measureStartUs(0),
+		_wirePackets(0),
+		_wireDrops(0),
+		_impaired(false),
+		_framesReceived(0),
+		_inFlight((std::vector<unsigned int> *)0),
+		_lastProgress((std::vector<int64_t> *)0)
+	{
+		nodeCount = std::max(2U,std::min(nodeCount,(unsigned int)ZT_LOOPBACK_MAX_NODES));
+
+		struct ZT_Node_Callbacks cb;
+		memset(&cb,0,sizeof(cb));
+		cb.version = 1;
+		cb.statePutFunction = &_statePut;
+		cb.stateGetFunction = &_stateGet;
+		cb.wirePacketSendFunction = &_wirePacketSend;
+		cb.virtualNetworkFrameFunction = &_virtualNetworkFrame;
+		cb.virtualNetworkConfigFunction = &_virtualNetworkConfig;
+		cb.eventCallback = &_event;
+		cb.pathCheckFunction = &_pathCheck;
+		cb.virtualNetworkFrameBatchFunction = &_virtualNetworkFrameBatch;
+
+		const int64_t now = OSUtils::now();
+		for(unsigned int i=0;i<nodeCount;++i) {
+			_Node *const n = new _Node();
+			n->parent = this;
+			n->index = i;
+			n->node = (ZT_Node *)0;
+			n->deadline = 0;
+			n->dirty = false;
+			n->up = false;
+			n->tap = (TestEthernetTap *)0;
+			const uint32_t ip = Utils::hton((uint32_t)(0x0a000001 | (i << 8)));
+			n->addr = InetAddress(&ip,4,ZT_LOOPBACK_PORT);
+			_nodes.push_back(n);
+			ZT_Node_new(&(n->node),n,(void *)0,&cb,now);
+		}
+
+		ZT_PhysicalPathConfiguration ppc;
+		memset(&ppc,0,sizeof(ppc));
+		ppc.mtu = (int)std::max((unsigned int)ZT_MIN_PHYSMTU,std::min(wire.mtu,(unsigned int)ZT_MAX_PHYSMTU));
+		const uint32_t net = Utils::hton((uint32_t)0x0a000000);
+		InetAddress pathNetwork(&net,4,16);
+		for(unsigned int i=0;i<nodeCount;++i)
+			ZT_Node_setPhysicalPathConfiguration(_nodes[i]->node,reinterpret_cast<const struct sockaddr_storage *>(&pathNetwork),&ppc);
+	}
+
+	~LoopbackHarness()
+	{
+		for(std::vector<_Node *>::iterator n(_nodes.begin());n!=_nodes.end();++n) {
+			if ((*n)->node)
+				ZT_Node_delete((*n)->node);
+			delete *n;
+		}
+		while (!_wire.empty()) {
+			delete _wire.top();
+			_wire.pop();
+		}
+		for(std::vector<_Packet *>::iterator p(_free.begin());p!=_free.end();++p)
+			delete *p;
+	}
+
+	/**
+	 * Set up the moon and controller and wait for every endpoint to be configured
+	 *
+	 * Bring-up happens over an unimpaired wire (latency and MTU apply, loss,
+	 * jitter and reordering do not) so scenarios measure the data path.
+	 *
+	 * @param timeoutMs Maximum time to wait
+	 * @return True if all endpoints joined the network in time
+	 */
+	inline bool start(unsigned int timeoutMs)
+	{
+		for(std::vector<_Node *>::iterator n(_nodes.begin());n!=_nodes.end();++n) {
+			if (!(*n)->node)
+				return false;
+		}
+
+		ZT_NodeStatus ns;
+		ZT_Node_status(_nodes[0]->node,&ns);
+		const Identity rootId(ns.publicIdentity);
+		const uint64_t moonId = rootId.address().toInt();
+
+		std::vector<World::Root> roots;
+		roots.push_back(World::Root());
+		roots.back().identity = rootId;
+		roots.back().stableEndpoints.push_back(_nodes[0]->addr);
+		const C25519::Pair signingKey(C25519::generate());
+		const World moon(World::make(World::TYPE_MOON,moonId,(uint64_t)OSUtils::now(),signingKey.pub,roots,signingKey));
+		Buffer<ZT_WORLD_MAX_SERIALIZED_LENGTH> mb;
+		moon.serialize(mb,false);
+
+		for(std::vector<_Node *>::iterator n(_nodes.begin());n!=_nodes.end();++n) {
+			(*n)->state[_StateKey(ZT_STATE_OBJECT_MOON,moonId,0)].assign(reinterpret_cast<const char *>(mb.data()),mb.size());
+			ZT_Node_orbit((*n)->node,(void *)0,moonId,0);
+		}
+
+		ZT_Node_setNetconfMaster(_nodes[0]->node,&_controller);
+		_nwid = (moonId << 24) | 0x000001ULL;
+		for(unsigned int i=1;i<(unsigned int)_nodes.size();++i)
+			ZT_Node_join(_nodes[i]->node,_nwid,(void *)0,(void *)0);
+
+		const int64_t until = _usNow() + ((int64_t)timeoutMs * 1000);
+		while (_usNow() < until) {
+			bool allUp = true;
+			for(unsigned int i=1;i<(unsigned int)_nodes.size();++i) {
+				if (!_nodes[i]->up) {
+					allUp = false;
+					break;
+				}
+			}
+			if (allUp)
+				return true;
+			_wait(_step());
+		}
+		return false;
+	}
+
+	/**
+	 * Stream frames around the ring of endpoints and measure what arrives
+	 *
+	 * Endpoint i sends to endpoint i+1 (wrapping), keeping at most window
+	 * frames of its own in flight. A window stuck for longer than a few
+	 * wire round trips is written off as lost so loss cannot stall a run.
+	 *
+	 * @param frameSize Ethernet payload bytes per frame (clamped to the network MTU)
+	 * @param warmupMs Time to run before measuring (lets peers find direct paths)
+	 * @param durationMs Measurement time
+	 * @param window Frames in flight per endpoint
+	 * @return Result (all zero if start() has not succeeded)
+	 */
+	inline Result run(unsigned int frameSize,unsigned int warmupMs,unsigned int durationMs,unsigned int window)
+	{
+		Result r;
+		const unsigned int endpoints = (unsigned int)_nodes.size() - 1;
+		for(unsigned int i=1;i<=endpoints;++i) {
+			if (!_nodes[i]->tap)
+				return r;
+		}
+		frameSize = std::max((unsigned int)ZT_LOOPBACK_FRAME_HEADER_LENGTH,std::min(frameSize,_nodes[1]->tap->mtu()));
+		window = std::max(window,1U);
+
+		// Random payload so the core's compression cannot shrink frames
+		std::vector<uint8_t> frame(frameSize,0);
+		for(unsigned int i=0;i<frameSize;++i)
+			frame[i] = (uint8_t)_rand();
+		std::vector<unsigned int> inFlight(endpoints + 1,0);
+		std::vector<int64_t> lastProgress(endpoints + 1,0);
+		const int64_t stallUs = (4 * ((int64_t)_wireConfig.latencyUs + (int64_t)_wireConfig.jitterUs)) + 100000;
+
+		_impaired = true;
+		_measuring = false;
+		_inFlight = &inFlight;
+		_lastProgress = &lastProgress;
+		_latencies.clear();
+		_framesReceived = 0;
+
+		const int64_t startUs = _usNow();
+		const int64_t measureStartUs = startUs + ((int64_t)warmupMs * 1000);
+		const int64_t measureEndUs = measureStartUs + ((int64_t)durationMs * 1000);
+		uint64_t wirePackets0 = 0,wireDrops0 = 0;
+		for(;;) {
+			int64_t nowUs = _usNow();
+			if (nowUs >= measureEndUs)
+				break;
+			if ((!_measuring)&&(nowUs >= measureStartUs)) {
+				_measuring = true;
+				_measureStartUs = measureStartUs;
+				_latencies.clear();
+				_framesReceived = 0;
+				wirePackets0 = _wirePackets;
+				wireDrops0 = _wireDrops;
+			}
+
+			for(unsigned int i=1;i<=endpoints;++i) {
+				if ((inFlight[i] >= window)&&((nowUs - lastProgress[i]) > stallUs))
+					inFlight[i] = 0;
+				if (inFlight[i] < window) {
+					TestEthernetTap *const src = _nodes[i]->tap;
+					TestEthernetTap *const dst = _nodes[(i % endpoints) + 1]->tap;
+					while (inFlight[i] < window) {
+						nowUs = _usNow();
+						memcpy(frame.data(),&nowUs,8);
+						const uint32_t idx = i;
+						memcpy(frame.data() + 8,&idx,4);
+						src->inject((void *)0,src->mac(),dst->mac(),ZT_LOOPBACK_ETHERTYPE,frame.data(),frameSize);
+						if (_measuring)
+							++r.framesSent;
+						++inFlight[i];
+					}
+					lastProgress[i] = nowUs;
+				}
+			}
+
+			const int64_t wait = _step();
+			bool windowOpen = false;
+			for(unsigned int i=1;i<=endpoints;++i)
+				windowOpen |= (inFlight[i] < window);
+			if (!windowOpen)
+				_wait(wait);
+		}
+
+		r.endpoints = endpoints;
+		r.frameSize = frameSize;
+		r.framesReceived = _framesReceived;
+		r.wirePackets = _wirePackets - wirePackets0;
+		r.wireDrops = _wireDrops - wireDrops0;
+		r.seconds = (double)(measureEndUs - measureStartUs) / 1000000.0;
+		r.framesPerSecond = (double)r.framesReceived / r.seconds;
+		r.gbps = (r.framesPerSecond * (double)frameSize * 8.0) / 1000000000.0;
+		if (!_latencies.empty()) {
+			std::sort(_latencies.begin(),_latencies.end());
+			r.p50Us = _latencies[(_latencies.size() * 50) / 100];
+			r.p99Us = _latencies[std::min(_latencies.size() - 1,(_latencies.size() * 99) / 100)];
+		}
+
+		_measuring = false;
+		_impaired = false;
+		_inFlight = (std::vector<unsigned int> *)0;
+		_lastProgress = (std::vector<int64_t> *)0;
+		return r;
+	}
+
+	/**
+	 * Set the rule table the controller issues (default: accept everything)
+	 *
+	 * This must be called before start().
+	 *
+	 * @param rules Rules
+	 * @param count Number of rules (at most ZT_MAX_NETWORK_RULES are used)
+	 */
+	inline void setRules(const ZT_VirtualNetworkRule *rules,unsigned int count) { _controller.setRules(rules,count); }
+
+	inline unsigned int nodeCount() const { return (unsigned int)_nodes.size(); }
+	inline uint64_t networkId() const { return _nwid; }
+	inline ZT_Node *node(unsigned int i) const { return _nodes[i]->node; }
+	inline TestEthernetTap *tap(unsigned int i) const { return _nodes[i]->tap; }
+
+private:
+	typedef std::pair< int,std::pair<uint64_t,uint64_t> > _StateKeyType;
+	static inline _StateKeyType _StateKey(int type,uint64_t id0,uint64_t id1) { return _StateKeyType(type,std::pair<uint64_t,uint64_t>(id0,id1)); }
+
+	struct _Node
+	{
+		LoopbackHarness *parent;
+		unsigned int index;
+		ZT_Node *node;
+		volatile int64_t deadline;
+		bool dirty; // received wire packets since the last flushFrames()
+		bool up; // benchmark network is configured
+		InetAddress addr;
+		std::map< _StateKeyType,std::string > state;
+		std::vector< std::shared_ptr<TestEthernetTap> > taps;
+		TestEthernetTap *tap; // port on the benchmark network
+	};
+
+	struct _Packet
+	{
+		int64_t at;
+		uint64_t seq;
+		unsigned int from;
+		unsigned int to;
+		unsigned int len;
+		uint8_t data[ZT_MAX_PHYSPAYLOAD];
+	};
+
+	struct _PacketLater
+	{
+		inline bool operator()(const _Packet *a,const _Packet *b) const { return ((a->at > b->at)||((a->at == b->at)&&(a->seq > b->seq))); }
+	};
+
+	/**
+	 * Minimal controller: everyone is a member of any of its networks and
+	 * gets the same rule table
+	 */
+	class _Controller : public NetworkController
+	{
+	public:
+		_Controller() :
+			_sender((NetworkController::Sender *)0),
+			_rules(1)
+		{
+			memset(_rules.data(),0,sizeof(ZT_VirtualNetworkRule));
+			_rules[0].t = (uint8_t)ZT_NETWORK_RULE_ACTION_ACCEPT;
+		}
+		virtual ~_Controller() {}
+
+		inline void setRules(const ZT_VirtualNetworkRule *rules,unsigned int count)
+		{
+			_rules.assign(rules,rules + std::min(count,(unsigned int)ZT_MAX_NETWORK_RULES));
+		}
+
+		virtual void init(const Identity &signingId,Sender *sender) { _sender = sender; }
+
+		virtual void request(
+			uint64_t nwid,
+			const InetAddress &fromAddr,
+			uint64_t requestPacketId,
+			const Identity &identity,
+			const Dictionary<ZT_NETWORKCONFIG_METADATA_DICT_CAPACITY> &metaData)
+		{
+			if (!_sender)
+				return;
+			std::unique_ptr<NetworkConfig> nc(new NetworkConfig());
+			nc->networkId = nwid;
+			nc->timestamp = OSUtils::now();
+			nc->credentialTimeMaxDelta = ZT_NETWORKCONFIG_DEFAULT_CREDENTIAL_TIME_MAX_MAX_DELTA;
+			nc->revision = 1;
+			nc->issuedTo = identity.address();
+			nc->flags = ZT_NETWORKCONFIG_FLAG_ENABLE_BROADCAST;
+			nc->mtu = ZT_DEFAULT_MTU;
+			nc->multicastLimit = 32;
+			nc->type = ZT_NETWORK_TYPE_PUBLIC;
+			Utils::scopy(nc->name,sizeof(nc->name),"loopback");
+			nc->ruleCount = (unsigned int)_rules.size();
+			for(unsigned int i=0;i<nc->ruleCount;++i)
+				nc->rules[i] = _rules[i];
+			_sender->ncSendConfig(nwid,requestPacketId,identity.address(),*nc,false);
+		}
+
+	private:
+		NetworkController::Sender *_sender;
+		std::vector<ZT_VirtualNetworkRule> _rules;
+	};
+
+	static inline int64_t _usNow() { return (int64_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count(); }
+
+	inline uint64_t _rand()
+	{
+		// xorshift64*, reproducible for a given seed
+		_prng ^= _prng >> 12;
+		_prng ^= _prng << 25;
+		_prng ^= _prng >> 27;
+		return _prng * 0x2545F4914F6CDD1DULL;
+	}
+
+	inline int _nodeIndex(const struct sockaddr_storage *addr) const
+	{
+		const InetAddress *const a = reinterpret_cast<const InetAddress *>(addr);
+		if ((a->ss_family != AF_INET)||(a->port() != ZT_LOOPBACK_PORT))
+			return -1;
+		const uint32_t ip = Utils::ntoh((uint32_t)reinterpret_cast<const struct sockaddr_in *>(addr)->sin_addr.s_addr);
+		if ((ip & 0xffff00ff) != 0x0a000001)
+			return -1;
+		const int i = (int)((ip >> 8) & 0xff);
+		return ((i >= 0)&&(i < (int)_nodes.size())) ? i : -1;
+	}
+
+	/**
+	 * Deliver everything due, flush receivers, and run due background tasks
+	 *
+	 * @return Microseconds until the next packet is due (at most 1000)
+	 */
+	inline int64_t _step()
+	{
+		const int64_t nowUs = _usNow();
+		const int64_t now = OSUtils::now();
+
+		// Frame and HELLO batches are per thread and a node's unflushed batch
+		// waits for that node to run on the thread again when another node
+		// takes over, so each node is flushed before the next one processes a
+		// packet.
+		_Node *last = (_Node *)0;
+		while ((!_wire.empty())&&(_wire.top()->at <= nowUs)) {
+			_Packet *const p = _wire.top();
+			_wire.pop();
+			_Node *const n = _nodes[p->to];
+			if ((last)&&(last != n))
+				ZT_Node_flushFrames(last->node,(void *)0);
+			last = n;
+			ZT_Node_processWirePacket(n->node,(void *)0,now,-1,reinterpret_cast<const struct sockaddr_storage *>(&(_nodes[p->from]->addr)),p->data,p->len,&(n->deadline));
+			n->dirty = true;
+			_free.push_back(p);
+		}
+		if (last)
+			ZT_Node_flushFrames(last->node,(void *)0);
+
+		for(std::vector<_Node *>::iterator n(_nodes.begin());n!=_nodes.end();++n) {
+			if ((*n)->dirty) {
+				(*n)->dirty = false;
+				if ((*n)->tap)
+					_drain(**n);
+			}
+			if ((*n)->deadline <= now)
+				ZT_Node_processBackgroundTasks((*n)->node,(void *)0,now,&((*n)->deadline));
+		}
+
+		return (_wire.empty()) ? 1000 : std::max((int64_t)0,std::min((int64_t)1000,_wire.top()->at - _usNow()));
+	}
+
+	static inline void _wait(const int64_t us)
+	{
+		// Sleeping has tens of microseconds of slop, so short waits just yield
+		if (us > 100)
+			std::this_thread::sleep_for(std::chrono::microseconds(us - 50));
+		else if (us > 0)
+			std::this_thread::yield();
+	}
+
+	inline void _drain(_Node &n)
+	{
+		MAC from,to;
+		unsigned int etherType = 0,len = 0;
+		while (n.tap->get(from,to,etherType,_frameBuf,len)) {
+			if ((etherType != ZT_LOOPBACK_ETHERTYPE)||(len < ZT_LOOPBACK_FRAME_HEADER_LENGTH))
+				continue;
+			const int64_t nowUs = _usNow();
+			int64_t sentUs;
+			uint32_t sender;
+			memcpy(&sentUs,_frameBuf,8);
+			memcpy(&sender,_frameBuf + 8,4);
+			if ((_inFlight)&&(sender < (uint32_t)_inFlight->size())) {
+				if ((*_inFlight)[sender])
+					--(*_inFlight)[sender];
+				(*_lastProgress)[sender] = nowUs;
+			}
+			if ((_measuring)&&(sentUs >= _measureStartUs)) {
+				++_framesReceived;
+				_latencies.push_back(nowUs - sentUs);
+			}
+		}
+	}
+
+	static int _wirePacketSend(ZT_Node *node,void *uptr,void *tptr,int64_t localSocket,const struct sockaddr_storage *addr,const void *data,unsigned int len,unsigned int ttl)
+	{
+		_Node *const n = reinterpret_cast<_Node *>(uptr);
+		LoopbackHarness *const h = n->parent;
+		const int to = h->_nodeIndex(addr);
+		if (to < 0)
+			return -1;
+		++h->_wirePackets;
+
+		const Wire &w = h->_wireConfig;
+		if ((len > w.mtu)||(len > ZT_MAX_PHYSPAYLOAD)) {
+			++h->_wireDrops;
+			return 0;
+		}
+		int64_t delay = (int64_t)w.latencyUs;
+		if (h->_impaired) {
+			if ((w.lossPpm)&&((h->_rand() % 1000000) < w.lossPpm)) {
+				++h->_wireDrops;
+				return 0;
+			}
+			if (w.jitterUs)
+				delay += (int64_t)(h->_rand() % ((uint64_t)w.jitterUs + 1));
+			if ((w.reorderPpm)&&((h->_rand() % 1000000) < w.reorderPpm))
+				delay += (int64_t)w.latencyUs + (int64_t)w.jitterUs + 200;
+		}
+
+		_Packet *p;
+		if (h->_free.empty()) {
+			p = new _Packet;
+		} else {
+			p = h->_free.back();
+			h->_free.pop_back();
+		}
+		p->at = _usNow() + delay;
+		p->seq = h->_seq++;
+		p->from = n->index;
+		p->to = (unsigned int)to;
+		p->len = len;
+		memcpy(p->data,data,len);
+		h->_wire.push(p);
+		return 0;
+	}
+
+	static int _pathCheck(ZT_Node *node,void *uptr,void *tptr,uint64_t ztaddr,int64_t localSocket,const struct sockaddr_storage *remoteAddr)
+	{
+		return (reinterpret_cast<_Node *>(uptr)->parent->_nodeIndex(remoteAddr) >= 0) ? 1 : 0;
+	}
+
+	static void _statePut(ZT_Node *node,void *uptr,void *tptr,enum ZT_StateObjectType type,const uint64_t id[2],const void *data,int len)
+	{
+		_Node *const n = reinterpret_cast<_Node *>(uptr);
+		if (len < 0)
+			n->state.erase(_StateKey((int)type,id[0],id[1]));
+		else n->state[_StateKey((int)type,id[0],id[1])].assign(reinterpret_cast<const char *>(data),(unsigned long)len);
+	}
+
+	static int _stateGet(ZT_Node *node,void *uptr,void *tptr,enum ZT_StateObjectType type,const uint64_t id[2],void *data,unsigned int maxlen)
+	{
+		_Node *const n = reinterpret_cast<_Node *>(uptr);
+		std::map< _StateKeyType,std::string >::const_iterator s(n->state.find(_StateKey((int)type,id[0],id[1])));
+		if ((s == n->state.end())||(s->second.length() > maxlen))
+			return -1;
+		memcpy(data,s->second.data(),s->second.length());
+		return (int)s->second.length();
+	}
+
+	static int _virtualNetworkConfig(ZT_Node *node,void *uptr,void *tptr,uint64_t nwid,void **nuptr,enum ZT_VirtualNetworkConfigOperation op,const ZT_VirtualNetworkConfig *nwc)
+	{
+		_Node *const n = reinterpret_cast<_Node *>(uptr);
+		switch(op) {
+			case ZT_VIRTUAL_NETWORK_CONFIG_OPERATION_UP:
+			case ZT_VIRTUAL_NETWORK_CONFIG_OPERATION_CONFIG_UPDATE:
+				if (!*nuptr) {
+					n->taps.push_back(std::shared_ptr<TestEthernetTap>(new TestEthernetTap((const char *)0,MAC(nwc->mac),nwc->mtu,0,nwid,(const char *)0,&_tapFrame,n)));
+					*nuptr = (void *)n->taps.back().get();
+				}
+				reinterpret_cast<TestEthernetTap *>(*nuptr)->setMtu(nwc->mtu);
+				if (nwid == n->parent->_nwid) {
+					n->tap = reinterpret_cast<TestEthernetTap *>(*nuptr);
+					n->up = (nwc->status == ZT_NETWORK_STATUS_OK);
+				}
+				break;
+			case ZT_VIRTUAL_NETWORK_CONFIG_OPERATION_DOWN:
+			case ZT_VIRTUAL_NETWORK_CONFIG_OPERATION_DESTROY:
+				if (*nuptr) {
+					if (n->tap == reinterpret_cast<TestEthernetTap *>(*nuptr)) {
+						n->tap = (TestEthernetTap *)0;
+						n->up = false;
+					}
+					for(std::vector< std::shared_ptr<TestEthernetTap> >::iterator t(n->taps.begin());t!=n->taps.end();++t) {
+						if (t->get() == *nuptr) {
+							n->taps.erase(t);
+							break;
+						}
+					}
+					*nuptr = (void *)0;
+				}
+				break;
+		}
+		return 0;
+	}
+
+	static void _virtualNetworkFrame(ZT_Node *node,void *uptr,void *tptr,uint64_t nwid,void **nuptr,uint64_t sourceMac,uint64_t destMac,unsigned int etherType,unsigned int vlanId,const void *data,unsigned int len)
+	{
+		if ((nuptr)&&(*nuptr))
+			reinterpret_cast<TestEthernetTap *>(*nuptr)->put(MAC(sourceMac),MAC(destMac),etherType,data,len);
+	}
+
+	static void _virtualNetworkFrameBatch(ZT_Node *node,void *uptr,void *tptr,ZT_VirtualNetworkFrame *frames,unsigned int count)
+	{
+		// nuptr is only a copy, so check the tap it names still exists
+		_Node *const n = reinterpret_cast<_Node *>(uptr);
+		unsigned int start = 0;
+		while (start < count) {
+			void *const nuptr = frames[start].nuptr;
+			unsigned int end = start + 1;
+			while ((end < count)&&(frames[end].nuptr == nuptr))
+				++end;
+			for(std::vector< std::shared_ptr<TestEthernetTap> >::const_iterator t(n->taps.begin());t!=n->taps.end();++t) {
+				if (t->get() == nuptr) {
+					(*t)->putBatch(frames + start,end - start);
+					break;
+				}
+			}
+			start = end;
+		}
+	}
+
+	static void _event(ZT_Node *node,void *uptr,void *tptr,enum ZT_Event event,const void *metaData)
+	{
+	}
+
+	static void _tapFrame(void *uptr,void *tptr,uint64_t nwid,const MAC &from,const MAC &to,unsigned int etherType,unsigned int vlanId,const void *data,unsigned int len)
+	{
+		_Node *const n = reinterpret_cast<_Node *>(uptr);
+		ZT_Node_processVirtualNetworkFrame(n->node,tptr,OSUtils::now(),nwid,from.toInt(),to.toInt(),etherType,vlanId,data,len,&(n->deadline));
+	}
+
+	Wire _wireConfig;
+	uint64_t _prng;
+	uint64_t _seq;
+	uint64_t _nwid;
+	std::vector<_Node *> _nodes;
+	std::priority_queue< _Packet *,std::vector<_Packet *>,_PacketLater > _wire;
+	std::vector<_Packet *> _free;
+	_Controller _controller;
+
+	bool _measuring;
+	int64_t _measureStartUs; // frames sent before this are not counted
+	uint64_t _wirePackets;
+	uint64_t _wireDrops;
+	bool _impaired;
+	uint64_t _framesReceived;
+	std::vector<int64_t> _latencies;
+	std::vector<unsigned int> *_inFlight;
+	std::vector<int64_t> *_lastProgress;
+	uint8_t _frameBuf[ZT_MAX_MTU];
+};
+
+} // namespace ZeroTier
+
+#endif
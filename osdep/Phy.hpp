@@ -58,6 +58,7 @@
 #include <sys/types.h>
 #include <sys/select.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <sys/un.h>
 #include <arpa/inet.h>
 #include <netinet/in.h>
@@ -67,6 +68,8 @@
 #ifndef IPV6_DONTFRAG
 #define IPV6_DONTFRAG 62
 #endif
+// Linux accepts IP_TTL as per-packet ancillary data on sendmsg()
+#define ZT_PHY_HAVE_SEND_TTL_CMSG 1
 #endif
 
 #define ZT_PHY_SOCKFD_TYPE int
@@ -387,9 +390,11 @@ public:
 	 * @param localAddress Local endpoint address and port
 	 * @param uptr Initial value of user pointer associated with this socket (default: NULL)
 	 * @param bufferSize Desired socket receive/send buffer size -- will set as close to this as possible (default: 0, leave alone)
+	 * @param reusePort If true, set SO_REUSEPORT so several sockets can share this address (where supported)
+	 * @param device If non-NULL, bind to this device before binding the address (Linux only, needed for SO_REUSEPORT groups)
 	 * @return Socket or NULL on failure to bind
 	 */
-	inline PhySocket *udpBind(const struct sockaddr *localAddress,void *uptr = (void *)0,int bufferSize = 0)
+	inline PhySocket *udpBind(const struct sockaddr *localAddress,void *uptr = (void *)0,int bufferSize = 0,bool reusePort = false,const char *device = (const char *)0)
 	{
 		if (_socks.size() >= ZT_PHY_MAX_SOCKETS)
 			return (PhySocket *)0;
@@ -439,6 +444,15 @@ public:
 			}
 			f = 0; setsockopt(s,SOL_SOCKET,SO_REUSEADDR,(void *)&f,sizeof(f));
 			f = 1; setsockopt(s,SOL_SOCKET,SO_BROADCAST,(void *)&f,sizeof(f));
+#ifdef SO_REUSEPORT
+			if (reusePort) {
+				f = 1; setsockopt(s,SOL_SOCKET,SO_REUSEPORT,(void *)&f,sizeof(f));
+			}
+#endif
+#ifdef SO_BINDTODEVICE
+			if ((device)&&(device[0]))
+				setsockopt(s,SOL_SOCKET,SO_BINDTODEVICE,device,(socklen_t)strlen(device));
+#endif
 #ifdef IP_DONTFRAG
 			f = 0; setsockopt(s,IPPROTO_IP,IP_DONTFRAG,&f,sizeof(f));
 #endif
@@ -524,6 +538,94 @@ public:
 #endif
 	}
 
+	/**
+	 * Send a UDP packet with a per-packet IPv4 TTL
+	 *
+	 * @param sock UDP socket
+	 * @param remoteAddress Destination address (must be correct type for socket)
+	 * @param data Data to send
+	 * @param len Length of packet
+	 * @param ttl IP TTL for this packet only or 0 for default (ignored for IPv6)
+	 * @return True if packet appears to have been sent successfully
+	 */
+	inline bool udpSend(PhySocket *sock,const struct sockaddr *remoteAddress,const void *data,unsigned long len,unsigned int ttl)
+	{
+		return udpSendMulti(&sock,1,remoteAddress,data,len,ttl);
+	}
+
+	/**
+	 * Send the same UDP packet from several sockets
+	 *
+	 * The message and its TTL control data are built once and reused for every
+	 * socket. Where the OS supports IP_TTL as ancillary data the TTL applies to
+	 * this packet only; otherwise (or if the kernel rejects it) it's set on the
+	 * socket around the send as setIp4UdpTtl() would.
+	 *
+	 * @param socks UDP sockets (must match the family of remoteAddress)
+	 * @param count Number of sockets
+	 * @param remoteAddress Destination address
+	 * @param data Data to send
+	 * @param len Length of packet
+	 * @param ttl IP TTL for this packet only or 0 for default (ignored for IPv6)
+	 * @return True if packet appears to have been sent successfully from at least one socket
+	 */
+	inline bool udpSendMulti(PhySocket *const *socks,unsigned int count,const struct sockaddr *remoteAddress,const void *data,unsigned long len,unsigned int ttl)
+	{
+		bool r = false;
+		if ((!ttl)||(remoteAddress->sa_family != AF_INET)) {
+			for(unsigned int i=0;i<count;++i) {
+				if (udpSend(socks[i],remoteAddress,data,len))
+					r = true;
+			}
+			return r;
+		}
+
+#ifdef ZT_PHY_HAVE_SEND_TTL_CMSG
+		struct iovec iov;
+		iov.iov_base = const_cast<void *>(data);
+		iov.iov_len = (size_t)len;
+		union {
+			char buf[CMSG_SPACE(sizeof(int))];
+			struct cmsghdr align;
+		} cbuf;
+		memset(&cbuf,0,sizeof(cbuf));
+		struct msghdr mh;
+		memset(&mh,0,sizeof(mh));
+		mh.msg_name = const_cast<struct sockaddr *>(remoteAddress);
+		mh.msg_namelen = sizeof(struct sockaddr_in);
+		mh.msg_iov = &iov;
+		mh.msg_iovlen = 1;
+		mh.msg_control = cbuf.buf;
+		mh.msg_controllen = sizeof(cbuf.buf);
+		struct cmsghdr *const cm = CMSG_FIRSTHDR(&mh);
+		cm->cmsg_level = IPPROTO_IP;
+		cm->cmsg_type = IP_TTL;
+		cm->cmsg_len = CMSG_LEN(sizeof(int));
+		const int cttl = (ttl > 255) ? 255 : (int)ttl;
+		memcpy(CMSG_DATA(cm),&cttl,sizeof(int));
+		for(unsigned int i=0;i<count;++i) {
+			PhySocketImpl &sws = *(reinterpret_cast<PhySocketImpl *>(socks[i]));
+			const long sr = (long)::sendmsg(sws.sock,&mh,0);
+			if (sr == (long)len) {
+				r = true;
+			} else if ((sr < 0)&&(errno == EINVAL)) { // old kernel without IP_TTL cmsg support
+				setIp4UdpTtl(socks[i],ttl);
+				if (udpSend(socks[i],remoteAddress,data,len))
+					r = true;
+				setIp4UdpTtl(socks[i],255);
+			}
+		}
+#else
+		for(unsigned int i=0;i<count;++i) {
+			setIp4UdpTtl(socks[i],ttl);
+			if (udpSend(socks[i],remoteAddress,data,len))
+				r = true;
+			setIp4UdpTtl(socks[i],255);
+		}
+#endif
+		return r;
+	}
+
 #ifdef __UNIX_LIKE__
 	/**
 	 * Listen for connections on a Unix domain socket
@@ -0,0 +1,108 @@
+/*
+ * ZeroTier One - Network Virtualization Everywhere
+ * Copyright (C) 2011-2019  ZeroTier, Inc.  https://www.zerotier.com/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * --
+ *
+ * You can be released from the requirements of the license by purchasing
+ * a commercial license. Buying such a license is mandatory as soon as you
+ * develop commercial closed-source software that incorporates or links
+ * directly against ZeroTier software without disclosing the source code
+ * of your own application.
+ */
+
+
+#ifndef ZT_RWMUTEX_HPP
+#define ZT_RWMUTEX_HPP
+
+#include "../node/Constants.hpp"
+
+#ifdef __WINDOWS__
+#include <Windows.h>
+#else
+#include <pthread.h>
+#endif
+
+namespace ZeroTier {
+
+/**
+ * Reader/writer lock for C++11 code that predates std::shared_mutex
+ *
+ * lock() and unlock() take the lock exclusively so std::lock_guard works for
+ * writers. Readers use RWMutex::RLock. Where the platform allows it writers
+ * are preferred, so a steady stream of readers cannot starve them; as with
+ * std::shared_mutex a thread must not take the same lock twice in any mode.
+ */
+class RWMutex
+{
+public:
+#ifdef __WINDOWS__
+	RWMutex() { InitializeSRWLock(&_l); }
+	~RWMutex() {}
+
+	inline void lock() { AcquireSRWLockExclusive(&_l); }
+	inline void unlock() { ReleaseSRWLockExclusive(&_l); }
+	inline void lock_shared() { AcquireSRWLockShared(&_l); }
+	inline void unlock_shared() { ReleaseSRWLockShared(&_l); }
+#else
+	RWMutex()
+	{
+		pthread_rwlockattr_t a;
+		pthread_rwlockattr_init(&a);
+#if defined(__GLIBC__) && defined(PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP)
+		pthread_rwlockattr_setkind_np(&a,PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+#endif
+		pthread_rwlock_init(&_l,&a);
+		pthread_rwlockattr_destroy(&a);
+	}
+	~RWMutex() { pthread_rwlock_destroy(&_l); }
+
+	inline void lock() { pthread_rwlock_wrlock(&_l); }
+	inline void unlock() { pthread_rwlock_unlock(&_l); }
+	inline void lock_shared() { pthread_rwlock_rdlock(&_l); }
+	inline void unlock_shared() { pthread_rwlock_unlock(&_l); }
+#endif
+
+	/**
+	 * Holds a shared (read) lock for the life of this object
+	 */
+	class RLock
+	{
+	public:
+		RLock(RWMutex &m) : _m(&m) { m.lock_shared(); }
+		RLock(const RWMutex &m) : _m(const_cast<RWMutex *>(&m)) { _m->lock_shared(); }
+		~RLock() { _m->unlock_shared(); }
+
+	private:
+		RLock(const RLock &) : _m((RWMutex *)0) {}
+		const RLock &operator=(const RLock &) { return *this; }
+		RWMutex *const _m;
+	};
+
+private:
+	RWMutex(const RWMutex &) {}
+	const RWMutex &operator=(const RWMutex &) { return *this; }
+
+#ifdef __WINDOWS__
+	SRWLOCK _l;
+#else
+	pthread_rwlock_t _l;
+#endif
+};
+
+} // namespace ZeroTier
+
+#endif
@@ -0,0 +1,485 @@
+/*
+ * ZeroTier One - Network Virtualization Everywhere
+ * Copyright (C) 2011-2019  ZeroTier, Inc.  https://www.zerotier.com/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * --
+ *
+ * You can be released from the requirements of the license by purchasing
+ * a commercial license. Buying such a license is mandatory as soon as you
+ * develop commercial closed-source software that incorporates or links
+ * directly against ZeroTier software without disclosing the source code
+ * of your own application.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include "StateStore.hpp"
+#include "OSUtils.hpp"
+
+// peers.dat starts with this, followed by records of:
+//   <[8] address> <[8] timestamp> <[4] length> <[...] serialized peer>
+// with all integers big-endian. A zero length record deletes the peer.
+#define ZT_STATESTORE_PEERS_MAGIC "ZTPEERS1"
+#define ZT_STATESTORE_PEERS_MAGIC_LEN 8
+#define ZT_STATESTORE_PEER_HEADER_LEN 20
+
+namespace ZeroTier {
+
+namespace {
+
+inline void _setU64(uint8_t *p,const uint64_t i) { for(int k=7;k>=0;--k) p[7 - k] = (uint8_t)(i >> (k * 8)); }
+inline uint64_t _getU64(const uint8_t *p) { uint64_t i = 0; for(int k=0;k<8;++k) i = (i << 8) | (uint64_t)p[k]; return i; }
+
+} // anonymous namespace
+
+StateStore::StateStore(const std::string &homePath,bool singleFilePeers) :
+	_homePath(homePath),
+	_singleFilePeers(singleFilePeers),
+	_cleanPeersBefore(0),
+	_run(true),
+	_peerFile((FILE *)0),
+	_peerFileEnd(0),
+	_peerLiveBytes(0)
+{
+	if (_singleFilePeers)
+		_openPeers();
+	_thread = std::thread(&StateStore::_threadMain,this);
+}
+
+StateStore::~StateStore()
+{
+	{
+		std::lock_guard<std::mutex> l(_lock);
+		_run = false;
+	}
+	_wake.notify_all();
+	if (_thread.joinable())
+		_thread.join();
+	flush();
+	if (_peerFile)
+		fclose(_peerFile);
+}
+
+void StateStore::put(const enum ZT_StateObjectType type,const uint64_t id[2],const void *data,int len)
+{
+	const _Key k(type,id);
+	_Pending v;
+	if ((len >= 0)&&(data))
+		v.data.assign(reinterpret_cast<const char *>(data),(unsigned long)len);
+	else v.erase = true;
+
+	if ((type == ZT_STATE_OBJECT_IDENTITY_PUBLIC)||(type == ZT_STATE_OBJECT_IDENTITY_SECRET)) {
+		{
+			std::lock_guard<std::mutex> l(_lock);
+			_dirty.erase(k);
+		}
+		_write(k,v);
+		return;
+	}
+
+	bool wake;
+	{
+		std::lock_guard<std::mutex> l(_lock);
+		_dirty[k] = v;
+		wake = (_dirty.size() >= ZT_STATESTORE_FLUSH_THRESHOLD);
+	}
+	if (wake)
+		_wake.notify_one();
+}
+
+int StateStore::get(const enum ZT_StateObjectType type,const uint64_t id[2],void *data,unsigned int maxlen)
+{
+	const _Key k(type,id);
+	{
+		std::lock_guard<std::mutex> l(_lock);
+		// A write still in _dirty is newer than one being flushed
+		const _Pending *pending = (const _Pending *)0;
+		std::map<_Key,_Pending>::const_iterator p(_dirty.find(k));
+		if (p != _dirty.end()) {
+			pending = &(p->second);
+		} else {
+			p = _flushing.find(k);
+			if (p != _flushing.end())
+				pending = &(p->second);
+		}
+		if (pending) {
+			if (pending->erase)
+				return -1;
+			const unsigned int n = std::min((unsigned int)pending->data.length(),maxlen);
+			memcpy(data,pending->data.data(),n);
+			return (int)n;
+		}
+	}
+
+	if ((type == ZT_STATE_OBJECT_PEER)&&(_singleFilePeers)) {
+		const int n = _readPeer(id[0],data,maxlen);
+		if (n >= 0)
+			return n;
+	}
+	return _readFile(k,data,maxlen);
+}
+
+void StateStore::flush()
+{
+	std::lock_guard<std::mutex> fl(_flush_m);
+
+	int64_t cleanPeersBefore;
+	{
+		std::lock_guard<std::mutex> l(_lock);
+		_flushing.swap(_dirty);
+		cleanPeersBefore = _cleanPeersBefore;
+		_cleanPeersBefore = 0;
+	}
+
+	if (!_flushing.empty()) {
+		const int64_t now = OSUtils::now();
+		bool peersWritten = false;
+		for(std::map<_Key,_Pending>::const_iterator p(_flushing.begin());p!=_flushing.end();++p) {
+			if ((p->first.type == (int)ZT_STATE_OBJECT_PEER)&&(_singleFilePeers)) {
+				std::lock_guard<std::mutex> l(_peer_m);
+				if (p->second.erase) {
+					_appendPeer(p->first.id0,now,(const void *)0,0);
+					_write(p->first,p->second); // also remove any copy left in peers.d
+				} else _appendPeer(p->first.id0,now,p->second.data.data(),(unsigned int)p->second.data.length());
+				peersWritten = true;
+			} else {
+				_write(p->first,p->second);
+			}
+		}
+		if (peersWritten) {
+			std::lock_guard<std::mutex> l(_peer_m);
+			if (_peerFile)
+				fflush(_peerFile);
+		}
+
+		std::lock_guard<std::mutex> l(_lock);
+		_flushing.clear();
+	}
+
+	if (_singleFilePeers) {
+		std::lock_guard<std::mutex> l(_peer_m);
+		const uint64_t dead = _peerFileEnd - ZT_STATESTORE_PEERS_MAGIC_LEN - _peerLiveBytes;
+		if ((cleanPeersBefore)||((dead > _peerLiveBytes)&&(dead > ZT_STATESTORE_MAX_PEER_RECORD)))
+			_compactPeers(cleanPeersBefore);
+	} else if (cleanPeersBefore) {
+		OSUtils::cleanDirectory((_homePath + ZT_PATH_SEPARATOR_S "peers.d").c_str(),cleanPeersBefore);
+	}
+}
+
+void StateStore::cleanPeers(const int64_t olderThan)
+{
+	{
+		std::lock_guard<std::mutex> l(_lock);
+		_cleanPeersBefore = olderThan;
+	}
+	_wake.notify_one();
+}
+
+unsigned long StateStore::pending() const
+{
+	std::lock_guard<std::mutex> l(_lock);
+	return (unsigned long)_dirty.size();
+}
+
+bool StateStore::_path(const int type,const uint64_t id0,char *p,unsigned int plen,char *dirname,unsigned int dlen,bool &secure) const
+{
+	dirname[0] = 0;
+	secure = false;
+	switch(type) {
+		case ZT_STATE_OBJECT_IDENTITY_PUBLIC:
+			OSUtils::ztsnprintf(p,plen,"%s" ZT_PATH_SEPARATOR_S "identity.public",_homePath.c_str());
+			break;
+		case ZT_STATE_OBJECT_IDENTITY_SECRET:
+			OSUtils::ztsnprintf(p,plen,"%s" ZT_PATH_SEPARATOR_S "identity.secret",_homePath.c_str());
+			secure = true;
+			break;
+		case ZT_STATE_OBJECT_PLANET:
+			OSUtils::ztsnprintf(p,plen,"%s" ZT_PATH_SEPARATOR_S "planet",_homePath.c_str());
+			break;
+		case ZT_STATE_OBJECT_MOON:
+			OSUtils::ztsnprintf(dirname,dlen,"%s" ZT_PATH_SEPARATOR_S "moons.d",_homePath.c_str());
+			OSUtils::ztsnprintf(p,plen,"%s" ZT_PATH_SEPARATOR_S "%.16llx.moon",dirname,(unsigned long long)id0);
+			break;
+		case ZT_STATE_OBJECT_NETWORK_CONFIG:
+			OSUtils::ztsnprintf(dirname,dlen,"%s" ZT_PATH_SEPARATOR_S "networks.d",_homePath.c_str());
+			OSUtils::ztsnprintf(p,plen,"%s" ZT_PATH_SEPARATOR_S "%.16llx.conf",dirname,(unsigned long long)id0);
+			secure = true;
+			break;
+		case ZT_STATE_OBJECT_PEER:
+			OSUtils::ztsnprintf(dirname,dlen,"%s" ZT_PATH_SEPARATOR_S "peers.d",_homePath.c_str());
+			OSUtils::ztsnprintf(p,plen,"%s" ZT_PATH_SEPARATOR_S "%.10llx.peer",dirname,(unsigned long long)id0);
+			break;
+		default:
+			return false;
+	}
+	return true;
+}
+
+void StateStore::_write(const _Key &k,const _Pending &v)
+{
+	char p[1024];
+	char dirname[1024];
+	bool secure;
+	if (!_path(k.type,k.id0,p,sizeof(p),dirname,sizeof(dirname),secure))
+		return;
+
+	if (v.erase) {
+		OSUtils::rm(p);
+		return;
+	}
+
+	// Check to see if we've already written this first. This reduces
+	// redundant writes and I/O overhead on most platforms and has
+	// little effect on others.
+	FILE *f = fopen(p,"rb");
+	if (f) {
+		std::vector<char> buf(v.data.length() + 1);
+		const size_t l = fread(buf.data(),1,buf.size(),f);
+		fclose(f);
+		if ((l == v.data.length())&&(memcmp(v.data.data(),buf.data(),l) == 0))
+			return;
+	}
+
+	f = fopen(p,"wb");
+	if ((!f)&&(dirname[0])) { // create subdirectory if it does not exist
+		OSUtils::mkdir(dirname);
+		f = fopen(p,"wb");
+	}
+	if (f) {
+		if ((v.data.length() > 0)&&(fwrite(v.data.data(),v.data.length(),1,f) != 1))
+			fprintf(stderr,"WARNING: unable to write to file: %s (I/O error)" ZT_EOL_S,p);
+		fclose(f);
+		if (secure)
+			OSUtils::lockDownFile(p,false);
+	} else {
+		fprintf(stderr,"WARNING: unable to write to file: %s (unable to open)" ZT_EOL_S,p);
+	}
+}
+
+int StateStore::_readFile(const _Key &k,void *data,unsigned int maxlen) const
+{
+	char p[1024];
+	char dirname[1024];
+	bool secure;
+	if (!_path(k.type,k.id0,p,sizeof(p),dirname,sizeof(dirname),secure))
+		return -1;
+	FILE *f = fopen(p,"rb");
+	if (f) {
+		const int n = (int)fread(data,1,maxlen,f);
+		fclose(f);
+		if (n >= 0)
+			return n;
+	}
+	return -1;
+}
+
+void StateStore::_openPeers()
+{
+	const std::string p(_homePath + ZT_PATH_SEPARATOR_S "peers.dat");
+	_peerIndex.clear();
+	_peerFileEnd = ZT_STATESTORE_PEERS_MAGIC_LEN;
+	_peerLiveBytes = 0;
+
+	_peerFile = fopen(p.c_str(),"r+b");
+	if (_peerFile) {
+		char magic[ZT_STATESTORE_PEERS_MAGIC_LEN];
+		if ((fread(magic,1,sizeof(magic),_peerFile) == sizeof(magic))&&(memcmp(magic,ZT_STATESTORE_PEERS_MAGIC,sizeof(magic)) == 0)) {
+			fseek(_peerFile,0,SEEK_END);
+			const uint64_t size = (uint64_t)ftell(_peerFile);
+			fseek(_peerFile,ZT_STATESTORE_PEERS_MAGIC_LEN,SEEK_SET);
+
+			// Index records up to the first one that's truncated or corrupt,
+			// which would be from a write interrupted by a crash or power loss.
+			uint8_t h[ZT_STATESTORE_PEER_HEADER_LEN];
+			while (fread(h,1,sizeof(h),_peerFile) == sizeof(h)) {
+				const uint64_t address = _getU64(h);
+				const int64_t ts = (int64_t)_getU64(h + 8);
+				const unsigned int len = ((unsigned int)h[16] << 24) | ((unsigned int)h[17] << 16) | ((unsigned int)h[18] << 8) | (unsigned int)h[19];
+				const uint64_t next = _peerFileEnd + ZT_STATESTORE_PEER_HEADER_LEN + len;
+				if ((len > ZT_STATESTORE_MAX_PEER_RECORD)||(next > size))
+					break;
+				const _PeerRecord *const old = _peerIndex.get(address);
+				if (old) {
+					_peerLiveBytes -= ZT_STATESTORE_PEER_HEADER_LEN + old->len;
+					_peerIndex.erase(address);
+				}
+				if (len) {
+					_PeerRecord &r = _peerIndex[address];
+					r.offset = _peerFileEnd + ZT_STATESTORE_PEER_HEADER_LEN;
+					r.ts = ts;
+					r.len = len;
+					_peerLiveBytes += ZT_STATESTORE_PEER_HEADER_LEN + len;
+				}
+				_peerFileEnd = next;
+				if (fseek(_peerFile,(long)_peerFileEnd,SEEK_SET) != 0)
+					break;
+			}
+
+			if (_peerFileEnd != size)
+				_compactPeers(0); // rewrite without the damaged tail
+			return;
+		}
+		fclose(_peerFile);
+		fprintf(stderr,"WARNING: %s is not a peer store, replacing it" ZT_EOL_S,p.c_str());
+	}
+
+	_peerFile = fopen(p.c_str(),"w+b");
+	if (_peerFile) {
+		fwrite(ZT_STATESTORE_PEERS_MAGIC,ZT_STATESTORE_PEERS_MAGIC_LEN,1,_peerFile);
+		fflush(_peerFile);
+	} else {
+		fprintf(stderr,"WARNING: unable to open peer store: %s" ZT_EOL_S,p.c_str());
+	}
+}
+
+void StateStore::_appendPeer(const uint64_t address,const int64_t ts,const void *data,const unsigned int len)
+{
+	// assumes _peer_m is locked
+	if ((!_peerFile)||(len > ZT_STATESTORE_MAX_PEER_RECORD))
+		return;
+
+	const _PeerRecord *const old = _peerIndex.get(address);
+	if (old) {
+		if ((len == old->len)&&(len)) {
+			// Skip rewriting identical records, as the per-file store does
+			std::vector<uint8_t> buf(len);
+			if ((fseek(_peerFile,(long)old->offset,SEEK_SET) == 0)&&(fread(buf.data(),1,len,_peerFile) == len)&&(memcmp(buf.data(),data,len) == 0))
+				return;
+		}
+	} else if (!len) {
+		return; // deleting a peer we don't have
+	}
+
+	uint8_t h[ZT_STATESTORE_PEER_HEADER_LEN];
+	_setU64(h,address);
+	_setU64(h + 8,(uint64_t)ts);
+	h[16] = (uint8_t)(len >> 24);
+	h[17] = (uint8_t)(len >> 16);
+	h[18] = (uint8_t)(len >> 8);
+	h[19] = (uint8_t)len;
+	if ((fseek(_peerFile,(long)_peerFileEnd,SEEK_SET) != 0)||(fwrite(h,sizeof(h),1,_peerFile) != 1)||((len)&&(fwrite(data,len,1,_peerFile) != 1))) {
+		fprintf(stderr,"WARNING: unable to write to peer store (I/O error)" ZT_EOL_S);
+		return;
+	}
+
+	if (old) {
+		_peerLiveBytes -= ZT_STATESTORE_PEER_HEADER_LEN + old->len;
+		_peerIndex.erase(address);
+	}
+	if (len) {
+		_PeerRecord &r = _peerIndex[address];
+		r.offset = _peerFileEnd + ZT_STATESTORE_PEER_HEADER_LEN;
+		r.ts = ts;
+		r.len = len;
+		_peerLiveBytes += ZT_STATESTORE_PEER_HEADER_LEN + len;
+	}
+	_peerFileEnd += ZT_STATESTORE_PEER_HEADER_LEN + len;
+}
+
+int StateStore::_readPeer(const uint64_t address,void *data,unsigned int maxlen)
+{
+	std::lock_guard<std::mutex> l(_peer_m);
+	const _PeerRecord *const r = _peerIndex.get(address);
+	if ((!r)||(!_peerFile))
+		return -1;
+	const unsigned int n = std::min(r->len,maxlen);
+	if ((fseek(_peerFile,(long)r->offset,SEEK_SET) != 0)||(fread(data,1,n,_peerFile) != n))
+		return -1;
+	return (int)n;
+}
+
+void StateStore::_compactPeers(const int64_t olderThan)
+{
+	// assumes _peer_m is locked
+	if (!_peerFile)
+		return;
+
+	const std::string p(_homePath + ZT_PATH_SEPARATOR_S "peers.dat");
+	const std::string tmp(p + ".tmp");
+	FILE *nf = fopen(tmp.c_str(),"w+b");
+	if (!nf)
+		return;
+
+	Hashtable< uint64_t,_PeerRecord > ni;
+	uint64_t end = ZT_STATESTORE_PEERS_MAGIC_LEN;
+	bool ok = (fwrite(ZT_STATESTORE_PEERS_MAGIC,ZT_STATESTORE_PEERS_MAGIC_LEN,1,nf) == 1);
+	std::vector<uint8_t> buf(ZT_STATESTORE_PEER_HEADER_LEN + ZT_STATESTORE_MAX_PEER_RECORD);
+
+	Hashtable< uint64_t,_PeerRecord >::Iterator i(_peerIndex);
+	uint64_t *a = (uint64_t *)0;
+	_PeerRecord *r = (_PeerRecord *)0;
+	while ((ok)&&(i.next(a,r))) {
+		if (r->ts < olderThan)
+			continue;
+		_setU64(buf.data(),*a);
+		_setU64(buf.data() + 8,(uint64_t)r->ts);
+		buf[16] = (uint8_t)(r->len >> 24);
+		buf[17] = (uint8_t)(r->len >> 16);
+		buf[18] = (uint8_t)(r->len >> 8);
+		buf[19] = (uint8_t)r->len;
+		ok = ( (fseek(_peerFile,(long)r->offset,SEEK_SET) == 0) &&
+		       (fread(buf.data() + ZT_STATESTORE_PEER_HEADER_LEN,1,r->len,_peerFile) == r->len) &&
+		       (fwrite(buf.data(),ZT_STATESTORE_PEER_HEADER_LEN + r->len,1,nf) == 1) );
+		_PeerRecord &nr = ni[*a];
+		nr.offset = end + ZT_STATESTORE_PEER_HEADER_LEN;
+		nr.ts = r->ts;
+		nr.len = r->len;
+		end += ZT_STATESTORE_PEER_HEADER_LEN + r->len;
+	}
+	ok &= (fflush(nf) == 0);
+
+	if (!ok) {
+		fclose(nf);
+		OSUtils::rm(tmp);
+		fprintf(stderr,"WARNING: unable to compact peer store (I/O error)" ZT_EOL_S);
+		return;
+	}
+
+	fclose(_peerFile);
+	fclose(nf);
+	OSUtils::rm(p); // rename() won't replace an existing file on Windows
+	if (rename(tmp.c_str(),p.c_str()) != 0) {
+		fprintf(stderr,"WARNING: unable to replace %s with compacted copy" ZT_EOL_S,p.c_str());
+		_peerFile = (FILE *)0;
+		_openPeers();
+		return;
+	}
+
+	_peerFile = fopen(p.c_str(),"r+b");
+	_peerIndex = ni;
+	_peerFileEnd = end;
+	_peerLiveBytes = end - ZT_STATESTORE_PEERS_MAGIC_LEN;
+}
+
+void StateStore::_threadMain()
+{
+	std::unique_lock<std::mutex> l(_lock);
+	while (_run) {
+		_wake.wait_for(l,std::chrono::milliseconds(ZT_STATESTORE_FLUSH_INTERVAL));
+		if (!_run)
+			break;
+		l.unlock();
+		flush();
+		l.lock();
+	}
+}
+
+} // namespace ZeroTier
@@ -0,0 +1,187 @@
+/*
+ * ZeroTier One - Network Virtualization Everywhere
+ * Copyright (C) 2011-2019  ZeroTier, Inc.  https://www.zerotier.com/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * --
+ *
+ * You can be released from the requirements of the license by purchasing
+ * a commercial license. Buying such a license is mandatory as soon as you
+ * develop commercial closed-source software that incorporates or links
+ * directly against ZeroTier software without disclosing the source code
+ * of your own application.
+ */
+
+#ifndef ZT_STATESTORE_HPP
+#define ZT_STATESTORE_HPP
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <string>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "../node/Constants.hpp"
+#include "../node/Hashtable.hpp"
+#include "../include/ZeroTierOne.h"
+
+/**
+ * Interval between background flushes of pending state writes in ms
+ */
+#define ZT_STATESTORE_FLUSH_INTERVAL 2000
+
+/**
+ * Number of pending writes that triggers an early background flush
+ */
+#define ZT_STATESTORE_FLUSH_THRESHOLD 1024
+
+/**
+ * Largest record accepted by the single file peer store
+ */
+#define ZT_STATESTORE_MAX_PEER_RECORD 65536
+
+namespace ZeroTier {
+
+/**
+ * Write-behind store for node state objects in a home directory
+ *
+ * put() records an object in an in-memory dirty set and returns at once.
+ * A background thread writes the set out every ZT_STATESTORE_FLUSH_INTERVAL
+ * ms, or sooner once ZT_STATESTORE_FLUSH_THRESHOLD writes are pending, so
+ * several writes to one object between flushes cost a single file write.
+ * get() checks pending writes first and always returns what was last put.
+ * Identities are the exception and are written through immediately, since
+ * losing one can't be recovered from.
+ *
+ * Peers are stored one file per peer in peers.d unless single file mode is
+ * enabled. In that mode they're appended as records to peers.dat, which is
+ * indexed in memory when opened and compacted once superseded records take
+ * up more than half of it. Peers not found there are still read from
+ * peers.d so switching modes doesn't forget them.
+ */
+class StateStore
+{
+public:
+	/**
+	 * @param homePath Home directory
+	 * @param singleFilePeers If true keep peers in peers.dat instead of peers.d
+	 */
+	StateStore(const std::string &homePath,bool singleFilePeers);
+
+	/**
+	 * Stop the background thread and write anything still pending
+	 */
+	~StateStore();
+
+	/**
+	 * Store or delete a state object (same semantics as ZT_StatePutFunction)
+	 *
+	 * @param type Object type
+	 * @param id Object ID
+	 * @param data Object data
+	 * @param len Length of data or -1 to delete
+	 */
+	void put(const enum ZT_StateObjectType type,const uint64_t id[2],const void *data,int len);
+
+	/**
+	 * Get a state object (same semantics as ZT_StateGetFunction)
+	 *
+	 * @param type Object type
+	 * @param id Object ID
+	 * @param data Buffer to fill
+	 * @param maxlen Size of buffer
+	 * @return Length of object or -1 if not found
+	 */
+	int get(const enum ZT_StateObjectType type,const uint64_t id[2],void *data,unsigned int maxlen);
+
+	/**
+	 * Write all pending objects now, blocking until done
+	 */
+	void flush();
+
+	/**
+	 * Ask the background thread to delete peers not written since a given time
+	 *
+	 * @param olderThan Time in ms since epoch
+	 */
+	void cleanPeers(const int64_t olderThan);
+
+	/**
+	 * @return Number of writes waiting for the next flush
+	 */
+	unsigned long pending() const;
+
+private:
+	struct _Key
+	{
+		_Key(const enum ZT_StateObjectType t,const uint64_t id[2]) : type((int)t),id0(id[0]),id1(id[1]) {}
+		inline bool operator<(const _Key &k) const { return ((type < k.type)||((type == k.type)&&((id0 < k.id0)||((id0 == k.id0)&&(id1 < k.id1))))); }
+		int type;
+		uint64_t id0,id1;
+	};
+
+	struct _Pending
+	{
+		_Pending() : erase(false) {}
+		std::string data;
+		bool erase;
+	};
+
+	struct _PeerRecord
+	{
+		_PeerRecord() : offset(0),ts(0),len(0) {}
+		uint64_t offset; // of data, after record header
+		int64_t ts;
+		unsigned int len;
+	};
+
+	bool _path(const int type,const uint64_t id0,char *p,unsigned int plen,char *dirname,unsigned int dlen,bool &secure) const;
+	void _write(const _Key &k,const _Pending &v);
+	int _readFile(const _Key &k,void *data,unsigned int maxlen) const;
+
+	void _openPeers();
+	void _appendPeer(const uint64_t address,const int64_t ts,const void *data,const unsigned int len);
+	int _readPeer(const uint64_t address,void *data,unsigned int maxlen);
+	void _compactPeers(const int64_t olderThan);
+
+	void _threadMain();
+
+	const std::string _homePath;
+	const bool _singleFilePeers;
+
+	std::map<_Key,_Pending> _dirty;
+	std::map<_Key,_Pending> _flushing; // being written by flush(), still visible to get()
+	int64_t _cleanPeersBefore; // if nonzero, run peer expiration on next flush
+	bool _run;
+	mutable std::mutex _lock; // guards above
+	std::condition_variable _wake;
+
+	std::mutex _flush_m; // one flush() at a time
+
+	FILE *_peerFile;
+	Hashtable< uint64_t,_PeerRecord > _peerIndex;
+	uint64_t _peerFileEnd;
+	uint64_t _peerLiveBytes;
+	std::mutex _peer_m; // guards peer file and index
+
+	std::thread _thread;
+};
+
+} // namespace ZeroTier
+
+#endif
@@ -0,0 +1,222 @@
+/*
+ * ZeroTier One - Network Virtualization Everywhere
+ * Copyright (C) 2011-2019  ZeroTier, Inc.  https://www.zerotier.com/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * --
+ *
+ * You can be released from the requirements of the license by purchasing
+ * a commercial license. Buying such a license is mandatory as soon as you
+ * develop commercial closed-source software that incorporates or links
+ * directly against ZeroTier software without disclosing the source code
+ * of your own application.
+ */
+
+
+#include <string.h>
+
+#include <algorithm>
+
+#include "../node/Constants.hpp"
+#include "../node/Utils.hpp"
+#include "OSUtils.hpp"
+#include "TestEthernetTap.hpp"
+
+namespace ZeroTier {
+
+static std::atomic<unsigned int> _testEthernetTapCounter(0);
+
+TestEthernetTap::TestEthernetTap(
+	const char *homePath,
+	const MAC &mac,
+	unsigned int mtu,
+	unsigned int metric,
+	uint64_t nwid,
+	const char *friendlyName,
+	void (*handler)(void *,void *,uint64_t,const MAC &,const MAC &,unsigned int,unsigned int,const void *,unsigned int),
+	void *arg) :
+	_handler(handler),
+	_arg(arg),
+	_nwid(nwid),
+	_mac(mac),
+	_ring(new _Frame[ZT_TEST_ETHERNET_TAP_RING_SIZE]),
+	_ringHead(0),
+	_ringCount(0),
+	_mtu(std::min(mtu,(unsigned int)ZT_MAX_MTU)),
+	_enabled(true),
+	_framesIn(0),
+	_framesOut(0),
+	_drops(0)
+{
+	char tmp[64];
+	OSUtils::ztsnprintf(tmp,sizeof(tmp),"zttest%u",_testEthernetTapCounter++);
+	_dev = tmp;
+}
+
+TestEthernetTap::~TestEthernetTap()
+{
+	delete [] _ring;
+}
+
+void TestEthernetTap::setEnabled(bool en)
+{
+	_enabled = en;
+}
+
+bool TestEthernetTap::enabled() const
+{
+	return _enabled;
+}
+
+bool TestEthernetTap::addIp(const InetAddress &ip)
+{
+	if (!ip)
+		return false;
+	Mutex::Lock _l(_ips_m);
+	if (std::find(_ips.begin(),_ips.end(),ip) == _ips.end()) {
+		_ips.push_back(ip);
+		std::sort(_ips.begin(),_ips.end());
+	}
+	return true;
+}
+
+bool TestEthernetTap::removeIp(const InetAddress &ip)
+{
+	Mutex::Lock _l(_ips_m);
+	std::vector<InetAddress>::iterator i(std::find(_ips.begin(),_ips.end(),ip));
+	if (i == _ips.end())
+		return false;
+	_ips.erase(i);
+	return true;
+}
+
+std::vector<InetAddress> TestEthernetTap::ips() const
+{
+	Mutex::Lock _l(_ips_m);
+	return _ips;
+}
+
+void TestEthernetTap::put(const MAC &from,const MAC &to,unsigned int etherType,const void *data,unsigned int len)
+{
+	if ((!_enabled)||(len > _mtu))
+		return;
+	Mutex::Lock _l(_ring_m);
+	if (_ringCount >= ZT_TEST_ETHERNET_TAP_RING_SIZE) {
+		++_drops;
+		return;
+	}
+	_Frame &f = _ring[(_ringHead + _ringCount) % ZT_TEST_ETHERNET_TAP_RING_SIZE];
+	f.from = from;
+	f.to = to;
+	f.etherType = etherType;
+	f.len = len;
+	memcpy(f.data,data,len);
+	++_ringCount;
+	++_framesIn;
+}
+
+void TestEthernetTap::putBatch(ZT_VirtualNetworkFrame *frames,unsigned int count)
+{
+	if (!_enabled)
+		return;
+	const unsigned int mtu = _mtu;
+	Mutex::Lock _l(_ring_m);
+	for(unsigned int i=0;i<count;++i) {
+		if (frames[i].len > mtu)
+			continue;
+		if (_ringCount >= ZT_TEST_ETHERNET_TAP_RING_SIZE) {
+			_drops += count - i;
+			return;
+		}
+		_Frame &f = _ring[(_ringHead + _ringCount) % ZT_TEST_ETHERNET_TAP_RING_SIZE];
+		f.from = MAC(frames[i].sourceMac);
+		f.to = MAC(frames[i].destMac);
+		f.etherType = frames[i].etherType;
+		f.len = frames[i].len;
+		memcpy(f.data,frames[i].data,frames[i].len);
+		++_ringCount;
+		++_framesIn;
+	}
+}
+
+std::string TestEthernetTap::deviceName() const
+{
+	return _dev;
+}
+
+void TestEthernetTap::setFriendlyName(const char *friendlyName)
+{
+}
+
+void TestEthernetTap::scanMulticastGroups(std::vector<MulticastGroup> &added,std::vector<MulticastGroup> &removed)
+{
+	std::vector<MulticastGroup> newGroups;
+
+	std::vector<InetAddress> allIps(ips());
+	for(std::vector<InetAddress>::iterator ip(allIps.begin());ip!=allIps.end();++ip)
+		newGroups.push_back(MulticastGroup::deriveMulticastGroupForAddressResolution(*ip));
+
+	std::sort(newGroups.begin(),newGroups.end());
+	newGroups.erase(std::unique(newGroups.begin(),newGroups.end()),newGroups.end());
+
+	for(std::vector<MulticastGroup>::iterator m(newGroups.begin());m!=newGroups.end();++m) {
+		if (!std::binary_search(_multicastGroups.begin(),_multicastGroups.end(),*m))
+			added.push_back(*m);
+	}
+	for(std::vector<MulticastGroup>::iterator m(_multicastGroups.begin());m!=_multicastGroups.end();++m) {
+		if (!std::binary_search(newGroups.begin(),newGroups.end(),*m))
+			removed.push_back(*m);
+	}
+
+	_multicastGroups.swap(newGroups);
+}
+
+void TestEthernetTap::setMtu(unsigned int mtu)
+{
+	_mtu = std::min(mtu,(unsigned int)ZT_MAX_MTU);
+}
+
+bool TestEthernetTap::inject(void *tPtr,const MAC &from,const MAC &to,unsigned int etherType,const void *data,unsigned int len)
+{
+	if ((!_enabled)||(len > _mtu))
+		return false;
+	++_framesOut;
+	_handler(_arg,tPtr,_nwid,from,to,etherType,0,data,len);
+	return true;
+}
+
+bool TestEthernetTap::get(MAC &from,MAC &to,unsigned int &etherType,void *data,unsigned int &len)
+{
+	Mutex::Lock _l(_ring_m);
+	if (!_ringCount)
+		return false;
+	const _Frame &f = _ring[_ringHead];
+	from = f.from;
+	to = f.to;
+	etherType = f.etherType;
+	len = f.len;
+	memcpy(data,f.data,f.len);
+	_ringHead = (_ringHead + 1) % ZT_TEST_ETHERNET_TAP_RING_SIZE;
+	--_ringCount;
+	return true;
+}
+
+unsigned int TestEthernetTap::pending() const
+{
+	Mutex::Lock _l(_ring_m);
+	return _ringCount;
+}
+
+} // namespace ZeroTier
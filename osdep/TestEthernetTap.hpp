@@ -0,0 +1,146 @@
+/*
+ * ZeroTier One - Network Virtualization Everywhere
+ * Copyright (C) 2011-2019  ZeroTier, Inc.  https://www.zerotier.com/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * --
+ *
+ * You can be released from the requirements of the license by purchasing
+ * a commercial license. Buying such a license is mandatory as soon as you
+ * develop commercial closed-source software that incorporates or links
+ * directly against ZeroTier software without disclosing the source code
+ * of your own application.
+ */
+
+
+#ifndef ZT_TESTETHERNETTAP_HPP
+#define ZT_TESTETHERNETTAP_HPP
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <string>
+#include <vector>
+#include <atomic>
+
+#include "../node/Mutex.hpp"
+#include "../node/MulticastGroup.hpp"
+#include "EthernetTap.hpp"
+
+/**
+ * Number of frames a TestEthernetTap can hold before put() starts dropping
+ */
+#define ZT_TEST_ETHERNET_TAP_RING_SIZE 256
+
+namespace ZeroTier {
+
+/**
+ * In-memory EthernetTap for tests and benchmarks
+ *
+ * No OS device is created. Frames the node sends to the port (put/putBatch)
+ * land in a preallocated ring and are read back with get(), and frames are
+ * "sent by the OS" with inject(), which calls the handler synchronously on
+ * the calling thread just as a real tap's reader thread would. A full ring
+ * drops frames like a real device queue and counts them.
+ *
+ * EthernetTap::newInstance() returns this when built with ZT_USE_TEST_TAP=1.
+ */
+class TestEthernetTap : public EthernetTap
+{
+public:
+	TestEthernetTap(
+		const char *homePath,
+		const MAC &mac,
+		unsigned int mtu,
+		unsigned int metric,
+		uint64_t nwid,
+		const char *friendlyName,
+		void (*handler)(void *,void *,uint64_t,const MAC &,const MAC &,unsigned int,unsigned int,const void *,unsigned int),
+		void *arg);
+
+	virtual ~TestEthernetTap();
+
+	virtual void setEnabled(bool en);
+	virtual bool enabled() const;
+	virtual bool addIp(const InetAddress &ip);
+	virtual bool removeIp(const InetAddress &ip);
+	virtual std::vector<InetAddress> ips() const;
+	virtual void put(const MAC &from,const MAC &to,unsigned int etherType,const void *data,unsigned int len);
+	virtual void putBatch(ZT_VirtualNetworkFrame *frames,unsigned int count);
+	virtual std::string deviceName() const;
+	virtual void setFriendlyName(const char *friendlyName);
+	virtual void scanMulticastGroups(std::vector<MulticastGroup> &added,std::vector<MulticastGroup> &removed);
+	virtual void setMtu(unsigned int mtu);
+
+	/**
+	 * Pass a frame to the node as if it had been written to the device by the OS
+	 *
+	 * @param tPtr Thread pointer to hand to the handler
+	 * @return False if the tap is disabled or the frame exceeds the MTU
+	 */
+	bool inject(void *tPtr,const MAC &from,const MAC &to,unsigned int etherType,const void *data,unsigned int len);
+
+	/**
+	 * Take the oldest frame the node has delivered to this port
+	 *
+	 * @param data Buffer of at least ZT_MAX_MTU bytes
+	 * @return True if a frame was available
+	 */
+	bool get(MAC &from,MAC &to,unsigned int &etherType,void *data,unsigned int &len);
+
+	/**
+	 * @return Number of frames waiting to be read with get()
+	 */
+	unsigned int pending() const;
+
+	inline uint64_t nwid() const { return _nwid; }
+	inline const MAC &mac() const { return _mac; }
+	inline unsigned int mtu() const { return _mtu; }
+	inline uint64_t framesIn() const { return _framesIn; }
+	inline uint64_t framesOut() const { return _framesOut; }
+	inline uint64_t drops() const { return _drops; }
+
+private:
+	struct _Frame
+	{
+		MAC from;
+		MAC to;
+		unsigned int etherType;
+		unsigned int len;
+		uint8_t data[ZT_MAX_MTU];
+	};
+
+	void (*_handler)(void *,void *,uint64_t,const MAC &,const MAC &,unsigned int,unsigned int,const void *,unsigned int);
+	void *_arg;
+	uint64_t _nwid;
+	MAC _mac;
+	std::string _dev;
+	std::vector<InetAddress> _ips;
+	std::vector<MulticastGroup> _multicastGroups;
+	_Frame *_ring;
+	unsigned int _ringHead; // next slot to read
+	unsigned int _ringCount;
+	std::atomic<unsigned int> _mtu;
+	std::atomic_bool _enabled;
+	std::atomic<uint64_t> _framesIn; // delivered to the port by the node
+	std::atomic<uint64_t> _framesOut; // injected into the node
+	std::atomic<uint64_t> _drops;
+	Mutex _ring_m;
+	Mutex _ips_m;
+};
+
+} // namespace ZeroTier
+
+#endif
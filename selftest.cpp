@@ -33,10 +33,16 @@
 #include <iostream>
 #include <string>
 #include <vector>
+#include <set>
 #include <thread>
+#include <algorithm>
+#include <unordered_map>
+#include <map>
+#include <mutex>
 
 #include "node/Constants.hpp"
 #include "node/Hashtable.hpp"
+#include "node/FlatHashtable.hpp"
 #include "node/RuntimeEnvironment.hpp"
 #include "node/InetAddress.hpp"
 #include "node/Utils.hpp"
@@ -50,13 +56,32 @@
 #include "node/Dictionary.hpp"
 #include "node/SHA512.hpp"
 #include "node/C25519.hpp"
+#include "node/SignatureCache.hpp"
 #include "node/Poly1305.hpp"
 #include "node/CertificateOfMembership.hpp"
 #include "node/Node.hpp"
 #include "node/IncomingPacket.hpp"
+#include "node/PacketSampleTable.hpp"
+#include "node/RunningStatistics.hpp"
+#include "node/FlowTable.hpp"
+#include "node/Topology.hpp"
+#include "node/Trace.hpp"
+#include "node/AdaptiveCompression.hpp"
 
 #include "osdep/OSUtils.hpp"
+#include "osdep/StateStore.hpp"
+#include "osdep/JsonWriter.hpp"
+
+#include "controller/FileDB.hpp"
+#include "controller/EmbeddedNetworkController.hpp"
+
+#ifdef ZT_CONTROLLER_USE_LIBPQ
+#include "controller/PostgreSQL.hpp"
+#include <libpq-fe.h>
+#endif
 #include "osdep/Phy.hpp"
+#include "osdep/Binder.hpp"
+#include "osdep/LoopbackHarness.hpp"
 #include "osdep/PortMapper.hpp"
 #include "osdep/Thread.hpp"
 
@@ -190,6 +215,21 @@ static int testCrypto()
 		std::cout << "FAIL (test vector 1)" << std::endl;
 		return -1;
 	}
+	{
+		// Bulk keystream must match crypt20() over zeroes across the 8/4/1 block paths and calls
+		uint8_t ks1[64 * 45],ks2[64 * 45];
+		memset(ks1,0,sizeof(ks1));
+		s20.init(s20TV0Key,s20TV0Iv);
+		s20.crypt20(ks1,ks1,sizeof(ks1));
+		s20.init(s20TV0Key,s20TV0Iv);
+		s20.keystream20(ks2,3);
+		s20.keystream20(ks2 + (64 * 3),37);
+		s20.keystream20(ks2 + (64 * 40),5);
+		if (memcmp(ks1,ks2,sizeof(ks1))) {
+			std::cout << "FAIL (bulk keystream)" << std::endl;
+			return -1;
+		}
+	}
 	std::cout << "PASS" << std::endl;
 
 #ifdef ZT_SALSA20_SSE
@@ -268,6 +308,22 @@ static int testCrypto()
 		::free((void *)bb);
 	}
 
+	std::cout << "[crypto] Benchmarking Salsa20/20 bulk keystream... "; std::cout.flush();
+	{
+		unsigned char *bb = (unsigned char *)::malloc(64 * 16384);
+		Salsa20 s20(s20TV0Key,s20TV0Iv);
+		long double bytes = 0.0;
+		uint64_t start = OSUtils::now();
+		for(unsigned int i=0;i<16;++i) {
+			s20.keystream20(bb,16384);
+			bytes += 64.0 * 16384.0;
+		}
+		uint64_t end = OSUtils::now();
+		SHA512::hash(buf1,bb,64 * 16384);
+		std::cout << ((bytes / 1048576.0) / ((long double)(end - start) / 1024.0)) << " MiB/second (" << Utils::hex(buf1,16,hexbuf) << ')' << std::endl;
+		::free((void *)bb);
+	}
+
 	std::cout << "[crypto] Testing SHA-512... "; std::cout.flush();
 	SHA512::hash(buf1,sha512TV0Input,(unsigned int)strlen(sha512TV0Input));
 	if (memcmp(buf1,sha512TV0Digest,64)) {
@@ -383,6 +439,35 @@ static int testCrypto()
 	uint64_t et = OSUtils::now();
 	std::cout << ((double)(et - st) / 50.0) << "ms per agreement." << std::endl;
 
+	std::cout << "[crypto] Testing batched C25519 key agreement (" << C25519::agreeBackend(true) << ")... "; std::cout.flush();
+	{
+		const C25519::Public *theirs[7];
+		uint8_t bkeys[7 * 64];
+		for(int k=0;k<7;++k)
+			theirs[k] = &(bp[(k * 3) & 7].pub);
+		C25519::agreeBatch(bp[0].priv,theirs,7,bkeys,64);
+		for(int k=0;k<7;++k) {
+			C25519::agree(bp[0],*(theirs[k]),buf1,64);
+			if (memcmp(buf1,bkeys + (k * 64),64)) {
+				std::cout << "FAIL (1)" << std::endl;
+				return -1;
+			}
+		}
+		std::cout << "PASS" << std::endl;
+
+		std::cout << "[crypto] Benchmarking C25519 key agreement per core... "; std::cout.flush();
+		st = OSUtils::now();
+		for(unsigned int k=0;k<1000;++k)
+			C25519::agree(bp[0],bp[k & 7].pub,buf1,32);
+		et = OSUtils::now();
+		std::cout << (1000000.0 / (double)(et - st)) << "/sec (" << C25519::agreeBackend(false) << "), "; std::cout.flush();
+		st = OSUtils::now();
+		for(unsigned int k=0;k<1000;k+=4)
+			C25519::agreeBatch(bp[0].priv,theirs,4,bkeys,32);
+		et = OSUtils::now();
+		std::cout << (1000000.0 / (double)(et - st)) << "/sec batched (" << C25519::agreeBackend(true) << ")" << std::endl;
+	}
+
 	std::cout << "[crypto] Testing Ed25519 ECC signatures... "; std::cout.flush();
 	C25519::Pair didntSign = C25519::generate();
 	for(unsigned int i=0;i<10;++i) {
@@ -428,6 +513,93 @@ static int testCrypto()
 	et = OSUtils::now();
 	std::cout << ((double)(et - st) / 50.0) << "ms per signature." << std::endl;
 
+	std::cout << "[crypto] Testing Ed25519 batch verification... "; std::cout.flush();
+	{
+		C25519::Pair bkeys[4];
+		for(int k=0;k<4;++k)
+			bkeys[k] = C25519::generate();
+		unsigned char bmsgs[100][32];
+		C25519::Signature bsigs[100];
+		const C25519::Public *bpubs[100];
+		const void *bmsgp[100];
+		unsigned int blens[100];
+		const void *bsigp[100];
+		bool bvalid[100];
+		for(int k=0;k<100;++k) {
+			Utils::getSecureRandom(bmsgs[k],32);
+			bsigs[k] = C25519::sign(bkeys[k & 3],bmsgs[k],32);
+			bpubs[k] = &(bkeys[k & 3].pub);
+			bmsgp[k] = bmsgs[k];
+			blens[k] = 32;
+			bsigp[k] = bsigs[k].data;
+		}
+		if (!C25519::verifyBatch(100,bpubs,bmsgp,blens,bsigp,bvalid)) {
+			std::cout << "FAIL (1)" << std::endl;
+			return -1;
+		}
+		for(int k=0;k<100;++k) {
+			if (!bvalid[k]) {
+				std::cout << "FAIL (2)" << std::endl;
+				return -1;
+			}
+		}
+		bsigs[17].data[5] ^= 0x01; // bad R
+		bsigs[70].data[40] ^= 0x80; // bad S
+		bpubs[90] = &(didntSign.pub); // wrong key
+		if (C25519::verifyBatch(100,bpubs,bmsgp,blens,bsigp,bvalid)) {
+			std::cout << "FAIL (3)" << std::endl;
+			return -1;
+		}
+		for(int k=0;k<100;++k) {
+			if (bvalid[k] != ((k != 17)&&(k != 70)&&(k != 90))) {
+				std::cout << "FAIL (4)" << std::endl;
+				return -1;
+			}
+		}
+		bsigs[17].data[5] ^= 0x01;
+		bsigs[70].data[40] ^= 0x80;
+		bpubs[90] = &(bkeys[90 & 3].pub);
+
+		SignatureCache sc;
+		Identity sid;
+		sid.generate();
+		const C25519::Signature ssig(sid.sign(bmsgs[0],32));
+		C25519::Signature fsig(sid.sign(bmsgs[2],32));
+		fsig.data[40] ^= 0x80; // forged: digest matches but S is wrong
+		SignatureCache::Batch sb;
+		sb.add(sid,bmsgs[0],32,ssig);
+		sb.add(sid,bmsgs[1],32,ssig); // signature does not match this message
+		sb.add(sid,bmsgs[2],32,fsig);
+		if (sc.verify(sb) != 2) {
+			std::cout << "FAIL (5)" << std::endl;
+			return -1;
+		}
+		if ((sc.verify(sb) != 0)||(!sc.verify(sid,bmsgs[0],32,ssig))||(sc.verify(sid,bmsgs[1],32,ssig))||(sc.verify(sid,bmsgs[2],32,fsig))) {
+			std::cout << "FAIL (6)" << std::endl;
+			return -1;
+		}
+		std::cout << "PASS" << std::endl;
+
+		std::cout << "[crypto] Benchmarking Ed25519 batch verification... "; std::cout.flush();
+		st = OSUtils::now();
+		for(int r=0;r<10;++r) {
+			for(int k=0;k<100;++k)
+				C25519::verify(*(bpubs[k]),bmsgp[k],blens[k],bsigp[k]);
+		}
+		et = OSUtils::now();
+		std::cout << ((double)(et - st) / 1000.0) << "ms individually, "; std::cout.flush();
+		st = OSUtils::now();
+		for(int r=0;r<10;++r)
+			C25519::verifyBatch(100,bpubs,bmsgp,blens,bsigp,bvalid);
+		et = OSUtils::now();
+		std::cout << ((double)(et - st) / 1000.0) << "ms batched, "; std::cout.flush();
+		st = OSUtils::now();
+		for(int r=0;r<1000;++r)
+			sc.verify(sid,bmsgs[0],32,ssig);
+		et = OSUtils::now();
+		std::cout << ((double)(et - st) / 1000.0) << "ms cached per signature." << std::endl;
+	}
+
 	return 0;
 }
 
@@ -478,6 +650,31 @@ static int testIdentity()
 		}
 	}
 
+	{
+		const unsigned int threads = std::max(std::thread::hardware_concurrency(),1U);
+		std::cout << "[identity] Benchmarking generation with " << threads << " thread(s)... "; std::cout.flush();
+		const uint64_t genstart = OSUtils::now();
+		for(unsigned int k=0;k<8;++k) {
+			id.generate(0);
+			if (!id.locallyValidate()) {
+				std::cout << "FAIL (" << id.toString(false,buf2) << ")" << std::endl;
+				return -1;
+			}
+		}
+		const uint64_t genend = OSUtils::now();
+		std::cout << (8000.0 / (double)std::max(genend - genstart,(uint64_t)1)) << " identities/second" << std::endl;
+
+		std::cout << "[identity] Generate with 4-bit address prefix... "; std::cout.flush();
+		for(unsigned int k=0;k<3;++k) {
+			id.generate(0,(uint64_t)(k + 0xd),4);
+			if (((id.address().toInt() >> 36) != (uint64_t)(k + 0xd))||(!id.locallyValidate())) {
+				std::cout << "FAIL (" << id.address().toString(buf2) << ")" << std::endl;
+				return -1;
+			}
+		}
+		std::cout << "PASS (" << id.address().toString(buf2) << ")" << std::endl;
+	}
+
 	{
 		Identity id2;
 		buf.clear();
@@ -637,6 +834,78 @@ static int testPacket()
 	}
 
 	std::cout << "PASS" << std::endl;
+
+	std::cout << "[packet] Testing decompression of large packets... ";
+	{
+		// The second packet fills the buffer and barely compresses, so its
+		// compressed payload is nearly as large as the packet can be
+		static char frame[ZT_PROTO_MAX_PACKET_LENGTH - ZT_PACKET_IDX_PAYLOAD];
+		const unsigned int sizes[2] = { 9000,(unsigned int)sizeof(frame) };
+		for(unsigned int t=0;t<2;++t) {
+			for(unsigned int i=0;i<sizes[t];++i)
+				frame[i] = (t == 0) ? (((i & 0x3ff) < 0x200) ? (char)(i % 17) : (char)rand()) : ((i < 512) ? (char)0 : (char)rand());
+			a.reset(Address(),Address(),Packet::VERB_FRAME);
+			a.append(frame,sizes[t]);
+			b = a;
+			if ((!a.compress())||(!a.uncompress())||(a != b)) {
+				std::cout << "FAIL" << std::endl;
+				return -1;
+			}
+		}
+	}
+	std::cout << "PASS" << std::endl;
+
+	std::cout << "[packet] Benchmarking adaptive compression on TLS-like (incompressible) traffic..." << std::endl;
+	{
+		// TLS records look like random bytes to LZ4; 1400 bytes approximates a full-MTU record
+		char tls[1400];
+		Utils::getSecureRandom(tls,sizeof(tls));
+		const unsigned int count = 50000;
+		int64_t simNow = 0;
+		AdaptiveCompression ac;
+		unsigned int compressions[2] = { 0,0 };
+		int64_t elapsed[2] = { 0,0 };
+		for(unsigned int mode=0;mode<2;++mode) {
+			const int64_t start = OSUtils::now();
+			for(unsigned int k=0;k<count;++k) {
+				tls[k % sizeof(tls)] ^= (char)k;
+				a.reset(Address(),Address(),Packet::VERB_FRAME);
+				a.append(tls,sizeof(tls));
+				if ((mode == 0)||(ac.shouldCompress(1,simNow))) {
+					++compressions[mode];
+					const unsigned int before = a.payloadLength();
+					a.compress();
+					if (mode == 1)
+						ac.sample(before,a.payloadLength(),simNow);
+				}
+				if ((k % 10) == 0)
+					++simNow; // ~10 packets/ms, about 110Mbps
+			}
+			elapsed[mode] = OSUtils::now() - start;
+		}
+		std::cout << "[packet]   always compress: " << compressions[0] << " compressions, " << elapsed[0] << "ms" << std::endl;
+		std::cout << "[packet]   adaptive:        " << compressions[1] << " compressions, " << elapsed[1] << "ms (" << (((compressions[0] - compressions[1]) * 100) / compressions[0]) << "% of compression work skipped)" << std::endl;
+		if ((ac.backoff() == 0)||(compressions[1] >= (compressions[0] / 4))) {
+			std::cout << "[packet]   FAIL (did not back off on incompressible traffic)" << std::endl;
+			return -1;
+		}
+
+		// Compressible traffic on the same slot should never trigger back-off
+		AdaptiveCompression ac2;
+		for(unsigned int k=0;k<(ZT_COMPRESSION_SAMPLE_WINDOW * 4);++k) {
+			a.reset(Address(),Address(),Packet::VERB_FRAME);
+			for(int i=0;i<32;++i)
+				a.append("supercalifragilisticexpealidocious",(unsigned int)strlen("supercalifragilisticexpealidocious"));
+			if (!ac2.shouldCompress(1,k)) {
+				std::cout << "[packet]   FAIL (backed off on compressible traffic)" << std::endl;
+				return -1;
+			}
+			const unsigned int before = a.payloadLength();
+			a.compress();
+			ac2.sample(before,a.payloadLength(),k);
+		}
+	}
+
 	return 0;
 }
 
@@ -835,6 +1104,301 @@ static int testOther()
 	std::cout << "PASS" << std::endl;
 #endif
 
+	std::cout << "[other] Testing FlatHashtable... "; std::cout.flush();
+	{
+		FlatHashtable<uint64_t,std::string> ht(4);
+		std::unordered_map<uint64_t,std::string> ref;
+		for(int i=0;i<200000;++i) {
+			const uint64_t k = (uint64_t)(rand() % 20000) << ((rand() & 1) ? 40 : 0); // collide in low bits too
+			switch(rand() % 4) {
+				case 0:
+				case 1: {
+					char v[24];
+					OSUtils::ztsnprintf(v,sizeof(v),"%d",i);
+					ht.set(k,v);
+					ref[k] = v;
+				}	break;
+				case 2:
+					if (ht.erase(k) != (ref.erase(k) > 0)) {
+						std::cout << "FAILED! (erase)" << std::endl;
+						return -1;
+					}
+					break;
+				default: {
+					const std::string *const v = ht.get(k);
+					std::unordered_map<uint64_t,std::string>::const_iterator r(ref.find(k));
+					if ((!v) != (r == ref.end())) {
+						std::cout << "FAILED! (get)" << std::endl;
+						return -1;
+					}
+					if ((v)&&(*v != r->second)) {
+						std::cout << "FAILED! (get, data mismatch)" << std::endl;
+						return -1;
+					}
+				}	break;
+			}
+		}
+		if (ht.size() != ref.size()) {
+			std::cout << "FAILED! (size mismatch)" << std::endl;
+			return -1;
+		}
+
+		FlatHashtable<uint64_t,std::string> ht2;
+		ht2 = ht;
+		FlatHashtable<uint64_t,std::string> ht3(ht2);
+		for(std::unordered_map<uint64_t,std::string>::const_iterator r(ref.begin());r!=ref.end();++r) {
+			const std::string *const v = ht3.get(r->first);
+			if ((!v)||(*v != r->second)) {
+				std::cout << "FAILED! (copy)" << std::endl;
+				return -1;
+			}
+		}
+
+		// Erase every other entry while iterating and make sure nothing is skipped or seen twice
+		unsigned long seen = 0,erased = 0;
+		{
+			FlatHashtable<uint64_t,std::string>::Iterator i(ht);
+			uint64_t *k = (uint64_t *)0;
+			std::string *v = (std::string *)0;
+			while (i.next(k,v)) {
+				if ((ref.count(*k) == 0)||(ref[*k] != *v)) {
+					std::cout << "FAILED! (iterate)" << std::endl;
+					return -1;
+				}
+				if ((seen++ & 1) == 0) {
+					ref.erase(*k);
+					ht.erase(*k);
+					++erased;
+				}
+			}
+		}
+		if ((seen != ht2.size())||(ht.size() != ref.size())||(ht.size() != (ht2.size() - erased))) {
+			std::cout << "FAILED! (iterate with erase, " << seen << " of " << ht2.size() << ")" << std::endl;
+			return -1;
+		}
+		for(std::unordered_map<uint64_t,std::string>::const_iterator r(ref.begin());r!=ref.end();++r) {
+			if (!ht.contains(r->first)) {
+				std::cout << "FAILED! (iterate with erase, lost key)" << std::endl;
+				return -1;
+			}
+		}
+
+		ht.clear();
+		if ((!ht.empty())||(ht3.size() != ht2.size())) {
+			std::cout << "FAILED! (clear)" << std::endl;
+			return -1;
+		}
+	}
+	std::cout << "PASS" << std::endl;
+
+	std::cout << "[other] Testing JsonWriter... "; std::cout.flush();
+	{
+		std::set<std::string> fields;
+		fields.insert("id");
+		fields.insert("list");
+		std::string out;
+		JsonWriter w(out);
+		w.beginArray();
+		for(int i=0;i<3;++i) {
+			w.beginObject(&fields);
+			if (w.key("id")) w.value(i);
+			if (w.key("skipped")) w.value("not written");
+			if (w.key("list")) {
+				w.beginArray();
+				w.value("a\"b\\c\n\x01");
+				w.value(18446744073709551615ULL);
+				w.value(-9223372036854775807LL);
+				w.value(true);
+				w.null();
+				w.beginObject();
+				w.key("skipped");
+				w.value(false);
+				w.endObject();
+				w.endArray();
+			}
+			w.endObject();
+		}
+		w.endArray();
+		try {
+			const nlohmann::json j(OSUtils::jsonParse(out));
+			if ((j.size() != 3)||(j[2].size() != 2)||(j[2]["id"] != 2)||(j[1]["list"][0] != "a\"b\\c\n\x01")||(j[1]["list"][1] != 18446744073709551615ULL)||(j[1]["list"][2] != -9223372036854775807LL)||(j[0]["list"][5]["skipped"] != false)) {
+				std::cout << "FAILED! (wrong content: " << out << ")" << std::endl;
+				return -1;
+			}
+		} catch ( ... ) {
+			std::cout << "FAILED! (invalid JSON: " << out << ")" << std::endl;
+			return -1;
+		}
+	}
+	std::cout << "PASS" << std::endl;
+
+	std::cout << "[other] Testing PacketSampleTable... "; std::cout.flush();
+	{
+		PacketSampleTable<256> *pst = new PacketSampleTable<256>();
+		unsigned int added = 0;
+		for(uint64_t i=1;i<=128;++i) {
+			if (pst->add(i << 4,(int64_t)i))
+				++added;
+		}
+		if ((added < 120)||(pst->count() != added)) {
+			std::cout << "FAILED (add, " << added << ")" << std::endl;
+			return -1;
+		}
+		int64_t v = 0;
+		if ((pst->take(3 << 4,v))&&(v != 3)) {
+			std::cout << "FAILED (take returned wrong value)" << std::endl;
+			return -1;
+		}
+		if (pst->take(3 << 4,v)) {
+			std::cout << "FAILED (take returned removed sample)" << std::endl;
+			return -1;
+		}
+		pst->expire(65);
+		uint64_t ids[256];
+		int64_t vs[256];
+		const unsigned int n = pst->drain(ids,vs,256);
+		for(unsigned int i=0;i<n;++i) {
+			if ((vs[i] < 65)||(ids[i] != ((uint64_t)vs[i] << 4))) {
+				std::cout << "FAILED (drain returned bad sample)" << std::endl;
+				return -1;
+			}
+		}
+		if (pst->count() != 0) {
+			std::cout << "FAILED (not empty after drain)" << std::endl;
+			return -1;
+		}
+		delete pst;
+	}
+	std::cout << "PASS" << std::endl;
+
+	std::cout << "[other] Testing RunningStatistics... "; std::cout.flush();
+	{
+		RunningStatistics<uint32_t,16> rs;
+		for(uint32_t i=0;i<100;++i)
+			rs.push(i);
+		// Window now holds 84..99: mean 91.5, sample variance 22.666...
+		if ((rs.count() != 16)||(fabs(rs.mean() - 91.5f) > 0.001f)||(fabs(rs.variance() - (68.0f / 3.0f)) > 0.001f)) {
+			std::cout << "FAILED (mean " << rs.mean() << ", variance " << rs.variance() << ")" << std::endl;
+			return -1;
+		}
+	}
+	std::cout << "PASS" << std::endl;
+
+	std::cout << "[other] Testing FlowTable... "; std::cout.flush();
+	{
+		FlowTable<int,16> ft;
+		int p = -1;
+		ft.set(12345,1000,1);
+		if ((!ft.get(12345,1100,ZT_MULTIPATH_FLOWLET_TIMEOUT,p))||(p != 1)||(ft.get(54321,1100,ZT_MULTIPATH_FLOWLET_TIMEOUT,p))||(ft.get(12345,1100 + ZT_MULTIPATH_FLOWLET_TIMEOUT,ZT_MULTIPATH_FLOWLET_TIMEOUT,p))) {
+			std::cout << "FAILED (pinning or flowlet expiry incorrect)" << std::endl;
+			return -1;
+		}
+	}
+	std::cout << "PASS" << std::endl;
+
+	std::cout << "[other] Simulating random vs. flow-hashed multipath over two links of differing latency and loss..." << std::endl;
+	{
+		// A real Peer with two learned paths chooses the path for each packet
+		// through getAppropriatePath(). Link 0: 10ms +/- 2ms, 0.2% loss. Link 1:
+		// 45ms +/- 5ms, 1% loss. Links are FIFO.
+		static const int64_t linkLatency[2] = { 10000,45000 }; // microseconds
+		static const int64_t linkJitter[2] = { 2000,5000 };
+		static const unsigned int linkLossPerMillion[2] = { 2000,10000 };
+		static const unsigned int flowCount = 16;
+		struct SimPkt { int64_t arrival; unsigned int flow; unsigned int seq; };
+
+		LoopbackHarness::Wire w;
+		LoopbackHarness h(3,w); // nodes 1 and 2 supply two addresses the path check accepts
+		Node *const node = reinterpret_cast<Node *>(h.node(0));
+		RuntimeEnvironment renv(node);
+		renv.identity = node->identity();
+		Trace trace(&renv);
+		renv.t = &trace;
+		Topology topology(&renv,(void *)0);
+		renv.topology = &topology;
+		Identity remote;
+		remote.generate();
+
+		uint64_t simRand = 0x9e3779b97f4a7c15ULL;
+		for(unsigned int mode=0;mode<2;++mode) {
+			node->setMultipathMode((mode == 0) ? ZT_MULTIPATH_RANDOM : ZT_MULTIPATH_BALANCE_FLOW_HASH);
+			SharedPtr<Peer> peer(new Peer(&renv,renv.identity,remote));
+			peer->setRemoteVersion(ZT_PROTO_VERSION,1,4,6);
+			// Both paths share the unspecified local socket, so each is learned
+			// before the other is marked alive or it would count as redundant.
+			SharedPtr<Path> links[2];
+			for(unsigned int l=0;l<2;++l) {
+				const uint32_t ip = Utils::hton((uint32_t)(0x0a000001 | ((l + 1) << 8)));
+				links[l].set(new Path(-1,InetAddress(&ip,4,ZT_LOOPBACK_PORT)));
+				peer->received((void *)0,links[l],0,(uint64_t)(l + 1),0,Packet::VERB_OK,0,Packet::VERB_HELLO,false,0);
+			}
+			links[0]->received(node->now());
+			links[1]->received(node->now());
+			const int64_t base = node->now() + ZT_PATH_QUALITY_COMPUTE_INTERVAL;
+			peer->doPingAndKeepalive((void *)0,base);
+			if (!peer->canUseMultipath()) {
+				std::cout << "[other]   FAILED (peer did not enable multipath over two paths)" << std::endl;
+				return -1;
+			}
+
+			const int64_t start = OSUtils::now();
+			std::vector<SimPkt> delivered;
+			unsigned long linkSent[2] = { 0,0 };
+			unsigned long sent = 0;
+			for(unsigned int f=1;f<=flowCount;++f) {
+				const uint64_t flowId = (uint64_t)f * 0x9e3779b97f4a7c15ULL;
+				int64_t linkTail[2] = { 0,0 };
+				unsigned int seq = 0;
+				int64_t t = (int64_t)(f * 977);
+				while (t < 5000000LL) { // 5 simulated seconds of on/off traffic per flow
+					simRand ^= simRand << 13; simRand ^= simRand >> 7; simRand ^= simRand << 17;
+					const unsigned int burst = 20 + (unsigned int)(simRand % 180);
+					for(unsigned int b=0;b<burst;++b,t+=500) {
+						simRand ^= simRand << 13; simRand ^= simRand >> 7; simRand ^= simRand << 17;
+						const int64_t now = base + (t / 1000);
+						links[0]->received(now);
+						links[1]->received(now);
+						const SharedPtr<Path> via(peer->getAppropriatePath(now,false,flowId));
+						const int link = (via == links[0]) ? 0 : ((via == links[1]) ? 1 : -1);
+						if (link < 0) {
+							std::cout << "[other]   FAILED (no path chosen)" << std::endl;
+							return -1;
+						}
+						peer->recordOutgoingPacket(via,simRand,1400,Packet::VERB_FRAME,now);
+						++linkSent[link];
+						++sent;
+						if ((unsigned int)((simRand >> 8) % 1000000) < linkLossPerMillion[link])
+							continue;
+						int64_t arrival = t + linkLatency[link] + (int64_t)((simRand >> 32) % (uint64_t)(linkJitter[link] * 2)) - linkJitter[link];
+						if (arrival < linkTail[link])
+							arrival = linkTail[link];
+						linkTail[link] = arrival;
+						SimPkt sp;
+						sp.arrival = arrival; sp.flow = f; sp.seq = seq++;
+						delivered.push_back(sp);
+					}
+					simRand ^= simRand << 13; simRand ^= simRand >> 7; simRand ^= simRand << 17;
+					t += (int64_t)(simRand % 1000000); // idle 0-1000ms between bursts
+				}
+			}
+			std::stable_sort(delivered.begin(),delivered.end(),[](const SimPkt &a,const SimPkt &b) { return ((a.flow < b.flow)||((a.flow == b.flow)&&(a.arrival < b.arrival))); });
+			unsigned long reordered = 0;
+			unsigned int highestSeq = 0;
+			for(std::vector<SimPkt>::const_iterator sp(delivered.begin());sp!=delivered.end();++sp) {
+				if ((sp != delivered.begin())&&((sp - 1)->flow == sp->flow)&&(sp->seq < highestSeq))
+					++reordered;
+				else highestSeq = sp->seq;
+			}
+			const int64_t end = OSUtils::now();
+			std::cout << "[other]   " << ((mode == 0) ? "random:      " : "flow-hashed: ") << sent << " sent, " << delivered.size() << " delivered, " << reordered << " reordered (" << ((double)reordered * 100.0 / (double)delivered.size()) << "%), link share " << ((double)linkSent[0] * 100.0 / (double)sent) << "% / " << ((double)linkSent[1] * 100.0 / (double)sent) << "% (" << (end - start) << "ms)" << std::endl;
+			if ((mode == 1)&&((reordered)||(linkSent[0] == 0)||(linkSent[1] == 0))) {
+				std::cout << "[other]   FAILED (flow-hashed multipath reordered packets or did not use both links)" << std::endl;
+				return -1;
+			}
+		}
+		node->setMultipathMode(ZT_MULTIPATH_NONE);
+	}
+
 	std::cout << "[other] Testing/fuzzing Dictionary... "; std::cout.flush();
 	for(int k=0;k<1000;++k) {
 		Dictionary<8194> *test = new Dictionary<8194>();
@@ -908,6 +1472,8 @@ struct TestPhyHandlers
 	inline void phyOnDatagram(PhySocket *sock,void **uptr,const struct sockaddr *localAddr,const struct sockaddr *from,void *data,unsigned long len)
 	{
 		++phyTestUdpPacketCount;
+		if (*uptr) // per-socket count for shard steering test
+			++*reinterpret_cast<unsigned long *>(*uptr);
 	}
 
 	inline void phyOnTcpConnect(PhySocket *sock,void **uptr,bool success)
@@ -1011,6 +1577,75 @@ static int testPhy()
 	}
 	std::cout << "got " << phyTestUdpPacketCount << " packets, OK" << std::endl;
 
+	std::cout << "[phy] Testing UDP send with per-packet TTL... "; std::cout.flush();
+	{
+		const unsigned long before = phyTestUdpPacketCount;
+		PhySocket *const socks[2] = { udpListenSock,udpListenSock };
+		timeoutAt = OSUtils::now() + ZT_TEST_PHY_TIMEOUT_MS;
+		for(unsigned int k=0;k<8;++k) {
+			if ((!testPhyInstance->udpSend(udpListenSock,(const struct sockaddr *)&bindaddr,udpTestPayload,sizeof(udpTestPayload),2))||
+			    (!testPhyInstance->udpSendMulti(socks,2,(const struct sockaddr *)&bindaddr,udpTestPayload,sizeof(udpTestPayload),3))) {
+				std::cout << "FAILED (send)" << std::endl;
+				return -1;
+			}
+		}
+		while (((uint64_t)OSUtils::now() < timeoutAt)&&((phyTestUdpPacketCount - before) < 24))
+			testPhyInstance->poll(100);
+		if ((phyTestUdpPacketCount - before) < 24) {
+			std::cout << "FAILED (got " << (phyTestUdpPacketCount - before) << " packets)" << std::endl;
+			return -1;
+		}
+		std::cout << "got " << (phyTestUdpPacketCount - before) << " packets, OK" << std::endl;
+	}
+
+#ifdef ZT_BINDER_UDP_SHARDING
+	std::cout << "[phy] Testing SO_REUSEPORT shard steering by source address... "; std::cout.flush();
+	{
+		struct sockaddr_in shardaddr;
+		memset(&shardaddr,0,sizeof(shardaddr));
+		shardaddr.sin_family = AF_INET;
+		shardaddr.sin_port = Utils::hton((uint16_t)60006);
+		shardaddr.sin_addr.s_addr = Utils::hton((uint32_t)0x7f000001);
+		unsigned long shardCounts[3] = { 0,0,0 };
+		PhySocket *shardSocks[3];
+		for(unsigned int k=0;k<3;++k) {
+			shardSocks[k] = testPhyInstance->udpBind((const struct sockaddr *)&shardaddr,(void *)&(shardCounts[k]),0,true);
+			if (!shardSocks[k]) {
+				std::cout << "FAILED (bind)" << std::endl;
+				return -1;
+			}
+		}
+		if (!Binder::attachShardSteering((int)Phy<TestPhyHandlers *>::getDescriptor(shardSocks[0]),3)) {
+			std::cout << "not supported by kernel, SKIPPED" << std::endl;
+		} else {
+			// 12 packets from each of three source addresses: fake heads with source at bytes 13-17
+			char head[64];
+			memset(head,0,sizeof(head));
+			for(unsigned int src=0;src<3;++src) {
+				head[13] = 0x12;
+				head[14] = 0x34;
+				head[15] = 0x56;
+				head[16] = 0x00;
+				head[17] = (char)(0x30 + src); // 0x30 % 3 == 0 so address % 3 == src
+				for(unsigned int k=0;k<12;++k) {
+					head[0] = (char)k; // vary packet ID, steering must not depend on it
+					testPhyInstance->udpSend(udpListenSock,(const struct sockaddr *)&shardaddr,head,sizeof(head));
+				}
+			}
+			timeoutAt = OSUtils::now() + ZT_TEST_PHY_TIMEOUT_MS;
+			while (((uint64_t)OSUtils::now() < timeoutAt)&&((shardCounts[0] + shardCounts[1] + shardCounts[2]) < 36))
+				testPhyInstance->poll(100);
+			if ((shardCounts[0] != 12)||(shardCounts[1] != 12)||(shardCounts[2] != 12)) {
+				std::cout << "FAILED (" << shardCounts[0] << "/" << shardCounts[1] << "/" << shardCounts[2] << ")" << std::endl;
+				return -1;
+			}
+			std::cout << "12/12/12, OK" << std::endl;
+		}
+		for(unsigned int k=0;k<3;++k)
+			testPhyInstance->close(shardSocks[k],false);
+	}
+#endif
+
 	std::cout << "[phy] Testing TCP... "; std::cout.flush();
 	timeoutAt = OSUtils::now() + ZT_TEST_PHY_TIMEOUT_MS;
 	while ((OSUtils::now() < timeoutAt)&&(phyTestTcpByteCount < (ZT_TEST_PHY_NUM_VALID_TCP_CONNECTS * ZT_TEST_PHY_TCP_MESSAGE_SIZE))) {
@@ -1038,6 +1673,666 @@ static int testPhy()
 	return 0;
 }
 
+static unsigned long _countMembers(FileDB &db,const uint64_t nwid)
+{
+	nlohmann::json network;
+	std::vector<nlohmann::json> members;
+	db.get(nwid,network,members);
+	return (unsigned long)members.size();
+}
+
+static int testFileDB()
+{
+	const char *const path = "zt-selftest-filedb";
+	const uint64_t nwids[2] = { 0x8056c2e21c000001ULL,0x8056c2e21c000002ULL };
+	const unsigned long count = 10000;
+	char tmp[64];
+	OSUtils::rmDashRf(path);
+
+	std::cout << "[filedb] Writing " << count << " members in per-file layout... "; std::cout.flush();
+	{
+		FileDB db(path);
+		for(int n=0;n<2;++n) {
+			nlohmann::json network;
+			OSUtils::ztsnprintf(tmp,sizeof(tmp),"%.16llx",(unsigned long long)nwids[n]);
+			network["id"] = tmp;
+			network["nwid"] = tmp;
+			DB::initNetwork(network);
+			db.save(network,false);
+		}
+		for(unsigned long i=0;i<count;++i) {
+			nlohmann::json member;
+			OSUtils::ztsnprintf(tmp,sizeof(tmp),"%.16llx",(unsigned long long)nwids[i & 1]);
+			member["nwid"] = tmp;
+			OSUtils::ztsnprintf(tmp,sizeof(tmp),"%.10llx",(unsigned long long)(0x1000000000ULL + i));
+			member["id"] = tmp;
+			member["address"] = tmp;
+			DB::initMember(member);
+			member["authorized"] = true;
+			db.save(member,false);
+		}
+	}
+	std::cout << "OK" << std::endl;
+
+	int64_t start = OSUtils::now();
+	{
+		FileDB db(path);
+		if ((_countMembers(db,nwids[0]) + _countMembers(db,nwids[1])) != count) {
+			std::cout << "[filedb] FAILED (per-file load)" << std::endl;
+			return -1;
+		}
+	}
+	std::cout << "[filedb] Per-file load: " << (OSUtils::now() - start) << "ms" << std::endl;
+
+	std::cout << "[filedb] Importing per-file layout into record log... "; std::cout.flush();
+	start = OSUtils::now();
+	{
+		FileDB db(path,true);
+		if ((_countMembers(db,nwids[0]) + _countMembers(db,nwids[1])) != count) {
+			std::cout << "FAILED (import)" << std::endl;
+			return -1;
+		}
+		db.eraseMember(nwids[0],0x1000000000ULL);
+		nlohmann::json network,member;
+		db.get(nwids[1],network,0x1000000001ULL,member);
+		member["authorized"] = false;
+		db.save(member,false);
+	}
+	std::cout << (OSUtils::now() - start) << "ms" << std::endl;
+
+	for(int pass=0;pass<3;++pass) {
+		if (pass == 2) {
+			// A torn append at the tail must not lose earlier records
+			FILE *f = fopen((std::string(path) + ZT_PATH_SEPARATOR_S ZT_FILEDB_LOG_FILE).c_str(),"ab");
+			if (f) {
+				fwrite("\0\0\1\0junk",1,8,f);
+				fclose(f);
+			}
+		}
+		start = OSUtils::now();
+		FileDB db(path,true);
+		const int64_t end = OSUtils::now();
+		nlohmann::json network,member,member2;
+		const bool erased = !db.get(nwids[0],network,0x1000000000ULL,member);
+		db.get(nwids[1],network,0x1000000001ULL,member);
+		db.get(nwids[1],network,0x1000000003ULL,member2);
+		if ((!erased)||(OSUtils::jsonBool(member["authorized"],true))||((pass > 0)&&(OSUtils::jsonBool(member2["authorized"],true)))||((_countMembers(db,nwids[0]) + _countMembers(db,nwids[1])) != (count - 1))) {
+			std::cout << "[filedb] FAILED (replay pass " << pass << ")" << std::endl;
+			return -1;
+		}
+		std::cout << "[filedb] Record log replay " << ((pass == 0) ? "(snapshot + log)" : ((pass == 1) ? "(compacted)" : "(torn tail)")) << ": " << (end - start) << "ms" << std::endl;
+		if (pass == 0) {
+			// Writes logged while a snapshot is being written must survive the log swap
+			std::thread compactor([&db]() { db.compact(); });
+			member2["authorized"] = false;
+			db.save(member2,false);
+			compactor.join();
+		}
+	}
+
+	OSUtils::rmDashRf(path);
+	return 0;
+}
+
+static int testStateStore()
+{
+	const char *const path = "zt-selftest-statestore";
+	const unsigned long count = 2000;
+	char tmp[256];
+	uint64_t id[2];
+	OSUtils::rmDashRf(path);
+	OSUtils::mkdir(path);
+
+	for(int singleFile=0;singleFile<2;++singleFile) {
+		std::cout << "[statestore] Testing " << ((singleFile) ? "single file" : "per-file") << " peer storage... "; std::cout.flush();
+		{
+			StateStore ss(path,singleFile != 0);
+			for(int pass=0;pass<3;++pass) { // rewrites should coalesce and leave dead records to compact
+				for(unsigned long i=0;i<count;++i) {
+					id[0] = 0x1000000000ULL + i;
+					id[1] = 0;
+					const int l = OSUtils::ztsnprintf(tmp,sizeof(tmp),"peer %lu pass %d",i,pass);
+					ss.put(ZT_STATE_OBJECT_PEER,id,tmp,l);
+				}
+				ss.flush();
+			}
+			id[0] = 0x8056c2e21c000001ULL;
+			ss.put(ZT_STATE_OBJECT_NETWORK_CONFIG,id,"netconf",7);
+			id[0] = 0x1000000000ULL;
+			ss.put(ZT_STATE_OBJECT_PEER,id,(const void *)0,-1);
+			if ((ss.get(ZT_STATE_OBJECT_PEER,id,tmp,sizeof(tmp)) != -1)||(ss.pending() != 2)) {
+				std::cout << "FAILED (read before flush)" << std::endl;
+				return -1;
+			}
+		}
+		{
+			StateStore ss(path,singleFile != 0);
+			id[0] = 0x8056c2e21c000001ULL;
+			id[1] = 0;
+			if ((ss.get(ZT_STATE_OBJECT_NETWORK_CONFIG,id,tmp,sizeof(tmp)) != 7)||(memcmp(tmp,"netconf",7) != 0)) {
+				std::cout << "FAILED (network config)" << std::endl;
+				return -1;
+			}
+			for(unsigned long i=0;i<count;++i) {
+				id[0] = 0x1000000000ULL + i;
+				char expected[256];
+				const int el = (i == 0) ? -1 : OSUtils::ztsnprintf(expected,sizeof(expected),"peer %lu pass 2",i);
+				const int l = ss.get(ZT_STATE_OBJECT_PEER,id,tmp,sizeof(tmp));
+				if ((l != el)||((l > 0)&&(memcmp(tmp,expected,l) != 0))) {
+					std::cout << "FAILED (peer " << i << " after reopen)" << std::endl;
+					return -1;
+				}
+			}
+			if (singleFile) {
+				// Only the latest record for each peer should have survived compaction
+				const uint64_t sz = OSUtils::getFileSize((std::string(path) + ZT_PATH_SEPARATOR_S "peers.dat").c_str());
+				if (sz > (count * 64)) {
+					std::cout << "FAILED (peers.dat not compacted, " << sz << " bytes)" << std::endl;
+					return -1;
+				}
+			}
+			ss.cleanPeers(OSUtils::now() + 1000);
+			ss.flush();
+			id[0] = 0x1000000001ULL;
+			if ((singleFile)&&(ss.get(ZT_STATE_OBJECT_PEER,id,tmp,sizeof(tmp)) != -1)) {
+				std::cout << "FAILED (peers not cleaned)" << std::endl;
+				return -1;
+			}
+		}
+		std::cout << "OK" << std::endl;
+	}
+
+	OSUtils::rmDashRf(path);
+	return 0;
+}
+
+class _BenchDB : public DB
+{
+public:
+	virtual bool waitForReady() { return true; }
+	virtual bool isReady() { return true; }
+	virtual bool save(nlohmann::json &record,bool notifyListeners) { return false; }
+	virtual void eraseNetwork(const uint64_t networkId) {}
+	virtual void eraseMember(const uint64_t networkId,const uint64_t memberId) {}
+	virtual void nodeIsOnline(const uint64_t networkId,const uint64_t memberId,const InetAddress &physicalAddress) {}
+	inline void load(nlohmann::json &record)
+	{
+		nlohmann::json old;
+		if (record["objtype"] == "network")
+			_networkChanged(old,record,false);
+		else _memberChanged(old,record,false);
+	}
+	inline void unload(nlohmann::json &record)
+	{
+		nlohmann::json empty;
+		_memberChanged(record,empty,false);
+	}
+	inline unsigned long memberBytes()
+	{
+		unsigned long b = 0;
+		RWMutex::RLock l(_networks_l);
+		for(auto n=_networks.begin();n!=_networks.end();++n) {
+			RWMutex::RLock l2(n->second->lock);
+			for(auto m=n->second->members.begin();m!=n->second->members.end();++m)
+				b += m->second.sizeBytes();
+		}
+		return b;
+	}
+};
+
+// Set ZT_SELFTEST_CONTROLLER_MEMBERS to change the size of the synthetic member DB
+static int testControllerDB()
+{
+	char tmp[ZT_IDENTITY_STRING_BUFFER_LENGTH];
+	Identity id;
+	id.generate();
+	const std::string idStr(id.toString(false,tmp));
+
+	std::cout << "[controller] Testing compact member record round trip... "; std::cout.flush();
+	{
+		nlohmann::json m;
+		m["id"] = "1122334455";
+		m["address"] = "1122334455";
+		m["nwid"] = "8056c2e21c000001";
+		m["identity"] = "1122334455" + idStr.substr(10);
+		DB::initMember(m);
+		m["authorized"] = true;
+		m["creationTime"] = 1546300800000LL;
+		m["lastAuthorizedCredentialType"] = "token";
+		m["lastAuthorizedCredential"] = "letmein";
+		m["remoteTraceTarget"] = "aabbccddee";
+		m["capabilities"].push_back(1);
+		m["capabilities"].push_back(0xffffffffULL);
+		nlohmann::json t = nlohmann::json::array();
+		t.push_back(100);
+		t.push_back(7);
+		m["tags"].push_back(t);
+		m["ipAssignments"].push_back("10.1.2.3");
+		m["ipAssignments"].push_back("fd80:56c2:e21c::1");
+		m["name"] = "extra field";
+
+		MemberRecord::Interner interner;
+		MemberRecord r,r2;
+		r.fromJson(m,0x8056c2e21c000001ULL,0x1122334455ULL,&interner);
+		r2.fromJson(m,0x8056c2e21c000001ULL,0x1122334455ULL,&interner);
+		nlohmann::json out;
+		r.toJson(out);
+		if ((out != m)||(!r.authorized)||(r.remoteTraceTarget != 0xaabbccddeeULL)||(r.tags().size() != 1)||(&(r.tags()) != &(r2.tags()))||(r != r2)) {
+			std::cout << "FAILED (typed fields)" << std::endl;
+			return -1;
+		}
+		std::vector<InetAddress> ips;
+		r.ipAssignments(ips);
+		if ((ips.size() != 2)||(ips[0] != InetAddress("10.1.2.3/0"))) {
+			std::cout << "FAILED (IP assignments)" << std::endl;
+			return -1;
+		}
+
+		// Values not in canonical form must survive untouched, including through init()
+		m["authorized"] = "yes";
+		m["ipAssignments"].push_back(12345);
+		m["remoteTraceTarget"] = "000000000";
+		m["revision"] = -1;
+		m.erase("creationTime");
+		r.fromJson(m,0x8056c2e21c000001ULL,0x1122334455ULL,&interner);
+		r.init();
+		r.toJson(out);
+		out.erase("creationTime");
+		if ((out != m)||(r.authorized)||(r == r2)) {
+			std::cout << "FAILED (untyped fields)" << std::endl;
+			return -1;
+		}
+
+		m["identity"] = "not an identity";
+		r.fromJson(m,0x8056c2e21c000001ULL,0x1122334455ULL,&interner);
+		if (!r.identityInvalid) {
+			std::cout << "FAILED (invalid identity)" << std::endl;
+			return -1;
+		}
+	}
+	std::cout << "OK" << std::endl;
+
+	unsigned long count = 10000;
+	const char *const countEnv = getenv("ZT_SELFTEST_CONTROLLER_MEMBERS");
+	if (countEnv)
+		count = std::max((unsigned long)strtoul(countEnv,(char **)0,10),1UL);
+	const unsigned long networkCount = std::max(count / 1000,1UL);
+
+	const auto makeMember = [&idStr](const unsigned long i,const uint64_t nwid,nlohmann::json &m) {
+		char ids[64];
+		OSUtils::ztsnprintf(ids,sizeof(ids),"%.16llx",(unsigned long long)nwid);
+		m["nwid"] = ids;
+		OSUtils::ztsnprintf(ids,sizeof(ids),"%.10llx",(unsigned long long)(0x1000000000ULL + i));
+		m["id"] = ids;
+		m["address"] = ids;
+		m["identity"] = std::string(ids) + idStr.substr(10);
+		DB::initMember(m);
+		m["authorized"] = true;
+		m["tags"].push_back(nlohmann::json::array({ 1,(int)(i % 4) }));
+		m["capabilities"].push_back(1);
+		OSUtils::ztsnprintf(ids,sizeof(ids),"10.%u.%u.%u",(unsigned int)((i >> 16) & 0xff),(unsigned int)((i >> 8) & 0xff),(unsigned int)(i & 0xff));
+		m["ipAssignments"].push_back(ids);
+		m["vMajor"] = 1;
+		m["vMinor"] = 4;
+		m["vRev"] = 6;
+		m["vProto"] = 10;
+	};
+
+	std::cout << "[controller] Loading " << count << " synthetic members into " << networkCount << " networks... "; std::cout.flush();
+	int64_t start = OSUtils::now();
+	_BenchDB db;
+	for(unsigned long n=0;n<networkCount;++n) {
+		nlohmann::json network;
+		OSUtils::ztsnprintf(tmp,sizeof(tmp),"%.16llx",(unsigned long long)(0x8056c2e21c000000ULL + n));
+		network["id"] = tmp;
+		network["nwid"] = tmp;
+		DB::initNetwork(network);
+		db.load(network);
+	}
+	for(unsigned long i=0;i<count;++i) {
+		nlohmann::json m;
+		makeMember(i,0x8056c2e21c000000ULL + (i % networkCount),m);
+		db.load(m);
+	}
+	std::cout << (OSUtils::now() - start) << "ms" << std::endl;
+
+	// Every member must come back both typed and as JSON. Load and get
+	// timings at scale are in zerotier-bench.
+	std::cout << "[controller] Testing member get... "; std::cout.flush();
+	unsigned long jsonBytes = 0;
+	{
+		nlohmann::json network,mj;
+		MemberRecord mr;
+		for(unsigned long i=0;i<count;++i) {
+			const uint64_t nwid = 0x8056c2e21c000000ULL + (i % networkCount);
+			if ((!db.get(nwid,network,0x1000000000ULL + i,mr))||(!db.get(nwid,network,0x1000000000ULL + i,mj))||(OSUtils::jsonIntHex(mj["id"],0ULL) != mr.id)) {
+				std::cout << "FAILED (member " << i << ")" << std::endl;
+				return -1;
+			}
+			jsonBytes += (unsigned long)OSUtils::jsonDump(mj,-1).length();
+		}
+	}
+	std::cout << "OK" << std::endl;
+	std::cout << "[controller] Bytes per member: compact record " << (db.memberBytes() / count) << ", serialized JSON " << (jsonBytes / count) << std::endl;
+
+	std::cout << "[controller] Testing member change feed... "; std::cout.flush();
+	{
+		const uint64_t nwid = 0x8056c2e21c000000ULL;
+		std::vector<DB::MemberChange> changes;
+		uint64_t cursor = 0,cursor2 = 0;
+		bool full = false;
+		if ((!db.memberRevisions(nwid,changes))||(changes.size() != ((count + networkCount - 1) / networkCount))) {
+			std::cout << "FAILED (member revisions)" << std::endl;
+			return -1;
+		}
+		if ((!db.memberChanges(nwid,0,0,0,changes,cursor,full))||(!full)||(changes.size() != ((count + networkCount - 1) / networkCount))) {
+			std::cout << "FAILED (initial full list)" << std::endl;
+			return -1;
+		}
+		if ((!db.memberChanges(nwid,cursor,0,0,changes,cursor2,full))||(full)||(!changes.empty())||(cursor2 != cursor)) {
+			std::cout << "FAILED (no changes)" << std::endl;
+			return -1;
+		}
+
+		nlohmann::json m;
+		makeMember(0,nwid,m);
+		m["revision"] = 2;
+		db.load(m);
+		m["revision"] = 3;
+		db.load(m);
+		nlohmann::json m2;
+		makeMember(networkCount,nwid,m2);
+		db.unload(m2);
+		if ((!db.memberChanges(nwid,cursor,0,0,changes,cursor2,full))||(full)||(changes.size() != 2)||(changes[0].memberId != 0x1000000000ULL)||(changes[0].revision != 3)||(!changes[1].erased)||(cursor2 != (cursor + 3))) {
+			std::cout << "FAILED (coalesced changes)" << std::endl;
+			return -1;
+		}
+		cursor = cursor2;
+
+		std::thread changer([&db,&m]() {
+			std::this_thread::sleep_for(std::chrono::milliseconds(100));
+			m["revision"] = 4;
+			db.load(m);
+		});
+		start = OSUtils::now();
+		const bool found = db.memberChanges(nwid,cursor,0,10000,changes,cursor2,full);
+		const int64_t waited = OSUtils::now() - start;
+		changer.join();
+		if ((!found)||(changes.size() != 1)||(changes[0].revision != 4)||(waited >= 10000)) {
+			std::cout << "FAILED (long poll)" << std::endl;
+			return -1;
+		}
+	}
+	std::cout << "OK" << std::endl;
+
+	return 0;
+}
+
+class _NullSender : public NetworkController::Sender
+{
+public:
+	virtual void ncSendConfig(uint64_t nwid,uint64_t requestPacketId,const Address &destination,const NetworkConfig &nc,bool sendLegacyFormatConfig) {}
+	virtual void ncSendRevocation(const Address &destination,const Revocation &rev) {}
+	virtual void ncSendError(uint64_t nwid,uint64_t requestPacketId,const Address &destination,NetworkController::ErrorCode errorCode) {}
+};
+
+// Records config pushes (requests with no packet ID) instead of answering them. It
+// has no Node since only deauthorization uses one and nothing here deauthorizes.
+class _PushRecordingController : public EmbeddedNetworkController
+{
+public:
+	_PushRecordingController(const char *path) : EmbeddedNetworkController((Node *)0,path,path,-1) {}
+	virtual void request(uint64_t nwid,const InetAddress &fromAddr,uint64_t requestPacketId,const Identity &identity,const Dictionary<ZT_NETWORKCONFIG_METADATA_DICT_CAPACITY> &metaData)
+	{
+		if (requestPacketId) {
+			EmbeddedNetworkController::request(nwid,fromAddr,requestPacketId,identity,metaData);
+		} else {
+			std::lock_guard<std::mutex> l(pushes_l);
+			pushes.push_back(std::pair<int64_t,uint64_t>(OSUtils::now(),identity.address().toInt()));
+		}
+	}
+	inline std::vector< std::pair<int64_t,uint64_t> > takePushes()
+	{
+		std::lock_guard<std::mutex> l(pushes_l);
+		std::vector< std::pair<int64_t,uint64_t> > p;
+		p.swap(pushes);
+		return p;
+	}
+	inline unsigned long pushCount()
+	{
+		std::lock_guard<std::mutex> l(pushes_l);
+		return (unsigned long)pushes.size();
+	}
+	std::vector< std::pair<int64_t,uint64_t> > pushes;
+	std::mutex pushes_l;
+};
+
+static int testControllerPush()
+{
+	const char *const path = "zt-selftest-push";
+	const unsigned long count = ZT_CONTROLLER_MAX_PUSHES_PER_SECOND + 500; // one full bucket plus a quarter second's worth
+	char tmp[ZT_IDENTITY_STRING_BUFFER_LENGTH];
+	char nwids[24],addrs[16];
+	std::map<std::string,std::string> urlArgs,headers;
+	std::string responseBody,responseContentType;
+	OSUtils::rmDashRf(path);
+
+	Identity signingId;
+	signingId.generate();
+	Identity memberId;
+	memberId.generate();
+	const std::string memberIdStr(memberId.toString(false,tmp));
+	const uint64_t nwid = (signingId.address().toInt() << 24) | 1ULL;
+	OSUtils::ztsnprintf(nwids,sizeof(nwids),"%.16llx",(unsigned long long)nwid);
+
+	{
+		_NullSender sender;
+		_PushRecordingController controller(path);
+		controller.init(signingId,&sender);
+
+		std::vector<std::string> networkPath;
+		networkPath.push_back("network");
+		networkPath.push_back(nwids);
+		if (controller.handleControlPlaneHttpPOST(networkPath,urlArgs,headers,"{\"private\":false}",responseBody,responseContentType) != 200) {
+			std::cout << "[controller] Creating push test network... FAILED" << std::endl;
+			return -1;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(ZT_CONTROLLER_PUSH_DEBOUNCE * 2)); // its push finds nobody online
+
+		// Every member that joins is saved, and each save schedules one push
+		std::cout << "[controller] Bringing " << count << " members online for push tests... "; std::cout.flush();
+		Dictionary<ZT_NETWORKCONFIG_METADATA_DICT_CAPACITY> metaData;
+		metaData.add(ZT_NETWORKCONFIG_REQUEST_METADATA_KEY_NODE_MAJOR_VERSION,(uint64_t)1);
+		metaData.add(ZT_NETWORKCONFIG_REQUEST_METADATA_KEY_PROTOCOL_VERSION,(uint64_t)ZT_PROTO_VERSION);
+		for(unsigned long i=0;i<count;++i) {
+			OSUtils::ztsnprintf(addrs,sizeof(addrs),"%.10llx",(unsigned long long)(0x1000000000ULL + i));
+			Identity id;
+			id.fromString((std::string(addrs) + memberIdStr.substr(10)).c_str());
+			controller.request(nwid,InetAddress(),(uint64_t)(i + 1),id,metaData);
+		}
+		int64_t start = OSUtils::now();
+		while ((controller.pushCount() < count)&&((OSUtils::now() - start) < 60000))
+			std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		std::this_thread::sleep_for(std::chrono::milliseconds(1100)); // let the bucket refill
+		const unsigned long initialPushes = (unsigned long)controller.takePushes().size();
+		if (initialPushes != count) {
+			std::cout << "FAILED (" << initialPushes << " initial pushes)" << std::endl;
+			return -1;
+		}
+		std::cout << "OK" << std::endl;
+
+		std::cout << "[controller] Testing that rapid member changes coalesce into one push... "; std::cout.flush();
+		{
+			std::vector<std::string> memberPath(networkPath);
+			memberPath.push_back("member");
+			memberPath.push_back("1000000000");
+			start = OSUtils::now();
+			for(int i=1;i<=20;++i) {
+				OSUtils::ztsnprintf(tmp,sizeof(tmp),"{\"remoteTraceLevel\":%d}",i);
+				if (controller.handleControlPlaneHttpPOST(memberPath,urlArgs,headers,tmp,responseBody,responseContentType) != 200) {
+					std::cout << "FAILED (member update)" << std::endl;
+					return -1;
+				}
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(ZT_CONTROLLER_PUSH_DEBOUNCE * 3));
+			const std::vector< std::pair<int64_t,uint64_t> > p(controller.takePushes());
+			if ((p.size() != 1)||(p[0].second != 0x1000000000ULL)||((p[0].first - start) < ZT_CONTROLLER_PUSH_DEBOUNCE)) {
+				std::cout << "FAILED (" << p.size() << " pushes)" << std::endl;
+				return -1;
+			}
+		}
+		std::cout << "OK" << std::endl;
+
+		std::cout << "[controller] Testing push rate limit with a network change to " << count << " online members... "; std::cout.flush();
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+			start = OSUtils::now();
+			if (controller.handleControlPlaneHttpPOST(networkPath,urlArgs,headers,"{\"name\":\"push test\"}",responseBody,responseContentType) != 200) {
+				std::cout << "FAILED (network update)" << std::endl;
+				return -1;
+			}
+			while ((controller.pushCount() < count)&&((OSUtils::now() - start) < 10000))
+				std::this_thread::sleep_for(std::chrono::milliseconds(50));
+			std::this_thread::sleep_for(std::chrono::milliseconds(ZT_CONTROLLER_PUSH_DEBOUNCE));
+			const std::vector< std::pair<int64_t,uint64_t> > p(controller.takePushes());
+			std::set<uint64_t> pushed;
+			for(auto i=p.begin();i!=p.end();++i)
+				pushed.insert(i->second);
+			if ((p.size() != count)||(pushed.size() != count)) {
+				std::cout << "FAILED (" << p.size() << " pushes to " << pushed.size() << " members)" << std::endl;
+				return -1;
+			}
+			// A full bucket goes out at once, the rest at the refill rate (less a little for millisecond rounding)
+			const int64_t span = p.back().first - p.front().first;
+			const int64_t minSpan = (int64_t)(((count - ZT_CONTROLLER_MAX_PUSHES_PER_SECOND) * 1000) / ZT_CONTROLLER_MAX_PUSHES_PER_SECOND) - 20;
+			if (((p.front().first - start) < ZT_CONTROLLER_PUSH_DEBOUNCE)||(span < minSpan)) {
+				std::cout << "FAILED (first push after " << (p.front().first - start) << "ms, last " << span << "ms later)" << std::endl;
+				return -1;
+			}
+			std::cout << "OK (" << count << " pushes over " << span << "ms)" << std::endl;
+		}
+	}
+
+	OSUtils::rmDashRf(path);
+	return 0;
+}
+
+static int testLoopback()
+{
+	struct {
+		const char *name;
+		unsigned int nodes;
+		unsigned int frameSize;
+		unsigned int window;
+		unsigned int latencyUs,jitterUs,lossPpm,reorderPpm,mtu;
+	} const scenarios[] = {
+		{ "2 endpoints, clean wire",             3, 1400, 32,   0,   0,     0,     0, ZT_DEFAULT_PHYSMTU },
+		{ "2 endpoints, jumbo frames",           3, 2800, 32,   0,   0,     0,     0, ZT_DEFAULT_PHYSMTU },
+		{ "2 endpoints, 500us + 1% loss",        3, 1400, 64, 500,   0, 10000,     0, ZT_DEFAULT_PHYSMTU },
+		{ "2 endpoints, 200us jitter, 5% reord", 3, 1400, 64, 200, 200,     0, 50000, ZT_DEFAULT_PHYSMTU },
+		{ "2 endpoints, 1400 byte wire MTU",     3, 1400, 32,   0,   0,     0,     0, ZT_MIN_PHYSMTU },
+		{ "4 endpoints, clean wire",             5, 1400, 16,   0,   0,     0,     0, ZT_DEFAULT_PHYSMTU }
+	};
+
+	for(unsigned int s=0;s<(sizeof(scenarios) / sizeof(scenarios[0]));++s) {
+		LoopbackHarness::Wire w;
+		w.latencyUs = scenarios[s].latencyUs;
+		w.jitterUs = scenarios[s].jitterUs;
+		w.lossPpm = scenarios[s].lossPpm;
+		w.reorderPpm = scenarios[s].reorderPpm;
+		w.mtu = scenarios[s].mtu;
+		w.seed = s + 1;
+
+		LoopbackHarness h(scenarios[s].nodes,w);
+		std::cout << "[loopback] " << scenarios[s].name << ": "; std::cout.flush();
+		if (!h.start(15000)) {
+			std::cout << "FAILED (endpoints did not join network)" << std::endl;
+			return -1;
+		}
+		const LoopbackHarness::Result r(h.run(scenarios[s].frameSize,500,1000,scenarios[s].window));
+		if ((!r.framesReceived)||(r.framesReceived > r.framesSent)) {
+			std::cout << "FAILED (" << r.framesReceived << " of " << r.framesSent << " frames received)" << std::endl;
+			return -1;
+		}
+		char tmp[256];
+		OSUtils::ztsnprintf(tmp,sizeof(tmp),"%.0f frames/s, %.3f Gbps, p50 %lldus, p99 %lldus, %llu/%llu frames, %llu wire packets, %llu dropped",
+			r.framesPerSecond,
+			r.gbps,
+			(long long)r.p50Us,
+			(long long)r.p99Us,
+			(unsigned long long)r.framesReceived,
+			(unsigned long long)r.framesSent,
+			(unsigned long long)r.wirePackets,
+			(unsigned long long)r.wireDrops);
+		std::cout << tmp << std::endl;
+	}
+
+	return 0;
+}
+
+#ifdef ZT_CONTROLLER_USE_LIBPQ
+// Set ZT_SELFTEST_PG_CONNSTR to a libpq connection string for a scratch database to run this
+static int testPostgreSQL()
+{
+	const char *connStr = getenv("ZT_SELFTEST_PG_CONNSTR");
+	if (!connStr) {
+		std::cout << "[postgresql] ZT_SELFTEST_PG_CONNSTR not set, skipping" << std::endl;
+		return 0;
+	}
+	PGconn *conn = PQconnectdb(connStr);
+	if (PQstatus(conn) != CONNECTION_OK) {
+		std::cout << "[postgresql] FAILED (connect: " << PQerrorMessage(conn) << ")" << std::endl;
+		PQfinish(conn);
+		return -1;
+	}
+
+	// A temporary table shadows any real ztc_member_status for this session only
+	PGresult *res = PQexec(conn,"CREATE TEMP TABLE ztc_member_status (network_id CHAR(16) NOT NULL, member_id CHAR(10) NOT NULL, address INET, last_updated TIMESTAMP WITH TIME ZONE, PRIMARY KEY (network_id, member_id))");
+	const bool created = (PQresultStatus(res) == PGRES_COMMAND_OK);
+	PQclear(res);
+	if (!created) {
+		std::cout << "[postgresql] FAILED (create temp table: " << PQerrorMessage(conn) << ")" << std::endl;
+		PQfinish(conn);
+		return -1;
+	}
+
+	std::vector<PostgreSQL::OnlineRecord> records;
+	const unsigned long count = 200000;
+	for(unsigned long i=0;i<count;++i) {
+		PostgreSQL::OnlineRecord r;
+		r.networkId = 0x8056c2e21c000000ULL + (i % 64);
+		r.memberId = 0x1000000000ULL + i;
+		r.lastSeen = OSUtils::now();
+		if (i & 1)
+			r.physicalAddress = InetAddress((uint32_t)Utils::hton((uint32_t)(0x0a000000 + i)),9993);
+		records.push_back(r);
+	}
+
+	for(int pass=0;pass<2;++pass) {
+		std::cout << "[postgresql] Upserting " << count << " member status rows (" << ((pass == 0) ? "insert" : "update") << ")... "; std::cout.flush();
+		const int64_t start = OSUtils::now();
+		const long n = PostgreSQL::upsertMemberStatus(conn,records);
+		const int64_t end = OSUtils::now();
+		if (n != (long)count) {
+			std::cout << "FAILED (" << PQerrorMessage(conn) << ")" << std::endl;
+			PQfinish(conn);
+			return -1;
+		}
+		std::cout << (end - start) << "ms, " << (((double)count * 1000.0) / (double)((end > start) ? (end - start) : 1)) << " rows/second" << std::endl;
+	}
+
+	res = PQexec(conn,"SELECT COUNT(*) FROM ztc_member_status");
+	const long rows = ((PQresultStatus(res) == PGRES_TUPLES_OK)&&(PQntuples(res) == 1)) ? atol(PQgetvalue(res,0,0)) : -1;
+	PQclear(res);
+	PQfinish(conn);
+	if (rows != (long)count) {
+		std::cout << "[postgresql] FAILED (expected " << count << " rows, found " << rows << ")" << std::endl;
+		return -1;
+	}
+	return 0;
+}
+#endif
+
 #ifdef __WINDOWS__
 int __cdecl _tmain(int argc, _TCHAR* argv[])
 #else
@@ -1102,6 +2397,14 @@ int main(int argc,char **argv)
 	r |= testIdentity();
 	r |= testCertificate();
 	r |= testPhy();
+	r |= testFileDB();
+	r |= testStateStore();
+	r |= testControllerDB();
+	r |= testControllerPush();
+	r |= testLoopback();
+#ifdef ZT_CONTROLLER_USE_LIBPQ
+	r |= testPostgreSQL();
+#endif
 	//*/
 
 	if (r)
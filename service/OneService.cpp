@@ -31,10 +31,13 @@
 
 #include <string>
 #include <map>
+#include <set>
 #include <vector>
 #include <algorithm>
 #include <list>
 #include <thread>
+#include <memory>
+#include <atomic>
 #include <mutex>
 #include <condition_variable>
 
@@ -61,6 +64,8 @@
 #include "../osdep/Binder.hpp"
 #include "../osdep/ManagedRoute.hpp"
 #include "../osdep/BlockingQueue.hpp"
+#include "../osdep/StateStore.hpp"
+#include "../osdep/JsonWriter.hpp"
 
 #include "OneService.hpp"
 #include "SoftwareUpdater.hpp"
@@ -140,6 +145,13 @@ using json = nlohmann::json;
 // TCP activity timeout
 #define ZT_TCP_ACTIVITY_TIMEOUT 60000
 
+// Max time a UDP shard loop waits before delivering batched frames and checking for shutdown
+#define ZT_UDP_SHARD_POLL_TIMEOUT 1000
+
+// Threads that handle control plane (local HTTP API) requests off the main I/O loop
+// (more than ZT_CONTROLLER_MAX_LONG_POLLS, so waiting controller GETs leave some free)
+#define ZT_CONTROL_PLANE_THREADS 4
+
 #if ZT_VAULT_SUPPORT
 size_t curlResponseWrite(void *ptr, size_t size, size_t nmemb, std::string *data)
 {
@@ -176,7 +188,7 @@ static std::string _trimString(const std::string &s)
 	return s.substr(start,end - start);
 }
 
-static void _networkToJson(nlohmann::json &nj,const ZT_VirtualNetworkConfig *nc,const std::string &portDeviceName,const OneService::NetworkSettings &localSettings)
+static void _networkToJson(JsonWriter &w,const ZT_VirtualNetworkConfig *nc,const std::string &portDeviceName,const OneService::NetworkSettings &localSettings,const std::set<std::string> *fields = (const std::set<std::string> *)0)
 {
 	char tmp[256];
 
@@ -194,55 +206,70 @@ static void _networkToJson(nlohmann::json &nj,const ZT_VirtualNetworkConfig *nc,
 		case ZT_NETWORK_TYPE_PUBLIC:                     ntype = "PUBLIC"; break;
 	}
 
+	w.beginObject(fields);
 	OSUtils::ztsnprintf(tmp,sizeof(tmp),"%.16llx",nc->nwid);
-	nj["id"] = tmp;
-	nj["nwid"] = tmp;
-	OSUtils::ztsnprintf(tmp,sizeof(tmp),"%.2x:%.2x:%.2x:%.2x:%.2x:%.2x",(unsigned int)((nc->mac >> 40) & 0xff),(unsigned int)((nc->mac >> 32) & 0xff),(unsigned int)((nc->mac >> 24) & 0xff),(unsigned int)((nc->mac >> 16) & 0xff),(unsigned int)((nc->mac >> 8) & 0xff),(unsigned int)(nc->mac & 0xff));
-	nj["mac"] = tmp;
-	nj["name"] = nc->name;
-	nj["status"] = nstatus;
-	nj["type"] = ntype;
-	nj["mtu"] = nc->mtu;
-	nj["dhcp"] = (bool)(nc->dhcp != 0);
-	nj["bridge"] = (bool)(nc->bridge != 0);
-	nj["broadcastEnabled"] = (bool)(nc->broadcastEnabled != 0);
-	nj["portError"] = nc->portError;
-	nj["netconfRevision"] = nc->netconfRevision;
-	nj["portDeviceName"] = portDeviceName;
-	nj["allowManaged"] = localSettings.allowManaged;
-	nj["allowGlobal"] = localSettings.allowGlobal;
-	nj["allowDefault"] = localSettings.allowDefault;
-
-	nlohmann::json aa = nlohmann::json::array();
-	for(unsigned int i=0;i<nc->assignedAddressCount;++i) {
-		aa.push_back(reinterpret_cast<const InetAddress *>(&(nc->assignedAddresses[i]))->toString(tmp));
-	}
-	nj["assignedAddresses"] = aa;
+	if (w.key("id")) w.value(tmp);
+	if (w.key("nwid")) w.value(tmp);
+	if (w.key("mac")) {
+		OSUtils::ztsnprintf(tmp,sizeof(tmp),"%.2x:%.2x:%.2x:%.2x:%.2x:%.2x",(unsigned int)((nc->mac >> 40) & 0xff),(unsigned int)((nc->mac >> 32) & 0xff),(unsigned int)((nc->mac >> 24) & 0xff),(unsigned int)((nc->mac >> 16) & 0xff),(unsigned int)((nc->mac >> 8) & 0xff),(unsigned int)(nc->mac & 0xff));
+		w.value(tmp);
+	}
+	if (w.key("name")) w.value(nc->name);
+	if (w.key("status")) w.value(nstatus);
+	if (w.key("type")) w.value(ntype);
+	if (w.key("mtu")) w.value(nc->mtu);
+	if (w.key("dhcp")) w.value((bool)(nc->dhcp != 0));
+	if (w.key("bridge")) w.value((bool)(nc->bridge != 0));
+	if (w.key("broadcastEnabled")) w.value((bool)(nc->broadcastEnabled != 0));
+	if (w.key("portError")) w.value(nc->portError);
+	if (w.key("netconfRevision")) w.value(nc->netconfRevision);
+	if (w.key("portDeviceName")) w.value(portDeviceName);
+	if (w.key("allowManaged")) w.value(localSettings.allowManaged);
+	if (w.key("allowGlobal")) w.value(localSettings.allowGlobal);
+	if (w.key("allowDefault")) w.value(localSettings.allowDefault);
+
+	if (w.key("assignedAddresses")) {
+		w.beginArray();
+		for(unsigned int i=0;i<nc->assignedAddressCount;++i)
+			w.value(reinterpret_cast<const InetAddress *>(&(nc->assignedAddresses[i]))->toString(tmp));
+		w.endArray();
+	}
 
-	nlohmann::json ra = nlohmann::json::array();
-	for(unsigned int i=0;i<nc->routeCount;++i) {
-		nlohmann::json rj;
-		rj["target"] = reinterpret_cast<const InetAddress *>(&(nc->routes[i].target))->toString(tmp);
-		if (nc->routes[i].via.ss_family == nc->routes[i].target.ss_family)
-			rj["via"] = reinterpret_cast<const InetAddress *>(&(nc->routes[i].via))->toIpString(tmp);
-		else rj["via"] = nlohmann::json();
-		rj["flags"] = (int)nc->routes[i].flags;
-		rj["metric"] = (int)nc->routes[i].metric;
-		ra.push_back(rj);
+	if (w.key("routes")) {
+		w.beginArray();
+		for(unsigned int i=0;i<nc->routeCount;++i) {
+			w.beginObject();
+			w.key("target");
+			w.value(reinterpret_cast<const InetAddress *>(&(nc->routes[i].target))->toString(tmp));
+			w.key("via");
+			if (nc->routes[i].via.ss_family == nc->routes[i].target.ss_family)
+				w.value(reinterpret_cast<const InetAddress *>(&(nc->routes[i].via))->toIpString(tmp));
+			else w.null();
+			w.key("flags");
+			w.value((int)nc->routes[i].flags);
+			w.key("metric");
+			w.value((int)nc->routes[i].metric);
+			w.endObject();
+		}
+		w.endArray();
 	}
-	nj["routes"] = ra;
 
-	nlohmann::json mca = nlohmann::json::array();
-	for(unsigned int i=0;i<nc->multicastSubscriptionCount;++i) {
-		nlohmann::json m;
-		m["mac"] = MAC(nc->multicastSubscriptions[i].mac).toString(tmp);
-		m["adi"] = nc->multicastSubscriptions[i].adi;
-		mca.push_back(m);
+	if (w.key("multicastSubscriptions")) {
+		w.beginArray();
+		for(unsigned int i=0;i<nc->multicastSubscriptionCount;++i) {
+			w.beginObject();
+			w.key("mac");
+			w.value(MAC(nc->multicastSubscriptions[i].mac).toString(tmp));
+			w.key("adi");
+			w.value(nc->multicastSubscriptions[i].adi);
+			w.endObject();
+		}
+		w.endArray();
 	}
-	nj["multicastSubscriptions"] = mca;
+	w.endObject();
 }
 
-static void _peerToJson(nlohmann::json &pj,const ZT_Peer *peer)
+static void _peerToJson(JsonWriter &w,const ZT_Peer *peer,const std::set<std::string> *fields = (const std::set<std::string> *)0)
 {
 	char tmp[256];
 
@@ -253,31 +280,46 @@ static void _peerToJson(nlohmann::json &pj,const ZT_Peer *peer)
 		case ZT_PEER_ROLE_PLANET: prole = "PLANET"; break;
 	}
 
-	OSUtils::ztsnprintf(tmp,sizeof(tmp),"%.10llx",peer->address);
-	pj["address"] = tmp;
-	pj["versionMajor"] = peer->versionMajor;
-	pj["versionMinor"] = peer->versionMinor;
-	pj["versionRev"] = peer->versionRev;
-	OSUtils::ztsnprintf(tmp,sizeof(tmp),"%d.%d.%d",peer->versionMajor,peer->versionMinor,peer->versionRev);
-	pj["version"] = tmp;
-	pj["latency"] = peer->latency;
-	pj["role"] = prole;
-
-	nlohmann::json pa = nlohmann::json::array();
-	for(unsigned int i=0;i<peer->pathCount;++i) {
-		int64_t lastSend = peer->paths[i].lastSend;
-		int64_t lastReceive = peer->paths[i].lastReceive;
-		nlohmann::json j;
-		j["address"] = reinterpret_cast<const InetAddress *>(&(peer->paths[i].address))->toString(tmp);
-		j["lastSend"] = (lastSend < 0) ? 0 : lastSend;
-		j["lastReceive"] = (lastReceive < 0) ? 0 : lastReceive;
-		j["trustedPathId"] = peer->paths[i].trustedPathId;
-		j["active"] = (bool)(peer->paths[i].expired == 0);
-		j["expired"] = (bool)(peer->paths[i].expired != 0);
-		j["preferred"] = (bool)(peer->paths[i].preferred != 0);
-		pa.push_back(j);
+	w.beginObject(fields);
+	if (w.key("address")) {
+		OSUtils::ztsnprintf(tmp,sizeof(tmp),"%.10llx",peer->address);
+		w.value(tmp);
 	}
-	pj["paths"] = pa;
+	if (w.key("versionMajor")) w.value(peer->versionMajor);
+	if (w.key("versionMinor")) w.value(peer->versionMinor);
+	if (w.key("versionRev")) w.value(peer->versionRev);
+	if (w.key("version")) {
+		OSUtils::ztsnprintf(tmp,sizeof(tmp),"%d.%d.%d",peer->versionMajor,peer->versionMinor,peer->versionRev);
+		w.value(tmp);
+	}
+	if (w.key("latency")) w.value(peer->latency);
+	if (w.key("role")) w.value(prole);
+
+	if (w.key("paths")) {
+		w.beginArray();
+		for(unsigned int i=0;i<peer->pathCount;++i) {
+			const int64_t lastSend = peer->paths[i].lastSend;
+			const int64_t lastReceive = peer->paths[i].lastReceive;
+			w.beginObject();
+			w.key("address");
+			w.value(reinterpret_cast<const InetAddress *>(&(peer->paths[i].address))->toString(tmp));
+			w.key("lastSend");
+			w.value((long long)((lastSend < 0) ? 0 : lastSend));
+			w.key("lastReceive");
+			w.value((long long)((lastReceive < 0) ? 0 : lastReceive));
+			w.key("trustedPathId");
+			w.value((unsigned long long)peer->paths[i].trustedPathId);
+			w.key("active");
+			w.value((bool)(peer->paths[i].expired == 0));
+			w.key("expired");
+			w.value((bool)(peer->paths[i].expired != 0));
+			w.key("preferred");
+			w.value((bool)(peer->paths[i].preferred != 0));
+			w.endObject();
+		}
+		w.endArray();
+	}
+	w.endObject();
 }
 
 static void _peerAggregateLinkToJson(nlohmann::json &pj,const ZT_Peer *peer)
@@ -343,6 +385,7 @@ static void SnodeStatePutFunction(ZT_Node *node,void *uptr,void *tptr,enum ZT_St
 static int SnodeStateGetFunction(ZT_Node *node,void *uptr,void *tptr,enum ZT_StateObjectType type,const uint64_t id[2],void *data,unsigned int maxlen);
 static int SnodeWirePacketSendFunction(ZT_Node *node,void *uptr,void *tptr,int64_t localSocket,const struct sockaddr_storage *addr,const void *data,unsigned int len,unsigned int ttl);
 static void SnodeVirtualNetworkFrameFunction(ZT_Node *node,void *uptr,void *tptr,uint64_t nwid,void **nuptr,uint64_t sourceMac,uint64_t destMac,unsigned int etherType,unsigned int vlanId,const void *data,unsigned int len);
+static void SnodeVirtualNetworkFrameBatchFunction(ZT_Node *node,void *uptr,void *tptr,ZT_VirtualNetworkFrame *frames,unsigned int count);
 static int SnodePathCheckFunction(ZT_Node *node,void *uptr,void *tptr,uint64_t ztaddr,int64_t localSocket,const struct sockaddr_storage *remoteAddr);
 static int SnodePathLookupFunction(ZT_Node *node,void *uptr,void *tptr,uint64_t ztaddr,int family,struct sockaddr_storage *result);
 static void StapFrameHandler(void *uptr,void *tptr,uint64_t nwid,const MAC &from,const MAC &to,unsigned int etherType,unsigned int vlanId,const void *data,unsigned int len);
@@ -399,6 +442,7 @@ struct TcpConnection
 	PhySocket *sock;
 	InetAddress remoteAddr;
 	uint64_t lastReceive;
+	uint64_t id; // unique, so a late HTTP response can't go to a new connection at the same address
 
 	// Used for inbound HTTP connections
 	http_parser parser;
@@ -437,6 +481,7 @@ public:
 	EmbeddedNetworkController *_controller;
 	Phy<OneServiceImpl *> _phy;
 	Node *_node;
+	StateStore *_stateStore;
 	SoftwareUpdater *_updater;
 	PhySocket *_localControlSocket4;
 	PhySocket *_localControlSocket6;
@@ -477,6 +522,23 @@ public:
 	unsigned int _ports[3];
 	Binder _binder;
 
+	// Additional Phy loops, each with its own thread, that serve one shard of
+	// the SO_REUSEPORT UDP sockets opened when "udpShards" is set in local.conf.
+	// A shard's lock is held while it polls and is taken by the main thread
+	// (after setting pause and whacking it) while bindings are refreshed.
+	struct UdpShard
+	{
+		UdpShard(OneServiceImpl *s) : phy(s,false,true),run(true),pause(false) {}
+		Phy<OneServiceImpl *> phy;
+		std::thread thread;
+		Mutex lock;
+		std::atomic<bool> run;
+		std::atomic<bool> pause;
+	};
+	std::vector<UdpShard *> _udpShards;
+	std::vector< Phy<OneServiceImpl *> * > _udpShardPhys;
+	unsigned int _udpShardCount; // local.conf "udpShards", UDP sockets per binding (only read at startup)
+
 	// Time we last received a packet from a global address
 	uint64_t _lastDirectReceiveFromGlobal;
 #ifdef ZT_TCP_FALLBACK_RELAY
@@ -514,6 +576,31 @@ public:
 	std::vector< TcpConnection * > _tcpConnections;
 	Mutex _tcpConnections_m;
 	TcpConnection *_tcpFallbackTunnel;
+	uint64_t _nextTcpConnectionId;
+
+	// Control plane HTTP requests are parsed by the main I/O loop and then
+	// queued for a pool of threads, so slow queries like listing every peer
+	// on a root don't hold up packet processing. Finished responses come
+	// back through _httpResponses and are sent by the main loop after it's
+	// whacked. Requests that change anything run one at a time, and those
+	// that join, leave or reconfigure a local network still run on the main
+	// loop since they create, destroy and reconfigure taps.
+	struct HttpRequest
+	{
+		TcpConnection *tc;
+		uint64_t connectionId;
+		InetAddress remoteAddr;
+		unsigned int method;
+		std::string url;
+		std::map< std::string,std::string > headers;
+		std::string body;
+		std::string response;
+	};
+	BlockingQueue< std::shared_ptr<HttpRequest> > _httpRequests;
+	std::vector< std::shared_ptr<HttpRequest> > _httpResponses;
+	Mutex _httpResponses_m;
+	Mutex _httpChange_m;
+	std::vector<std::thread> _httpThreads;
 
 	// Termination status information
 	ReasonForTermination _termReason;
@@ -550,6 +637,7 @@ public:
 		,_controller((EmbeddedNetworkController *)0)
 		,_phy(this,false,true)
 		,_node((Node *)0)
+		,_stateStore((StateStore *)0)
 		,_updater((SoftwareUpdater *)0)
 		,_localControlSocket4((PhySocket *)0)
 		,_localControlSocket6((PhySocket *)0)
@@ -563,6 +651,7 @@ public:
 		,_lastRestart(0)
 		,_nextBackgroundTaskDeadline(0)
 		,_tcpFallbackTunnel((TcpConnection *)0)
+		,_nextTcpConnectionId(0)
 		,_termReason(ONE_STILL_RUNNING)
 		,_portMappingEnabled(true)
 #ifdef ZT_USE_MINIUPNPC
@@ -580,6 +669,7 @@ public:
 		_ports[0] = 0;
 		_ports[1] = 0;
 		_ports[2] = 0;
+		_udpShardCount = 0;
 
 #if ZT_VAULT_SUPPORT
 		curl_global_init(CURL_GLOBAL_DEFAULT);
@@ -588,7 +678,9 @@ public:
 
 	virtual ~OneServiceImpl()
 	{
-		_binder.closeAll(_phy);
+		_binder.closeAll(_phy,(_udpShardPhys.empty()) ? (Phy<OneServiceImpl *> *const *)0 : &(_udpShardPhys[0]),(unsigned int)_udpShardPhys.size());
+		for(std::vector<UdpShard *>::iterator s(_udpShards.begin());s!=_udpShards.end();++s)
+			delete *s;
 		_phy.close(_localControlSocket4);
 		_phy.close(_localControlSocket6);
 
@@ -626,9 +718,23 @@ public:
 				_authToken = _trimString(_authToken);
 			}
 
+			{
+				// The state store has to exist before the node, which loads its
+				// identity and peers through it, so this is read ahead of the rest
+				// of local.conf.
+				bool singleFilePeerStore = false;
+				std::string lcbuf;
+				if (OSUtils::readFile((_homePath + ZT_PATH_SEPARATOR_S "local.conf").c_str(),lcbuf)) {
+					try {
+						singleFilePeerStore = OSUtils::jsonBool(OSUtils::jsonParse(lcbuf)["settings"]["singleFilePeerStore"],false);
+					} catch ( ... ) {} // reported by readLocalSettings()
+				}
+				_stateStore = new StateStore(_homePath,singleFilePeerStore);
+			}
+
 			{
 				struct ZT_Node_Callbacks cb;
-				cb.version = 0;
+				cb.version = 1;
 				cb.stateGetFunction = SnodeStateGetFunction;
 				cb.statePutFunction = SnodeStatePutFunction;
 				cb.wirePacketSendFunction = SnodeWirePacketSendFunction;
@@ -637,6 +743,7 @@ public:
 				cb.eventCallback = SnodeEventCallback;
 				cb.pathCheckFunction = SnodePathCheckFunction;
 				cb.pathLookupFunction = SnodePathLookupFunction;
+				cb.virtualNetworkFrameBatchFunction = SnodeVirtualNetworkFrameBatchFunction;
 				_node = new Node(this,(void *)0,&cb,OSUtils::now());
 			}
 
@@ -757,6 +864,12 @@ public:
 				}
 			}
 
+			// Start UDP shard loops if enabled, bindings are sharded on first refresh
+			_startUdpShards();
+
+			for(unsigned int i=0;i<ZT_CONTROL_PLANE_THREADS;++i)
+				_httpThreads.push_back(std::thread(&OneServiceImpl::_httpThreadMain,this));
+
 			// Main I/O loop
 			_nextBackgroundTaskDeadline = 0;
 			int64_t clockShouldBe = OSUtils::now();
@@ -818,7 +931,7 @@ public:
 						if (_ports[i])
 							p[pc++] = _ports[i];
 					}
-					_binder.refresh(_phy,p,pc,explicitBind,*this);
+					_refreshBindings(p,pc);
 					{
 						Mutex::Lock _l(_nets_m);
 						for(std::map<uint64_t,NetworkState>::iterator n(_nets.begin());n!=_nets.end();++n) {
@@ -847,22 +960,26 @@ public:
 				// Sync multicast group memberships
 				if ((now - lastTapMulticastGroupCheck) >= ZT_TAP_CHECK_MULTICAST_INTERVAL) {
 					lastTapMulticastGroupCheck = now;
-					std::vector< std::pair< uint64_t,std::pair< std::vector<MulticastGroup>,std::vector<MulticastGroup> > > > mgChanges;
+					std::vector<uint64_t> mgNetworks;
+					std::vector< std::pair< std::vector<MulticastGroup>,std::vector<MulticastGroup> > > mgChanges;
 					{
 						Mutex::Lock _l(_nets_m);
-						mgChanges.reserve(_nets.size() + 1);
+						std::vector<EthernetTap *> taps;
+						taps.reserve(_nets.size());
+						mgNetworks.reserve(_nets.size());
 						for(std::map<uint64_t,NetworkState>::const_iterator n(_nets.begin());n!=_nets.end();++n) {
 							if (n->second.tap) {
-								mgChanges.push_back(std::pair< uint64_t,std::pair< std::vector<MulticastGroup>,std::vector<MulticastGroup> > >(n->first,std::pair< std::vector<MulticastGroup>,std::vector<MulticastGroup> >()));
-								n->second.tap->scanMulticastGroups(mgChanges.back().second.first,mgChanges.back().second.second);
+								taps.push_back(n->second.tap.get());
+								mgNetworks.push_back(n->first);
 							}
 						}
+						EthernetTap::scanAllMulticastGroups(taps,mgChanges);
 					}
-					for(std::vector< std::pair< uint64_t,std::pair< std::vector<MulticastGroup>,std::vector<MulticastGroup> > > >::iterator c(mgChanges.begin());c!=mgChanges.end();++c) {
-						for(std::vector<MulticastGroup>::iterator m(c->second.first.begin());m!=c->second.first.end();++m)
-							_node->multicastSubscribe((void *)0,c->first,m->mac().toInt(),m->adi());
-						for(std::vector<MulticastGroup>::iterator m(c->second.second.begin());m!=c->second.second.end();++m)
-							_node->multicastUnsubscribe(c->first,m->mac().toInt(),m->adi());
+					for(unsigned long c=0;c<mgChanges.size();++c) {
+						for(std::vector<MulticastGroup>::iterator m(mgChanges[c].first.begin());m!=mgChanges[c].first.end();++m)
+							_node->multicastSubscribe((void *)0,mgNetworks[c],m->mac().toInt(),m->adi());
+						for(std::vector<MulticastGroup>::iterator m(mgChanges[c].second.begin());m!=mgChanges[c].second.end();++m)
+							_node->multicastUnsubscribe(mgNetworks[c],m->mac().toInt(),m->adi());
 					}
 				}
 
@@ -885,15 +1002,17 @@ public:
 						_node->addLocalInterfaceAddress(reinterpret_cast<const struct sockaddr_storage *>(&(*i)));
 				}
 
-				// Clean peers.d periodically
+				// Clean stored peers periodically
 				if ((now - lastCleanedPeersDb) >= 3600000) {
 					lastCleanedPeersDb = now;
-					OSUtils::cleanDirectory((_homePath + ZT_PATH_SEPARATOR_S "peers.d").c_str(),now - 2592000000LL); // delete older than 30 days
+					_stateStore->cleanPeers(now - 2592000000LL); // delete older than 30 days
 				}
 
 				const unsigned long delay = (dl > now) ? (unsigned long)(dl - now) : 100;
 				clockShouldBe = now + (uint64_t)delay;
 				_phy.poll(delay);
+				_node->flushFrames((void *)0); // deliver all frames decoded during this poll to taps at once
+				_sendHttpResponses();
 			}
 		} catch (std::exception &e) {
 			Mutex::Lock _l(_termReason_m);
@@ -905,6 +1024,15 @@ public:
 			_fatalErrorMessage = "unexpected exception in main thread: unknown exception";
 		}
 
+		_stopUdpShards();
+
+		if (_controller)
+			_controller->stopLongPolls();
+		_httpRequests.stop();
+		for(std::vector<std::thread>::iterator t(_httpThreads.begin());t!=_httpThreads.end();++t)
+			t->join();
+		_httpThreads.clear();
+
 		try {
 			Mutex::Lock _l(_tcpConnections_m);
 			while (!_tcpConnections.empty())
@@ -920,10 +1048,68 @@ public:
 		_updater = (SoftwareUpdater *)0;
 		delete _node;
 		_node = (Node *)0;
+		delete _stateStore; // writes anything still pending
+		_stateStore = (StateStore *)0;
 
 		return _termReason;
 	}
 
+	void _startUdpShards()
+	{
+#ifdef ZT_BINDER_UDP_SHARDING
+		const unsigned int n = std::min(_udpShardCount,(unsigned int)ZT_BINDER_MAX_UDP_SHARDS);
+		for(unsigned int i=(unsigned int)_udpShards.size()+1;i<n;++i) {
+			UdpShard *const s = new UdpShard(this);
+			_udpShards.push_back(s);
+			_udpShardPhys.push_back(&(s->phy));
+			s->thread = std::thread(&OneServiceImpl::_udpShardMain,this,s);
+		}
+#endif
+	}
+
+	void _udpShardMain(UdpShard *const s)
+	{
+		while (s->run) {
+			if (s->pause) {
+				std::this_thread::yield();
+				continue;
+			}
+			{
+				Mutex::Lock _l(s->lock);
+				s->phy.poll(ZT_UDP_SHARD_POLL_TIMEOUT);
+			}
+			_node->flushFrames((void *)0); // each thread delivers the frames it batched
+		}
+	}
+
+	void _stopUdpShards()
+	{
+		for(std::vector<UdpShard *>::iterator s(_udpShards.begin());s!=_udpShards.end();++s) {
+			(*s)->run = false;
+			(*s)->phy.whack();
+		}
+		for(std::vector<UdpShard *>::iterator s(_udpShards.begin());s!=_udpShards.end();++s) {
+			if ((*s)->thread.joinable())
+				(*s)->thread.join();
+		}
+	}
+
+	void _refreshBindings(unsigned int *p,unsigned int pc)
+	{
+		// Shard loops must be stopped while sockets are added to or removed from their Phy
+		for(std::vector<UdpShard *>::iterator s(_udpShards.begin());s!=_udpShards.end();++s) {
+			(*s)->pause = true;
+			(*s)->phy.whack();
+		}
+		for(std::vector<UdpShard *>::iterator s(_udpShards.begin());s!=_udpShards.end();++s)
+			(*s)->lock.lock();
+		_binder.refresh(_phy,(_udpShardPhys.empty()) ? (Phy<OneServiceImpl *> *const *)0 : &(_udpShardPhys[0]),(unsigned int)_udpShardPhys.size(),p,pc,explicitBind,*this);
+		for(std::vector<UdpShard *>::iterator s(_udpShards.begin());s!=_udpShards.end();++s) {
+			(*s)->lock.unlock();
+			(*s)->pause = false;
+		}
+	}
+
 	void readLocalSettings()
 	{		
 		// Read local configuration
@@ -1156,6 +1342,25 @@ public:
 			return 404;
 		}
 
+		// GET of the network and peer lists takes ?offset=N&limit=N to return
+		// one page, and GET of those lists or their records takes ?fields=a,b
+		// to return only the named top-level fields of each object.
+		unsigned long offset = 0,limit = 0xffffffffUL;
+		std::set<std::string> fields;
+		{
+			std::map<std::string,std::string>::const_iterator a(urlArgs.find("offset"));
+			if (a != urlArgs.end())
+				offset = (unsigned long)Utils::strToU64(a->second.c_str());
+			a = urlArgs.find("limit");
+			if (a != urlArgs.end())
+				limit = (unsigned long)Utils::strToU64(a->second.c_str());
+			a = urlArgs.find("fields");
+			if (a != urlArgs.end()) {
+				std::vector<std::string> f(OSUtils::split(a->second.c_str(),",","",""));
+				fields.insert(f.begin(),f.end());
+			}
+		}
+
 		bool isAuth = false;
 		{
 			std::map<std::string,std::string>::const_iterator ah(headers.find("x-zt1-auth"));
@@ -1291,14 +1496,15 @@ public:
 						if (ps.size() == 1) {
 							// Return [array] of all networks
 
-							res = nlohmann::json::array();
-							for(unsigned long i=0;i<nws->networkCount;++i) {
+							JsonWriter w(responseBody);
+							w.beginArray();
+							for(unsigned long i=offset;((i<nws->networkCount)&&((i - offset) < limit));++i) {
 								OneService::NetworkSettings localSettings;
 								getNetworkSettings(nws->networks[i].nwid,localSettings);
-								nlohmann::json nj;
-								_networkToJson(nj,&(nws->networks[i]),portDeviceName(nws->networks[i].nwid),localSettings);
-								res.push_back(nj);
+								_networkToJson(w,&(nws->networks[i]),portDeviceName(nws->networks[i].nwid),localSettings,&fields);
 							}
+							w.endArray();
+							responseContentType = "application/json";
 
 							scode = 200;
 						} else if (ps.size() == 2) {
@@ -1309,7 +1515,9 @@ public:
 								if (nws->networks[i].nwid == wantnw) {
 									OneService::NetworkSettings localSettings;
 									getNetworkSettings(nws->networks[i].nwid,localSettings);
-									_networkToJson(res,&(nws->networks[i]),portDeviceName(nws->networks[i].nwid),localSettings);
+									JsonWriter w(responseBody);
+									_networkToJson(w,&(nws->networks[i]),portDeviceName(nws->networks[i].nwid),localSettings,&fields);
+									responseContentType = "application/json";
 									scode = 200;
 									break;
 								}
@@ -1322,14 +1530,14 @@ public:
 					ZT_PeerList *pl = _node->peers();
 					if (pl) {
 						if (ps.size() == 1) {
-							// Return [array] of all peers
+							// Return [array] of all peers, which are sorted by address so pages are stable
 
-							res = nlohmann::json::array();
-							for(unsigned long i=0;i<pl->peerCount;++i) {
-								nlohmann::json pj;
-								_peerToJson(pj,&(pl->peers[i]));
-								res.push_back(pj);
-							}
+							JsonWriter w(responseBody);
+							w.beginArray();
+							for(unsigned long i=offset;((i<pl->peerCount)&&((i - offset) < limit));++i)
+								_peerToJson(w,&(pl->peers[i]),&fields);
+							w.endArray();
+							responseContentType = "application/json";
 
 							scode = 200;
 						} else if (ps.size() == 2) {
@@ -1338,7 +1546,9 @@ public:
 							uint64_t wantp = Utils::hexStrToU64(ps[1].c_str());
 							for(unsigned long i=0;i<pl->peerCount;++i) {
 								if (pl->peers[i].address == wantp) {
-									_peerToJson(res,&(pl->peers[i]));
+									JsonWriter w(responseBody);
+									_peerToJson(w,&(pl->peers[i]),&fields);
+									responseContentType = "application/json";
 									scode = 200;
 									break;
 								}
@@ -1421,7 +1631,9 @@ public:
 									}
 
 									setNetworkSettings(nws->networks[i].nwid,localSettings);
-									_networkToJson(res,&(nws->networks[i]),portDeviceName(nws->networks[i].nwid),localSettings);
+									JsonWriter w(responseBody);
+									_networkToJson(w,&(nws->networks[i]),portDeviceName(nws->networks[i].nwid),localSettings);
+									responseContentType = "application/json";
 
 									scode = 200;
 									break;
@@ -1585,6 +1797,7 @@ public:
 			_allowTcpFallbackRelay = false;
 		}
 		_portMappingEnabled = OSUtils::jsonBool(settings["portMappingEnabled"],true);
+		_udpShardCount = (unsigned int)OSUtils::jsonInt(settings["udpShards"],0);
 
 #ifndef ZT_SDK
 		const std::string up(OSUtils::jsonString(settings["softwareUpdate"],ZT_SOFTWARE_UPDATE_DEFAULT));
@@ -1895,6 +2108,7 @@ public:
 			tc->sock = sockN;
 			tc->remoteAddr = from;
 			tc->lastReceive = OSUtils::now();
+			tc->id = ++_nextTcpConnectionId;
 			http_parser_init(&(tc->parser),HTTP_REQUEST);
 			tc->parser.data = (void *)tc;
 			tc->messageSize = 0;
@@ -2326,75 +2540,7 @@ public:
 			// else fallback to disk
 		}
 #endif
-		char p[1024];
-		FILE *f;
-		bool secure = false;
-		char dirname[1024];
-		dirname[0] = 0;
-
-		switch(type) {
-			case ZT_STATE_OBJECT_IDENTITY_PUBLIC:
-				OSUtils::ztsnprintf(p,sizeof(p),"%s" ZT_PATH_SEPARATOR_S "identity.public",_homePath.c_str());
-				break;
-			case ZT_STATE_OBJECT_IDENTITY_SECRET:
-				OSUtils::ztsnprintf(p,sizeof(p),"%s" ZT_PATH_SEPARATOR_S "identity.secret",_homePath.c_str());
-				secure = true;
-				break;
-			case ZT_STATE_OBJECT_PLANET:
-				OSUtils::ztsnprintf(p,sizeof(p),"%s" ZT_PATH_SEPARATOR_S "planet",_homePath.c_str());
-				break;
-			case ZT_STATE_OBJECT_MOON:
-				OSUtils::ztsnprintf(dirname,sizeof(dirname),"%s" ZT_PATH_SEPARATOR_S "moons.d",_homePath.c_str());
-				OSUtils::ztsnprintf(p,sizeof(p),"%s" ZT_PATH_SEPARATOR_S "%.16llx.moon",dirname,(unsigned long long)id[0]);
-				break;
-			case ZT_STATE_OBJECT_NETWORK_CONFIG:
-				OSUtils::ztsnprintf(dirname,sizeof(dirname),"%s" ZT_PATH_SEPARATOR_S "networks.d",_homePath.c_str());
-				OSUtils::ztsnprintf(p,sizeof(p),"%s" ZT_PATH_SEPARATOR_S "%.16llx.conf",dirname,(unsigned long long)id[0]);
-				secure = true;
-				break;
-			case ZT_STATE_OBJECT_PEER:
-				OSUtils::ztsnprintf(dirname,sizeof(dirname),"%s" ZT_PATH_SEPARATOR_S "peers.d",_homePath.c_str());
-				OSUtils::ztsnprintf(p,sizeof(p),"%s" ZT_PATH_SEPARATOR_S "%.10llx.peer",dirname,(unsigned long long)id[0]);
-				break;
-			default:
-				return;
-		}
-
-		if ((len >= 0)&&(data)) {
-			// Check to see if we've already written this first. This reduces
-			// redundant writes and I/O overhead on most platforms and has
-			// little effect on others.
-			f = fopen(p,"rb");
-			if (f) {
-				char *const buf = (char *)malloc(len*4);
-				if (buf) {
-					long l = (long)fread(buf,1,(size_t)(len*4),f);
-					fclose(f);
-					if ((l == (long)len)&&(memcmp(data,buf,l) == 0)) {
-						free(buf);
-						return;
-					}
-					free(buf);
-				}
-			}
-
-			f = fopen(p,"wb");
-			if ((!f)&&(dirname[0])) { // create subdirectory if it does not exist
-				OSUtils::mkdir(dirname);
-				f = fopen(p,"wb");
-			}
-			if (f) {
-				if (fwrite(data,len,1,f) != 1)
-					fprintf(stderr,"WARNING: unable to write to file: %s (I/O error)" ZT_EOL_S,p);
-				fclose(f);
-				if (secure)
-					OSUtils::lockDownFile(p,false);
-			} else {
-				fprintf(stderr,"WARNING: unable to write to file: %s (unable to open)" ZT_EOL_S,p);
-			}
-		} else {
-			OSUtils::rm(p);
-		}
+		_stateStore->put(type,id,data,len);
 	}
 
 #if ZT_VAULT_SUPPORT
@@ -2484,48 +2630,19 @@ public:
 			// else continue file based lookup
 		}
 #endif
-		char p[4096];
-		switch(type) {
-			case ZT_STATE_OBJECT_IDENTITY_PUBLIC:
-				OSUtils::ztsnprintf(p,sizeof(p),"%s" ZT_PATH_SEPARATOR_S "identity.public",_homePath.c_str());
-				break;
-			case ZT_STATE_OBJECT_IDENTITY_SECRET:
-				OSUtils::ztsnprintf(p,sizeof(p),"%s" ZT_PATH_SEPARATOR_S "identity.secret",_homePath.c_str());
-				break;
-			case ZT_STATE_OBJECT_PLANET:
-				OSUtils::ztsnprintf(p,sizeof(p),"%s" ZT_PATH_SEPARATOR_S "planet",_homePath.c_str());
-				break;
-			case ZT_STATE_OBJECT_MOON:
-				OSUtils::ztsnprintf(p,sizeof(p),"%s" ZT_PATH_SEPARATOR_S "moons.d" ZT_PATH_SEPARATOR_S "%.16llx.moon",_homePath.c_str(),(unsigned long long)id[0]);
-				break;
-			case ZT_STATE_OBJECT_NETWORK_CONFIG:
-				OSUtils::ztsnprintf(p,sizeof(p),"%s" ZT_PATH_SEPARATOR_S "networks.d" ZT_PATH_SEPARATOR_S "%.16llx.conf",_homePath.c_str(),(unsigned long long)id[0]);
-				break;
-			case ZT_STATE_OBJECT_PEER:
-				OSUtils::ztsnprintf(p,sizeof(p),"%s" ZT_PATH_SEPARATOR_S "peers.d" ZT_PATH_SEPARATOR_S "%.10llx.peer",_homePath.c_str(),(unsigned long long)id[0]);
-				break;
-			default:
-				return -1;
-		}
-		FILE *f = fopen(p,"rb");
-		if (f) {
-			int n = (int)fread(data,1,maxlen,f);
-			fclose(f);
+		const int n = _stateStore->get(type,id,data,maxlen);
 #if ZT_VAULT_SUPPORT
-			if (_vaultEnabled && (type == ZT_STATE_OBJECT_IDENTITY_SECRET || type == ZT_STATE_OBJECT_IDENTITY_PUBLIC)) {
-				// If we've gotten here while Vault is enabled, Vault does not know the key and it's been
-				// read from disk instead.
-				//
-				// We should put the value in Vault and remove the local file.
-				if (nodeVaultPutIdentity(type, data, n)) {
-					unlink(p);
-				}
+		if ((n >= 0) && _vaultEnabled && (type == ZT_STATE_OBJECT_IDENTITY_SECRET || type == ZT_STATE_OBJECT_IDENTITY_PUBLIC)) {
+			// If we've gotten here while Vault is enabled, Vault does not know the key and it's been
+			// read from disk instead.
+			//
+			// We should put the value in Vault and remove the local file.
+			if (nodeVaultPutIdentity(type, data, n)) {
+				_stateStore->put(type,id,(const void *)0,-1);
 			}
-#endif
-			if (n >= 0)
-				return n;
 		}
-		return -1;
+#endif
+		return n;
 	}
 
 	inline int nodeWirePacketSendFunction(const int64_t localSocket,const struct sockaddr_storage *addr,const void *data,unsigned int len,unsigned int ttl)
@@ -2593,10 +2710,7 @@ public:
 		// proxy fallback, which is slow.
 
 		if ((localSocket != -1)&&(localSocket != 0)&&(_binder.isUdpSocketValid((PhySocket *)((uintptr_t)localSocket)))) {
-			if ((ttl)&&(addr->ss_family == AF_INET)) _phy.setIp4UdpTtl((PhySocket *)((uintptr_t)localSocket),ttl);
-			const bool r = _phy.udpSend((PhySocket *)((uintptr_t)localSocket),(const struct sockaddr *)addr,data,len);
-			if ((ttl)&&(addr->ss_family == AF_INET)) _phy.setIp4UdpTtl((PhySocket *)((uintptr_t)localSocket),255);
-			return ((r) ? 0 : -1);
+			return ((_phy.udpSend((PhySocket *)((uintptr_t)localSocket),(const struct sockaddr *)addr,data,len,ttl)) ? 0 : -1);
 		} else {
 			return ((_binder.udpSendAll(_phy,addr,data,len,ttl)) ? 0 : -1);
 		}
@@ -2604,10 +2718,35 @@ public:
 
 	inline void nodeVirtualNetworkFrameFunction(uint64_t nwid,void **nuptr,uint64_t sourceMac,uint64_t destMac,unsigned int etherType,unsigned int vlanId,const void *data,unsigned int len)
 	{
-		NetworkState *n = reinterpret_cast<NetworkState *>(*nuptr);
-		if ((!n)||(!n->tap))
-			return;
-		n->tap->put(MAC(sourceMac),MAC(destMac),etherType,data,len);
+		// This can run on a UDP shard thread while the main loop leaves the
+		// network, so *nuptr may already be dangling. Hold the tap instead.
+		const std::shared_ptr<EthernetTap> tap(_tapForNetwork(nwid));
+		if (tap)
+			tap->put(MAC(sourceMac),MAC(destMac),etherType,data,len);
+	}
+
+	inline void nodeVirtualNetworkFrameBatchFunction(ZT_VirtualNetworkFrame *frames,unsigned int count)
+	{
+		// Hand each run of consecutive frames for the same network to its tap at
+		// once. The network may have been left since these were received, so the
+		// tap is looked up again and held by reference while it is written.
+		unsigned int start = 0;
+		while (start < count) {
+			unsigned int end = start + 1;
+			while ((end < count)&&(frames[end].nwid == frames[start].nwid))
+				++end;
+			const std::shared_ptr<EthernetTap> tap(_tapForNetwork(frames[start].nwid));
+			if (tap)
+				tap->putBatch(frames + start,end - start);
+			start = end;
+		}
+	}
+
+	inline std::shared_ptr<EthernetTap> _tapForNetwork(const uint64_t nwid)
+	{
+		Mutex::Lock _l(_nets_m);
+		const std::map<uint64_t,NetworkState>::const_iterator n(_nets.find(nwid));
+		return ((n != _nets.end()) ? n->second.tap : std::shared_ptr<EthernetTap>());
 	}
 
 	inline int nodePathCheckFunction(uint64_t ztaddr,const int64_t localSocket,const struct sockaddr_storage *remoteAddr)
@@ -2685,17 +2824,71 @@ public:
 	}
 
 	inline void onHttpRequestToServer(TcpConnection *tc)
+	{
+		// Note that we check allowed IP ranges when HTTP connections are first detected in
+		// phyOnTcpData(). If we made it here the source IP is okay.
+
+		std::shared_ptr<HttpRequest> r(new HttpRequest());
+		r->tc = tc;
+		r->connectionId = tc->id;
+		r->remoteAddr = tc->remoteAddr;
+		r->method = tc->parser.method;
+		r->url.swap(tc->url);
+		r->headers.swap(tc->headers);
+		r->body.swap(tc->readq);
+
+		// Joining, leaving or changing the settings of a local network creates,
+		// destroys or reconfigures taps, which has always happened here on the
+		// main loop. Everything else, including controller writes that may sync
+		// to disk, goes to the pool so it doesn't hold up packet processing.
+		if ((_httpThreads.empty())||(_httpNeedsMainLoop(*r))) {
+			_handleHttpRequest(*r);
+			_sendHttpResponse(*r);
+		} else {
+			_httpRequests.post(r);
+		}
+	}
+
+	// True for requests that change local network membership or settings
+	static inline bool _httpNeedsMainLoop(const HttpRequest &r)
+	{
+		if ((r.method == HTTP_GET)||(r.method == HTTP_HEAD))
+			return false;
+		const std::size_t s = r.url.find_first_not_of('/');
+		if ((s == std::string::npos)||(r.url.compare(s,7,"network") != 0))
+			return false;
+		return ((r.url.length() == (s + 7))||(r.url[s + 7] == '/')||(r.url[s + 7] == '?'));
+	}
+
+	void _httpThreadMain()
+	{
+		std::shared_ptr<HttpRequest> r;
+		while (_httpRequests.get(r)) {
+			if ((r->method == HTTP_GET)||(r->method == HTTP_HEAD)) {
+				_handleHttpRequest(*r);
+			} else {
+				Mutex::Lock _l(_httpChange_m);
+				_handleHttpRequest(*r);
+			}
+			{
+				Mutex::Lock _l(_httpResponses_m);
+				_httpResponses.push_back(r);
+			}
+			r.reset();
+			_phy.whack();
+		}
+	}
+
+	// Runs handleControlPlaneHttpRequest() and fills in r.response
+	void _handleHttpRequest(HttpRequest &r)
 	{
 		char tmpn[4096];
 		std::string data;
 		std::string contentType("text/plain"); // default if not changed in handleRequest()
 		unsigned int scode = 404;
 
-		// Note that we check allowed IP ranges when HTTP connections are first detected in
-		// phyOnTcpData(). If we made it here the source IP is okay.
-
 		try {
-			scode = handleControlPlaneHttpRequest(tc->remoteAddr,tc->parser.method,tc->url,tc->headers,tc->readq,data,contentType);
+			scode = handleControlPlaneHttpRequest(r.remoteAddr,r.method,r.url,r.headers,r.body,data,contentType);
 		} catch (std::exception &exc) {
 			fprintf(stderr,"WARNING: unexpected exception processing control HTTP request: %s" ZT_EOL_S,exc.what());
 			scode = 500;
@@ -2722,14 +2915,37 @@ public:
 			scodestr,
 			contentType.c_str(),
 			(unsigned long)data.length());
+		r.response = tmpn;
+		if (r.method != HTTP_HEAD)
+			r.response.append(data);
+	}
+
+	// Main I/O loop only: queue a finished response if its connection is still open
+	void _sendHttpResponse(HttpRequest &r)
+	{
 		{
-			Mutex::Lock _l(tc->writeq_m);
-			tc->writeq = tmpn;
-			if (tc->parser.method != HTTP_HEAD)
-				tc->writeq.append(data);
+			Mutex::Lock _l(_tcpConnections_m);
+			if ((std::find(_tcpConnections.begin(),_tcpConnections.end(),r.tc) == _tcpConnections.end())||(r.tc->id != r.connectionId))
+				return;
+		}
+		{
+			Mutex::Lock _l(r.tc->writeq_m);
+			r.tc->writeq.swap(r.response);
 		}
+		_phy.setNotifyWritable(r.tc->sock,true);
+	}
 
-		_phy.setNotifyWritable(tc->sock,true);
+	void _sendHttpResponses()
+	{
+		std::vector< std::shared_ptr<HttpRequest> > done;
+		{
+			Mutex::Lock _l(_httpResponses_m);
+			if (_httpResponses.empty())
+				return;
+			done.swap(_httpResponses);
+		}
+		for(std::vector< std::shared_ptr<HttpRequest> >::iterator r(done.begin());r!=done.end();++r)
+			_sendHttpResponse(**r);
 	}
 
 	inline void onHttpResponseFromClient(TcpConnection *tc)
@@ -2842,6 +3058,8 @@ static int SnodeWirePacketSendFunction(ZT_Node *node,void *uptr,void *tptr,int64
 { return reinterpret_cast<OneServiceImpl *>(uptr)->nodeWirePacketSendFunction(localSocket,addr,data,len,ttl); }
 static void SnodeVirtualNetworkFrameFunction(ZT_Node *node,void *uptr,void *tptr,uint64_t nwid,void **nuptr,uint64_t sourceMac,uint64_t destMac,unsigned int etherType,unsigned int vlanId,const void *data,unsigned int len)
 { reinterpret_cast<OneServiceImpl *>(uptr)->nodeVirtualNetworkFrameFunction(nwid,nuptr,sourceMac,destMac,etherType,vlanId,data,len); }
+static void SnodeVirtualNetworkFrameBatchFunction(ZT_Node *node,void *uptr,void *tptr,ZT_VirtualNetworkFrame *frames,unsigned int count)
+{ reinterpret_cast<OneServiceImpl *>(uptr)->nodeVirtualNetworkFrameBatchFunction(frames,count); }
 static int SnodePathCheckFunction(ZT_Node *node,void *uptr,void *tptr,uint64_t ztaddr,int64_t localSocket,const struct sockaddr_storage *remoteAddr)
 { return reinterpret_cast<OneServiceImpl *>(uptr)->nodePathCheckFunction(ztaddr,localSocket,remoteAddr); }
 static int SnodePathLookupFunction(ZT_Node *node,void *uptr,void *tptr,uint64_t ztaddr,int family,struct sockaddr_storage *result)